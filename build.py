@@ -36,6 +36,19 @@
   All files created during building are cleaned afterwards by
   default, but one can use `--clean` flag to remove them manually.
 
+  Use '--alloc-stats' flag to count the allocations of Dust,
+  which are then printed with 'dust <command> ... --alloc-stats'.
+  This slows Dust down so it's only meant for profiling.
+
+  Use '--trace' flag to compile trace points into Dust, then
+  'dust <command> ... --trace=out.json' writes a trace of the
+  front-end that can be opened in Perfetto or chrome://tracing.
+
+  Use '--library' flag to build libdust instead of the Dust
+  executable, as a static (libdust.a) and a shared (libdust.so,
+  dust.dll or libdust.dylib) library. Only the functions of
+  'include/dust/dust.h' are exported from them.
+
 
   b) Distributing Dust
   ----------------------------
@@ -65,6 +78,8 @@ import threading
 GH_REPO = "https://github.com/kadir014/Dust"
 CPU_COUNT = multiprocessing.cpu_count()
 FINAL_BUILD = "dust.exe" if platform.system() == "Windows" else "dust"
+LIBRARY_STATIC = "libdust.a"
+LIBRARY_SHARED = {"Windows": "dust.dll", "Darwin": "libdust.dylib"}.get(platform.system(), "libdust.so")
 
 DUST_PATH = pathlib.Path(os.getcwd())
 
@@ -76,9 +91,33 @@ SOURCE_FILES = [
     DUST_PATH / "src" / "io.c",
     DUST_PATH / "src" / "tokenizer.c",
     DUST_PATH / "src" / "parser.c",
-    DUST_PATH / "src" / "transpiler.c"
+    DUST_PATH / "src" / "transpiler.c",
+    DUST_PATH / "src" / "incremental.c",
+    DUST_PATH / "src" / "fold.c",
+    DUST_PATH / "src" / "thread.c",
+    DUST_PATH / "src" / "scheduler.c",
+    DUST_PATH / "src" / "pipeline.c",
+    DUST_PATH / "src" / "structural.c",
+    DUST_PATH / "src" / "source.c",
+    DUST_PATH / "src" / "check.c",
+    DUST_PATH / "src" / "resolver.c",
+    DUST_PATH / "src" / "typecheck.c",
+    DUST_PATH / "src" / "module.c",
+    DUST_PATH / "src" / "ir.c",
+    DUST_PATH / "src" / "lower.c",
+    DUST_PATH / "src" / "bench.c",
+    DUST_PATH / "src" / "perf.c",
+    DUST_PATH / "src" / "alloc.c",
+    DUST_PATH / "src" / "trace.c",
+    DUST_PATH / "src" / "allocator.c",
+    DUST_PATH / "src" / "dust.c",
+    DUST_PATH / "src" / "serve.c",
+    DUST_PATH / "src" / "watch.c"
 ]
 
+# Everything but the command line interface, the server and watch mode goes into libdust
+LIBRARY_FILES = [source for source in SOURCE_FILES if source.name not in ("cli.c", "serve.c", "watch.c")]
+
 INCLUDE_FILES = [
     DUST_PATH / "include" / "dust" / "tokenizer.h",
     DUST_PATH / "include" / "dust" / "ustring.h",
@@ -87,7 +126,28 @@ INCLUDE_FILES = [
     DUST_PATH / "include" / "dust" / "io.h",
     DUST_PATH / "include" / "dust" / "parser.h",
     DUST_PATH / "include" / "dust" / "platform.h",
-    DUST_PATH / "include" / "dust" / "transpiler.h"
+    DUST_PATH / "include" / "dust" / "transpiler.h",
+    DUST_PATH / "include" / "dust" / "incremental.h",
+    DUST_PATH / "include" / "dust" / "fold.h",
+    DUST_PATH / "include" / "dust" / "thread.h",
+    DUST_PATH / "include" / "dust" / "scheduler.h",
+    DUST_PATH / "include" / "dust" / "pipeline.h",
+    DUST_PATH / "include" / "dust" / "structural.h",
+    DUST_PATH / "include" / "dust" / "source.h",
+    DUST_PATH / "include" / "dust" / "check.h",
+    DUST_PATH / "include" / "dust" / "resolver.h",
+    DUST_PATH / "include" / "dust" / "typecheck.h",
+    DUST_PATH / "include" / "dust" / "module.h",
+    DUST_PATH / "include" / "dust" / "ir.h",
+    DUST_PATH / "include" / "dust" / "bench.h",
+    DUST_PATH / "include" / "dust" / "perf.h",
+    DUST_PATH / "include" / "dust" / "alloc.h",
+    DUST_PATH / "include" / "dust" / "trace.h",
+    DUST_PATH / "include" / "dust" / "allocator.h",
+    DUST_PATH / "include" / "dust" / "dust.h",
+    DUST_PATH / "include" / "dust" / "serve.h",
+    DUST_PATH / "include" / "dust" / "watch.h",
+    DUST_PATH / "include" / "dust" / "simd.h"
 ]
 
 class ValidityError(Exception): pass
@@ -197,6 +257,9 @@ class OptionHandler:
         self.cores        = CPU_COUNT # -jx
         self.optimization = 0         # -Ox
         self.clean        = False     # --clean
+        self.alloc_stats  = False     # --alloc-stats
+        self.trace        = False     # --trace
+        self.library      = False     # --library
 
         self.optimization_map = {
             0: "Don't optimize",
@@ -210,6 +273,7 @@ class OptionHandler:
         self.package_clean = False
 
         self.gcc_args = [] # GCC arguments
+        self.defines = [] # Preprocessor definitions
         self.resources = [] # Resource paths
 
         if platform.system() == "Windows":
@@ -218,6 +282,7 @@ class OptionHandler:
 
         elif platform.system() == "Linux":
             self.gcc_args.append("-lm")
+            self.gcc_args.append("-lpthread")
 
         elif platform.system() == "Darwin":
             self.gcc_args.append("-framework CoreServices")
@@ -240,6 +305,17 @@ class OptionHandler:
             except ValueError:
                 raise OptionError("integer expected after -O flag (-O0, -O2, etc..)")
 
+        elif opt == "--alloc-stats":
+            self.alloc_stats = True
+            self.defines.append("-DDUST_ALLOC_STATS")
+
+        elif opt == "--trace":
+            self.trace = True
+            self.defines.append("-DDUST_TRACE")
+
+        elif opt == "--library":
+            self.library = True
+
         elif opt.startswith("--clean"):
             self.clean = True
 
@@ -287,7 +363,7 @@ class Compiler:
             os.system("windres assets/dust.rc -O coff -o dust-res.res")
 
         start_time = time.perf_counter()
-        os.system(f"gcc -o dust {' '.join(self.targets)} {' '.join(self.option_handler.resources)} -I./include/ {self.option_handler.get_gcc_argstr()}")
+        os.system(f"gcc -o dust {' '.join(self.targets)} {' '.join(self.option_handler.resources)} -I./include/ {' '.join(self.option_handler.defines)} {self.option_handler.get_gcc_argstr()}")
         end_time = time.perf_counter() - start_time
 
         if os.path.exists("dust-res.res"): os.remove("dust-res.res")
@@ -304,13 +380,14 @@ class Compiler:
 
         start_time = time.perf_counter()
         for sources in self.targets:
-            subprocs.append(subprocess.Popen(("gcc", "-c", *sources, "-I./include/")))
+            subprocs.append(subprocess.Popen(("gcc", "-c", *sources, "-I./include/", *self.option_handler.defines)))
 
         for s in subprocs:
             s.communicate()
 
         # Link all object files to finish compiling
-        os.system(f"gcc -o dust cli.o ustring.o error.o platform.o tokenizer.o parser.o transpiler.o {' '.join(self.option_handler.resources)} {self.option_handler.get_gcc_argstr()}")
+        objects = " ".join(f"{source.stem}.o" for source in SOURCE_FILES)
+        os.system(f"gcc -o dust {objects} {' '.join(self.option_handler.resources)} {self.option_handler.get_gcc_argstr()}")
     
         end_time = time.perf_counter() - start_time
         remove_object_files()
@@ -318,10 +395,52 @@ class Compiler:
 
         return end_time
 
+    def compile_library(self):
+        """
+        Compiles libdust
+
+        Symbols are hidden by default so only the public API is exported
+        from the shared library, and the static library is linked into one
+        object first so internal symbols can be made local to it as well
+        """
+        remove_object_files()
+        for library in (LIBRARY_STATIC, LIBRARY_SHARED):
+            if os.path.exists(library): os.remove(library)
+
+        flags = ["-I./include/", "-fvisibility=hidden", "-DDUST_BUILD_LIBRARY", f"-O{self.option_handler.optimization}"]
+        if platform.system() != "Windows": flags.append("-fPIC")
+
+        cores = max(1, self.option_handler.cores)
+        groups = [[str(source) for source in LIBRARY_FILES[i::cores]] for i in range(cores)]
+        subprocs = []
+
+        start_time = time.perf_counter()
+        for sources in groups:
+            if sources:
+                subprocs.append(subprocess.Popen(("gcc", "-c", *sources, *flags, *self.option_handler.defines)))
+
+        for s in subprocs:
+            s.communicate()
+
+        objects = " ".join(f"{source.stem}.o" for source in LIBRARY_FILES)
+
+        os.system(f"gcc -r -o libdust.o {objects}")
+        os.system("objcopy --localize-hidden libdust.o")
+        os.system(f"ar rcs {LIBRARY_STATIC} libdust.o")
+        os.system(f"gcc -shared -o {LIBRARY_SHARED} {objects} {' '.join(self.option_handler.gcc_args)}")
+
+        end_time = time.perf_counter() - start_time
+        remove_object_files()
+
+        return end_time
+
     def compile(self):
         """
         Compile Dust
         """
+        if self.option_handler.library:
+            return self.compile_library()
+
         if os.path.exists(FINAL_BUILD): os.remove(FINAL_BUILD)
 
         if self.option_handler.cores == 1:
@@ -362,7 +481,10 @@ if __name__ == "__main__":
               "Configured settings\n" + \
               f" - Compiler process(es): {Color.fgyellow}{option_handler.cores}{Color.reset}\n" + \
               f" - Optimization level  : {Color.fgyellow}{option_handler.optimization}{Color.reset} " + \
-              f"({option_handler.optimization_map[option_handler.optimization]})\n")
+              f"({option_handler.optimization_map[option_handler.optimization]})\n" + \
+              f" - Allocation stats    : {Color.fgyellow}{('off', 'on')[option_handler.alloc_stats]}{Color.reset}\n" + \
+              f" - Tracing             : {Color.fgyellow}{('off', 'on')[option_handler.trace]}{Color.reset}\n" + \
+              f" - Target              : {Color.fgyellow}{('executable', 'library')[option_handler.library]}{Color.reset}\n")
 
         if option_handler.cores > CPU_COUNT:
             print(f"{Color.fglightred}[WARNING]{Color.reset} given process count ({option_handler.cores})" + \
@@ -391,5 +513,6 @@ if __name__ == "__main__":
         loader.stop()
         while not loader.done: pass
 
-        print(f"{Color.fglightgreen}[DONE]{Color.reset} Dust succesfully built in {round(end_time, 1)} secs " + \
+        built = f"{LIBRARY_STATIC} and {LIBRARY_SHARED}" if option_handler.library else "Dust"
+        print(f"{Color.fglightgreen}[DONE]{Color.reset} {built} succesfully built in {round(end_time, 1)} secs " + \
                f"({int(end_time*1000)} ms)")
\ No newline at end of file
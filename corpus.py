@@ -0,0 +1,314 @@
+"""
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+
+  Dust benchmark corpus generator
+  -------------------------------------------------------
+  This Python script generates synthetic Dust sources to
+  benchmark the front-end with (see `dust bench`).
+  This script must be run in the same directory as Dust.
+
+  Shape of the corpus is described by a spec file, which is
+  'bench/corpus.json' by default. Every workload in the spec
+  is generated with its own random generator seeded from the
+  spec's seed and the workload's name, so the same spec always
+  generates byte-identical sources on every machine.
+
+  Usage:
+    python corpus.py [spec] [-o directory] [--scale x]
+
+    -o       -  Directory the sources are written into
+                (default is 'bench/corpus')
+    --scale  -  Multiplies the size of every workload, e.g.
+                '--scale 0.1' for a quick run
+
+  Workload kinds and their parameters:
+    decls    -  Wide flat file of declarations         (count)
+    nested   -  Deeply nested if/while bodies          (count, depth)
+    array    -  One huge array literal                 (elements)
+    chain    -  Long chains of binary operators        (count, length)
+    enum     -  One large enum                         (members)
+    strings  -  String and Unicode heavy literals      (count, length)
+    modules  -  Many small files importing each other  (files, statements, imports)
+    mixed    -  Mix of every statement kind            (count)
+
+  A digest of all generated sources is printed at the end,
+  runs with the same digest benchmarked the same inputs.
+
+"""
+
+import os
+import argparse
+import json
+import random
+import hashlib
+import zlib
+
+
+DEFAULT_SPEC = os.path.join("bench", "corpus.json")
+DEFAULT_OUTPUT = os.path.join("bench", "corpus")
+
+TYPES = ("int", "int32", "uint8", "float", "bool", "string")
+
+BINARY_OPS = ("+", "-", "*", "/", "^", "==", "!=", "<", "<=", ">", ">=", "and", "or")
+
+UNICODE_WORDS = (
+    "merhaba", "dünya", "çiçek", "ağaç", "ışık", "öğrenci",
+    "γειά", "κόσμε", "привет", "мир", "こんにちは", "世界",
+    "안녕", "שלום", "مرحبا", "नमस्ते", "🙂", "✓", "→", "∑"
+)
+
+
+class Writer:
+    """
+    Builds a source file line by line
+    """
+    def __init__(self):
+        self.lines = []
+
+    def line(self, depth: int, text: str):
+        self.lines.append("    " * depth + text)
+
+    def text(self) -> str:
+        return "\n".join(self.lines) + "\n"
+
+
+def name(rng: random.Random, prefix: str = "v") -> str:
+    return f"{prefix}{rng.randrange(1000)}"
+
+def literal(rng: random.Random) -> str:
+    kind = rng.randrange(4)
+    if kind == 0: return str(rng.randrange(100000))
+    elif kind == 1: return f"{rng.randrange(1000)}.{rng.randrange(1000)}"
+    elif kind == 2: return hex(rng.randrange(65536))
+    else: return f"\"{rng.choice(UNICODE_WORDS)}\""
+
+def operand(rng: random.Random) -> str:
+    kind = rng.randrange(6)
+    if kind < 2: return str(rng.randrange(1000))
+    elif kind < 4: return name(rng)
+    elif kind == 4: return f"{name(rng, 'f')}({name(rng)}, {rng.randrange(10)})"
+    else: return f"{name(rng, 'a')}[{rng.randrange(100)}]"
+
+def expression(rng: random.Random, length: int) -> str:
+    parts = [operand(rng)]
+
+    for _ in range(length - 1):
+        parts.append(rng.choice(BINARY_OPS))
+        parts.append(operand(rng))
+
+    return " ".join(parts)
+
+def condition(rng: random.Random) -> str:
+    return f"{name(rng)} {rng.choice(('<', '>', '==', '!='))} {rng.randrange(100)}"
+
+def statement(rng: random.Random) -> str:
+    kind = rng.randrange(5)
+    if kind == 0: return f"{rng.choice(TYPES)} {name(rng)} = {expression(rng, 3)};"
+    elif kind == 1: return f"{name(rng)} {rng.choice(('=', '+=', '-=', '*='))} {expression(rng, 2)};"
+    elif kind == 2: return f"{name(rng, 'f')}({operand(rng)}, {literal(rng)});"
+    elif kind == 3: return f"{rng.choice(TYPES)} {name(rng)};"
+    else: return f"{name(rng, 'o')}.{name(rng, 'm')}({operand(rng)});"
+
+
+def gen_decls(rng: random.Random, count: int) -> str:
+    w = Writer()
+    w.line(0, "// Wide flat file of declarations")
+
+    for i in range(count):
+        w.line(0, f"{rng.choice(TYPES)} d{i} = {expression(rng, rng.randrange(1, 4))};")
+
+    return w.text()
+
+def gen_nested(rng: random.Random, count: int, depth: int) -> str:
+    w = Writer()
+    w.line(0, "// Deeply nested if/while bodies")
+
+    for _ in range(count):
+        for d in range(depth):
+            if d % 2 == 0: w.line(d, f"if {condition(rng)} {{")
+            else: w.line(d, f"while {condition(rng)} {{")
+            w.line(d + 1, statement(rng))
+
+        for d in reversed(range(depth)):
+            w.line(d, "}")
+
+    return w.text()
+
+def gen_array(rng: random.Random, elements: int) -> str:
+    w = Writer()
+    w.line(0, "// One huge array literal")
+    w.line(0, "array<int> values = [")
+
+    row = []
+    for i in range(elements):
+        row.append(str(rng.randrange(1000000)))
+        if len(row) == 16 or i == elements - 1:
+            w.line(1, ", ".join(row) + ("," if i < elements - 1 else ""))
+            row = []
+
+    w.line(0, "];")
+    return w.text()
+
+def gen_chain(rng: random.Random, count: int, length: int) -> str:
+    w = Writer()
+    w.line(0, "// Long chains of binary operators")
+
+    for i in range(count):
+        w.line(0, f"c{i} = {expression(rng, length)};")
+
+    return w.text()
+
+def gen_enum(rng: random.Random, members: int) -> str:
+    w = Writer()
+    w.line(0, "// One large enum")
+    w.line(0, "enum Large {")
+
+    for i in range(members):
+        end = "," if i < members - 1 else ""
+        if rng.randrange(4) == 0: w.line(1, f"M{i} = {i * 2}{end}")
+        else: w.line(1, f"M{i}{end}")
+
+    w.line(0, "};")
+    return w.text()
+
+def gen_strings(rng: random.Random, count: int, length: int) -> str:
+    w = Writer()
+    w.line(0, "/* String and Unicode heavy literals: " + " ".join(UNICODE_WORDS) + " */")
+
+    for i in range(count):
+        words = []
+        while sum(len(word) + 1 for word in words) < length:
+            words.append(rng.choice(UNICODE_WORDS))
+
+        quote = rng.choice(("\"", "'"))
+        w.line(0, f"string s{i} = {quote}{' '.join(words)}{quote}; // {rng.choice(UNICODE_WORDS)}")
+
+    return w.text()
+
+def gen_modules(rng: random.Random, files: int, statements: int, imports: int) -> dict:
+    sources = {}
+
+    for i in range(files):
+        w = Writer()
+        w.line(0, f"// Module {i}")
+
+        for _ in range(min(imports, files - 1)):
+            j = rng.randrange(files)
+            if j == i: continue
+            if rng.randrange(2) == 0: w.line(0, f"import mod{j};")
+            else: w.line(0, f"import {name(rng, 'f')} from mod{j};")
+
+        for _ in range(statements):
+            w.line(0, statement(rng))
+
+        sources[f"mod{i}.dust"] = w.text()
+
+    return sources
+
+def gen_mixed(rng: random.Random, count: int) -> str:
+    w = Writer()
+    w.line(0, "// Mix of every statement kind")
+    w.line(0, "import io;")
+
+    for i in range(count):
+        kind = rng.randrange(8)
+
+        if kind < 3:
+            w.line(0, statement(rng))
+        elif kind == 3:
+            w.line(0, f"if {condition(rng)} {{ {statement(rng)} }} "
+                      f"elif {condition(rng)} {{ {statement(rng)} }} else {{ {statement(rng)} }}")
+        elif kind == 4:
+            w.line(0, f"for i in 0..{rng.randrange(100)} {{ {statement(rng)} }}")
+        elif kind == 5:
+            w.line(0, f"repeat {rng.randrange(10)} {{ {statement(rng)} }}")
+        elif kind == 6:
+            w.line(0, f"array<int> r{i} = [{', '.join(str(rng.randrange(100)) for _ in range(rng.randrange(1, 8)))}];")
+        else:
+            w.line(0, f"/* block {i} */ {name(rng)} = \"{rng.choice(UNICODE_WORDS)}\"; // tail")
+
+    return w.text()
+
+
+GENERATORS = {
+    "decls": (gen_decls, ("count",)),
+    "nested": (gen_nested, ("count", "depth")),
+    "array": (gen_array, ("elements",)),
+    "chain": (gen_chain, ("count", "length")),
+    "enum": (gen_enum, ("members",)),
+    "strings": (gen_strings, ("count", "length")),
+    "modules": (gen_modules, ("files", "statements", "imports")),
+    "mixed": (gen_mixed, ("count",))
+}
+
+# Parameters that describe the shape of a workload rather than its size
+UNSCALED = ("depth", "length", "imports", "statements")
+
+
+def generate(spec: dict, output: str, scale: float):
+    seed = spec.get("seed", 0)
+    digest = hashlib.sha256()
+    total = 0
+
+    for workload in spec["workloads"]:
+        wname = workload["name"]
+        kind = workload["kind"]
+
+        if kind not in GENERATORS:
+            raise ValueError(f"unknown workload kind '{kind}' in '{wname}'")
+
+        func, params = GENERATORS[kind]
+        args = []
+        for param in params:
+            value = workload[param]
+            if param not in UNSCALED: value = max(1, int(value * scale))
+            args.append(value)
+
+        rng = random.Random(seed * 1000003 + zlib.crc32(wname.encode("utf-8")))
+        result = func(rng, *args)
+
+        # Multi-file workloads get their own directory
+        if isinstance(result, dict):
+            files = {os.path.join(wname, fname): source for fname, source in result.items()}
+        else:
+            files = {f"{wname}.dust": result}
+
+        size = 0
+        for fname, source in sorted(files.items()):
+            path = os.path.join(output, fname)
+            os.makedirs(os.path.dirname(path), exist_ok=True)
+
+            data = source.encode("utf-8")
+            with open(path, "wb") as f:
+                f.write(data)
+
+            digest.update(fname.replace(os.sep, "/").encode("utf-8"))
+            digest.update(data)
+            size += len(data)
+
+        total += size
+        print(f"{wname:<16} {kind:<8} {len(files):>5} file(s) {size:>12,} bytes")
+
+    print(f"\n{total:,} bytes in '{output}', digest {digest.hexdigest()[:16]}")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Generates synthetic Dust sources to benchmark the front-end with.")
+    parser.add_argument("spec", nargs="?", default=DEFAULT_SPEC,
+                        help=f"spec file describing the corpus (default is '{DEFAULT_SPEC}')")
+    parser.add_argument("-o", dest="output", default=DEFAULT_OUTPUT,
+                        help=f"directory the sources are written into (default is '{DEFAULT_OUTPUT}')")
+    parser.add_argument("--scale", type=float, default=1.0,
+                        help="multiplies the size of every workload, e.g. '--scale 0.1' for a quick run")
+    args = parser.parse_args()
+
+    with open(args.spec, "r", encoding="utf-8") as f:
+        spec = json.load(f)
+
+    generate(spec, args.output, args.scale)
@@ -0,0 +1,82 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+*/
+
+#pragma once
+#ifndef ALLOC_H
+#define ALLOC_H
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "dust/allocator.h"
+
+// Maximum number of phases allocations are grouped into
+#define ALLOC_PHASES 16
+
+// Number of call sites shown for each phase in the report
+#define ALLOC_TOP_SITES 5
+
+/**
+ * @brief Allocation counts of a phase (or of the whole run)
+ *
+ * @param name Name of the phase
+ * @param allocations Number of allocations (reallocations included)
+ * @param bytes Total bytes allocated
+ * @param frees Number of frees
+ * @param peak Highest number of live bytes while the phase was running
+ */
+typedef struct {
+    char *name;
+    size_t allocations;
+    size_t bytes;
+    size_t frees;
+    size_t peak;
+} AllocCounts;
+
+void *alloc_malloc(size_t size, char *file, int line);
+
+void *alloc_calloc(size_t count, size_t size, char *file, int line);
+
+void *alloc_realloc(void *ptr, size_t size, char *file, int line);
+
+void alloc_free(void *ptr);
+
+void alloc_phase(char *name);
+
+void alloc_input(size_t length);
+
+AllocCounts alloc_totals();
+
+size_t alloc_live();
+
+void alloc_reset();
+
+void alloc_report(FILE *stream);
+
+void alloc_report_at_exit();
+
+
+/*
+  Building with DUST_ALLOC_STATS defined counts the allocations every
+  module including this header makes with the current allocator.
+  This header must be included after the other headers.
+*/
+#if defined(DUST_ALLOC_STATS) && !defined(DUST_ALLOC_IMPL)
+
+#define dust_malloc(size) alloc_malloc((size), __FILE__, __LINE__)
+#define dust_calloc(count, size) alloc_calloc((count), (size), __FILE__, __LINE__)
+#define dust_realloc(ptr, size) alloc_realloc((ptr), (size), __FILE__, __LINE__)
+#define dust_free(ptr) alloc_free(ptr)
+
+#endif
+
+
+#endif
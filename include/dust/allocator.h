@@ -0,0 +1,128 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+*/
+
+#pragma once
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "dust/thread.h"
+
+// Alignment of every block given by the arena and pool allocators
+#define ALLOCATOR_ALIGN 16
+
+// Default size of an arena chunk
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+// Number of pool size classes, from 16 bytes up to POOL_MAX_SIZE
+#define POOL_CLASSES 9
+
+// Largest block served from a pool size class, larger ones use malloc
+#define POOL_MAX_SIZE 4096
+
+// Size of a pool slab that size class blocks are cut from
+#define POOL_SLAB_SIZE (64 * 1024)
+
+/**
+ * @brief Allocator the library allocates through
+ *
+ * @param malloc Allocate a block
+ * @param realloc Resize a block (block may be NULL)
+ * @param free Release a block (block is never NULL)
+ * @param context Passed to every function
+ */
+typedef struct _DustAllocator {
+    void *(*malloc)(void *context, size_t size);
+    void *(*realloc)(void *context, void *ptr, size_t size);
+    void (*free)(void *context, void *ptr);
+    void *context;
+} DustAllocator;
+
+extern DustAllocator DUST_SYSTEM_ALLOCATOR;
+
+extern THREAD_LOCAL DustAllocator *DUST_ALLOCATOR;
+
+DustAllocator *dust_allocator_use(DustAllocator *allocator);
+
+void *dust_malloc(size_t size);
+
+void *dust_calloc(size_t count, size_t size);
+
+void *dust_realloc(void *ptr, size_t size);
+
+void dust_free(void *ptr);
+
+
+/**
+ * @brief A chunk of an arena, blocks follow the header
+ *
+ * @param next Previously filled chunk
+ * @param size Size of the chunk's data
+ * @param used Bytes used of the chunk's data
+ */
+typedef struct _ArenaChunk {
+    struct _ArenaChunk *next;
+    size_t size;
+    size_t used;
+} ArenaChunk;
+
+/**
+ * @brief Bump allocator, blocks are released all at once with Arena_reset
+ *
+ * @param chunks Current chunk (linked to the filled ones)
+ * @param chunk_size Size of a new chunk
+ * @param allocated Bytes of every chunk
+ * @param lock Taken by every operation, threads Dust starts share the allocator
+ * @param allocator Allocator interface of the arena
+ */
+typedef struct {
+    ArenaChunk *chunks;
+    size_t chunk_size;
+    size_t allocated;
+    atomic_flag lock;
+    DustAllocator allocator;
+} Arena;
+
+Arena *Arena_new(size_t chunk_size);
+
+void Arena_free(Arena *arena);
+
+void Arena_reset(Arena *arena);
+
+
+/**
+ * @brief Size class allocator, freed blocks are reused by later
+ *        allocations of the same class
+ *
+ * @param free_lists Freed blocks of each class
+ * @param slabs Slabs blocks are cut from (linked to each other)
+ * @param slab_used Bytes used of the current slab
+ * @param large Blocks too large for a size class (linked to each other)
+ * @param lock Taken by every operation, threads Dust starts share the allocator
+ * @param allocator Allocator interface of the pool
+ */
+typedef struct {
+    void *free_lists[POOL_CLASSES];
+    char *slabs;
+    size_t slab_used;
+    char *large;
+    atomic_flag lock;
+    DustAllocator allocator;
+} Pool;
+
+Pool *Pool_new();
+
+void Pool_free(Pool *pool);
+
+
+#endif
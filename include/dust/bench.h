@@ -0,0 +1,118 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+*/
+
+#pragma once
+#ifndef BENCH_H
+#define BENCH_H
+
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include "dust/perf.h"
+
+// Default number of measured runs
+#define BENCH_RUNS 20
+
+// Default number of unmeasured runs before measuring
+#define BENCH_WARMUP 3
+
+// Relative change of the median reported as a regression or improvement
+#define BENCH_THRESHOLD 0.05
+
+typedef enum {
+    BenchPhase_READ,
+    BenchPhase_DECODE,
+    BenchPhase_ENCODE,
+    BenchPhase_TOKENIZE,
+    BenchPhase_PARSE,
+    BenchPhase_TRANSPILE,
+    BenchPhase_COUNT
+} BenchPhase;
+
+extern char *BENCH_PHASE_NAMES[BenchPhase_COUNT];
+
+typedef enum {
+    BenchAllocator_SYSTEM,
+    BenchAllocator_ARENA,
+    BenchAllocator_POOL,
+    BenchAllocator_COUNT
+} BenchAllocator;
+
+extern char *BENCH_ALLOCATOR_NAMES[BenchAllocator_COUNT];
+
+/**
+ * @brief Statistics of one phase's samples, in seconds
+ *
+ * @param min Fastest run
+ * @param median Median run
+ * @param p99 99th percentile run
+ * @param measured Phase has samples
+ */
+typedef struct {
+    double min;
+    double median;
+    double p99;
+    bool measured;
+} BenchStats;
+
+/**
+ * @param runs Number of measured runs
+ * @param warmup Number of unmeasured runs
+ * @param files Number of source files
+ * @param bytes Total size of the source files
+ * @param tokens Total number of tokens in the source files
+ * @param phases Statistics of each phase
+ * @param counted Whether each performance counter was available
+ * @param counters Mean count of each performance counter in one run of each phase
+ * @param counter_error Why some or all performance counters weren't available
+ */
+typedef struct {
+    size_t runs;
+    size_t warmup;
+    size_t files;
+    size_t bytes;
+    size_t tokens;
+    BenchStats phases[BenchPhase_COUNT];
+    bool counted[PerfCounter_COUNT];
+    double counters[BenchPhase_COUNT][PerfCounter_COUNT];
+    char *counter_error;
+} BenchResult;
+
+/**
+ * @brief Front-end timings with each allocator
+ *
+ * @param build Tokenizing and parsing every file
+ * @param teardown Releasing the tokens and syntax trees of every file
+ * @param total Both of them
+ */
+typedef struct {
+    BenchStats build[BenchAllocator_COUNT];
+    BenchStats teardown[BenchAllocator_COUNT];
+    BenchStats total[BenchAllocator_COUNT];
+} BenchAllocators;
+
+double bench_clock();
+
+BenchStats bench_stats(double *samples, size_t count);
+
+BenchResult bench_files(char **paths, int count, size_t runs, size_t warmup);
+
+int bench_print(BenchResult *result, BenchResult *baseline);
+
+BenchAllocators bench_allocators(char **paths, int count, size_t runs, size_t warmup);
+
+void bench_print_allocators(BenchAllocators *result);
+
+bool bench_save(BenchResult *result, char *path);
+
+bool bench_load(BenchResult *result, char *path);
+
+
+#endif
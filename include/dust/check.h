@@ -0,0 +1,33 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+*/
+
+#pragma once
+#ifndef CHECK_H
+#define CHECK_H
+
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include "dust/ustring.h"
+#include "dust/tokenizer.h"
+
+/**
+ * @param message Error message
+ * @param offset Offset in source the error points at
+ */
+typedef struct {
+    u32char *message;
+    size_t offset;
+} CheckError;
+
+bool check(TokenArray *tokens, CheckError *error);
+
+
+#endif
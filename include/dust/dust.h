@@ -0,0 +1,183 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+*/
+
+#pragma once
+#ifndef DUST_H
+#define DUST_H
+
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+
+/*
+  This is the only header libdust embedders need. Everything a parse
+  produces belongs to its DustDocument and is released with it. Errors
+  are returned as diagnostics, the library never prints or exits, and
+  different documents can be used on different threads at once.
+  DUST_API_VERSION is raised only when this API changes in a way
+  existing callers would notice.
+*/
+#define DUST_API_VERSION 1
+
+#if defined(_WIN32)
+    #if defined(DUST_BUILD_LIBRARY)
+    #define DUST_API __declspec(dllexport)
+    #else
+    #define DUST_API
+    #endif
+#elif defined(__GNUC__)
+#define DUST_API __attribute__((visibility("default")))
+#else
+#define DUST_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * @brief Tokens and syntax tree of a source code
+ */
+typedef struct _DustDocument DustDocument;
+
+/**
+ * @brief A node of the syntax tree, valid while its document is
+ */
+typedef struct _Node DustNode;
+
+typedef enum {
+    DustToken_IDENTIFIER,
+    DustToken_STRING,
+    DustToken_OPERATOR,
+    DustToken_NUMERIC,
+    DustToken_COMMA,
+    DustToken_PERIOD,
+    DustToken_LPAREN,
+    DustToken_RPAREN,
+    DustToken_LCURLY,
+    DustToken_RCURLY,
+    DustToken_LSQRB,
+    DustToken_RSQRB,
+    DustToken_NEXTSTM,
+    DustToken_EOF
+} DustTokenKind;
+
+typedef enum {
+    DustNode_INTEGER,
+    DustNode_FLOAT,
+    DustNode_STRING,
+    DustNode_VAR,
+    DustNode_PRIMITIVE,
+    DustNode_ARRAY,
+    DustNode_DECL,
+    DustNode_DECLN,
+    DustNode_ASSIGN,
+    DustNode_BINOP,
+    DustNode_UNARYOP,
+    DustNode_RUNARYOP,
+    DustNode_IMPORT,
+    DustNode_IMPORTF,
+    DustNode_CHILD,
+    DustNode_SUBSCRIPT,
+    DustNode_CALL,
+    DustNode_FUNCBASE,
+    DustNode_ENUM,
+    DustNode_BODY,
+    DustNode_GENTYPE,
+    DustNode_IF,
+    DustNode_ELIF,
+    DustNode_ELSE,
+    DustNode_WHEN,
+    DustNode_REPEAT,
+    DustNode_FOR,
+    DustNode_WHILE,
+    DustNode_CONVERT
+} DustNodeKind;
+
+typedef enum {
+    DustDiagnostic_SYNTAX,
+    DustDiagnostic_INTERNAL
+} DustDiagnosticKind;
+
+/**
+ * @param kind Kind of the token
+ * @param text Text of the token in UTF-8
+ * @param offset Offset of the token's first character in the source
+ */
+typedef struct {
+    DustTokenKind kind;
+    const char *text;
+    size_t offset;
+} DustToken;
+
+/**
+ * @param kind Kind of the diagnostic
+ * @param message Message in UTF-8
+ * @param offset Offset of the character in the source it points at
+ * @param line Line of the character, starting from 1
+ * @param column Column of the character, starting from 1
+ */
+typedef struct {
+    DustDiagnosticKind kind;
+    const char *message;
+    size_t offset;
+    int line;
+    int column;
+} DustDiagnostic;
+
+/*
+  Offsets count characters (Unicode code points), not bytes.
+  Strings returned from a document are owned by it.
+*/
+
+DUST_API int dust_api_version();
+
+DUST_API const char *dust_version();
+
+DUST_API DustDocument *dust_tokenize(const char *source);
+
+DUST_API DustDocument *dust_parse(const char *source);
+
+DUST_API void dust_document_free(DustDocument *document);
+
+DUST_API size_t dust_diagnostic_count(DustDocument *document);
+
+DUST_API bool dust_diagnostic(DustDocument *document, size_t index, DustDiagnostic *diagnostic);
+
+DUST_API size_t dust_token_count(DustDocument *document);
+
+DUST_API bool dust_token(DustDocument *document, size_t index, DustToken *token);
+
+DUST_API const DustNode *dust_root(DustDocument *document);
+
+DUST_API DustNodeKind dust_node_kind(const DustNode *node);
+
+DUST_API size_t dust_node_child_count(const DustNode *node);
+
+DUST_API const DustNode *dust_node_child(const DustNode *node, size_t index);
+
+DUST_API const char *dust_node_text(DustDocument *document, const DustNode *node);
+
+DUST_API const char *dust_node_member(DustDocument *document, const DustNode *node);
+
+DUST_API const char *dust_node_operator(DustDocument *document, const DustNode *node);
+
+DUST_API long dust_node_integer(const DustNode *node);
+
+DUST_API double dust_node_float(const DustNode *node);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
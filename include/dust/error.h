@@ -13,21 +13,51 @@
 #define ERRORHANDLING_H
 
 
+#include <stdlib.h>
+#include <setjmp.h>
 #include "dust/ustring.h"
+#include "dust/thread.h"
 
 
 typedef enum {
     ErrorType_Syntax,
+    ErrorType_Name,
+    ErrorType_Type,
+    ErrorType_Import,
+    ErrorType_Internal
 } ErrorType;
 
+/**
+ * @brief Catches the error raised while it is set, instead of exiting
+ *
+ * @param jump Jumped to with longjmp(jump, 1) when an error is raised
+ * @param type Type of the raised error
+ * @param message Message of the raised error
+ * @param offset Offset in source the raised error points at
+ */
+typedef struct {
+    jmp_buf jump;
+    ErrorType type;
+    u32char *message;
+    size_t offset;
+} ErrorTrap;
+
 
 extern int ERROR_ANSI;
 
-void raise_ansi(ErrorType type, u32char *message, u32char *source, int x, int y);
+extern THREAD_LOCAL ErrorTrap *ERROR_TRAP;
+
+char *Error_repr(ErrorType type);
+
+void raise_ansi(ErrorType type, u32char *message, u32char *source, u32char *line, int x, int y);
+
+void raise_noansi(ErrorType type, u32char *message, u32char *source, u32char *line, int x, int y);
+
+char *report_text(ErrorType type, u32char *message, size_t offset, int ansi);
 
-void raise_noansi(ErrorType type, u32char *message, u32char *source, int x, int y);
+void report(ErrorType type, u32char *message, size_t offset);
 
-void raise(ErrorType type, u32char *message, u32char *source, int x, int y);
+void raise(ErrorType type, u32char *message, size_t offset);
 
 void raise_internal(u32char *message);
 
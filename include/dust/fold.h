@@ -0,0 +1,22 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+*/
+
+#pragma once
+#ifndef FOLD_H
+#define FOLD_H
+
+
+#include "dust/ustring.h"
+#include "dust/parser.h"
+
+void fold_expr(Node *node, u32char *type);
+
+
+#endif
\ No newline at end of file
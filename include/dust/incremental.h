@@ -0,0 +1,60 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+*/
+
+#pragma once
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+
+#include <stdlib.h>
+#include "dust/ustring.h"
+#include "dust/tokenizer.h"
+#include "dust/parser.h"
+
+/**
+ * @param base Offset of the statement's first token in source (before
+ *             the document's pending move), offsets of its tokens and of
+ *             the nodes under it are relative to it
+ * @param tokens Tokens of the statement
+ */
+typedef struct {
+    size_t base;
+    TokenArray *tokens;
+} DocumentStatement;
+
+/**
+ * @param source Current source code
+ * @param length Length of the source code
+ * @param statements Top-level statements
+ * @param count Number of top-level statements
+ * @param moved Index of the first statement whose base is not moved yet
+ * @param delta Characters the statements from moved on are still to be moved by
+ * @param tree Body node that holds one node per top-level statement
+ */
+typedef struct {
+    u32char *source;
+    size_t length;
+    DocumentStatement *statements;
+    size_t count;
+    size_t moved;
+    long delta;
+    Node *tree;
+} Document;
+
+Document *Document_new(u32char *source);
+
+void Document_free(Document *document);
+
+size_t Document_offset(Document *document, size_t n);
+
+void Document_edit(Document *document, size_t offset, size_t deleted, u32char *inserted);
+
+
+#endif
\ No newline at end of file
@@ -13,13 +13,56 @@
 #define IO_H
 
 
+#include <stdlib.h>
+#include <stdbool.h>
+#include "dust/ustring.h"
+
+// Bytes buffered by a writer before they are written out
+#define WRITER_BUFFER_SIZE (64 * 1024)
+
+/**
+ * @brief Buffered output to stdout or a file, text is encoded straight
+ *        into the buffer and written out whenever it fills up
+ *
+ * @param fd File descriptor written to
+ * @param path Path of the file (NULL for stdout)
+ * @param temp Path of the temporary file renamed onto path when closed
+ * @param buffer Bytes not written yet
+ * @param used Number of bytes in the buffer
+ * @param failed A write failed
+ */
+typedef struct {
+    int fd;
+    char *path;
+    char *temp;
+    char *buffer;
+    size_t used;
+    bool failed;
+} Writer;
+
+Writer *Writer_open(char *path);
+
+bool Writer_close(Writer *writer);
+
+void Writer_write(Writer *writer, char *data, size_t size);
+
+void Writer_write_u32n(Writer *writer, u32char *string, size_t n);
+
+void Writer_write_u32(Writer *writer, u32char *string);
+
+bool Writer_flush(Writer *writer);
+
 char *read_file(char *filepath);
 
-void write_file(char *filepath, char *content);
+bool write_file(char *filepath, char *content);
 
 int create_file(char *filepath);
 
 int remove_file(char *filepath);
 
+int create_dir(char *path);
+
+int remove_dir(char *path);
+
 
 #endif
\ No newline at end of file
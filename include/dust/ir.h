@@ -0,0 +1,185 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+*/
+
+#pragma once
+#ifndef IR_H
+#define IR_H
+
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include "dust/ustring.h"
+#include "dust/parser.h"
+#include "dust/typecheck.h"
+#include "dust/io.h"
+
+// No value or block
+#define IR_NONE -1
+
+typedef enum {
+    IrOp_CONST,    // integer, float, bool or string constant of its type
+    IrOp_UNDEF,    // value of a variable declared without one
+    IrOp_PHI,      // one operand per predecessor, in the order of preds
+    IrOp_ADD,
+    IrOp_SUB,
+    IrOp_MUL,
+    IrOp_DIV,
+    IrOp_MOD,
+    IrOp_POW,
+    IrOp_NEG,
+    IrOp_AND,      // logical on bools, bitwise on integers (same for or, xor)
+    IrOp_OR,
+    IrOp_XOR,
+    IrOp_NOT,
+    IrOp_EQ,
+    IrOp_NEQ,
+    IrOp_LT,
+    IrOp_LE,
+    IrOp_GT,
+    IrOp_GE,
+    IrOp_CONVERT,  // operand as the instruction's numeric type
+    IrOp_CONCAT,   // string + string
+    IrOp_IN,       // first operand is an element of the second
+    IrOp_RANGE,    // array from the first operand up to the second, excluded
+    IrOp_NEWARRAY, // array of as many elements as the operand
+    IrOp_LOAD,     // element of an array (or string) at an index
+    IrOp_STORE,    // array, index, value
+    IrOp_LENGTH,   // number of elements of an array (or string), as int64
+    IrOp_CALL,     // named function (or the first operand) called with the operands
+    IrOp_MEMBER,   // member called name of the operand
+    IrOp_IMPORT,   // module called name
+    IrOp_ENUM,     // enumeration called name, the operands are its members
+    IrOp_JUMP,     // to targets[0]
+    IrOp_BRANCH,   // to targets[0] if the operand is true, to targets[1] if not
+    IrOp_RETURN    // end of the program
+} IrOp;
+
+/**
+ * @brief An instruction, and the value it defines
+ *
+ * Values are numbered by their index in the program. Instructions that
+ * don't define a value (stores and terminators) have Type_NONE.
+ *
+ * @param op Operation
+ * @param type Type of the value
+ * @param block Block the instruction is in (IR_NONE once it is removed)
+ * @param offset Offset in source of the node it was lowered from
+ * @param args Operands
+ * @param arg_count Number of operands
+ * @param arg_size Allocated size of args
+ * @param targets Successor blocks of terminators
+ * @param integer Integer or bool constant
+ * @param floating Float constant
+ * @param name String constant, or name of a call, member, import or enumeration
+ */
+typedef struct {
+    IrOp op;
+    TypeId type;
+    int block;
+    size_t offset;
+    int *args;
+    int arg_count;
+    int arg_size;
+    int targets[2];
+    union {
+        long integer;
+        double floating;
+        u32char *name;
+    };
+} IrInstr;
+
+/**
+ * @brief Instructions that run one after another, phis first and a
+ *        terminator last
+ *
+ * @param instrs Instructions
+ * @param instr_count Number of instructions
+ * @param instr_size Allocated size of instrs
+ * @param preds Predecessor blocks, a block jumping here twice is in it twice
+ * @param pred_count Number of predecessors
+ * @param pred_size Allocated size of preds
+ */
+typedef struct {
+    int *instrs;
+    int instr_count;
+    int instr_size;
+    int *preds;
+    int pred_count;
+    int pred_size;
+} IrBlock;
+
+/**
+ * @param message Error message (owned by the program)
+ * @param value Value the error is about (IR_NONE if it is about a block)
+ */
+typedef struct {
+    u32char *message;
+    int value;
+} IrError;
+
+/**
+ * @brief A program in SSA form, the first block is where it starts
+ *
+ * @param values Every instruction
+ * @param value_count Number of instructions
+ * @param value_size Allocated size of values
+ * @param blocks Basic blocks
+ * @param block_count Number of blocks
+ * @param block_size Allocated size of blocks
+ * @param errors Errors of the last verification
+ * @param error_count Number of errors
+ * @param error_size Allocated size of errors
+ */
+typedef struct {
+    IrInstr *values;
+    int value_count;
+    int value_size;
+    IrBlock *blocks;
+    int block_count;
+    int block_size;
+    IrError *errors;
+    int error_count;
+    int error_size;
+} IrProgram;
+
+IrProgram *IrProgram_new();
+
+void IrProgram_free(IrProgram *program);
+
+int IrProgram_block(IrProgram *program);
+
+int IrProgram_insert(IrProgram *program, int block, int index, IrOp op, TypeId type, size_t offset);
+
+int IrProgram_add(IrProgram *program, int block, IrOp op, TypeId type, size_t offset);
+
+int IrProgram_add_phi(IrProgram *program, int block, TypeId type, size_t offset);
+
+void IrProgram_arg(IrProgram *program, int value, int arg);
+
+void IrProgram_jump(IrProgram *program, int block, int target, size_t offset);
+
+void IrProgram_branch(IrProgram *program, int block, int condition, int then, int otherwise, size_t offset);
+
+void IrProgram_compact(IrProgram *program);
+
+bool IrProgram_verify(IrProgram *program);
+
+u32char *IrProgram_repr(IrProgram *program);
+
+void IrProgram_write(IrProgram *program, Writer *writer);
+
+char *IrOp_repr(IrOp op);
+
+bool IrOp_isterminator(IrOp op);
+
+IrProgram *ir_lower(Node *body);
+
+
+#endif
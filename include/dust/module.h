@@ -0,0 +1,129 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+*/
+
+#pragma once
+#ifndef MODULE_H
+#define MODULE_H
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "dust/ustring.h"
+#include "dust/source.h"
+#include "dust/parser.h"
+#include "dust/thread.h"
+#include "dust/scheduler.h"
+
+// Number of buckets of the loader's module table
+#define LOADER_BUCKETS 256
+
+// Bumped whenever the layout of cached trees changes
+#define MODULE_CACHE_VERSION 1
+
+struct _Module;
+
+/**
+ * @param module Imported module
+ * @param offset Offset of the import statement in the importing source
+ */
+typedef struct {
+    struct _Module *module;
+    size_t offset;
+} ModuleImport;
+
+/**
+ * @brief A source file loaded once by the loader, along with the
+ *        modules it imports
+ *
+ * @param name Module name (file name without .dust)
+ * @param path Path the file was opened with
+ * @param key Canonical path, a file is the same module however it is reached
+ * @param hash Hash of the key
+ * @param source Source of the module, kept for diagnostics
+ * @param tree Body node of the module (NULL if it couldn't be parsed)
+ * @param tokens Tokens deferred bodies of the tree are parsed from (NULL if it was cached)
+ * @param cache Cached tree the names of the tree point into (NULL if it was parsed)
+ * @param imports Modules imported by the top-level import statements
+ * @param import_count Number of imports
+ * @param errors Diagnostics of the module, as they are printed
+ * @param error_count Number of diagnostics
+ * @param mark Whether the module is unvisited, being visited or ordered
+ *             by the loader's walk
+ * @param next Next module of the same bucket
+ */
+typedef struct _Module {
+    char *name;
+    char *path;
+    char *key;
+    uint64_t hash;
+    Source *source;
+    Node *tree;
+    TokenArray *tokens;
+    uint32_t *cache;
+    ModuleImport *imports;
+    size_t import_count;
+    char **errors;
+    size_t error_count;
+    int mark;
+    struct _Module *next;
+} Module;
+
+/**
+ * @brief Maps module names to files and loads every module a program
+ *        imports, each of them once
+ *
+ * A module is parsed as soon as the import naming it is seen, on the
+ * shared scheduler, so independent modules are parsed in parallel and
+ * loading takes as long as the longest chain of imports.
+ *
+ * @param root Directory of the first loaded file, searched after the
+ *             importing module's own directory
+ * @param cache_dir Directory parsed trees are cached in (NULL to not cache)
+ * @param lazy Bodies are parsed when they are first accessed, only the
+ *             imports are needed to load (syntax errors in bodies are
+ *             only reported when the tree is cached)
+ * @param buckets Modules by the hash of their key
+ * @param modules Modules in the order they were found
+ * @param count Number of modules
+ * @param size Allocated size of modules
+ * @param order Loaded modules, every module after the ones it imports
+ * @param order_count Number of ordered modules
+ * @param parsed Number of modules tokenized and parsed
+ * @param cached Number of modules read from the cache
+ * @param lock Guards the table, the counts and modules while loading
+ */
+typedef struct {
+    char *root;
+    char *cache_dir;
+    bool lazy;
+    Module *buckets[LOADER_BUCKETS];
+    Module **modules;
+    size_t count;
+    size_t size;
+    Module **order;
+    size_t order_count;
+    size_t parsed;
+    size_t cached;
+    Mutex lock;
+} Loader;
+
+Loader *Loader_new(char *cache_dir);
+
+void Loader_free(Loader *loader);
+
+Module *Loader_load(Loader *loader, char *path);
+
+size_t Loader_error_count(Loader *loader);
+
+char *module_cache_dir();
+
+
+#endif
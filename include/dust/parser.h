@@ -16,6 +16,8 @@
 #include <stdlib.h>
 #include "dust/ustring.h"
 #include "dust/tokenizer.h"
+#include "dust/io.h"
+#include "dust/thread.h"
 
 typedef enum {
     NodeType_INTEGER,
@@ -45,7 +47,8 @@ typedef enum {
     NodeType_WHEN,
     NodeType_REPEAT,
     NodeType_FOR,
-    NodeType_WHILE
+    NodeType_WHILE,
+    NodeType_CONVERT
 } NodeType;
 
 
@@ -79,8 +82,37 @@ typedef struct {
     size_t used;
 } NodeArray;
 
+/**
+ * @param nodes Node storage of this chunk
+ * @param size Capacity of the chunk
+ * @param used Number of nodes handed out from the chunk
+ * @param next Previously filled chunk
+ */
+typedef struct _NodeArena {
+    struct _Node *nodes;
+    size_t size;
+    size_t used;
+    struct _NodeArena *next;
+} NodeArena;
+
+// Depth and slot of a name the resolver hasn't resolved
+#define NODE_UNRESOLVED -1
+
+/*
+  offset is where the node is in the source, diagnostics about it point
+  there. Names are resolved into (depth, slot) pairs: slot is the name's
+  index in the frame of the scope declaring it and depth is the number
+  of scopes between the one using it and that one. Declarations only
+  have a slot, they are always in the current scope.
+
+  vtype is the type the type checker gave the node (a TypeId of
+  typecheck.h, 0 until it is checked).
+*/
 struct _Node {
     NodeType type;
+    bool pooled;
+    unsigned short vtype;
+    size_t offset;
     union {
         long integer;
 
@@ -88,7 +120,11 @@ struct _Node {
 
         u32char *string;
 
-        u32char *variable;
+        struct {
+            u32char *variable;
+            int var_depth;
+            int var_slot;
+        };
 
         u32char *primitive;
 
@@ -101,17 +137,21 @@ struct _Node {
             struct _Node *decl_type;
             u32char *decl_var;
             struct _Node *decl_expr;
+            int decl_slot;
         };
 
         struct {
             struct _Node *decln_type;
             u32char *decln_var;
+            int decln_slot;
         };
 
         struct {
             u32char *assign_var;
             u32char *assign_op;
             struct _Node *assign_expr;
+            int assign_depth;
+            int assign_slot;
         };
 
         struct {
@@ -135,6 +175,7 @@ struct _Node {
         struct {
             u32char *import_module;
             u32char *import_member;
+            int import_slot;
         };
 
         struct {
@@ -150,16 +191,25 @@ struct _Node {
         struct {
             u32char *enum_name;
             struct _Node *enum_body;
+            int enum_slot;
         };
 
         struct {
-            NodeArray *body;
+            // A deferred body has no statements yet, only where its tokens start
+            union {
+                NodeArray *body;
+                size_t body_start;
+            };
             int body_tokens;
+            int body_slots;
+            TokenArray *body_lazy;
+            NodeArena *body_arena;
         };
 
         struct {
             NodeArray *gentype;
             int gentype_tokens;
+            u32char *gentype_base;
         };
 
         struct {
@@ -189,10 +239,20 @@ struct _Node {
             struct _Node *for_expr;
             struct _Node *for_body;
         };
+
+        struct _Node *conv_expr;
     };
 };
 typedef struct _Node Node;
 
+NodeArena *NodeArena_new(size_t size);
+
+void NodeArena_free(NodeArena *arena);
+
+Node *Node_alloc();
+
+void Node_release(Node *node);
+
 Node *NodeInteger_new(long integer);
 
 Node *NodeFloat_new(double floating);
@@ -229,6 +289,10 @@ Node *NodeEnum_new(u32char *name, Node *body);
 
 Node *NodeBody_new(NodeArray *node_array, int tokens);
 
+Node *NodeLazyBody_new(TokenArray *tokens, size_t start, int body_tokens);
+
+NodeArray *Node_body(Node *node);
+
 Node *NodeGenType_new(NodeArray *node_array, int tokens);
 
 Node *NodeIf_new(Node *expression, Node *body);
@@ -243,22 +307,51 @@ Node *NodeWhile_new(Node *expression, Node *body);
 
 Node *NodeFor_new(Node *var, Node *iterator, Node *body);
 
+void Node_convert(Node *node, unsigned short type);
+
 void Node_free(Node *node);
 
 u32char *Node_repr(Node *node, int ident);
 
+void Node_write(Node *node, Writer *writer);
+
+u32char *Node_repr_op(OpType op);
+
 NodeArray *NodeArray_new(size_t def_size);
 
 void NodeArray_free(NodeArray *node_array);
 
 void NodeArray_append(NodeArray *node_array, Node *node);
 
+// Number of nodes in each chunk of a worker's node arena
+#define PARSER_ARENA_SIZE 4096
+
+// Top-level statement count below which parsing is not parallelized
+#define PARSER_PARALLEL_MIN 64
+
+// Ranges of top-level statements parsed in parallel for each job
+#define PARSER_PARALLEL_SPLIT 4
+
+extern int PARSER_FOLD;
+
+extern THREAD_LOCAL int PARSER_LAZY;
+
 Node *parse_expr(TokenArray *tokens);
 
 Node *parse_enum(TokenArray *tokens);
 
 Node *parse_body(TokenArray *tokens);
 
+Node *parse_block(TokenArray *tokens, size_t index);
+
+void parse_reset();
+
+Node *parse_body_parallel(TokenArray *tokens, int jobs);
+
+size_t *split_statements(TokenArray *tokens, size_t *count);
+
+Node *parse_statement(TokenArray *tokens, size_t start, size_t end);
+
 OpType get_optype(u32char *tokenval);
 
 Token *current_token(TokenArray *tokens);
@@ -0,0 +1,56 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+*/
+
+#pragma once
+#ifndef PERF_H
+#define PERF_H
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+    PerfCounter_CYCLES,
+    PerfCounter_INSTRUCTIONS,
+    PerfCounter_L1D_MISSES,
+    PerfCounter_LLC_MISSES,
+    PerfCounter_BRANCH_MISSES,
+    PerfCounter_PAGE_FAULTS,
+    PerfCounter_COUNT
+} PerfCounter;
+
+extern char *PERF_COUNTER_NAMES[PerfCounter_COUNT];
+
+/**
+ * @brief Performance counters of the calling thread
+ *
+ * @param fds Counter file descriptors (-1 where the counter isn't available)
+ * @param opened Number of counters available
+ * @param error Why some or all counters aren't available (NULL if all are)
+ */
+typedef struct {
+    int fds[PerfCounter_COUNT];
+    int opened;
+    char *error;
+} Perf;
+
+bool Perf_open(Perf *perf);
+
+void Perf_close(Perf *perf);
+
+bool Perf_has(Perf *perf, PerfCounter counter);
+
+void Perf_start(Perf *perf);
+
+void Perf_stop(Perf *perf, uint64_t values[PerfCounter_COUNT]);
+
+
+#endif
@@ -0,0 +1,30 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+*/
+
+#pragma once
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+
+#include "dust/ustring.h"
+#include "dust/parser.h"
+
+// Minimum number of characters lexed into one token batch
+#define PIPELINE_CHUNK 16384
+
+// Number of token batches that can wait between lexer and parser
+#define PIPELINE_RING 16
+
+Node *parse_pipelined(u32char *raw);
+
+Node *parse_file_pipelined(char *filepath);
+
+
+#endif
@@ -13,20 +13,23 @@
 #define PLATFORM_H
 
 
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
 #include "dust/ustring.h"
-
-enum {
-  OS_UNKNOWN,
-  OS_WINDOWS,
-  OS_LINUX,
-  OS_MACOS,
-  OS_FREEBSD,
-  OS_NETBSD,
-  OS_OPENBSD,
-  OS_DRAGONFLY,
-  OS_AMIGAOS,
-  OS_ANDROID
-};
+#include "dust/simd.h"
+
+// Values are macros (not enum constants) so they can be compared in #if
+#define OS_UNKNOWN   0
+#define OS_WINDOWS   1
+#define OS_LINUX     2
+#define OS_MACOS     3
+#define OS_FREEBSD   4
+#define OS_NETBSD    5
+#define OS_OPENBSD   6
+#define OS_DRAGONFLY 7
+#define OS_AMIGAOS   8
+#define OS_ANDROID   9
 
 #if defined(_WIN32)
 #define OS OS_WINDOWS
@@ -80,12 +83,52 @@ typedef struct {
 
 Platform get_platform();
 
+/**
+ * @param name Brand name of the CPU
+ * @param simd Widest vector instructions the CPU and the OS support
+ * @param cache_line Size of a cache line in bytes
+ * @param l1_size Size of a core's L1 data cache in bytes (0 if unknown)
+ * @param l2_size Size of a core's L2 cache in bytes (0 if unknown)
+ * @param l3_size Size of the L3 cache in bytes (0 if unknown)
+ * @param physical_cores Number of physical cores
+ * @param logical_cores Number of logical cores (hardware threads)
+ */
 typedef struct {
     u32char *name;
-    int corecount;
+    SIMDLevel simd;
+    size_t cache_line;
+    size_t l1_size;
+    size_t l2_size;
+    size_t l3_size;
+    int physical_cores;
+    int logical_cores;
 } CPUInfo;
 
 CPUInfo *get_cpuinfo();
 
+char *SIMDLevel_repr(SIMDLevel level);
+
+/**
+ * @brief Implementations of the vector kernels, each entry points to the
+ *        best one for the running CPU after the first call through it.
+ *        Entries are atomic because dispatch_use can repoint them while
+ *        other threads call through them.
+ *
+ * @param level Level the kernels were picked for
+ * @param structural_classify Classify 64 characters into structural masks
+ * @param utf8_ascii Widen the leading ASCII bytes of a UTF-8 string
+ */
+typedef struct {
+    _Atomic(SIMDLevel) level;
+    _Atomic(void (*)(u32char *block, uint64_t masks[6])) structural_classify;
+    _Atomic(size_t (*)(char *str, size_t n, u32char *out)) utf8_ascii;
+} DispatchTable;
+
+extern DispatchTable DISPATCH;
+
+void dispatch_init();
+
+void dispatch_use(SIMDLevel level);
+
 
 #endif
\ No newline at end of file
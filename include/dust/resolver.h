@@ -0,0 +1,117 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+*/
+
+#pragma once
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "dust/ustring.h"
+#include "dust/parser.h"
+
+// Initial number of entries of the name table (grows when 3/4 full)
+#define RESOLVER_TABLE_SIZE 64
+
+/**
+ * @param message Error message (owned by the resolver)
+ * @param offset Offset in source the error points at
+ */
+typedef struct {
+    u32char *message;
+    size_t offset;
+} ResolveError;
+
+/**
+ * @brief Every distinct name of the tree gets one
+ *
+ * @param name Name
+ * @param hash Hash of the name
+ * @param binding Innermost binding of the name (-1 if it isn't bound)
+ */
+typedef struct {
+    u32char *name;
+    uint32_t hash;
+    int binding;
+} ResolveName;
+
+/**
+ * @brief A name declared in a scope
+ *
+ * @param name Index of the name in names
+ * @param level Nesting level of the scope declaring it
+ * @param slot Index in the frame of that scope
+ * @param shadowed Binding it hides until its scope ends (-1 if none)
+ */
+typedef struct {
+    int name;
+    int level;
+    int slot;
+    int shadowed;
+} ResolveBinding;
+
+/**
+ * @param first First binding of the scope
+ * @param slots Number of names declared in the scope
+ */
+typedef struct {
+    size_t first;
+    int slots;
+} ResolveScope;
+
+/**
+ * @brief Lexical scopes of the tree being resolved
+ *
+ * Names are looked up in one table instead of a table per scope, each
+ * entry points at its innermost binding and bindings remember the one
+ * they shadow, so leaving a scope only pops its bindings.
+ *
+ * @param names Names seen so far
+ * @param name_count Number of names
+ * @param name_size Allocated size of names
+ * @param table Open addressing table of indices in names (-1 if empty)
+ * @param table_size Number of entries of the table (power of two)
+ * @param bindings Bindings of the open scopes, innermost last
+ * @param binding_count Number of bindings
+ * @param binding_size Allocated size of bindings
+ * @param scopes Open scopes, innermost last
+ * @param scope_count Number of scopes
+ * @param scope_size Allocated size of scopes
+ * @param errors Undefined and duplicate names, in source order of the walk
+ * @param error_count Number of errors
+ * @param error_size Allocated size of errors
+ */
+typedef struct {
+    ResolveName *names;
+    size_t name_count;
+    size_t name_size;
+    int *table;
+    size_t table_size;
+    ResolveBinding *bindings;
+    size_t binding_count;
+    size_t binding_size;
+    ResolveScope *scopes;
+    size_t scope_count;
+    size_t scope_size;
+    ResolveError *errors;
+    size_t error_count;
+    size_t error_size;
+} Resolver;
+
+Resolver *Resolver_new();
+
+void Resolver_free(Resolver *resolver);
+
+bool resolve(Resolver *resolver, Node *body);
+
+
+#endif
@@ -0,0 +1,179 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+*/
+
+#pragma once
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "dust/thread.h"
+
+// Initial number of slots of a worker's deque (grows when full)
+#define DEQUE_SIZE 256
+
+// Rounds an idle worker looks for work before it goes to sleep
+#define SCHEDULER_SPINS 64
+
+struct _Task;
+struct _TaskGroup;
+struct _Scheduler;
+
+typedef void (*TaskFunc)(struct _TaskGroup *group, void *arg);
+
+// Body of a parallel for, returns false to fail the iteration
+typedef bool (*ForFunc)(size_t index, void *arg);
+
+/**
+ * @brief Slots of a deque, replaced by a bigger copy when it is full
+ *
+ * @param capacity Number of slots (power of two)
+ * @param previous Array this one replaced, freed with the deque
+ *                 (thieves might still be reading it)
+ * @param slots Task storage
+ */
+typedef struct _DequeArray {
+    size_t capacity;
+    struct _DequeArray *previous;
+    _Atomic(struct _Task *) slots[];
+} DequeArray;
+
+/**
+ * @brief Chase–Lev work-stealing deque
+ *
+ * Its owner pushes and takes tasks at the bottom, any other thread
+ * steals them from the top.
+ *
+ * @param top Index of the oldest task
+ * @param bottom Index after the newest task (written only by the owner)
+ * @param array Slots
+ */
+typedef struct {
+    atomic_llong top;
+    atomic_llong bottom;
+    _Atomic(DequeArray *) array;
+} Deque;
+
+Deque *Deque_new(size_t capacity);
+
+void Deque_free(Deque *deque);
+
+void Deque_push(Deque *deque, struct _Task *task);
+
+struct _Task *Deque_take(Deque *deque);
+
+struct _Task *Deque_steal(Deque *deque, bool *contended);
+
+/**
+ * @brief A function to run on the scheduler
+ *
+ * @param func Function to run
+ * @param arg Argument passed to the function
+ * @param group Group the task belongs to
+ * @param allocator Allocator of the thread that spawned it
+ * @param source Current source of the thread that spawned it
+ */
+typedef struct _Task {
+    TaskFunc func;
+    void *arg;
+    struct _TaskGroup *group;
+    struct _DustAllocator *allocator;
+    struct _Source *source;
+} Task;
+
+/**
+ * @brief Tasks waited for together
+ *
+ * @param scheduler Scheduler the tasks run on
+ * @param pending Spawned tasks that haven't finished
+ * @param cancelled Tasks of the group that haven't started are skipped
+ */
+typedef struct _TaskGroup {
+    struct _Scheduler *scheduler;
+    atomic_size_t pending;
+    atomic_bool cancelled;
+} TaskGroup;
+
+/**
+ * @param scheduler Scheduler the worker belongs to
+ * @param deque Tasks spawned by the worker
+ * @param thread Thread of the worker
+ * @param started Thread was started
+ * @param cpu Logical core the worker is pinned to (-1 if it isn't)
+ * @param seed State of the victim picker
+ */
+typedef struct {
+    struct _Scheduler *scheduler;
+    Deque *deque;
+    Thread thread;
+    bool started;
+    int cpu;
+    uint32_t seed;
+} Worker;
+
+/**
+ * @brief Work-stealing thread pool
+ *
+ * The thread that waits on a group runs tasks too, so a scheduler of
+ * N jobs starts N - 1 workers.
+ *
+ * @param jobs Number of threads running tasks
+ * @param workers Workers (jobs - 1)
+ * @param inject Tasks spawned from outside the workers
+ * @param inject_lock Taken while inject is used
+ * @param queued Tasks that are spawned but not yet picked up
+ * @param sleeping Workers sleeping on wake
+ * @param stopping Workers exit once they see it
+ * @param lock Mutex of wake
+ * @param wake Idle workers sleep on it until tasks are spawned
+ */
+typedef struct _Scheduler {
+    int jobs;
+    Worker *workers;
+    Deque *inject;
+    atomic_flag inject_lock;
+    atomic_size_t queued;
+    atomic_int sleeping;
+    atomic_bool stopping;
+    Mutex lock;
+    Condition wake;
+} Scheduler;
+
+// Number of jobs of the shared scheduler (0 for one per physical core)
+extern int SCHEDULER_JOBS;
+
+// Workers of the shared scheduler are pinned to cores
+extern int SCHEDULER_PIN;
+
+Scheduler *Scheduler_new(int jobs, bool pin);
+
+void Scheduler_free(Scheduler *scheduler);
+
+Scheduler *scheduler_shared();
+
+int scheduler_jobs(int jobs);
+
+void TaskGroup_init(TaskGroup *group, Scheduler *scheduler);
+
+void TaskGroup_spawn(TaskGroup *group, TaskFunc func, void *arg);
+
+bool TaskGroup_wait(TaskGroup *group);
+
+void TaskGroup_cancel(TaskGroup *group);
+
+bool TaskGroup_cancelled(TaskGroup *group);
+
+size_t Scheduler_for(Scheduler *scheduler, size_t first, size_t last, ForFunc func, void *arg);
+
+
+#endif
@@ -0,0 +1,79 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+*/
+
+#pragma once
+#ifndef SERVE_H
+#define SERVE_H
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "dust/ustring.h"
+#include "dust/source.h"
+#include "dust/tokenizer.h"
+#include "dust/parser.h"
+#include "dust/allocator.h"
+
+// Number of sources whose tokens and trees are kept warm
+#define SERVE_CACHE_SIZE 256
+
+// Largest request accepted, in bytes
+#define SERVE_REQUEST_MAX (64 * 1024 * 1024)
+
+typedef enum {
+    ServeCommand_TOKENIZE,
+    ServeCommand_PARSE,
+    ServeCommand_CHECK,
+    ServeCommand_TRANSPILE,
+    ServeCommand_STOP,
+    ServeCommand_COUNT
+} ServeCommand;
+
+extern char *SERVE_COMMAND_NAMES[ServeCommand_COUNT];
+
+/**
+ * @brief Tokens, tree and outputs of a source, shared by the requests for it
+ *
+ * @param hash Hash of the source's name, code and options
+ * @param refs References from the cache and the requests using it
+ * @param lock Taken while the entry is used
+ * @param arena Every allocation of the entry but itself
+ * @param source Source
+ * @param tokens Tokens (NULL until tokenized)
+ * @param root Body node of the top-level statements (NULL until parsed)
+ * @param tokenize_error Diagnostic if tokenizing failed
+ * @param parse_error Diagnostic if parsing failed
+ * @param outputs Output of each command (NULL until requested)
+ * @param statuses Exit status of each command
+ */
+typedef struct {
+    uint64_t hash;
+    int refs;
+    atomic_flag lock;
+    Arena *arena;
+    Source *source;
+    TokenArray *tokens;
+    Node *root;
+    char *tokenize_error;
+    char *parse_error;
+    char *outputs[ServeCommand_COUNT];
+    int statuses[ServeCommand_COUNT];
+} ServeEntry;
+
+char *serve_socket();
+
+int serve(char *socket_path, int workers);
+
+int serve_client(char *socket_path, char *command, bool nocolor, bool ispath, char **paths, int count);
+
+
+#endif
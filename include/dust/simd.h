@@ -0,0 +1,37 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+*/
+
+#pragma once
+#ifndef SIMD_H
+#define SIMD_H
+
+
+// Vector kernels for x86 are all compiled in and picked at runtime with CPUID
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SIMD_X86
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+
+#elif defined(_M_X64)
+#define SIMD_X86
+#define SIMD_TARGET(isa)
+
+#endif
+
+// Ordered, every level includes the ones before it
+typedef enum {
+    SIMDLevel_SCALAR,
+    SIMDLevel_SSE2,
+    SIMDLevel_SSE42,
+    SIMDLevel_AVX2,
+    SIMDLevel_AVX512
+} SIMDLevel;
+
+
+#endif
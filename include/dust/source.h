@@ -0,0 +1,65 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+*/
+
+#pragma once
+#ifndef SOURCE_H
+#define SOURCE_H
+
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include "dust/ustring.h"
+#include "dust/structural.h"
+#include "dust/thread.h"
+
+/**
+ * @brief A source file, positions are kept as offsets everywhere else
+ *        and resolved into lines and columns only through this
+ *
+ * @param name Name shown in diagnostics
+ * @param raw Source code
+ * @param length Length of the source code
+ * @param lines Sorted offsets of line breaks
+ * @param line_count Number of line breaks
+ * @param line_size Allocated size of lines
+ * @param indexed All line breaks are in lines
+ * @param owned Source code is freed with the source
+ */
+typedef struct _Source {
+    u32char *name;
+    u32char *raw;
+    size_t length;
+    size_t *lines;
+    size_t line_count;
+    size_t line_size;
+    bool indexed;
+    bool owned;
+} Source;
+
+extern THREAD_LOCAL Source *CURRENT_SOURCE;
+
+Source *Source_new(u32char *name, u32char *raw, size_t length);
+
+void Source_free(Source *source);
+
+void Source_add_lines(Source *source, StructuralIndex *index, size_t offset);
+
+void Source_index(Source *source);
+
+void Source_position(Source *source, size_t offset, int *x, int *y);
+
+u32char *Source_line(Source *source, int y);
+
+void source_use(Source *source);
+
+Source *source_of(u32char *raw, size_t length);
+
+
+#endif
@@ -0,0 +1,67 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+*/
+
+#pragma once
+#ifndef STRUCTURAL_H
+#define STRUCTURAL_H
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "dust/ustring.h"
+#include "dust/simd.h"
+
+/**
+ * @brief Bitmasks over the source, bit i of word i/64 is set if
+ *        character i belongs to the class
+ *
+ * @param length Length of the indexed source
+ * @param words Number of 64-bit words in each mask
+ * @param quote Quotes " '
+ * @param space Spaces
+ * @param newline Line breaks
+ * @param star Stars (to find block comment ends)
+ * @param structural Structural characters { } ( ) [ ] ; , .
+ * @param delim Characters that end an identifier or literal
+ *              (all the above and operator characters)
+ */
+typedef struct {
+    size_t length;
+    size_t words;
+    uint64_t *quote;
+    uint64_t *space;
+    uint64_t *newline;
+    uint64_t *star;
+    uint64_t *structural;
+    uint64_t *delim;
+} StructuralIndex;
+
+StructuralIndex *StructuralIndex_new(u32char *raw, size_t length);
+
+void StructuralIndex_free(StructuralIndex *index);
+
+size_t StructuralIndex_next(StructuralIndex *index, uint64_t *mask, size_t from);
+
+size_t StructuralIndex_next_clear(StructuralIndex *index, uint64_t *mask, size_t from);
+
+void structural_classify_scalar(u32char *block, uint64_t masks[6]);
+
+#if defined(SIMD_X86)
+void structural_classify_sse2(u32char *block, uint64_t masks[6]);
+
+void structural_classify_avx2(u32char *block, uint64_t masks[6]);
+
+void structural_classify_avx512(u32char *block, uint64_t masks[6]);
+#endif
+
+char *structural_backend();
+
+
+#endif
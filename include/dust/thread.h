@@ -0,0 +1,136 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+*/
+
+#pragma once
+#ifndef THREAD_H
+#define THREAD_H
+
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "dust/platform.h"
+
+#if OS == OS_WINDOWS
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+// Storage class of per-thread globals
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
+
+typedef void *(*ThreadFunc)(void *arg);
+
+struct _DustAllocator;
+struct _Source;
+
+/**
+ * @param handle Native thread handle
+ * @param func Function the thread runs
+ * @param arg Argument passed to the function
+ * @param result Value returned from the function
+ * @param allocator Allocator of the thread that started it
+ * @param source Current source of the thread that started it
+ */
+typedef struct {
+    #if OS == OS_WINDOWS
+    HANDLE handle;
+    #else
+    pthread_t handle;
+    #endif
+    ThreadFunc func;
+    void *arg;
+    void *result;
+    struct _DustAllocator *allocator;
+    struct _Source *source;
+} Thread;
+
+bool Thread_start(Thread *thread, ThreadFunc func, void *arg);
+
+void *Thread_join(Thread *thread);
+
+int thread_count();
+
+void thread_yield();
+
+/**
+ * @brief Mutual exclusion lock
+ */
+typedef struct {
+    #if OS == OS_WINDOWS
+    SRWLOCK handle;
+    #else
+    pthread_mutex_t handle;
+    #endif
+} Mutex;
+
+void Mutex_init(Mutex *mutex);
+
+void Mutex_destroy(Mutex *mutex);
+
+void Mutex_lock(Mutex *mutex);
+
+void Mutex_unlock(Mutex *mutex);
+
+/**
+ * @brief Condition variable threads sleep on until they are woken
+ */
+typedef struct {
+    #if OS == OS_WINDOWS
+    CONDITION_VARIABLE handle;
+    #else
+    pthread_cond_t handle;
+    #endif
+} Condition;
+
+void Condition_init(Condition *condition);
+
+void Condition_destroy(Condition *condition);
+
+void Condition_wait(Condition *condition, Mutex *mutex);
+
+void Condition_wake(Condition *condition);
+
+void Condition_wake_all(Condition *condition);
+
+/**
+ * @brief Bounded lock-free queue for one producer and one consumer thread
+ *
+ * @param slots Item storage
+ * @param capacity Number of slots (power of two)
+ * @param head Count of popped items (written only by the consumer)
+ * @param tail Count of pushed items (written only by the producer)
+ */
+typedef struct {
+    void **slots;
+    size_t capacity;
+    atomic_size_t head;
+    atomic_size_t tail;
+} Ring;
+
+Ring *Ring_new(size_t capacity);
+
+void Ring_free(Ring *ring);
+
+bool Ring_push(Ring *ring, void *item);
+
+bool Ring_pop(Ring *ring, void **item);
+
+void Ring_push_wait(Ring *ring, void *item);
+
+void *Ring_pop_wait(Ring *ring);
+
+
+#endif
\ No newline at end of file
@@ -15,6 +15,8 @@
 
 #include <stdlib.h>
 #include <dust/ustring.h>
+#include "dust/source.h"
+#include "dust/io.h"
 
 typedef enum {
     TokenType_IDENTIFIER,
@@ -35,8 +37,9 @@ typedef enum {
 
 typedef struct {
     TokenType type;
+    int match;
     u32char *data;
-    int x, y;
+    size_t offset;
 } Token;
 
 Token *Token_new(TokenType type, u32char *data);
@@ -61,8 +64,20 @@ TokenArray *TokenArray_slice(TokenArray *token_array, int index);
 
 TokenArray *TokenArray_slicet(TokenArray *token_array, int index);
 
+TokenArray *TokenArray_subslice(TokenArray *token_array, size_t start, size_t end);
+
+TokenArray TokenArray_view(TokenArray *token_array, size_t start, size_t end);
+
 u32char *TokenArray_repr(TokenArray *token_array);
 
+void TokenArray_write(TokenArray *token_array, Writer *writer);
+
+TokenArray *tokenize_part(u32char *raw, size_t offset, Source *source);
+
+void tokenize_match(TokenArray *tokens);
+
+void tokenize_end(TokenArray *tokens);
+
 TokenArray *tokenize(u32char *raw);
 
 TokenArray *tokenize_file(char *filepath);
@@ -0,0 +1,106 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+*/
+
+#pragma once
+#ifndef TRACE_H
+#define TRACE_H
+
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+// Number of spans kept for each thread, older spans are overwritten
+#define TRACE_BUFFER_SIZE 65536
+
+// Span argument that isn't shown
+#define TRACE_NOARG ((size_t)-1)
+
+/**
+ * @brief A finished span
+ *
+ * @param name Name of the span (must outlive the trace)
+ * @param start Start time in seconds
+ * @param duration Duration in seconds
+ * @param arg Source offset or size the span is about (TRACE_NOARG if none)
+ */
+typedef struct {
+    char *name;
+    double start;
+    double duration;
+    size_t arg;
+} TraceEvent;
+
+/**
+ * @brief Ring of one thread's spans, written only by that thread
+ *
+ * @param events Span storage
+ * @param count Number of spans ever written
+ * @param tid Thread id shown in the trace
+ * @param name Thread name shown in the trace
+ * @param next Next buffer in the list of all buffers
+ */
+typedef struct _TraceBuffer {
+    TraceEvent events[TRACE_BUFFER_SIZE];
+    atomic_size_t count;
+    int tid;
+    char *name;
+    struct _TraceBuffer *next;
+} TraceBuffer;
+
+/**
+ * @brief A span that is being recorded
+ *
+ * @param name Name of the span (NULL if no span is open)
+ * @param start Start time in seconds
+ * @param arg Source offset or size the span is about
+ */
+typedef struct {
+    char *name;
+    double start;
+    size_t arg;
+} TraceSpan;
+
+void trace_begin(TraceSpan *span, char *name, size_t arg);
+
+void trace_end(TraceSpan *span);
+
+void trace_thread(char *name);
+
+bool trace_dump(char *path);
+
+void trace_dump_at_exit(char *path);
+
+void trace_reset();
+
+
+/*
+  Trace points are compiled in only when building with DUST_TRACE, so
+  they cost nothing otherwise. Beginning an open span ends it first,
+  which lets a loop record one span per iteration with the same span.
+*/
+#ifdef DUST_TRACE
+
+#define TRACE_SPAN(span) TraceSpan span = {NULL, 0.0, TRACE_NOARG}
+#define TRACE_BEGIN(span, name, arg) trace_begin(&(span), (name), (arg))
+#define TRACE_END(span) trace_end(&(span))
+#define TRACE_THREAD(name) trace_thread(name)
+
+#else
+
+#define TRACE_SPAN(span)
+#define TRACE_BEGIN(span, name, arg) ((void)0)
+#define TRACE_END(span) ((void)0)
+#define TRACE_THREAD(name) ((void)0)
+
+#endif
+
+
+#endif
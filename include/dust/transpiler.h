@@ -20,9 +20,14 @@
 
 #include "dust/ustring.h"
 #include "dust/parser.h"
+#include "dust/io.h"
+
+u32char *transpile_source(NodeArray *node_array);
 
 void transpile(NodeArray *node_array);
 
+void transpile_write(NodeArray *node_array, Writer *writer);
+
 u32char *translate_expr(Node *node);
 
 u32char *translate_op(OpType op);
@@ -0,0 +1,114 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+*/
+
+#pragma once
+#ifndef TYPECHECK_H
+#define TYPECHECK_H
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "dust/ustring.h"
+#include "dust/parser.h"
+
+/*
+  A type fits in the vtype field of nodes: the low byte is the base
+  type and the high byte is how many arrays it is nested in, so
+  array<int8> is TYPE_ARRAY(Type_INT8).
+*/
+typedef uint16_t TypeId;
+
+typedef enum {
+    Type_NONE,      // not checked, or nothing is expected
+    Type_DYNAMIC,   // only known at runtime (calls, imports, members...)
+    Type_BOOL,
+    Type_STRING,
+    Type_INT8,
+    Type_INT16,
+    Type_INT32,
+    Type_INT64,
+    Type_INT128,
+    Type_UINT8,
+    Type_UINT16,
+    Type_UINT32,
+    Type_UINT64,
+    Type_UINT128,
+    Type_FLOAT32,
+    Type_FLOAT64
+} Type;
+
+#define TYPE_BASE(type) ((type) & 0xff)
+#define TYPE_DIMS(type) ((type) >> 8)
+#define TYPE_ARRAY(type) ((TypeId)((type) + 0x100))
+#define TYPE_ELEMENT(type) ((TypeId)((type) - 0x100))
+
+/**
+ * @param message Error message (owned by the type checker)
+ * @param offset Offset in source the error points at
+ */
+typedef struct {
+    u32char *message;
+    size_t offset;
+} TypeError;
+
+/**
+ * @brief Types of the names of the open scopes
+ *
+ * Slots of every open scope are kept in one stack, the slot a resolved
+ * name uses is found from its (depth, slot) pair without looking at
+ * the name.
+ *
+ * @param slots Type of every slot of the open scopes, innermost last
+ * @param slot_count Number of slots
+ * @param slot_size Allocated size of slots
+ * @param frames First slot of each open scope, innermost last
+ * @param frame_count Number of open scopes
+ * @param frame_size Allocated size of frames
+ * @param errors Mismatches, in the order they were found
+ * @param error_count Number of errors
+ * @param error_size Allocated size of errors
+ */
+typedef struct {
+    TypeId *slots;
+    size_t slot_count;
+    size_t slot_size;
+    size_t *frames;
+    size_t frame_count;
+    size_t frame_size;
+    TypeError *errors;
+    size_t error_count;
+    size_t error_size;
+} TypeChecker;
+
+bool Type_isint(TypeId type);
+
+bool Type_issigned(TypeId type);
+
+bool Type_isfloat(TypeId type);
+
+int Type_bits(TypeId type);
+
+TypeId Type_parse(Node *node);
+
+void Type_repr_build(StringBuilder *builder, TypeId type);
+
+u32char *Type_repr(TypeId type);
+
+char *Type_ctype(TypeId type);
+
+TypeChecker *TypeChecker_new();
+
+void TypeChecker_free(TypeChecker *checker);
+
+bool typecheck(TypeChecker *checker, Node *body);
+
+
+#endif
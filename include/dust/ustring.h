@@ -13,8 +13,10 @@
 #define USTRING_H
 
 
+#include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include "dust/simd.h"
 
 typedef uint32_t u32char;
 
@@ -32,6 +34,16 @@ char *utf32_to_ascii(u32char *str);
 
 u32char *utf8_to_utf32(char *str);
 
+size_t utf8_ascii_scalar(char *str, size_t n, u32char *out);
+
+#if defined(SIMD_X86)
+size_t utf8_ascii_sse2(char *str, size_t n, u32char *out);
+
+size_t utf8_ascii_avx2(char *str, size_t n, u32char *out);
+
+size_t utf8_ascii_avx512(char *str, size_t n, u32char *out);
+#endif
+
 u32char *ascii_to_utf32(char *str);
 
 bool u32isempty(u32char *str);
@@ -94,8 +106,36 @@ char *u8readfile(char *filepath);
 
 u32char *u32readfile(char *filepath);
 
-int u32toint(u32char *str, int base);
+long u32toint(u32char *str, int base);
 
 double u32tofloat(u32char *str);
 
+/**
+ * @brief Growable string, builds long strings in linear time where
+ *        joining strings one by one would be quadratic
+ *
+ * @param data Built string (always null-terminated)
+ * @param length Length of the built string
+ * @param size Allocated size in characters
+ */
+typedef struct {
+    u32char *data;
+    size_t length;
+    size_t size;
+} StringBuilder;
+
+StringBuilder *StringBuilder_new(size_t def_size);
+
+void StringBuilder_free(StringBuilder *builder);
+
+void StringBuilder_appendn(StringBuilder *builder, u32char *str, size_t n);
+
+void StringBuilder_append(StringBuilder *builder, u32char *str);
+
+void StringBuilder_push(StringBuilder *builder, u32char chr);
+
+void StringBuilder_fill(StringBuilder *builder, u32char chr, size_t amount);
+
+u32char *StringBuilder_finish(StringBuilder *builder);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,76 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+*/
+
+#pragma once
+#ifndef WATCH_H
+#define WATCH_H
+
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include "dust/allocator.h"
+
+// Milliseconds events are collected for after the first one before rebuilding
+#define WATCH_SETTLE 20
+
+/**
+ * @brief A source file of a watched directory
+ *
+ * @param path Path of the file
+ * @param module Name other files import it with
+ * @param imports Modules the file imports
+ * @param import_count Number of imports
+ * @param dirty File is rebuilt on the next rebuild
+ * @param failed Last build of the file had an error
+ */
+typedef struct {
+    char *path;
+    char *module;
+    char **imports;
+    size_t import_count;
+    bool dirty;
+    bool failed;
+} WatchFile;
+
+/**
+ * @brief Source files of a directory and what they import
+ *
+ * @param directory Watched directory
+ * @param transpiling Files are transpiled, otherwise only checked
+ * @param nocolor Diagnostics have no ANSI colors
+ * @param files Files
+ * @param count Number of files
+ * @param size Allocated size of files
+ * @param arena Allocations of the file being built, reset after it
+ */
+typedef struct {
+    char *directory;
+    bool transpiling;
+    bool nocolor;
+    WatchFile **files;
+    size_t count;
+    size_t size;
+    Arena *arena;
+} Watcher;
+
+Watcher *Watcher_new(char *directory, bool transpiling, bool nocolor);
+
+void Watcher_free(Watcher *watcher);
+
+void Watcher_scan(Watcher *watcher, char *directory);
+
+void Watcher_touch(Watcher *watcher, char *path);
+
+size_t Watcher_rebuild(Watcher *watcher, size_t *failed);
+
+int watch(char *directory, bool transpiling, bool nocolor);
+
+
+#endif
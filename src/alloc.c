@@ -0,0 +1,462 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+
+  alloc.c  -  Allocation statistics
+  -------------------------------------------------
+  Counts the front-end's allocations when built with
+  DUST_ALLOC_STATS, blocks are still allocated with
+  the current allocator. Every live block is kept in
+  a table keyed by its address, so frees of blocks
+  allocated elsewhere are passed through untouched.
+  Counts are grouped into phases (set with
+  alloc_phase) and call sites, and blocks still live
+  at exit are reported as leaks.
+
+*/
+
+#define DUST_ALLOC_IMPL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "dust/allocator.h"
+#include "dust/alloc.h"
+
+
+// Number of call sites tracked, allocations of further sites aren't attributed
+#define ALLOC_SITES 4096
+
+/**
+ * @param file Source file of the call site
+ * @param line Line of the call site
+ * @param phase Phase the allocations were made in
+ * @param allocations Number of allocations
+ * @param bytes Total bytes allocated
+ */
+typedef struct {
+    char *file;
+    int line;
+    int phase;
+    size_t allocations;
+    size_t bytes;
+} AllocSite;
+
+/**
+ * @param ptr Address of the block (NULL if the slot is empty)
+ * @param size Size of the block
+ * @param site Call site index (-1 if not attributed)
+ */
+typedef struct {
+    void *ptr;
+    size_t size;
+    int site;
+} AllocBlock;
+
+static atomic_flag alloc_lock = ATOMIC_FLAG_INIT;
+
+static AllocCounts alloc_phases[ALLOC_PHASES] = {{"other", 0, 0, 0, 0}};
+static int alloc_phase_count = 1;
+static int alloc_current = 0;
+
+static AllocSite alloc_sites[ALLOC_SITES];
+
+static AllocBlock *alloc_blocks = NULL;
+static size_t alloc_block_size = 0;
+static size_t alloc_block_count = 0;
+
+static size_t alloc_live_bytes = 0;
+static size_t alloc_peak_bytes = 0;
+static size_t alloc_input_length = 0;
+
+static bool alloc_exit_registered = false;
+
+
+static void alloc_acquire() {
+    while (atomic_flag_test_and_set_explicit(&alloc_lock, memory_order_acquire));
+}
+
+static void alloc_release() {
+    atomic_flag_clear_explicit(&alloc_lock, memory_order_release);
+}
+
+static size_t alloc_hash(void *ptr) {
+    return (size_t)(((uintptr_t)ptr >> 4) * 0x9E3779B97F4A7C15ull);
+}
+
+static int alloc_site(char *file, int line) {
+    size_t hash = ((uintptr_t)file * 31 + (size_t)line * 131 + (size_t)alloc_current) % ALLOC_SITES;
+
+    for (size_t i = 0; i < ALLOC_SITES; i++) {
+        AllocSite *site = &alloc_sites[(hash + i) % ALLOC_SITES];
+
+        if (site->file == NULL) {
+            site->file = file;
+            site->line = line;
+            site->phase = alloc_current;
+            return (int)((hash + i) % ALLOC_SITES);
+        }
+
+        if (site->file == file && site->line == line && site->phase == alloc_current)
+            return (int)((hash + i) % ALLOC_SITES);
+    }
+
+    return -1;
+}
+
+static void alloc_insert(AllocBlock block);
+
+// Double the block table, it is kept at most half full
+static void alloc_grow() {
+    AllocBlock *old = alloc_blocks;
+    size_t old_size = alloc_block_size;
+
+    alloc_block_size = old_size == 0 ? 1024 : old_size * 2;
+    alloc_blocks = (AllocBlock *)calloc(alloc_block_size, sizeof(AllocBlock));
+    alloc_block_count = 0;
+
+    for (size_t i = 0; i < old_size; i++)
+        if (old[i].ptr != NULL) alloc_insert(old[i]);
+
+    free(old);
+}
+
+static void alloc_insert(AllocBlock block) {
+    if ((alloc_block_count + 1) * 2 > alloc_block_size) alloc_grow();
+
+    size_t mask = alloc_block_size - 1;
+    size_t i = alloc_hash(block.ptr) & mask;
+
+    while (alloc_blocks[i].ptr != NULL) i = (i + 1) & mask;
+
+    alloc_blocks[i] = block;
+    alloc_block_count++;
+}
+
+// Remove a block, returns false if it wasn't allocated through here
+static bool alloc_remove(void *ptr, AllocBlock *removed) {
+    if (alloc_block_size == 0) return false;
+
+    size_t mask = alloc_block_size - 1;
+    size_t i = alloc_hash(ptr) & mask;
+
+    while (alloc_blocks[i].ptr != ptr) {
+        if (alloc_blocks[i].ptr == NULL) return false;
+        i = (i + 1) & mask;
+    }
+
+    *removed = alloc_blocks[i];
+    alloc_blocks[i].ptr = NULL;
+    alloc_block_count--;
+
+    // Shift the following blocks back so no lookup stops early at the hole
+    size_t hole = i;
+    for (i = (i + 1) & mask; alloc_blocks[i].ptr != NULL; i = (i + 1) & mask) {
+        size_t home = alloc_hash(alloc_blocks[i].ptr) & mask;
+
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            alloc_blocks[hole] = alloc_blocks[i];
+            alloc_blocks[i].ptr = NULL;
+            hole = i;
+        }
+    }
+
+    return true;
+}
+
+static void alloc_count(void *ptr, size_t size, char *file, int line) {
+    int site = alloc_site(file, line);
+    AllocCounts *phase = &alloc_phases[alloc_current];
+
+    if (site >= 0) {
+        alloc_sites[site].allocations++;
+        alloc_sites[site].bytes += size;
+    }
+
+    phase->allocations++;
+    phase->bytes += size;
+
+    alloc_live_bytes += size;
+    if (alloc_live_bytes > phase->peak) phase->peak = alloc_live_bytes;
+    if (alloc_live_bytes > alloc_peak_bytes) alloc_peak_bytes = alloc_live_bytes;
+
+    alloc_insert((AllocBlock){ptr, size, site});
+}
+
+static void alloc_uncount(void *ptr) {
+    AllocBlock block;
+
+    if (alloc_remove(ptr, &block)) {
+        alloc_live_bytes -= block.size;
+        alloc_phases[alloc_current].frees++;
+    }
+}
+
+
+/**
+ * @brief Counting malloc
+ *
+ * @param size Size of the block
+ * @param file Source file of the call site
+ * @param line Line of the call site
+ * @return Allocated block
+ */
+void *alloc_malloc(size_t size, char *file, int line) {
+    void *ptr = dust_malloc(size);
+    if (ptr == NULL) return NULL;
+
+    alloc_acquire();
+    alloc_count(ptr, size, file, line);
+    alloc_release();
+
+    return ptr;
+}
+
+/**
+ * @brief Counting calloc
+ */
+void *alloc_calloc(size_t count, size_t size, char *file, int line) {
+    void *ptr = dust_calloc(count, size);
+    if (ptr == NULL) return NULL;
+
+    alloc_acquire();
+    alloc_count(ptr, count * size, file, line);
+    alloc_release();
+
+    return ptr;
+}
+
+/**
+ * @brief Counting realloc, counted as a free and an allocation of the new size
+ */
+void *alloc_realloc(void *ptr, size_t size, char *file, int line) {
+    // Reallocated under the lock so no other thread gets the old block first
+    alloc_acquire();
+
+    void *new = dust_realloc(ptr, size);
+
+    if (new != NULL || size == 0) {
+        if (ptr != NULL) alloc_uncount(ptr);
+        if (new != NULL) alloc_count(new, size, file, line);
+    }
+
+    alloc_release();
+    return new;
+}
+
+/**
+ * @brief Counting free, blocks not allocated through here are just freed
+ *
+ * @param ptr Block to free
+ */
+void alloc_free(void *ptr) {
+    if (ptr == NULL) return;
+
+    alloc_acquire();
+    alloc_uncount(ptr);
+    alloc_release();
+
+    dust_free(ptr);
+}
+
+/**
+ * @brief Attribute following allocations to a phase
+ *
+ * @param name Name of the phase (must outlive the statistics)
+ */
+void alloc_phase(char *name) {
+    alloc_acquire();
+
+    int found = -1;
+    for (int i = 0; i < alloc_phase_count; i++)
+        if (!strcmp(alloc_phases[i].name, name)) found = i;
+
+    if (found < 0 && alloc_phase_count < ALLOC_PHASES) {
+        found = alloc_phase_count++;
+        memset(&alloc_phases[found], 0, sizeof(AllocCounts));
+        alloc_phases[found].name = name;
+    }
+
+    if (found >= 0) {
+        alloc_current = found;
+        if (alloc_live_bytes > alloc_phases[found].peak) alloc_phases[found].peak = alloc_live_bytes;
+    }
+
+    alloc_release();
+}
+
+/**
+ * @brief Set the length of the input to report allocations per character of
+ *
+ * @param length Number of characters in the source code
+ */
+void alloc_input(size_t length) {
+    alloc_input_length += length;
+}
+
+/**
+ * @brief Counts of the whole run
+ */
+AllocCounts alloc_totals() {
+    AllocCounts totals = {"total", 0, 0, 0, 0};
+
+    alloc_acquire();
+
+    for (int i = 0; i < alloc_phase_count; i++) {
+        totals.allocations += alloc_phases[i].allocations;
+        totals.bytes += alloc_phases[i].bytes;
+        totals.frees += alloc_phases[i].frees;
+    }
+    totals.peak = alloc_peak_bytes;
+
+    alloc_release();
+    return totals;
+}
+
+/**
+ * @brief Bytes allocated and not freed yet
+ */
+size_t alloc_live() {
+    return alloc_live_bytes;
+}
+
+/**
+ * @brief Forget every count and live block
+ */
+void alloc_reset() {
+    alloc_acquire();
+
+    free(alloc_blocks);
+    alloc_blocks = NULL;
+    alloc_block_size = 0;
+    alloc_block_count = 0;
+
+    memset(alloc_sites, 0, sizeof(alloc_sites));
+    memset(alloc_phases, 0, sizeof(alloc_phases));
+    alloc_phases[0].name = "other";
+    alloc_phase_count = 1;
+    alloc_current = 0;
+
+    alloc_live_bytes = 0;
+    alloc_peak_bytes = 0;
+    alloc_input_length = 0;
+
+    alloc_release();
+}
+
+static int alloc_compare_sites(const void *a, const void *b) {
+    size_t x = (*(AllocSite **)a)->bytes;
+    size_t y = (*(AllocSite **)b)->bytes;
+    return (x < y) - (x > y);
+}
+
+// Print the sites with the most bytes
+static void alloc_report_sites(FILE *stream, AllocSite **sites, size_t count) {
+    qsort(sites, count, sizeof(AllocSite *), alloc_compare_sites);
+
+    for (size_t i = 0; i < count && i < ALLOC_TOP_SITES; i++) {
+        // Only the file name of the call site is shown, not the whole path
+        char *file = sites[i]->file;
+        for (char *c = file; *c != '\0'; c++)
+            if (*c == '/' || *c == '\\') file = c + 1;
+
+        char location[256];
+        snprintf(location, sizeof(location), "%s:%d", file, sites[i]->line);
+
+        fprintf(stream, "  %-32s %12zu allocations %14zu bytes\n",
+                location, sites[i]->allocations, sites[i]->bytes);
+    }
+}
+
+/**
+ * @brief Print allocations of each phase, their top call sites and leaks
+ *
+ * @param stream Stream to print into
+ */
+void alloc_report(FILE *stream) {
+    AllocCounts totals = alloc_totals();
+    AllocSite **sites = (AllocSite **)malloc(sizeof(AllocSite *) * ALLOC_SITES);
+
+    alloc_acquire();
+
+    fprintf(stream, "\nAllocation statistics\n\n");
+    fprintf(stream, "%-12s %12s %12s %14s %14s\n", "phase", "allocations", "frees", "bytes", "peak live");
+
+    for (int p = 0; p < alloc_phase_count; p++) {
+        AllocCounts *phase = &alloc_phases[p];
+        if (phase->allocations == 0 && phase->frees == 0) continue;
+
+        fprintf(stream, "%-12s %12zu %12zu %14zu %14zu\n",
+                phase->name, phase->allocations, phase->frees, phase->bytes, phase->peak);
+    }
+
+    fprintf(stream, "%-12s %12zu %12zu %14zu %14zu\n",
+            totals.name, totals.allocations, totals.frees, totals.bytes, totals.peak);
+
+    if (alloc_input_length > 0)
+        fprintf(stream, "\n%.2f allocations and %.1f bytes per source character\n",
+                (double)totals.allocations / (double)alloc_input_length,
+                (double)totals.bytes / (double)alloc_input_length);
+
+    for (int p = 0; p < alloc_phase_count; p++) {
+        size_t count = 0;
+
+        for (size_t i = 0; i < ALLOC_SITES; i++)
+            if (alloc_sites[i].file != NULL && alloc_sites[i].phase == p) sites[count++] = &alloc_sites[i];
+
+        if (count == 0) continue;
+
+        fprintf(stream, "\nTop call sites of %s\n", alloc_phases[p].name);
+        alloc_report_sites(stream, sites, count);
+    }
+
+    // Leaks are grouped by the call site that allocated them
+    static AllocSite leaks[ALLOC_SITES];
+    size_t leaked_blocks = 0;
+    memset(leaks, 0, sizeof(leaks));
+
+    for (size_t i = 0; i < alloc_block_size; i++) {
+        AllocBlock *block = &alloc_blocks[i];
+        if (block->ptr == NULL) continue;
+
+        leaked_blocks++;
+        if (block->site < 0) continue;
+
+        leaks[block->site].file = alloc_sites[block->site].file;
+        leaks[block->site].line = alloc_sites[block->site].line;
+        leaks[block->site].allocations++;
+        leaks[block->site].bytes += block->size;
+    }
+
+    fprintf(stream, "\nLeaked %zu bytes in %zu allocations\n", alloc_live_bytes, leaked_blocks);
+
+    size_t count = 0;
+    for (size_t i = 0; i < ALLOC_SITES; i++)
+        if (leaks[i].allocations > 0) sites[count++] = &leaks[i];
+
+    alloc_report_sites(stream, sites, count);
+
+    alloc_release();
+    free(sites);
+}
+
+static void alloc_report_stderr() {
+    alloc_report(stderr);
+}
+
+/**
+ * @brief Print the report into stderr when the program exits
+ */
+void alloc_report_at_exit() {
+    if (alloc_exit_registered) return;
+
+    alloc_exit_registered = true;
+    atexit(alloc_report_stderr);
+}
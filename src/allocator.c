@@ -0,0 +1,488 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+
+  allocator.c  -  Pluggable allocators
+  -------------------------------------------------
+  Every allocation of the library goes through the
+  calling thread's current allocator, which is the
+  system allocator (malloc) unless another one is set
+  with dust_allocator_use. Threads started by Dust
+  use the allocator of the thread that started them.
+
+  Two allocators are provided besides the system one:
+  an arena that bumps a pointer and releases every
+  block at once, and a pool that reuses freed blocks
+  of the same size class. A block must be freed while
+  the allocator that made it is current.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "dust/allocator.h"
+
+
+static void *system_malloc(void *context, size_t size) {
+    return malloc(size);
+}
+
+static void *system_realloc(void *context, void *ptr, size_t size) {
+    return realloc(ptr, size);
+}
+
+static void system_free(void *context, void *ptr) {
+    free(ptr);
+}
+
+DustAllocator DUST_SYSTEM_ALLOCATOR = {system_malloc, system_realloc, system_free, NULL};
+
+// Current allocator of the thread, NULL is the system allocator
+THREAD_LOCAL DustAllocator *DUST_ALLOCATOR = NULL;
+
+
+/**
+ * @brief Set the allocator of the calling thread
+ *
+ * @param allocator Allocator to use (NULL for the system allocator)
+ * @return Previous allocator, to restore it later
+ */
+DustAllocator *dust_allocator_use(DustAllocator *allocator) {
+    DustAllocator *previous = DUST_ALLOCATOR;
+
+    if (allocator == &DUST_SYSTEM_ALLOCATOR) allocator = NULL;
+    DUST_ALLOCATOR = allocator;
+
+    return previous == NULL ? &DUST_SYSTEM_ALLOCATOR : previous;
+}
+
+/**
+ * @brief Allocate a block with the current allocator
+ *
+ * @param size Size of the block
+ * @return Allocated block
+ */
+void *dust_malloc(size_t size) {
+    DustAllocator *allocator = DUST_ALLOCATOR;
+
+    if (allocator == NULL) return malloc(size);
+    return allocator->malloc(allocator->context, size);
+}
+
+/**
+ * @brief Allocate a zeroed block with the current allocator
+ *
+ * @param count Number of items
+ * @param size Size of an item
+ * @return Allocated block
+ */
+void *dust_calloc(size_t count, size_t size) {
+    DustAllocator *allocator = DUST_ALLOCATOR;
+
+    if (allocator == NULL) return calloc(count, size);
+
+    void *ptr = allocator->malloc(allocator->context, count * size);
+    if (ptr != NULL) memset(ptr, 0, count * size);
+    return ptr;
+}
+
+/**
+ * @brief Resize a block with the current allocator
+ *
+ * @param ptr Block to resize (NULL to allocate a new one)
+ * @param size New size of the block
+ * @return Resized block
+ */
+void *dust_realloc(void *ptr, size_t size) {
+    DustAllocator *allocator = DUST_ALLOCATOR;
+
+    if (allocator == NULL) return realloc(ptr, size);
+    return allocator->realloc(allocator->context, ptr, size);
+}
+
+/**
+ * @brief Release a block with the current allocator
+ *
+ * @param ptr Block to release
+ */
+void dust_free(void *ptr) {
+    DustAllocator *allocator = DUST_ALLOCATOR;
+
+    if (ptr == NULL) return;
+
+    if (allocator == NULL) free(ptr);
+    else allocator->free(allocator->context, ptr);
+}
+
+
+static size_t align_up(size_t size) {
+    return (size + ALLOCATOR_ALIGN - 1) & ~(size_t)(ALLOCATOR_ALIGN - 1);
+}
+
+static void allocator_lock(atomic_flag *lock) {
+    while (atomic_flag_test_and_set_explicit(lock, memory_order_acquire));
+}
+
+static void allocator_unlock(atomic_flag *lock) {
+    atomic_flag_clear_explicit(lock, memory_order_release);
+}
+
+
+/*
+  Arena blocks are laid out back to back in chunks, each after a
+  header that holds its size:
+
+    [ArenaChunk][size|block][size|block]...
+*/
+
+#define ARENA_HEADER align_up(sizeof(ArenaChunk))
+
+static char *arena_data(ArenaChunk *chunk) {
+    return (char *)chunk + ARENA_HEADER;
+}
+
+static size_t *arena_size(void *ptr) {
+    return (size_t *)((char *)ptr - ALLOCATOR_ALIGN);
+}
+
+// Whether the block is the last one in the current chunk
+static bool arena_is_last(Arena *arena, void *ptr) {
+    ArenaChunk *chunk = arena->chunks;
+    return (char *)ptr + align_up(*arena_size(ptr)) == arena_data(chunk) + chunk->used;
+}
+
+static void *arena_alloc(Arena *arena, size_t size) {
+    size_t need = ALLOCATOR_ALIGN + align_up(size);
+    ArenaChunk *chunk = arena->chunks;
+
+    if (chunk == NULL || chunk->used + need > chunk->size) {
+        size_t chunk_size = need > arena->chunk_size ? need : arena->chunk_size;
+
+        chunk = (ArenaChunk *)malloc(ARENA_HEADER + chunk_size);
+        if (chunk == NULL) return NULL;
+
+        chunk->next = arena->chunks;
+        chunk->size = chunk_size;
+        chunk->used = 0;
+
+        arena->chunks = chunk;
+        arena->allocated += chunk_size;
+    }
+
+    char *block = arena_data(chunk) + chunk->used + ALLOCATOR_ALIGN;
+    *arena_size(block) = size;
+    chunk->used += need;
+
+    return block;
+}
+
+static void *arena_malloc(void *context, size_t size) {
+    Arena *arena = (Arena *)context;
+
+    allocator_lock(&arena->lock);
+    void *ptr = arena_alloc(arena, size);
+    allocator_unlock(&arena->lock);
+
+    return ptr;
+}
+
+static void *arena_realloc(void *context, void *ptr, size_t size) {
+    Arena *arena = (Arena *)context;
+    void *result;
+
+    allocator_lock(&arena->lock);
+
+    if (ptr == NULL) {
+        result = arena_alloc(arena, size);
+    }
+
+    else {
+        size_t old = *arena_size(ptr);
+        ArenaChunk *chunk = arena->chunks;
+
+        // Shrinking, or growing the last block while its chunk has room, is done in place
+        if (align_up(size) <= align_up(old)) {
+            result = ptr;
+        }
+        else if (arena_is_last(arena, ptr) &&
+                 chunk->used - align_up(old) + align_up(size) <= chunk->size) {
+            chunk->used += align_up(size) - align_up(old);
+            result = ptr;
+        }
+        else {
+            result = arena_alloc(arena, size);
+            if (result != NULL) memcpy(result, ptr, old < size ? old : size);
+        }
+
+        if (result == ptr) *arena_size(ptr) = size;
+    }
+
+    allocator_unlock(&arena->lock);
+    return result;
+}
+
+static void arena_free(void *context, void *ptr) {
+    Arena *arena = (Arena *)context;
+
+    allocator_lock(&arena->lock);
+
+    // Only the last block can be given back, the rest waits for Arena_reset
+    if (arena_is_last(arena, ptr))
+        arena->chunks->used -= ALLOCATOR_ALIGN + align_up(*arena_size(ptr));
+
+    allocator_unlock(&arena->lock);
+}
+
+/**
+ * @brief Create a new arena
+ *
+ * @param chunk_size Size of a chunk (0 for ARENA_CHUNK_SIZE)
+ * @return Arena's pointer
+ */
+Arena *Arena_new(size_t chunk_size) {
+    Arena *arena = (Arena *)malloc(sizeof(Arena));
+
+    arena->chunks = NULL;
+    arena->chunk_size = chunk_size > 0 ? align_up(chunk_size) : ARENA_CHUNK_SIZE;
+    arena->allocated = 0;
+    atomic_flag_clear(&arena->lock);
+
+    arena->allocator.malloc = arena_malloc;
+    arena->allocator.realloc = arena_realloc;
+    arena->allocator.free = arena_free;
+    arena->allocator.context = arena;
+
+    return arena;
+}
+
+/**
+ * @brief Release the arena and every block allocated from it
+ *
+ * @param arena Arena to free
+ */
+void Arena_free(Arena *arena) {
+    while (arena->chunks != NULL) {
+        ArenaChunk *next = arena->chunks->next;
+        free(arena->chunks);
+        arena->chunks = next;
+    }
+
+    free(arena);
+}
+
+/**
+ * @brief Release every block allocated from the arena, one chunk is
+ *        kept for the next allocations
+ *
+ * @param arena Arena to reset
+ */
+void Arena_reset(Arena *arena) {
+    ArenaChunk *keep = NULL;
+
+    while (arena->chunks != NULL) {
+        ArenaChunk *next = arena->chunks->next;
+
+        if (keep == NULL && arena->chunks->size == arena->chunk_size) keep = arena->chunks;
+        else free(arena->chunks);
+
+        arena->chunks = next;
+    }
+
+    if (keep != NULL) {
+        keep->next = NULL;
+        keep->used = 0;
+    }
+
+    arena->chunks = keep;
+    arena->allocated = keep != NULL ? keep->size : 0;
+}
+
+
+/*
+  Every pool block is preceded by its size class. Blocks of a class are
+  cut from slabs and freed ones are kept in the class's free list.
+  Larger blocks come from malloc and are linked together so the pool
+  can release them too:
+
+    class block  [-|class][block]
+    large block  [next|prev][size|class][block]
+*/
+
+#define POOL_LARGE POOL_CLASSES
+
+static size_t *pool_class(void *ptr) {
+    return (size_t *)((char *)ptr - sizeof(size_t));
+}
+
+static char **pool_links(void *ptr) {
+    return (char **)((char *)ptr - 2 * ALLOCATOR_ALIGN);
+}
+
+static size_t pool_class_of(size_t size) {
+    size_t class = 0;
+    while (((size_t)16 << class) < size) class++;
+    return class;
+}
+
+static void *pool_alloc(Pool *pool, size_t size) {
+    if (size > POOL_MAX_SIZE) {
+        char *raw = (char *)malloc(2 * ALLOCATOR_ALIGN + size);
+        if (raw == NULL) return NULL;
+
+        char *block = raw + 2 * ALLOCATOR_ALIGN;
+        char **links = pool_links(block);
+
+        links[0] = pool->large;
+        links[1] = NULL;
+        if (pool->large != NULL) pool_links(pool->large)[1] = block;
+        pool->large = block;
+
+        *(size_t *)(block - ALLOCATOR_ALIGN) = size;
+        *pool_class(block) = POOL_LARGE;
+        return block;
+    }
+
+    size_t class = pool_class_of(size);
+
+    if (pool->free_lists[class] != NULL) {
+        void *block = pool->free_lists[class];
+        pool->free_lists[class] = *(void **)block;
+        return block;
+    }
+
+    size_t need = ALLOCATOR_ALIGN + ((size_t)16 << class);
+
+    // Slabs start with a link to the previous slab
+    if (pool->slabs == NULL || pool->slab_used + need > POOL_SLAB_SIZE) {
+        char *slab = (char *)malloc(POOL_SLAB_SIZE);
+        if (slab == NULL) return NULL;
+
+        *(char **)slab = pool->slabs;
+        pool->slabs = slab;
+        pool->slab_used = ALLOCATOR_ALIGN;
+    }
+
+    char *block = pool->slabs + pool->slab_used + ALLOCATOR_ALIGN;
+    *pool_class(block) = class;
+    pool->slab_used += need;
+
+    return block;
+}
+
+static void pool_release(Pool *pool, void *ptr) {
+    size_t class = *pool_class(ptr);
+
+    if (class == POOL_LARGE) {
+        char **links = pool_links(ptr);
+
+        if (links[0] != NULL) pool_links(links[0])[1] = links[1];
+        if (links[1] != NULL) pool_links(links[1])[0] = links[0];
+        else pool->large = links[0];
+
+        free(links);
+        return;
+    }
+
+    *(void **)ptr = pool->free_lists[class];
+    pool->free_lists[class] = ptr;
+}
+
+static void *pool_malloc(void *context, size_t size) {
+    Pool *pool = (Pool *)context;
+
+    allocator_lock(&pool->lock);
+    void *ptr = pool_alloc(pool, size);
+    allocator_unlock(&pool->lock);
+
+    return ptr;
+}
+
+static void *pool_realloc(void *context, void *ptr, size_t size) {
+    Pool *pool = (Pool *)context;
+    void *result;
+
+    allocator_lock(&pool->lock);
+
+    if (ptr == NULL) {
+        result = pool_alloc(pool, size);
+    }
+
+    else {
+        size_t class = *pool_class(ptr);
+        size_t old = class == POOL_LARGE ? *(size_t *)((char *)ptr - ALLOCATOR_ALIGN) : (size_t)16 << class;
+
+        // Block's class still fits the new size
+        if (class != POOL_LARGE && size <= old) {
+            result = ptr;
+        }
+        else {
+            result = pool_alloc(pool, size);
+
+            if (result != NULL) {
+                memcpy(result, ptr, old < size ? old : size);
+                pool_release(pool, ptr);
+            }
+        }
+    }
+
+    allocator_unlock(&pool->lock);
+    return result;
+}
+
+static void pool_free(void *context, void *ptr) {
+    Pool *pool = (Pool *)context;
+
+    allocator_lock(&pool->lock);
+    pool_release(pool, ptr);
+    allocator_unlock(&pool->lock);
+}
+
+/**
+ * @brief Create a new pool
+ *
+ * @return Pool's pointer
+ */
+Pool *Pool_new() {
+    Pool *pool = (Pool *)malloc(sizeof(Pool));
+
+    for (size_t i = 0; i < POOL_CLASSES; i++) pool->free_lists[i] = NULL;
+    pool->slabs = NULL;
+    pool->slab_used = 0;
+    pool->large = NULL;
+    atomic_flag_clear(&pool->lock);
+
+    pool->allocator.malloc = pool_malloc;
+    pool->allocator.realloc = pool_realloc;
+    pool->allocator.free = pool_free;
+    pool->allocator.context = pool;
+
+    return pool;
+}
+
+/**
+ * @brief Release the pool and every block allocated from it
+ *
+ * @param pool Pool to free
+ */
+void Pool_free(Pool *pool) {
+    while (pool->slabs != NULL) {
+        char *next = *(char **)pool->slabs;
+        free(pool->slabs);
+        pool->slabs = next;
+    }
+
+    while (pool->large != NULL) {
+        char *next = pool_links(pool->large)[0];
+        free(pool_links(pool->large));
+        pool->large = next;
+    }
+
+    free(pool);
+}
@@ -0,0 +1,610 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+
+  bench.c  -  Front-end benchmarks
+  -------------------------------------------------
+  Times each phase of the front-end (reading, UTF-8
+  decoding and encoding, tokenizing, parsing and
+  transpiling) over a set of source files. Every phase
+  is run on inputs prepared once up front, so a run
+  measures only that phase. Hardware performance
+  counters are read around each phase where the
+  platform allows it. Results can be saved as JSON and
+  compared against later runs to catch regressions.
+  Tokenizing and parsing can also be compared between
+  the system, arena and pool allocators.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "dust/platform.h"
+#include "dust/ustring.h"
+#include "dust/error.h"
+#include "dust/tokenizer.h"
+#include "dust/parser.h"
+#include "dust/transpiler.h"
+#include "dust/source.h"
+#include "dust/perf.h"
+#include "dust/bench.h"
+
+#if OS == OS_WINDOWS
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "dust/allocator.h"
+#include "dust/alloc.h"
+
+
+char *BENCH_PHASE_NAMES[BenchPhase_COUNT] = {
+    "read",
+    "decode",
+    "encode",
+    "tokenize",
+    "parse",
+    "transpile"
+};
+
+char *BENCH_ALLOCATOR_NAMES[BenchAllocator_COUNT] = {
+    "system",
+    "arena",
+    "pool"
+};
+
+/**
+ * @param bytes File content
+ * @param raw Decoded file content
+ * @param tokens Tokens of the file
+ * @param body Syntax tree of the file
+ */
+typedef struct {
+    char *bytes;
+    u32char *raw;
+    TokenArray *tokens;
+    Node *body;
+} BenchInput;
+
+/**
+ * @param perf Performance counters
+ * @param start Time the current phase started at
+ * @param times Time of each phase in this run
+ * @param counts Counts of each phase in this run
+ */
+typedef struct {
+    Perf perf;
+    double start;
+    double times[BenchPhase_COUNT];
+    uint64_t counts[BenchPhase_COUNT][PerfCounter_COUNT];
+} BenchRun;
+
+
+/**
+ * @brief Monotonic wall clock
+ *
+ * @return Seconds since an unspecified point
+ */
+double bench_clock() {
+    #if OS == OS_WINDOWS
+
+    LARGE_INTEGER frequency, now;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart / (double)frequency.QuadPart;
+
+    #else
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+
+    #endif
+}
+
+static int bench_compare(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Start measuring a phase, counters are started first so their
+// syscalls stay outside of the timed region
+static void bench_begin(BenchRun *run) {
+    Perf_start(&run->perf);
+    run->start = bench_clock();
+}
+
+static void bench_end(BenchRun *run, BenchPhase phase) {
+    double time = bench_clock() - run->start;
+    uint64_t values[PerfCounter_COUNT];
+
+    Perf_stop(&run->perf, values);
+
+    run->times[phase] += time;
+    for (size_t c = 0; c < PerfCounter_COUNT; c++) run->counts[phase][c] += values[c];
+}
+
+/**
+ * @brief Summarize samples
+ *
+ * @param samples Samples in seconds (reordered)
+ * @param count Number of samples
+ * @return Statistics of the samples
+ */
+BenchStats bench_stats(double *samples, size_t count) {
+    BenchStats stats = {0.0, 0.0, 0.0, false};
+    if (count == 0) return stats;
+
+    qsort(samples, count, sizeof(double), bench_compare);
+
+    stats.min = samples[0];
+
+    if (count % 2 == 1) stats.median = samples[count / 2];
+    else stats.median = (samples[count / 2 - 1] + samples[count / 2]) / 2.0;
+
+    // Nearest-rank percentile
+    size_t rank = (size_t)ceil(0.99 * (double)count);
+    stats.p99 = samples[rank > 0 ? rank - 1 : 0];
+
+    stats.measured = true;
+    return stats;
+}
+
+/**
+ * @brief Benchmark every phase of the front-end on source files
+ *
+ * @param paths Paths of the source files
+ * @param count Number of source files
+ * @param runs Number of measured runs
+ * @param warmup Number of unmeasured runs before measuring
+ * @return Benchmark result
+ */
+BenchResult bench_files(char **paths, int count, size_t runs, size_t warmup) {
+    BenchResult result;
+    memset(&result, 0, sizeof(BenchResult));
+    result.runs = runs;
+    result.warmup = warmup;
+    result.files = count;
+
+    BenchInput *inputs = (BenchInput *)dust_malloc(sizeof(BenchInput) * count);
+    double *samples = (double *)dust_malloc(sizeof(double) * runs * BenchPhase_COUNT);
+
+    // Input of each phase is the output of the previous one, made only once
+    for (int i = 0; i < count; i++) {
+        FILE *f = fopen(paths[i], "r");
+        if (f == NULL) raise_internal(u32join(U"reading file failed: ", utf8_to_utf32(paths[i])));
+        fclose(f);
+
+        inputs[i].bytes = u8readfile(paths[i]);
+        inputs[i].raw = utf8_to_utf32(inputs[i].bytes);
+        inputs[i].tokens = tokenize(inputs[i].raw);
+        inputs[i].body = parse_body(inputs[i].tokens);
+
+        result.bytes += strlen(inputs[i].bytes);
+        result.tokens += inputs[i].tokens->used;
+    }
+
+    BenchRun run;
+    uint64_t totals[BenchPhase_COUNT][PerfCounter_COUNT] = {{0}};
+
+    Perf_open(&run.perf);
+    result.counter_error = run.perf.error;
+    for (size_t c = 0; c < PerfCounter_COUNT; c++) result.counted[c] = Perf_has(&run.perf, c);
+
+    for (size_t r = 0; r < warmup + runs; r++) {
+        memset(run.times, 0, sizeof(run.times));
+        memset(run.counts, 0, sizeof(run.counts));
+
+        for (int i = 0; i < count; i++) {
+            bench_begin(&run);
+            char *bytes = u8readfile(paths[i]);
+            bench_end(&run, BenchPhase_READ);
+            dust_free(bytes);
+
+            bench_begin(&run);
+            u32char *raw = utf8_to_utf32(inputs[i].bytes);
+            bench_end(&run, BenchPhase_DECODE);
+            dust_free(raw);
+
+            bench_begin(&run);
+            char *encoded = utf32_to_utf8(inputs[i].raw);
+            bench_end(&run, BenchPhase_ENCODE);
+            dust_free(encoded);
+
+            bench_begin(&run);
+            TokenArray *tokens = tokenize(inputs[i].raw);
+            bench_end(&run, BenchPhase_TOKENIZE);
+            TokenArray_free(tokens);
+
+            bench_begin(&run);
+            Node *body = parse_body(inputs[i].tokens);
+            bench_end(&run, BenchPhase_PARSE);
+            Node_free(body);
+
+            bench_begin(&run);
+            u32char *c = transpile_source(Node_body(inputs[i].body));
+            bench_end(&run, BenchPhase_TRANSPILE);
+            dust_free(c);
+        }
+
+        if (r >= warmup) {
+            for (size_t p = 0; p < BenchPhase_COUNT; p++) {
+                samples[p * runs + (r - warmup)] = run.times[p];
+                for (size_t c = 0; c < PerfCounter_COUNT; c++) totals[p][c] += run.counts[p][c];
+            }
+        }
+    }
+
+    Perf_close(&run.perf);
+
+    for (size_t p = 0; p < BenchPhase_COUNT; p++) {
+        result.phases[p] = bench_stats(samples + p * runs, runs);
+        for (size_t c = 0; c < PerfCounter_COUNT; c++)
+            result.counters[p][c] = (double)totals[p][c] / (double)runs;
+    }
+
+    for (int i = 0; i < count; i++) {
+        Node_free(inputs[i].body);
+        TokenArray_free(inputs[i].tokens);
+        dust_free(inputs[i].raw);
+        dust_free(inputs[i].bytes);
+    }
+
+    // Sources made by tokenize don't own the freed source codes
+    if (CURRENT_SOURCE != NULL) Source_free(CURRENT_SOURCE);
+
+    dust_free(inputs);
+    dust_free(samples);
+
+    return result;
+}
+
+// Print a count with a K/M/G suffix into a column of the given width
+static void bench_print_count(double count, int width) {
+    char *suffix = "";
+
+    if (count >= 1e9) { count /= 1e9; suffix = "G"; }
+    else if (count >= 1e6) { count /= 1e6; suffix = "M"; }
+    else if (count >= 1e3) { count /= 1e3; suffix = "K"; }
+
+    char text[32];
+    if (suffix[0] == '\0') sprintf(text, "%.0f", count);
+    else sprintf(text, "%.2f%s", count, suffix);
+
+    printf(" %*s", width, text);
+}
+
+/**
+ * @brief Print the performance counters of a benchmark result
+ *
+ * @param result Result to print
+ */
+static void bench_print_counters(BenchResult *result) {
+    bool any = false;
+    for (size_t c = 0; c < PerfCounter_COUNT; c++) any = any || result->counted[c];
+
+    if (!any) {
+        printf("\nPerformance counters not available: %s\n",
+               result->counter_error != NULL ? result->counter_error : "unknown reason");
+        return;
+    }
+
+    printf("\n%-10s", "phase");
+    for (size_t c = 0; c < PerfCounter_COUNT; c++) {
+        printf(" %13s", PERF_COUNTER_NAMES[c]);
+        if (c == PerfCounter_INSTRUCTIONS) printf(" %6s", "IPC");
+    }
+    printf("\n");
+
+    for (size_t p = 0; p < BenchPhase_COUNT; p++) {
+        double *counts = result->counters[p];
+        printf("%-10s", BENCH_PHASE_NAMES[p]);
+
+        for (size_t c = 0; c < PerfCounter_COUNT; c++) {
+            if (result->counted[c]) bench_print_count(counts[c], 13);
+            else printf(" %13s", "-");
+
+            if (c == PerfCounter_INSTRUCTIONS) {
+                if (result->counted[PerfCounter_CYCLES] && result->counted[PerfCounter_INSTRUCTIONS] &&
+                    counts[PerfCounter_CYCLES] > 0.0)
+                    printf(" %6.2f", counts[PerfCounter_INSTRUCTIONS] / counts[PerfCounter_CYCLES]);
+                else printf(" %6s", "-");
+            }
+        }
+
+        printf("\n");
+    }
+
+    printf("(mean counts of one run)\n");
+
+    if (result->counter_error != NULL)
+        printf("Some performance counters not available: %s\n", result->counter_error);
+}
+
+/**
+ * @brief Time tokenizing and parsing files with each allocator, and
+ *        releasing what they made
+ *
+ * The arena releases everything at once with Arena_reset, the others
+ * free every token array and syntax tree.
+ *
+ * @param paths Paths of the source files
+ * @param count Number of source files
+ * @param runs Number of measured runs
+ * @param warmup Number of unmeasured runs before measuring
+ * @return Timings of each allocator
+ */
+BenchAllocators bench_allocators(char **paths, int count, size_t runs, size_t warmup) {
+    BenchAllocators result;
+    u32char **raws = (u32char **)dust_malloc(sizeof(u32char *) * count);
+    TokenArray **tokens = (TokenArray **)dust_malloc(sizeof(TokenArray *) * count);
+    Node **bodies = (Node **)dust_malloc(sizeof(Node *) * count);
+    double *samples = (double *)dust_malloc(sizeof(double) * runs * 3);
+
+    for (int i = 0; i < count; i++) raws[i] = u32readfile(paths[i]);
+
+    // Sources are released by whichever allocator made them
+    if (CURRENT_SOURCE != NULL) Source_free(CURRENT_SOURCE);
+
+    Arena *arena = Arena_new(0);
+    Pool *pool = Pool_new();
+    DustAllocator *allocators[BenchAllocator_COUNT] = {
+        &DUST_SYSTEM_ALLOCATOR,
+        &arena->allocator,
+        &pool->allocator
+    };
+
+    for (size_t a = 0; a < BenchAllocator_COUNT; a++) {
+        for (size_t r = 0; r < warmup + runs; r++) {
+            DustAllocator *previous = dust_allocator_use(allocators[a]);
+
+            double start = bench_clock();
+
+            for (int i = 0; i < count; i++) {
+                tokens[i] = tokenize(raws[i]);
+                bodies[i] = parse_body(tokens[i]);
+            }
+
+            double built = bench_clock();
+
+            if (a == BenchAllocator_ARENA) {
+                Source_free(CURRENT_SOURCE);
+                Arena_reset(arena);
+            }
+            else {
+                for (int i = 0; i < count; i++) {
+                    Node_free(bodies[i]);
+                    TokenArray_free(tokens[i]);
+                }
+                Source_free(CURRENT_SOURCE);
+            }
+
+            double end = bench_clock();
+
+            dust_allocator_use(previous);
+
+            if (r >= warmup) {
+                samples[r - warmup] = built - start;
+                samples[runs + r - warmup] = end - built;
+                samples[2 * runs + r - warmup] = end - start;
+            }
+        }
+
+        result.build[a] = bench_stats(samples, runs);
+        result.teardown[a] = bench_stats(samples + runs, runs);
+        result.total[a] = bench_stats(samples + 2 * runs, runs);
+    }
+
+    Arena_free(arena);
+    Pool_free(pool);
+
+    for (int i = 0; i < count; i++) dust_free(raws[i]);
+    dust_free(raws);
+    dust_free(tokens);
+    dust_free(bodies);
+    dust_free(samples);
+
+    return result;
+}
+
+/**
+ * @brief Print timings of each allocator
+ *
+ * @param result Timings to print
+ */
+void bench_print_allocators(BenchAllocators *result) {
+    printf("\n%-10s %14s %14s %14s %9s\n", "allocator", "build ms", "teardown ms", "total ms", "speedup");
+
+    for (size_t a = 0; a < BenchAllocator_COUNT; a++) {
+        double system = result->total[BenchAllocator_SYSTEM].median;
+        double total = result->total[a].median > 0.0 ? result->total[a].median : 1e-12;
+
+        printf("%-10s %14.3f %14.3f %14.3f %8.2fx\n",
+               BENCH_ALLOCATOR_NAMES[a],
+               result->build[a].median * 1e3,
+               result->teardown[a].median * 1e3,
+               result->total[a].median * 1e3,
+               system / total);
+    }
+
+    printf("(medians)\n");
+}
+
+/**
+ * @brief Print a benchmark result
+ *
+ * @param result Result to print
+ * @param baseline Result to compare medians against (NULL to not compare)
+ * @return Number of phases slower than the baseline by more than BENCH_THRESHOLD
+ */
+int bench_print(BenchResult *result, BenchResult *baseline) {
+    int regressions = 0;
+
+    printf("%zu file(s), %zu bytes, %zu tokens, %zu runs after %zu warmup runs\n\n",
+           result->files, result->bytes, result->tokens, result->runs, result->warmup);
+
+    printf("%-10s %11s %11s %11s %10s %11s", "phase", "min ms", "median ms", "p99 ms", "MB/s", "Mtokens/s");
+    if (baseline != NULL) printf("   baseline");
+    printf("\n");
+
+    for (size_t p = 0; p < BenchPhase_COUNT; p++) {
+        BenchStats *stats = &result->phases[p];
+        double median = stats->median > 0.0 ? stats->median : 1e-12;
+
+        printf("%-10s %11.3f %11.3f %11.3f %10.1f %11.2f",
+               BENCH_PHASE_NAMES[p],
+               stats->min * 1e3,
+               stats->median * 1e3,
+               stats->p99 * 1e3,
+               (double)result->bytes / 1e6 / median,
+               (double)result->tokens / 1e6 / median);
+
+        if (baseline != NULL) {
+            BenchStats *base = &baseline->phases[p];
+
+            if (!base->measured || base->median <= 0.0) {
+                printf("   -");
+            }
+            else {
+                double change = stats->median / base->median - 1.0;
+
+                if (change > BENCH_THRESHOLD) {
+                    printf("   %+.1f%% slower", change * 100.0);
+                    regressions++;
+                }
+                else if (change < -BENCH_THRESHOLD) printf("   %+.1f%% faster", change * 100.0);
+                else printf("   %+.1f%%", change * 100.0);
+            }
+        }
+
+        printf("\n");
+    }
+
+    if (baseline != NULL && baseline->bytes != result->bytes)
+        printf("\nWARNING: baseline was measured on %zu bytes of source, not %zu\n",
+               baseline->bytes, result->bytes);
+
+    bench_print_counters(result);
+
+    return regressions;
+}
+
+/**
+ * @brief Save a benchmark result as JSON
+ *
+ * @param result Result to save
+ * @param path Path of the JSON file
+ * @return false if the file couldn't be written
+ */
+bool bench_save(BenchResult *result, char *path) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) return false;
+
+    fprintf(f, "{\n"
+               "  \"runs\": %zu,\n"
+               "  \"warmup\": %zu,\n"
+               "  \"files\": %zu,\n"
+               "  \"bytes\": %zu,\n"
+               "  \"tokens\": %zu,\n"
+               "  \"phases\": {\n",
+               result->runs, result->warmup, result->files, result->bytes, result->tokens);
+
+    for (size_t p = 0; p < BenchPhase_COUNT; p++) {
+        BenchStats *stats = &result->phases[p];
+
+        fprintf(f, "    \"%s\": {\"min\": %.9f, \"median\": %.9f, \"p99\": %.9f",
+                BENCH_PHASE_NAMES[p], stats->min, stats->median, stats->p99);
+
+        // Only the counters that were available are saved
+        for (size_t c = 0; c < PerfCounter_COUNT; c++) {
+            if (result->counted[c])
+                fprintf(f, ", \"%s\": %.1f", PERF_COUNTER_NAMES[c], result->counters[p][c]);
+        }
+
+        fprintf(f, "}%s\n", p + 1 < BenchPhase_COUNT ? "," : "");
+    }
+
+    fprintf(f, "  }\n}\n");
+    fclose(f);
+    return true;
+}
+
+static size_t bench_field(char *json, char *key) {
+    char *found = strstr(json, key);
+    if (found == NULL) return 0;
+    return (size_t)strtoull(found + strlen(key), NULL, 10);
+}
+
+static double bench_field_double(char *json, char *key) {
+    char *found = strstr(json, key);
+    if (found == NULL) return 0.0;
+    return strtod(found + strlen(key), NULL);
+}
+
+/**
+ * @brief Load a benchmark result saved with bench_save
+ *
+ * @param result Loaded result
+ * @param path Path of the JSON file
+ * @return false if the file couldn't be read or isn't a benchmark result
+ */
+bool bench_load(BenchResult *result, char *path) {
+    memset(result, 0, sizeof(BenchResult));
+
+    FILE *f = fopen(path, "r");
+    if (f == NULL) return false;
+    fclose(f);
+
+    char *json = u8readfile(path);
+    char *phases = strstr(json, "\"phases\"");
+
+    if (phases == NULL) {
+        dust_free(json);
+        return false;
+    }
+
+    result->runs = bench_field(json, "\"runs\":");
+    result->warmup = bench_field(json, "\"warmup\":");
+    result->files = bench_field(json, "\"files\":");
+    result->bytes = bench_field(json, "\"bytes\":");
+    result->tokens = bench_field(json, "\"tokens\":");
+
+    for (size_t p = 0; p < BenchPhase_COUNT; p++) {
+        char key[32];
+        sprintf(key, "\"%s\":", BENCH_PHASE_NAMES[p]);
+
+        char *phase = strstr(phases, key);
+        if (phase == NULL) continue;
+
+        // Only look inside this phase's object
+        char *end = strchr(phase, '}');
+        if (end != NULL) *end = '\0';
+
+        result->phases[p].min = bench_field_double(phase, "\"min\":");
+        result->phases[p].median = bench_field_double(phase, "\"median\":");
+        result->phases[p].p99 = bench_field_double(phase, "\"p99\":");
+        result->phases[p].measured = true;
+
+        for (size_t c = 0; c < PerfCounter_COUNT; c++) {
+            sprintf(key, "\"%s\":", PERF_COUNTER_NAMES[c]);
+            if (strstr(phase, key) == NULL) continue;
+
+            result->counted[c] = true;
+            result->counters[p][c] = bench_field_double(phase, key);
+        }
+
+        if (end != NULL) *end = '}';
+    }
+
+    dust_free(json);
+    return true;
+}
@@ -0,0 +1,551 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+
+  check.c  -  Syntax checking
+  -------------------------------------------------
+  A recognizer for the same grammar parser.c accepts.
+  It walks the token array in place with indices and
+  never builds nodes, node arrays or token slices, so
+  checking a file costs little more than tokenizing it.
+  The first error is returned instead of raised, so
+  many files can be checked in one run.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "dust/ustring.h"
+#include "dust/tokenizer.h"
+#include "dust/thread.h"
+#include "dust/check.h"
+#include "dust/alloc.h"
+
+
+static THREAD_LOCAL TokenArray *_check_tokens;
+static THREAD_LOCAL size_t _check_end;      // end of the body being checked
+static THREAD_LOCAL size_t _check_index;    // current token of expressions
+static THREAD_LOCAL CheckError *_check_error;
+static THREAD_LOCAL Token _check_eof;       // stands for tokens past the end
+
+bool check_expr();
+bool check_factor();
+
+
+/**
+ * @brief Token at an index, tokens past the current body read as EOF
+ */
+Token *check_at(size_t i) {
+    if (i < _check_end) return &(_check_tokens->array[i]);
+
+    _check_eof.type = TokenType_EOF;
+    _check_eof.data = U"";
+    _check_eof.offset = (_check_end > 0) ? _check_tokens->array[_check_end - 1].offset : 0;
+    return &_check_eof;
+}
+
+/**
+ * @brief Record an error and return false
+ */
+bool check_fail(u32char *message, Token *token) {
+    _check_error->message = message;
+    _check_error->offset = token->offset;
+    return false;
+}
+
+bool check_isop(Token *token, u32char *op) {
+    return token->type == TokenType_OPERATOR && u32isequal(token->data, op);
+}
+
+bool check_isend(Token *token) {
+    return token->type == TokenType_NEXTSTM || token->type == TokenType_EOF;
+}
+
+/**
+ * @brief Check that a statement ends where its expression stopped
+ *
+ * @param stop Index of the token the expression stopped at
+ * @param next Index of the next statement
+ */
+bool check_stmt_end(size_t stop, size_t *next) {
+    Token *token = check_at(stop);
+
+    if (check_isend(token)) {
+        *next = stop + 1;
+        return true;
+    }
+
+    // Last statement of a body can leave out its ;
+    if (token->type == TokenType_RCURLY && stop + 1 == _check_end) {
+        *next = stop;
+        return true;
+    }
+
+    return check_fail(U"Expected ;", token);
+}
+
+
+/* Expressions, same precedence levels as parse_expr_* */
+
+bool check_child() {
+    if (check_at(_check_index)->type == TokenType_PERIOD) {
+        _check_index++;
+        return check_factor();
+    }
+    return true;
+}
+
+bool check_call();
+
+bool check_subscript() {
+    if (check_at(_check_index)->type != TokenType_LSQRB) return true;
+    _check_index++;
+
+    if (check_at(_check_index)->type == TokenType_RSQRB)
+        return check_fail(U"Subscripting with nothing", check_at(_check_index));
+
+    if (!check_expr()) return false;
+
+    if (check_at(_check_index)->type != TokenType_RSQRB)
+        return check_fail(U"Expected ]", check_at(_check_index));
+    _check_index++;
+
+    return check_child() && check_call() && check_subscript();
+}
+
+bool check_call() {
+    if (check_at(_check_index)->type != TokenType_LPAREN) return true;
+    _check_index++;
+
+    /* Instant close () */
+    if (check_at(_check_index)->type == TokenType_RPAREN) {
+        Token *next = check_at(_check_index + 1);
+
+        if (!(next->type == TokenType_LPAREN || next->type == TokenType_LSQRB ||
+              next->type == TokenType_OPERATOR || next->type == TokenType_PERIOD ||
+              check_isend(next)))
+            return check_fail(u32join(U"Unexpected symbol '", u32join(next->data, U"' after function call")), next);
+
+        _check_index++;
+        return check_child() && check_subscript() && check_call();
+    }
+
+    /* Arguments (arg1, arg2, ...) */
+    if (!check_expr()) return false;
+
+    while (check_at(_check_index)->type == TokenType_COMMA) {
+        _check_index++;
+        if (!check_expr()) return false;
+    }
+
+    if (check_at(_check_index)->type != TokenType_RPAREN)
+        return check_fail(U"Expected ;", check_at(_check_index));
+    _check_index++;
+
+    return check_child() && check_subscript() && check_call();
+}
+
+bool check_factor() {
+    Token *token = check_at(_check_index);
+
+    /* Unary operator */
+    if (check_isop(token, U"+") || check_isop(token, U"-") || check_isop(token, U"not")) {
+        _check_index++;
+        return check_factor();
+    }
+
+    /* String literal */
+    else if (token->type == TokenType_STRING) {
+        _check_index++;
+        return check_subscript() && check_child() && check_subscript();
+    }
+
+    /* Integer/Float literal */
+    else if (token->type == TokenType_NUMERIC) {
+        _check_index++;
+
+        if (check_at(_check_index)->type == TokenType_PERIOD) {
+            _check_index++;
+
+            if (check_at(_check_index)->type != TokenType_NUMERIC)
+                return check_fail(U"Can't subscript integer literal", check_at(_check_index));
+
+            _check_index++;
+        }
+        return true;
+    }
+
+    /* Identifier  |  Function/Class call */
+    else if (token->type == TokenType_IDENTIFIER) {
+        _check_index++;
+
+        if (check_at(_check_index)->type == TokenType_LPAREN) return check_call();
+        return check_child() && check_subscript();
+    }
+
+    /* ( Expression ) */
+    else if (token->type == TokenType_LPAREN) {
+        _check_index++;
+
+        if (check_at(_check_index)->type == TokenType_RPAREN)
+            return check_fail(U"Expression expected between parantheses", token);
+
+        if (!check_expr()) return false;
+
+        if (check_at(_check_index)->type != TokenType_RPAREN)
+            return check_fail(U"Expected )", check_at(_check_index));
+        _check_index++;
+
+        return check_subscript();
+    }
+
+    /* Array Initialization [ Expression, ... ] */
+    else if (token->type == TokenType_LSQRB) {
+        _check_index++;
+
+        if (!check_expr()) return false;
+
+        while (check_at(_check_index)->type == TokenType_COMMA) {
+            _check_index++;
+            if (!check_expr()) return false;
+        }
+
+        if (check_at(_check_index)->type != TokenType_RSQRB)
+            return check_fail(U"Expected ;", check_at(_check_index));
+        _check_index++;
+
+        return check_child() && check_subscript();
+    }
+
+    return check_fail(U"Expression expected", token);
+}
+
+bool check_pow() {
+    if (!check_factor()) return false;
+
+    while (check_isop(check_at(_check_index), U"^") ||
+           check_isop(check_at(_check_index), U"%")) {
+        _check_index++;
+        if (!check_factor()) return false;
+    }
+
+    return true;
+}
+
+bool check_term() {
+    if (!check_pow()) return false;
+
+    while (1) {
+        Token *token = check_at(_check_index);
+
+        if (!(check_isop(token, U"*")  || check_isop(token, U"/")  ||
+              check_isop(token, U"==") || check_isop(token, U"!=") ||
+              check_isop(token, U"<")  || check_isop(token, U"<=") ||
+              check_isop(token, U">")  || check_isop(token, U">="))) break;
+
+        _check_index++;
+        if (!check_pow()) return false;
+    }
+
+    return true;
+}
+
+bool check_expr() {
+    if (!check_term()) return false;
+
+    while (1) {
+        Token *token = check_at(_check_index);
+
+        if (!(check_isop(token, U"+")   || check_isop(token, U"-")  ||
+              check_isop(token, U"..")  || check_isop(token, U"and") ||
+              check_isop(token, U"or")  || check_isop(token, U"xor") ||
+              check_isop(token, U"in"))) break;
+
+        _check_index++;
+        if (!check_term()) return false;
+    }
+
+    TokenType type = check_at(_check_index)->type;
+
+    if (!(type == TokenType_NEXTSTM || type == TokenType_EOF    ||
+          type == TokenType_RPAREN  || type == TokenType_LCURLY ||
+          type == TokenType_RCURLY  || type == TokenType_COMMA  ||
+          type == TokenType_RSQRB))
+        return check_fail(U"Expected ;", check_at(_check_index));
+
+    return true;
+}
+
+/**
+ * @brief Check the expression starting at i
+ *
+ * @param i Index of the expression's first token
+ * @param end Index of the token the expression stopped at
+ */
+bool check_expr_at(size_t i, size_t *end) {
+    _check_index = i;
+    if (!check_expr()) return false;
+    *end = _check_index;
+    return true;
+}
+
+
+/* Statements, same forms as parse_body */
+
+bool check_body(size_t start, size_t end);
+
+/**
+ * @brief Check a body starting with the curly brace at i
+ *
+ * @param i Index of the opening curly brace
+ * @param next Index after the closing curly brace
+ */
+bool check_block(size_t i, size_t *next) {
+    Token *token = check_at(i);
+
+    if (token->type != TokenType_LCURLY) return check_fail(U"Expected {", token);
+    if (token->match <= 0 || i + token->match >= _check_end) return check_fail(U"Expected }", token);
+
+    if (!check_body(i + 1, i + token->match + 1)) return false;
+
+    *next = i + token->match + 1;
+    return true;
+}
+
+/**
+ * @brief Check an enumeration body
+ *
+ * @param start Index after the opening curly brace
+ * @param end Index of the closing curly brace
+ */
+bool check_enum(size_t start, size_t end) {
+    size_t i = start;
+
+    while (i < end) {
+        Token *token = check_at(i);
+
+        if (token->type == TokenType_NEXTSTM)
+            return check_fail(U"Unexpected symbol ; in enumeration", token);
+
+        else if (token->type == TokenType_COMMA) {
+            if (i > start && check_at(i-1)->type == TokenType_COMMA)
+                return check_fail(U"Statement expected before ,", token);
+            i++;
+        }
+
+        else if (token->type == TokenType_IDENTIFIER) {
+            /* ASSIGNMENT   identifier = expression, */
+            if (check_isop(check_at(i+1), U"=")) {
+                if (!check_expr_at(i+2, &i)) return false;
+            }
+            else i++;
+        }
+
+        else return check_fail(U"Unexpected field in enumeration", token);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Check a generic type list
+ *
+ * @param i Index after the <
+ * @param next Index after the >
+ */
+bool check_generic(size_t i, size_t *next) {
+    while (1) {
+        Token *token = check_at(i);
+
+        if (check_isop(token, U">")) break;
+        else if (token->type == TokenType_COMMA) i++;
+        else if (token->type != TokenType_IDENTIFIER)
+            return check_fail(U"Expected type or >", token);
+        else {
+            _check_index = i;
+            if (!check_factor()) return false;
+            i = _check_index;
+        }
+    }
+
+    *next = i + 1;
+    return true;
+}
+
+/**
+ * @brief Check the statements of a body
+ *
+ * @param start Index of the body's first token
+ * @param end Index after the body's last token (its closing curly brace
+ *            for nested bodies)
+ */
+bool check_body(size_t start, size_t end) {
+    size_t outer = _check_end;
+    size_t i = start;
+    _check_end = end;
+
+    while (i < end) {
+        Token *token = check_at(i);
+
+        if (token->type == TokenType_LCURLY) {
+            if (!check_block(i, &i)) return false;
+            continue;
+        }
+
+        /* End of body */
+        else if (token->type == TokenType_RCURLY) {
+            if (token->match == 0) return check_fail(U"Unexpected }", token);
+            break;
+        }
+
+        else if (token->type == TokenType_EOF) break;
+
+        else if (token->type == TokenType_NEXTSTM) {
+            if (i == start || check_at(i-1)->type == TokenType_NEXTSTM)
+                return check_fail(U"Statement expected before ;", token);
+            i++;
+            continue;
+        }
+
+        else if (token->type == TokenType_IDENTIFIER) {
+            Token *t1 = check_at(i+1);
+            Token *t2 = check_at(i+2);
+
+            if (u32isequal(token->data, U"import")) {
+                /* IMPORT   import module; */
+                if (t1->type == TokenType_IDENTIFIER && check_isend(t2)) {
+                    i += 2;
+                }
+
+                /* IMPORT   import member from module; */
+                else if (t1->type == TokenType_IDENTIFIER && t2->type == TokenType_IDENTIFIER &&
+                         u32isequal(t2->data, U"from") &&
+                         check_at(i+3)->type == TokenType_IDENTIFIER && check_isend(check_at(i+4))) {
+                    i += 4;
+                }
+
+                else return check_fail(U"Invalid import scheme", token);
+                continue;
+            }
+
+            /* DECLERATION (NO INIT.)   type identifier; */
+            else if (t1->type == TokenType_IDENTIFIER && check_isend(t2)) {
+                i += 3;
+                continue;
+            }
+
+            /* DECLERATION   type identifier = expression; */
+            else if (t1->type == TokenType_IDENTIFIER && check_isop(t2, U"=")) {
+                if (!check_expr_at(i+3, &i)) return false;
+                if (!check_stmt_end(i, &i)) return false;
+                continue;
+            }
+
+            /* GENERIC DECLERATION   type<type, ...> identifier[ = expression]; */
+            else if (check_isop(t1, U"<")) {
+                if (!check_generic(i+2, &i)) return false;
+
+                if (check_at(i)->type != TokenType_IDENTIFIER)
+                    return check_fail(U"Identifier expected", check_at(i));
+
+                if (check_isend(check_at(i+1))) {
+                    i += 2;
+                }
+                else if (check_isop(check_at(i+1), U"=")) {
+                    if (!check_expr_at(i+2, &i)) return false;
+                    if (!check_stmt_end(i, &i)) return false;
+                }
+                else return check_fail(U"Expected either = or ; after identifier", check_at(i+1));
+
+                continue;
+            }
+
+            /* ASSIGNMENT   identifier = expression; */
+            else if (t1->type == TokenType_OPERATOR) {
+                size_t stop;
+                if (!check_expr_at(i+2, &stop)) return false;
+
+                if (!(u32isequal(t1->data, U"=")  || u32isequal(t1->data, U"+=") ||
+                      u32isequal(t1->data, U"-=") || u32isequal(t1->data, U"*=") ||
+                      u32isequal(t1->data, U"/=") || u32isequal(t1->data, U"^=") ||
+                      u32isequal(t1->data, U"%=")))
+                    return check_fail(U"Invalid assignment operator", t1);
+
+                if (!check_stmt_end(stop, &i)) return false;
+                continue;
+            }
+
+            /* ENUM   enum {identifier|assignment, ...} */
+            else if (u32isequal(token->data, U"enum")) {
+                if (t1->type != TokenType_IDENTIFIER)
+                    return check_fail(U"Identifier expected after enum", t1);
+
+                if (t2->type != TokenType_LCURLY || t2->match <= 0 || i + 2 + t2->match >= end)
+                    return check_fail(U"Expected }", t2);
+
+                size_t close = i + 2 + t2->match;
+                if (!check_enum(i + 3, close)) return false;
+
+                if (!check_stmt_end(close + 1, &i)) return false;
+                continue;
+            }
+
+            /* IF, ELIF, REPEAT, WHILE   keyword expression body */
+            else if (u32isequal(token->data, U"if")     || u32isequal(token->data, U"elif") ||
+                     u32isequal(token->data, U"repeat") || u32isequal(token->data, U"while")) {
+                if (!check_expr_at(i+1, &i)) return false;
+                if (!check_block(i, &i)) return false;
+                continue;
+            }
+
+            /* ELSE   else body */
+            else if (u32isequal(token->data, U"else")) {
+                if (!check_block(i+1, &i)) return false;
+                continue;
+            }
+
+            /* FOR   for identifier in iterable body */
+            else if (u32isequal(token->data, U"for")) {
+                if (t1->type != TokenType_IDENTIFIER)
+                    return check_fail(U"Non-identifier after for", token);
+                if (!check_isop(t2, U"in"))
+                    return check_fail(U"Missing in keyword", token);
+
+                if (!check_expr_at(i+3, &i)) return false;
+                if (!check_block(i, &i)) return false;
+                continue;
+            }
+        }
+
+        /* Expression statement */
+        if (!check_expr_at(i, &i)) return false;
+        if (!check_stmt_end(i, &i)) return false;
+    }
+
+    _check_end = outer;
+    return true;
+}
+
+/**
+ * @brief Check the syntax of a token array without building any nodes
+ *
+ * @param tokens Token array to check
+ * @param error First error found
+ * @return false if there is a syntax error
+ */
+bool check(TokenArray *tokens, CheckError *error) {
+    _check_tokens = tokens;
+    _check_end = tokens->used;
+    _check_error = error;
+
+    error->message = NULL;
+    error->offset = 0;
+
+    return check_body(0, tokens->used);
+}
@@ -20,13 +20,35 @@
 #include "dust/tokenizer.h"
 #include "dust/parser.h"
 #include "dust/transpiler.h"
+#include "dust/pipeline.h"
+#include "dust/check.h"
+#include "dust/resolver.h"
+#include "dust/typecheck.h"
+#include "dust/ir.h"
+#include "dust/bench.h"
+#include "dust/source.h"
+#include "dust/io.h"
+#include "dust/trace.h"
+#include "dust/serve.h"
+#include "dust/watch.h"
+#include "dust/module.h"
+#include "dust/scheduler.h"
+#include "dust/allocator.h"
+#include "dust/alloc.h"
 
 
 enum command {
     cmd_unknown,
     cmd_tokenize,
     cmd_parse,
-    cmd_transpile
+    cmd_transpile,
+    cmd_check,
+    cmd_resolve,
+    cmd_typecheck,
+    cmd_ir,
+    cmd_load,
+    cmd_bench,
+    cmd_serve
 };
 
 enum option {
@@ -35,16 +57,34 @@ enum option {
     opt_version, // -v | --version
 };
 
-// [-h | -v] <command> [-c string | path] [-d path] [-n] [args...]
+// [-h | -v] <command> [-c string | path...] [-d path] [-n] [-f] [-p] [-r n] [-w n] [-b path] [-a] [--alloc-stats] [--trace=path] [--server] [--socket=path] [--stop] [--watch] [--cache[=path]] [-j n] [--pin] [--lazy] [args...]
 struct arg {
     enum option opt;
     enum command cmd;
     char *cmdstr;
     bool ispath;
     char *path;
+    char **paths;
+    int pathcount;
     bool isdpath;
     char *dpath;
     bool nocolor;
+    bool fold;
+    bool pipeline;
+    int runs;
+    int warmup;
+    char *baseline;
+    bool allocators;
+    bool alloc_stats;
+    char *trace;
+    bool server;
+    char *socket;
+    bool stop;
+    bool watch;
+    char *cache;
+    int jobs;
+    bool pin;
+    bool lazy;
     char *argv[];
 };
 
@@ -52,6 +92,23 @@ struct arg parse_args(int argc, char *argv[]) {
     struct arg args;
     args.nocolor = false;
     args.isdpath = false;
+    args.fold = false;
+    args.pipeline = false;
+    args.pathcount = 0;
+    args.runs = BENCH_RUNS;
+    args.warmup = BENCH_WARMUP;
+    args.baseline = NULL;
+    args.allocators = false;
+    args.alloc_stats = false;
+    args.trace = NULL;
+    args.server = false;
+    args.socket = serve_socket();
+    args.stop = false;
+    args.watch = false;
+    args.cache = NULL;
+    args.jobs = 0;
+    args.pin = false;
+    args.lazy = false;
 
     if (!strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")) {
         args.opt = opt_help;
@@ -75,6 +132,34 @@ struct arg parse_args(int argc, char *argv[]) {
         args.cmd = cmd_transpile;
         args.cmdstr = argv[1];
     }
+    else if (!strcmp(argv[1], "check")) {
+        args.cmd = cmd_check;
+        args.cmdstr = argv[1];
+    }
+    else if (!strcmp(argv[1], "resolve")) {
+        args.cmd = cmd_resolve;
+        args.cmdstr = argv[1];
+    }
+    else if (!strcmp(argv[1], "typecheck")) {
+        args.cmd = cmd_typecheck;
+        args.cmdstr = argv[1];
+    }
+    else if (!strcmp(argv[1], "ir")) {
+        args.cmd = cmd_ir;
+        args.cmdstr = argv[1];
+    }
+    else if (!strcmp(argv[1], "load")) {
+        args.cmd = cmd_load;
+        args.cmdstr = argv[1];
+    }
+    else if (!strcmp(argv[1], "bench")) {
+        args.cmd = cmd_bench;
+        args.cmdstr = argv[1];
+    }
+    else if (!strcmp(argv[1], "serve")) {
+        args.cmd = cmd_serve;
+        args.cmdstr = argv[1];
+    }
     else {
         args.cmd = cmd_unknown;
         args.cmdstr = argv[1];
@@ -82,33 +167,97 @@ struct arg parse_args(int argc, char *argv[]) {
 
     if (argc > 2) {
         int i = 2;
-        if (!strcmp(argv[2], "-c")) {
+        args.paths = (char **)dust_malloc(sizeof(char *) * argc);
+
+        // serve takes only options
+        if (args.cmd == cmd_serve) {
+            args.ispath = false;
+            i = 1;
+        }
+        else if (!strcmp(argv[2], "-c")) {
             args.ispath = false;
             args.path = argv[3];
             i++;
         }
+        // --watch comes before its directory
+        else if (!strcmp(argv[2], "--watch") && argc > 3) {
+            args.ispath = true;
+            args.watch = true;
+            args.path = argv[3];
+            i++;
+        }
         else {
             args.ispath = true;
             args.path = argv[2];
         }
+        if (args.cmd != cmd_serve) args.paths[args.pathcount++] = args.path;
 
-        if (argc > i+1) {
-            int j = i;
-            if (!strcmp(argv[i+1], "-d") || !strcmp(argv[i+1], "--dest")) {
+        // remaining options can be given in any order
+        for (i++; i < argc; i++) {
+            if ((!strcmp(argv[i], "-d") || !strcmp(argv[i], "--dest")) && i+1 < argc) {
                 args.isdpath = true;
-                args.dpath = argv[i+2];
-                i++;
-                j+=3;
+                args.dpath = argv[++i];
             }
-            else {
-                args.isdpath = false;
-                j++;
+            else if (!strcmp(argv[i], "-n") || !strcmp(argv[i], "--no-color")) {
+                args.nocolor = true;
             }
-
-            if (argc > j) {
-                if (!strcmp(argv[j], "-n") || !strcmp(argv[j], "--no-color")) {
-                    args.nocolor = true;
-                }
+            else if (!strcmp(argv[i], "-f") || !strcmp(argv[i], "--fold")) {
+                args.fold = true;
+            }
+            else if (!strcmp(argv[i], "-p") || !strcmp(argv[i], "--pipeline")) {
+                args.pipeline = true;
+            }
+            else if ((!strcmp(argv[i], "-r") || !strcmp(argv[i], "--runs")) && i+1 < argc) {
+                args.runs = atoi(argv[++i]);
+                if (args.runs < 1) args.runs = 1;
+            }
+            else if ((!strcmp(argv[i], "-w") || !strcmp(argv[i], "--warmup")) && i+1 < argc) {
+                args.warmup = atoi(argv[++i]);
+                if (args.warmup < 0) args.warmup = 0;
+            }
+            else if ((!strcmp(argv[i], "-b") || !strcmp(argv[i], "--baseline")) && i+1 < argc) {
+                args.baseline = argv[++i];
+            }
+            else if (!strcmp(argv[i], "-a") || !strcmp(argv[i], "--allocators")) {
+                args.allocators = true;
+            }
+            else if (!strcmp(argv[i], "--alloc-stats")) {
+                args.alloc_stats = true;
+            }
+            else if (!strncmp(argv[i], "--trace=", 8)) {
+                args.trace = argv[i] + 8;
+            }
+            else if (!strcmp(argv[i], "--server")) {
+                args.server = true;
+            }
+            else if (!strncmp(argv[i], "--socket=", 9)) {
+                args.socket = argv[i] + 9;
+            }
+            else if (!strcmp(argv[i], "--stop")) {
+                args.stop = true;
+            }
+            else if (!strcmp(argv[i], "--watch")) {
+                args.watch = true;
+            }
+            else if (!strcmp(argv[i], "--cache")) {
+                args.cache = module_cache_dir();
+            }
+            else if (!strncmp(argv[i], "--cache=", 8)) {
+                args.cache = argv[i] + 8;
+            }
+            else if ((!strcmp(argv[i], "-j") || !strcmp(argv[i], "--jobs")) && i+1 < argc) {
+                args.jobs = atoi(argv[++i]);
+                if (args.jobs < 0) args.jobs = 0;
+            }
+            else if (!strcmp(argv[i], "--pin")) {
+                args.pin = true;
+            }
+            else if (!strcmp(argv[i], "--lazy")) {
+                args.lazy = true;
+            }
+            // more source files (only used by check, load and bench)
+            else if (args.ispath && argv[i][0] != '-') {
+                args.paths[args.pathcount++] = argv[i];
             }
         }
     }
@@ -117,74 +266,329 @@ struct arg parse_args(int argc, char *argv[]) {
 }
 
 
+/**
+ * @brief Writer of a command's output
+ * 
+ * @param args Parsed arguments
+ * @return Writer to the destination file, or to stdout without one
+ */
+Writer *open_output(struct arg *args) {
+    Writer *writer = Writer_open(args->isdpath ? args->dpath : NULL);
+    if (writer == NULL) printf("Couldn't write file: %s\n", args->dpath);
+    return writer;
+}
+
+/**
+ * @brief Close the writer of a command's output
+ * 
+ * @param args Parsed arguments
+ * @param writer Writer to close
+ * @return Exit status
+ */
+int close_output(struct arg *args, Writer *writer) {
+    TRACE_SPAN(span);
+    TRACE_BEGIN(span, "write", TRACE_NOARG);
+    bool written = Writer_close(writer);
+    TRACE_END(span);
+
+    if (!written) {
+        printf("Couldn't write file: %s\n", args->isdpath ? args->dpath : "<stdout>");
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Tokenize a source given in arguments
+ * 
+ * @param args Parsed arguments
+ * @param path Path of the source file (or the source itself with -c)
+ * @return Tokens
+ */
+TokenArray *tokenize_source(struct arg *args, char *path) {
+    TokenArray *tokens;
+
+    alloc_phase("tokenize");
+
+    if (args->ispath) tokens = tokenize_file(path);
+    else tokens = tokenize(utf8_to_utf32(path));
+
+    alloc_input(CURRENT_SOURCE->length);
+    return tokens;
+}
+
+/**
+ * @param args Parsed arguments
+ * @param reports Diagnostic of each source (NULL if it has none)
+ * @param lengths Length of each source
+ */
+typedef struct {
+    struct arg *args;
+    char **reports;
+    size_t *lengths;
+} CheckJob;
+
+/**
+ * @brief Check one of the sources given in arguments, its diagnostic
+ *        is kept to be printed in order
+ * 
+ * @param index Index of the source
+ * @param arg Check job
+ * @return false if the source couldn't be tokenized
+ */
+static bool check_job(size_t index, void *arg) {
+    CheckJob *job = (CheckJob *)arg;
+    char *path = job->args->paths[index];
+    ErrorTrap *outer = ERROR_TRAP;
+    ErrorTrap trap;
+    CheckError error;
+    bool tokenized;
+
+    // Each source is current only on its own thread, the spawner's isn't freed
+    CURRENT_SOURCE = NULL;
+    ERROR_TRAP = &trap;
+
+    if (setjmp(trap.jump) == 0) {
+        TokenArray *tokens;
+
+        if (job->args->ispath) tokens = tokenize_file(path);
+        else tokens = tokenize(utf8_to_utf32(path));
+
+        job->lengths[index] = CURRENT_SOURCE->length;
+
+        if (!check(tokens, &error))
+            job->reports[index] = report_text(ErrorType_Syntax, error.message, error.offset, ERROR_ANSI);
+
+        TokenArray_free(tokens);
+        tokenized = true;
+    }
+
+    // A file that couldn't be read is raised before it has a source, the
+    // other files are still checked
+    else if (CURRENT_SOURCE == NULL) {
+        job->reports[index] = (char *)dust_malloc(strlen(path) + 24);
+        sprintf(job->reports[index], "Couldn't read file: %s\n", path);
+        tokenized = true;
+    }
+    // Tokenizer errors stop the check as they did before it was parallel
+    else {
+        job->reports[index] = report_text(trap.type, trap.message, trap.offset, ERROR_ANSI);
+        tokenized = false;
+    }
+
+    ERROR_TRAP = outer;
+    source_use(NULL);
+    return tokenized;
+}
+
+/**
+ * @brief Tokenize and parse the source given in arguments
+ * 
+ * @param args Parsed arguments
+ * @return Body node
+ */
+Node *parse_source(struct arg *args) {
+    TRACE_SPAN(span);
+
+    if (args->pipeline) {
+        Node *body;
+        alloc_phase("parse");
+        TRACE_BEGIN(span, "parse", TRACE_NOARG);
+
+        if (args->ispath) body = parse_file_pipelined(args->path);
+        else body = parse_pipelined(utf8_to_utf32(args->path));
+
+        TRACE_END(span);
+
+        if (CURRENT_SOURCE != NULL) alloc_input(CURRENT_SOURCE->length);
+        return body;
+    }
+
+    TokenArray *tokens = tokenize_source(args, args->path);
+
+    TRACE_BEGIN(span, "parse", TRACE_NOARG);
+
+    alloc_phase("parse");
+    Node *body = parse_body_parallel(tokens, 0);
+
+    TRACE_END(span);
+
+    alloc_phase("free");
+    TokenArray_free(tokens);
+    return body;
+}
+
+
 int main(int argc, char *argv[]) {
-    Platform platform = get_platform();
     if (OS == OS_WINDOWS) system(" ");
 
     struct arg args = parse_args(argc, argv);
 
+    SCHEDULER_JOBS = args.jobs;
+    SCHEDULER_PIN = args.pin;
+
+    if (args.opt == opt_none && args.alloc_stats) {
+        #ifdef DUST_ALLOC_STATS
+        alloc_report_at_exit();
+        #else
+        printf("Dust was built without allocation statistics, build it with 'python build.py --alloc-stats'\n");
+        #endif
+    }
+
+    if (args.opt == opt_none && args.trace != NULL) {
+        #ifdef DUST_TRACE
+        TRACE_THREAD("main");
+        trace_dump_at_exit(args.trace);
+        #else
+        printf("Dust was built without tracing, build it with 'python build.py --trace'\n");
+        #endif
+    }
+
     if (args.opt == opt_help) {
 
-        printf("Usage: dust [-h | -v] <command> [-c string | path] [-d path] [-n] [args...]\n"
+        printf("Usage: dust [-h | -v] <command> [-c string | path...] [-d path] [-n] [-f] [-p] [-r n] [-w n] [-b path] [-a] [--alloc-stats] [--trace=path] [--server] [--socket=path] [--stop] [--watch] [--cache[=path]] [-j n] [--pin] [--lazy] [args...]\n"
                 "\n"
                 "Options and arguments:\n"
                 "-h | --help     : prints help message\n"
                 "-v | --version  : prints Dust and related version information\n"
                 "-c              : accepts a string as source code instead of a file\n"
-                "-d | --dest     : writes the tokenized/parsed result into a file\n"
+                "-d | --dest     : writes the tokenized/parsed/transpiled result (or benchmark result as JSON) into a file\n"
                 "-n | --no-color : disables ANSI coloring in outputs\n"
+                "-f | --fold     : folds constant expressions while parsing\n"
+                "-p | --pipeline : tokenizes and parses at the same time on two threads\n"
+                "-r | --runs     : number of measured benchmark runs (default 20)\n"
+                "-w | --warmup   : number of benchmark runs before measuring (default 3)\n"
+                "-b | --baseline : compares the benchmark against a JSON result saved with -d\n"
+                "-a | --allocators: also benchmarks the system, arena and pool allocators against each other\n"
+                "--alloc-stats   : prints allocation statistics at exit (needs a build with --alloc-stats)\n"
+                "--trace=path    : writes a Chrome trace of the front-end into a file (needs a build with --trace)\n"
+                "--server        : runs the command on a running 'dust serve' (locally if none answers)\n"
+                "--socket=path   : socket of the server (default $XDG_RUNTIME_DIR/dust.sock)\n"
+                "--stop          : stops the server running on the socket\n"
+                "--watch         : checks or transpiles a directory, then rebuilds what changes in it until interrupted (Linux)\n"
+                "--cache[=path]  : caches the trees load parses in a directory (default $XDG_CACHE_HOME/dust)\n"
+                "-j | --jobs     : number of threads parallel stages and the server use (default one per physical core)\n"
+                "--pin           : pins the threads of parallel stages to cores\n"
+                "--lazy          : load only parses the bodies of uncached modules when they are used\n"
                 "\n"
                 "Commands:\n"
                 "tokenize  : tokenizes the source code and prints tokens\n"
                 "parse     : parses the source code and prints the syntax tree\n"
-                "transpile : transpiles the source into C code (experimental)\n");
+                "transpile : transpiles the source into C code (experimental)\n"
+                "check     : checks the syntax of one or more sources without building a tree\n"
+                "resolve   : parses the source and reports every undefined or duplicate name\n"
+                "typecheck : resolves the source and reports every type mismatch (-d writes the tree with its conversions)\n"
+                "ir        : type checks the source, lowers it into SSA form, verifies it and prints it\n"
+                "load      : loads one or more sources with every module they import and prints them after their imports\n"
+                "bench     : times reading, decoding, tokenizing, parsing and transpiling of one or more files\n"
+                "serve     : answers tokenize, parse, check and transpile requests of --server on a socket\n");
     }
 
     else if (args.opt == opt_version) {
+        // Only needed here, reading it costs every other command startup time
+        Platform platform = get_platform();
+        CPUInfo *cpu = get_cpuinfo();
+
         printf("Dust     : %s\n"
                 "Compiler : %s %s\n"
-                "Platform : %s\n",
+                "Platform : %s\n"
+                "CPU      : %s (%d cores, %d threads, %s)\n"
+                "Caches   : L1 %zu KB, L2 %zu KB, L3 %zu KB, %zu byte lines\n",
                 DUST_VERSION_STR,
                 COMPILER,
                 COMPILER_VERSION_STR,
-                utf32_to_utf8(platform.prettyname));
+                utf32_to_utf8(platform.prettyname),
+                utf32_to_utf8(cpu->name),
+                cpu->physical_cores,
+                cpu->logical_cores,
+                SIMDLevel_repr(cpu->simd),
+                cpu->l1_size / 1024,
+                cpu->l2_size / 1024,
+                cpu->l3_size / 1024,
+                cpu->cache_line);
+    }
+
+    else if (args.watch && (args.cmd == cmd_check || args.cmd == cmd_transpile)) {
+        if (!args.ispath) {
+            printf("--watch needs a directory\n");
+            return 1;
+        }
+
+        return watch(args.path, args.cmd == cmd_transpile, args.nocolor);
     }
 
     else {
 
+        // Folding changes how a tree is parsed, the server only keeps unfolded ones
+        // and it answers on stdout
+        if (args.server && !args.fold && !args.isdpath &&
+            (args.cmd == cmd_tokenize || args.cmd == cmd_parse ||
+             args.cmd == cmd_check || args.cmd == cmd_transpile)) {
+            int status = serve_client(args.socket, args.cmdstr, args.nocolor,
+                                      args.ispath, args.paths, args.pathcount);
+            if (status >= 0) return status;
+        }
+
         if (args.cmd == cmd_unknown) {
             printf("Unknown command: %s\n"
                     "Try 'dust -h' for more information\n",
                     args.cmdstr);
         }
 
-        else if (args.cmd == cmd_tokenize) {
-            TokenArray *tokens;
+        else if (args.cmd == cmd_serve) {
+            if (args.stop) {
+                if (serve_client(args.socket, "stop", false, false, NULL, 0) < 0) {
+                    printf("No server is running on %s\n", args.socket);
+                    return 1;
+                }
+                return 0;
+            }
 
+            return serve(args.socket, args.jobs);
+        }
+
+        else if (args.cmd == cmd_tokenize) {
             if (args.nocolor) ERROR_ANSI = 0;
 
-            if (args.ispath) tokens = tokenize_file(args.path);
-            else tokens = tokenize(utf8_to_utf32(args.path));
+            TokenArray *tokens = tokenize_source(&args, args.path);
+            Writer *writer = open_output(&args);
+            if (writer == NULL) return 1;
 
-            printf("%s", utf32_to_utf8(TokenArray_repr(tokens)));
+            TRACE_SPAN(span);
+            TRACE_BEGIN(span, "print", TRACE_NOARG);
 
+            alloc_phase("print");
+            TokenArray_write(tokens, writer);
+
+            TRACE_END(span);
+            int status = close_output(&args, writer);
+
+            alloc_phase("free");
             TokenArray_free(tokens);
+            return status;
         }
 
         else if (args.cmd == cmd_parse) {
-            TokenArray *tokens;
-
             if (args.nocolor) ERROR_ANSI = 0;
+            if (args.fold) PARSER_FOLD = 1;
 
-            if (args.ispath) tokens = tokenize_file(args.path);
-            else tokens = tokenize(utf8_to_utf32(args.path));
+            Node *expr = parse_source(&args);
+            Writer *writer = open_output(&args);
+            if (writer == NULL) return 1;
 
-            Node *expr = parse_body(tokens);
+            TRACE_SPAN(span);
+            TRACE_BEGIN(span, "print", TRACE_NOARG);
 
-            printf("%s", utf32_to_utf8(Node_repr(expr, 0)));
+            alloc_phase("print");
+            Node_write(expr, writer);
 
-            TokenArray_free(tokens);
+            TRACE_END(span);
+            int status = close_output(&args, writer);
+
+            alloc_phase("free");
             Node_free(expr);
+            return status;
         }
 
         else if (args.cmd == cmd_transpile) {
@@ -194,19 +598,238 @@ int main(int argc, char *argv[]) {
                 printf("%sWARNING%s: Transpiler is still experimental and might be depreceated in the future.\n",
                         ANSI_FG_LIGHTRED, ANSI_END);
 
-            TokenArray *tokens;
+            if (args.nocolor) ERROR_ANSI = 0;
+            if (args.fold) PARSER_FOLD = 1;
+
+            Node *expr = parse_source(&args);
+            Writer *writer = open_output(&args);
+            if (writer == NULL) return 1;
+
+            alloc_phase("transpile");
+            transpile_write(expr->body, writer);
+            int status = close_output(&args, writer);
+
+            alloc_phase("free");
+            Node_free(expr);
+            return status;
+        }
+
+        else if (args.cmd == cmd_check) {
+            CheckJob job;
+            int failed = 0;
 
             if (args.nocolor) ERROR_ANSI = 0;
 
-            if (args.ispath) tokens = tokenize_file(args.path);
-            else tokens = tokenize(utf8_to_utf32(args.path));
+            job.args = &args;
+            job.reports = (char **)dust_calloc(args.pathcount, sizeof(char *));
+            job.lengths = (size_t *)dust_calloc(args.pathcount, sizeof(size_t));
 
-            Node *expr = parse_body(tokens);
+            alloc_phase("check");
+            size_t stopped = Scheduler_for(scheduler_shared(), 0, args.pathcount, check_job, &job);
 
-            transpile(expr->body);
+            // Printed in order, up to the file whose tokenizer error stopped the rest
+            for (size_t i = 0; i < (size_t)args.pathcount && i <= stopped; i++) {
+                alloc_input(job.lengths[i]);
+                if (job.reports[i] == NULL) continue;
 
-            TokenArray_free(tokens);
-            Node_free(expr);
+                printf("%s", job.reports[i]);
+                dust_free(job.reports[i]);
+                failed++;
+            }
+
+            dust_free(job.reports);
+            dust_free(job.lengths);
+            return failed > 0;
+        }
+
+        else if (args.cmd == cmd_resolve) {
+            if (args.nocolor) ERROR_ANSI = 0;
+            if (args.fold) PARSER_FOLD = 1;
+
+            Node *body = parse_source(&args);
+            Resolver *resolver = Resolver_new();
+
+            alloc_phase("resolve");
+            resolve(resolver, body);
+
+            for (size_t i = 0; i < resolver->error_count; i++)
+                report(ErrorType_Name, resolver->errors[i].message, resolver->errors[i].offset);
+
+            int status = resolver->error_count > 0;
+
+            alloc_phase("free");
+            Resolver_free(resolver);
+            Node_free(body);
+            return status;
+        }
+
+        else if (args.cmd == cmd_typecheck) {
+            if (args.nocolor) ERROR_ANSI = 0;
+            if (args.fold) PARSER_FOLD = 1;
+
+            Node *body = parse_source(&args);
+            Resolver *resolver = Resolver_new();
+            TypeChecker *checker = TypeChecker_new();
+
+            alloc_phase("resolve");
+            resolve(resolver, body);
+
+            alloc_phase("typecheck");
+            typecheck(checker, body);
+
+            for (size_t i = 0; i < resolver->error_count; i++)
+                report(ErrorType_Name, resolver->errors[i].message, resolver->errors[i].offset);
+
+            for (size_t i = 0; i < checker->error_count; i++)
+                report(ErrorType_Type, checker->errors[i].message, checker->errors[i].offset);
+
+            int status = resolver->error_count + checker->error_count > 0;
+
+            // The tree with its conversions
+            if (args.isdpath) {
+                Writer *writer = open_output(&args);
+                if (writer == NULL) return 1;
+
+                Node_write(body, writer);
+                if (close_output(&args, writer)) status = 1;
+            }
+
+            alloc_phase("free");
+            TypeChecker_free(checker);
+            Resolver_free(resolver);
+            Node_free(body);
+            return status;
+        }
+
+        else if (args.cmd == cmd_ir) {
+            if (args.nocolor) ERROR_ANSI = 0;
+            if (args.fold) PARSER_FOLD = 1;
+
+            Node *body = parse_source(&args);
+            Resolver *resolver = Resolver_new();
+            TypeChecker *checker = TypeChecker_new();
+            int status = 0;
+
+            alloc_phase("resolve");
+            resolve(resolver, body);
+
+            alloc_phase("typecheck");
+            typecheck(checker, body);
+
+            for (size_t i = 0; i < resolver->error_count; i++)
+                report(ErrorType_Name, resolver->errors[i].message, resolver->errors[i].offset);
+
+            for (size_t i = 0; i < checker->error_count; i++)
+                report(ErrorType_Type, checker->errors[i].message, checker->errors[i].offset);
+
+            // Only well typed trees are lowered
+            if (resolver->error_count + checker->error_count > 0) status = 1;
+
+            else {
+                alloc_phase("lower");
+                IrProgram *program = ir_lower(body);
+
+                alloc_phase("verify");
+                if (!IrProgram_verify(program)) {
+                    for (int i = 0; i < program->error_count; i++) {
+                        int value = program->errors[i].value;
+                        report(ErrorType_Internal, program->errors[i].message,
+                               value == IR_NONE ? 0 : program->values[value].offset);
+                    }
+                    status = 1;
+                }
+
+                Writer *writer = open_output(&args);
+
+                if (writer == NULL) status = 1;
+                else {
+                    alloc_phase("print");
+                    IrProgram_write(program, writer);
+                    if (close_output(&args, writer)) status = 1;
+                }
+
+                IrProgram_free(program);
+            }
+
+            alloc_phase("free");
+            TypeChecker_free(checker);
+            Resolver_free(resolver);
+            Node_free(body);
+            return status;
+        }
+
+        else if (args.cmd == cmd_load) {
+            if (args.nocolor) ERROR_ANSI = 0;
+            if (args.fold) PARSER_FOLD = 1;
+
+            if (args.pathcount == 0 || !args.ispath) {
+                printf("load needs one or more source files\n");
+                return 1;
+            }
+
+            Loader *loader = Loader_new(args.cache);
+            int status = 0;
+
+            // Syntax errors in bodies aren't reported unless the trees are cached
+            loader->lazy = args.lazy;
+
+            alloc_phase("load");
+
+            for (int i = 0; i < args.pathcount; i++) {
+                if (Loader_load(loader, args.paths[i]) == NULL) {
+                    printf("Couldn't read file: %s\n", args.paths[i]);
+                    status = 1;
+                }
+            }
+
+            // Diagnostics of a module come after the ones of the modules it imports
+            for (size_t i = 0; i < loader->order_count; i++) {
+                Module *module = loader->order[i];
+                for (size_t j = 0; j < module->error_count; j++) printf("%s", module->errors[j]);
+            }
+
+            if (Loader_error_count(loader) > 0) status = 1;
+
+            else if (status == 0) {
+                for (size_t i = 0; i < loader->order_count; i++) printf("%s\n", loader->order[i]->path);
+            }
+
+            alloc_phase("free");
+            Loader_free(loader);
+            return status;
+        }
+
+        else if (args.cmd == cmd_bench) {
+            BenchResult result;
+            BenchResult baseline;
+            int regressions;
+
+            if (args.nocolor) ERROR_ANSI = 0;
+
+            if (args.pathcount == 0 || !args.ispath) {
+                printf("bench needs one or more source files\n");
+                return 1;
+            }
+
+            if (args.baseline != NULL && !bench_load(&baseline, args.baseline)) {
+                printf("Couldn't load benchmark baseline: %s\n", args.baseline);
+                return 1;
+            }
+
+            result = bench_files(args.paths, args.pathcount, args.runs, args.warmup);
+            regressions = bench_print(&result, args.baseline != NULL ? &baseline : NULL);
+
+            if (args.allocators) {
+                BenchAllocators allocators = bench_allocators(args.paths, args.pathcount, args.runs, args.warmup);
+                bench_print_allocators(&allocators);
+            }
+
+            if (args.isdpath && !bench_save(&result, args.dpath)) {
+                printf("Couldn't write benchmark result: %s\n", args.dpath);
+                return 1;
+            }
+
+            return regressions > 0;
         }
     }
 
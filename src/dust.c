@@ -0,0 +1,444 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+
+  dust.c  -  Public API of libdust
+  -------------------------------------------------
+  Every document has its own arena, which is made the
+  current allocator while the document is tokenized
+  and parsed. An error raised on the way jumps back
+  through ERROR_TRAP and whatever was allocated until
+  then is released with the arena, so a failed parse
+  costs nothing extra to clean up. The thread's current
+  source and allocator are put back before returning,
+  the library leaves no state behind.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dust/dust.h"
+#include "dust/info.h"
+#include "dust/ustring.h"
+#include "dust/error.h"
+#include "dust/source.h"
+#include "dust/tokenizer.h"
+#include "dust/parser.h"
+#include "dust/allocator.h"
+#include "dust/alloc.h"
+
+
+_Static_assert((int)DustToken_EOF == (int)TokenType_EOF, "DustTokenKind must match TokenType");
+_Static_assert((int)DustNode_WHILE == (int)NodeType_WHILE, "DustNodeKind must match NodeType");
+
+// Initial size of a document's UTF-8 string table
+#define DOCUMENT_TEXTS 64
+
+/**
+ * @param arena Every allocation of the document but itself
+ * @param source Source code
+ * @param tokens Tokens (NULL if tokenizing failed)
+ * @param root Body node of the top-level statements (NULL if not parsed)
+ * @param failed An error was raised
+ * @param diagnostic Raised error
+ * @param keys UTF-32 strings converted so far (open addressing by pointer)
+ * @param texts UTF-8 conversions of keys
+ * @param text_size Size of the string table
+ * @param text_used Number of strings in the table
+ */
+struct _DustDocument {
+    Arena *arena;
+    Source *source;
+    TokenArray *tokens;
+    Node *root;
+    bool failed;
+    DustDiagnostic diagnostic;
+    u32char **keys;
+    char **texts;
+    size_t text_size;
+    size_t text_used;
+};
+
+
+/**
+ * @brief Version of the API the library was built with
+ *
+ * @return DUST_API_VERSION of the library
+ */
+int dust_api_version() {
+    return DUST_API_VERSION;
+}
+
+/**
+ * @brief Version of Dust the library was built from
+ *
+ * @return Version string
+ */
+const char *dust_version() {
+    return DUST_VERSION_STR;
+}
+
+static size_t document_slot(u32char **keys, size_t size, u32char *key) {
+    size_t i = ((size_t)key >> 4) & (size - 1);
+    while (keys[i] != NULL && keys[i] != key) i = (i + 1) & (size - 1);
+    return i;
+}
+
+// UTF-8 of a string of the document, converted only once
+static const char *document_text(DustDocument *document, u32char *str) {
+    if (str == NULL) return NULL;
+
+    size_t i = document_slot(document->keys, document->text_size, str);
+    if (document->keys[i] != NULL) return document->texts[i];
+
+    DustAllocator *previous = dust_allocator_use(&document->arena->allocator);
+
+    if ((document->text_used + 1) * 2 > document->text_size) {
+        size_t size = document->text_size * 2;
+        u32char **keys = (u32char **)dust_calloc(size, sizeof(u32char *));
+        char **texts = (char **)dust_malloc(sizeof(char *) * size);
+
+        for (size_t j = 0; j < document->text_size; j++) {
+            if (document->keys[j] == NULL) continue;
+            size_t k = document_slot(keys, size, document->keys[j]);
+            keys[k] = document->keys[j];
+            texts[k] = document->texts[j];
+        }
+
+        document->keys = keys;
+        document->texts = texts;
+        document->text_size = size;
+        i = document_slot(keys, size, str);
+    }
+
+    document->keys[i] = str;
+    document->texts[i] = utf32_to_utf8(str);
+    document->text_used++;
+
+    dust_allocator_use(previous);
+    return document->texts[i];
+}
+
+// Tokenize, and parse if asked, the source into a new document
+static DustDocument *document_new(const char *source, bool parse) {
+    DustDocument *document = (DustDocument *)malloc(sizeof(DustDocument));
+    if (document == NULL) return NULL;
+
+    document->arena = Arena_new(0);
+    document->source = NULL;
+    document->tokens = NULL;
+    document->root = NULL;
+    document->failed = false;
+    document->text_size = DOCUMENT_TEXTS;
+    document->text_used = 0;
+
+    DustAllocator *previous = dust_allocator_use(&document->arena->allocator);
+    Source *current = CURRENT_SOURCE;
+    ErrorTrap *outer = ERROR_TRAP;
+    ErrorTrap trap;
+
+    document->keys = (u32char **)dust_calloc(document->text_size, sizeof(u32char *));
+    document->texts = (char **)dust_malloc(sizeof(char *) * document->text_size);
+
+    u32char *raw = utf8_to_utf32((char *)source);
+    document->source = Source_new(U"<source>", raw, u32len(raw));
+    CURRENT_SOURCE = document->source;
+    ERROR_TRAP = &trap;
+
+    if (setjmp(trap.jump) == 0) {
+        document->tokens = tokenize(raw);
+        if (parse) document->root = parse_body(document->tokens);
+    }
+
+    else {
+        int x;
+        int y;
+
+        parse_reset();
+        Source_position(document->source, trap.offset, &x, &y);
+
+        document->failed = true;
+        document->root = NULL;
+        document->diagnostic.kind = trap.type == ErrorType_Internal ? DustDiagnostic_INTERNAL
+                                                                    : DustDiagnostic_SYNTAX;
+        document->diagnostic.message = utf32_to_utf8(trap.message);
+        document->diagnostic.offset = trap.offset;
+        document->diagnostic.line = y + 1;
+        document->diagnostic.column = x + 1;
+    }
+
+    ERROR_TRAP = outer;
+    CURRENT_SOURCE = current;
+    dust_allocator_use(previous);
+
+    return document;
+}
+
+/**
+ * @brief Tokenize a source code
+ *
+ * @param source Source code in UTF-8
+ * @return Document's pointer (NULL if out of memory)
+ */
+DustDocument *dust_tokenize(const char *source) {
+    return document_new(source, false);
+}
+
+/**
+ * @brief Tokenize and parse a source code
+ *
+ * @param source Source code in UTF-8
+ * @return Document's pointer (NULL if out of memory)
+ */
+DustDocument *dust_parse(const char *source) {
+    return document_new(source, true);
+}
+
+/**
+ * @brief Release a document and everything it owns
+ *
+ * @param document Document to free
+ */
+void dust_document_free(DustDocument *document) {
+    if (document == NULL) return;
+
+    Arena_free(document->arena);
+    free(document);
+}
+
+/**
+ * @brief Number of diagnostics of a document
+ *
+ * @param document Document
+ * @return Diagnostic count
+ */
+size_t dust_diagnostic_count(DustDocument *document) {
+    return document->failed ? 1 : 0;
+}
+
+/**
+ * @brief Get a diagnostic of a document
+ *
+ * @param document Document
+ * @param index Index of the diagnostic
+ * @param diagnostic Filled with the diagnostic
+ * @return false if index is out of range
+ */
+bool dust_diagnostic(DustDocument *document, size_t index, DustDiagnostic *diagnostic) {
+    if (index >= dust_diagnostic_count(document)) return false;
+
+    *diagnostic = document->diagnostic;
+    return true;
+}
+
+/**
+ * @brief Number of tokens of a document, the last one is always EOF
+ *
+ * @param document Document
+ * @return Token count (0 if tokenizing failed)
+ */
+size_t dust_token_count(DustDocument *document) {
+    return document->tokens != NULL ? document->tokens->used : 0;
+}
+
+/**
+ * @brief Get a token of a document
+ *
+ * @param document Document
+ * @param index Index of the token
+ * @param token Filled with the token
+ * @return false if index is out of range
+ */
+bool dust_token(DustDocument *document, size_t index, DustToken *token) {
+    if (index >= dust_token_count(document)) return false;
+
+    Token *t = &(document->tokens->array[index]);
+    token->kind = (DustTokenKind)t->type;
+    token->text = document_text(document, t->data != NULL ? t->data : U"");
+    token->offset = t->offset;
+    return true;
+}
+
+/**
+ * @brief Body node of the top-level statements of a document
+ *
+ * @param document Document
+ * @return Node's pointer (NULL if not parsed or parsing failed)
+ */
+const DustNode *dust_root(DustDocument *document) {
+    return document->root;
+}
+
+/**
+ * @brief Kind of a node
+ *
+ * @param node Node
+ * @return Node kind
+ */
+DustNodeKind dust_node_kind(const DustNode *node) {
+    return (DustNodeKind)node->type;
+}
+
+// Children kept in an array, or NULL if the node has fixed ones
+static NodeArray *node_array(const Node *node) {
+    switch (node->type) {
+        case NodeType_ARRAY: return node->array_nodearray;
+        case NodeType_BODY: return node->body_lazy != NULL ? NULL : node->body;
+        case NodeType_GENTYPE: return node->gentype;
+        default: return NULL;
+    }
+}
+
+// Fixed children of a node, missing ones are skipped
+static size_t node_fields(const Node *node, Node *fields[3]) {
+    Node *all[3] = {NULL, NULL, NULL};
+    size_t count = 0;
+
+    switch (node->type) {
+        case NodeType_DECL: all[0] = node->decl_type; all[1] = node->decl_expr; break;
+        case NodeType_DECLN: all[0] = node->decln_type; break;
+        case NodeType_ASSIGN: all[0] = node->assign_expr; break;
+        case NodeType_BINOP: all[0] = node->bin_left; all[1] = node->bin_right; break;
+        case NodeType_UNARYOP:
+        case NodeType_RUNARYOP: all[0] = node->unary_right; break;
+        case NodeType_CHILD: all[0] = node->chld_parent; all[1] = node->chld_child; break;
+        case NodeType_SUBSCRIPT: all[0] = node->subs_node; all[1] = node->subs_expr; break;
+        case NodeType_CALL: all[0] = node->call_base; break;
+        case NodeType_ENUM: all[0] = node->enum_body; break;
+        case NodeType_IF: all[0] = node->if_expr; all[1] = node->if_body; break;
+        case NodeType_ELIF: all[0] = node->elif_expr; all[1] = node->elif_body; break;
+        case NodeType_ELSE: all[0] = node->else_body; break;
+        case NodeType_REPEAT: all[0] = node->repeat_expr; all[1] = node->repeat_body; break;
+        case NodeType_WHILE: all[0] = node->while_expr; all[1] = node->while_body; break;
+        case NodeType_FOR: all[0] = node->for_var; all[1] = node->for_expr; all[2] = node->for_body; break;
+        case NodeType_CONVERT: all[0] = node->conv_expr; break;
+        default: break;
+    }
+
+    for (size_t i = 0; i < 3; i++)
+        if (all[i] != NULL) fields[count++] = all[i];
+
+    return count;
+}
+
+/**
+ * @brief Number of children of a node
+ *
+ * Children are in source order: declarations have their type and
+ * expression, calls their function and then arguments, blocks their
+ * condition and then body, and bodies their statements.
+ *
+ * @param node Node
+ * @return Child count
+ */
+size_t dust_node_child_count(const DustNode *node) {
+    Node *fields[3];
+    size_t count = node_fields(node, fields);
+    NodeArray *array = node_array(node);
+
+    if (array != NULL) count += array->used;
+    if (node->type == NodeType_CALL && node->call_args != NULL) count += node->call_args->used;
+
+    return count;
+}
+
+/**
+ * @brief Get a child of a node
+ *
+ * @param node Node
+ * @param index Index of the child
+ * @return Child's pointer (NULL if index is out of range)
+ */
+const DustNode *dust_node_child(const DustNode *node, size_t index) {
+    Node *fields[3];
+    size_t count = node_fields(node, fields);
+    NodeArray *array = node_array(node);
+
+    if (node->type == NodeType_CALL) array = node->call_args;
+
+    if (index < count) return fields[index];
+    index -= count;
+
+    if (array != NULL && index < array->used) return &(array->array[index]);
+    return NULL;
+}
+
+/**
+ * @brief Name or value of a node: identifiers, string contents, the
+ *        variable of declarations and assignments, the module of
+ *        imports and the name of enumerations
+ *
+ * @param document Document of the node
+ * @param node Node
+ * @return UTF-8 string (NULL if the node has none)
+ */
+const char *dust_node_text(DustDocument *document, const DustNode *node) {
+    switch (node->type) {
+        case NodeType_STRING: return document_text(document, node->string);
+        case NodeType_VAR: return document_text(document, node->variable);
+        case NodeType_PRIMITIVE: return document_text(document, node->primitive);
+        case NodeType_FUNCBASE: return document_text(document, node->func_base);
+        case NodeType_DECL: return document_text(document, node->decl_var);
+        case NodeType_DECLN: return document_text(document, node->decln_var);
+        case NodeType_ASSIGN: return document_text(document, node->assign_var);
+        case NodeType_IMPORT:
+        case NodeType_IMPORTF: return document_text(document, node->import_module);
+        case NodeType_ENUM: return document_text(document, node->enum_name);
+        default: return NULL;
+    }
+}
+
+/**
+ * @brief Imported member of a from-import node
+ *
+ * @param document Document of the node
+ * @param node Node
+ * @return UTF-8 string (NULL if the node isn't a from-import)
+ */
+const char *dust_node_member(DustDocument *document, const DustNode *node) {
+    if (node->type != NodeType_IMPORTF) return NULL;
+    return document_text(document, node->import_member);
+}
+
+/**
+ * @brief Operator of an operation or assignment node
+ *
+ * @param document Document of the node
+ * @param node Node
+ * @return UTF-8 string (NULL if the node has none)
+ */
+const char *dust_node_operator(DustDocument *document, const DustNode *node) {
+    switch (node->type) {
+        case NodeType_BINOP: return document_text(document, Node_repr_op(node->bin_optype));
+        case NodeType_UNARYOP:
+        case NodeType_RUNARYOP: return document_text(document, Node_repr_op(node->unary_optype));
+        case NodeType_ASSIGN: return document_text(document, node->assign_op);
+        default: return NULL;
+    }
+}
+
+/**
+ * @brief Value of an integer node
+ *
+ * @param node Node
+ * @return Value (0 if the node isn't an integer)
+ */
+long dust_node_integer(const DustNode *node) {
+    return node->type == NodeType_INTEGER ? node->integer : 0;
+}
+
+/**
+ * @brief Value of a float node
+ *
+ * @param node Node
+ * @return Value (0.0 if the node isn't a float)
+ */
+double dust_node_float(const DustNode *node) {
+    return node->type == NodeType_FLOAT ? node->floating : 0.0;
+}
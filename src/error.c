@@ -10,55 +10,184 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include "dust/ustring.h"
 #include "dust/ansi.h"
+#include "dust/error.h"
+#include "dust/source.h"
+#include "dust/allocator.h"
+#include "dust/alloc.h"
 
 
-typedef enum {
-    ErrorType_Syntax,
-} ErrorType;
-
 char *Error_repr(ErrorType type) {
     switch (type) {
         case ErrorType_Syntax:
             return "SyntaxError";
             break;
+
+        case ErrorType_Name:
+            return "NameError";
+            break;
+
+        case ErrorType_Type:
+            return "TypeError";
+            break;
+
+        case ErrorType_Import:
+            return "ImportError";
+            break;
+
+        case ErrorType_Internal:
+            return "InternalError";
+            break;
     }
 }
 
 
 int ERROR_ANSI = 1;
 
-void raise_ansi(ErrorType type, u32char *message, u32char *source, int x, int y) {
-    printf("\n%s %s%d%s:%s%d\n%s%s%s: %s%s\n%s...\n#%d %sline\n",
-           utf32_to_utf8(source), ANSI_FG_YELLOW, (y+1), ANSI_END, ANSI_FG_YELLOW, x,
-           ANSI_FG_LIGHTRED, Error_repr(type), ANSI_FG_DARKGRAY, ANSI_END, utf32_to_utf8(message),
-           ANSI_FG_DARKGRAY, (y+1),
-           ANSI_END);
-            
-    exit(1);
+// Errors of the current thread jump here if it is set, see ErrorTrap
+THREAD_LOCAL ErrorTrap *ERROR_TRAP = NULL;
+
+static void error_jump(ErrorType type, u32char *message, size_t offset) {
+    ErrorTrap *trap = ERROR_TRAP;
+
+    // Trap is cleared so an error raised while recovering isn't caught by it again
+    ERROR_TRAP = NULL;
+    trap->type = type;
+    trap->message = message;
+    trap->offset = offset;
+    longjmp(trap->jump, 1);
 }
 
-void raise_noansi(ErrorType type, u32char *message, u32char *source, int x, int y) {
-    printf("\n%s %d:%d\n%s: %s\n...\n#%d line\n",
-           utf32_to_utf8(source), (y+1), x, Error_repr(type), utf32_to_utf8(message), (y+1));
-            
-    exit(1);
+/**
+ * @brief Spaces to put a caret under the column of a line
+ *        (tabs are kept so the caret lines up)
+ */
+char *error_caret(u32char *line, int x, int y) {
+    int gutter = snprintf(NULL, 0, "%d | ", y+1);
+    char *pad = (char *)dust_malloc(gutter + x + 1);
+    int i;
+
+    for (i = 0; i < gutter; i++) pad[i] = ' ';
+    for (i = 0; i < x; i++) pad[gutter + i] = (line[i] == U'\t') ? '\t' : ' ';
+    pad[gutter + x] = '\0';
+
+    return pad;
 }
 
-void raise(ErrorType type, u32char *message, u32char *source, int x, int y) {
-    switch (ERROR_ANSI) {
-        case 1:
-            raise_ansi(type, message, source, x, y);
-            break;
+// Formatted string, like sprintf into a new buffer
+static char *error_format(char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(NULL, 0, format, args);
+    va_end(args);
 
-        case 0:
-            raise_noansi(type, message, source, x, y);
-            break;
+    char *text = (char *)dust_malloc(length + 1);
+
+    va_start(args, format);
+    vsnprintf(text, length + 1, format, args);
+    va_end(args);
+
+    return text;
+}
+
+// Text of an error as it is printed
+static char *error_text(ErrorType type, u32char *message, u32char *source, u32char *line, int x, int y, int ansi) {
+    char *source8 = utf32_to_utf8(source);
+    char *message8 = utf32_to_utf8(message);
+    char *line8 = utf32_to_utf8(line);
+    char *caret = error_caret(line, x, y);
+    char *text;
+
+    if (ansi)
+        text = error_format("\n%s %s%d%s:%s%d\n%s%s%s: %s%s\n%s%d |%s %s\n%s%s^%s\n",
+                            source8, ANSI_FG_YELLOW, (y+1), ANSI_END, ANSI_FG_YELLOW, x,
+                            ANSI_FG_LIGHTRED, Error_repr(type), ANSI_FG_DARKGRAY, ANSI_END, message8,
+                            ANSI_FG_DARKGRAY, (y+1), ANSI_END, line8,
+                            caret, ANSI_FG_LIGHTRED, ANSI_END);
+    else
+        text = error_format("\n%s %d:%d\n%s: %s\n%d | %s\n%s^\n",
+                            source8, (y+1), x, Error_repr(type), message8,
+                            (y+1), line8, caret);
+
+    dust_free(source8);
+    dust_free(message8);
+    dust_free(line8);
+    dust_free(caret);
+    return text;
+}
+
+void raise_ansi(ErrorType type, u32char *message, u32char *source, u32char *line, int x, int y) {
+    char *text = error_text(type, message, source, line, x, y, 1);
+    printf("%s", text);
+    dust_free(text);
+}
+
+void raise_noansi(ErrorType type, u32char *message, u32char *source, u32char *line, int x, int y) {
+    char *text = error_text(type, message, source, line, x, y, 0);
+    printf("%s", text);
+    dust_free(text);
+}
+
+/**
+ * @brief Text of an error in the current source, as report prints it
+ *
+ * @param type Type of the error
+ * @param message Error message
+ * @param offset Offset in source the error points at
+ * @param ansi Color the text with ANSI codes
+ * @return UTF-8 string
+ */
+char *report_text(ErrorType type, u32char *message, size_t offset, int ansi) {
+    u32char *source = U"<stdin>";
+    u32char *line = U"";
+    int x = 0;
+    int y = 0;
+
+    // Position is resolved only now that it is needed
+    if (CURRENT_SOURCE != NULL) {
+        if (offset > CURRENT_SOURCE->length) offset = CURRENT_SOURCE->length;
+        source = CURRENT_SOURCE->name;
+        Source_position(CURRENT_SOURCE, offset, &x, &y);
+        line = Source_line(CURRENT_SOURCE, y);
+        if (x > (int)u32len(line)) x = u32len(line);
     }
+
+    return error_text(type, message, source, line, x, y, ansi);
+}
+
+/**
+ * @brief Print an error in the current source
+ *
+ * @param type Type of the error
+ * @param message Error message
+ * @param offset Offset in source the error points at
+ */
+void report(ErrorType type, u32char *message, size_t offset) {
+    char *text = report_text(type, message, offset, ERROR_ANSI);
+    printf("%s", text);
+    dust_free(text);
+}
+
+/**
+ * @brief Print an error in the current source and exit, or jump to
+ *        ERROR_TRAP if it is set
+ *
+ * @param type Type of the error
+ * @param message Error message
+ * @param offset Offset in source the error points at
+ */
+void raise(ErrorType type, u32char *message, size_t offset) {
+    if (ERROR_TRAP != NULL) error_jump(type, message, offset);
+
+    report(type, message, offset);
+    exit(1);
 }
 
 void raise_internal(u32char *message) {
+    if (ERROR_TRAP != NULL) error_jump(ErrorType_Internal, message, 0);
+
     switch (ERROR_ANSI) {
         case 1:
             printf("%sInternalError%s:%s %s",
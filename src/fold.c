@@ -0,0 +1,467 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+
+  fold.c  -  Constant folding
+  -------------------------------------------------
+  Collapses operators over literals into a single
+  literal node in place. Arithmetic follows the
+  declared type of the expression when there is one:
+
+    int8 .. int128, uint8 .. uint128  wrap at their width
+                                      after every operation
+    float32                           rounds after every operation
+    float64                           double precision
+
+  Without a declared type integers are int64 and an
+  overflowing operation is left unfolded. Comparisons
+  and logical operators fold into true / false. Anything
+  that would fail at runtime (division by zero, negative
+  integer exponent) is never folded.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <math.h>
+#include "dust/ustring.h"
+#include "dust/parser.h"
+#include "dust/fold.h"
+#include "dust/alloc.h"
+
+
+#ifdef __SIZEOF_INT128__
+typedef __int128 foldint;
+typedef unsigned __int128 ufoldint;
+#define FOLD_MAXBITS 128
+#else
+typedef long long foldint;
+typedef unsigned long long ufoldint;
+#define FOLD_MAXBITS 64
+#endif
+
+
+/**
+ * @param typed Whether a numeric type was declared
+ * @param floating Whether the declared type is a float type
+ * @param issigned Whether the declared integer type is signed
+ * @param bits Width of the declared type
+ */
+typedef struct {
+    bool typed;
+    bool floating;
+    bool issigned;
+    int bits;
+} FoldType;
+
+
+/**
+ * @brief Get folding semantics of a primitive type
+ *
+ * @param type Name of the type (NULL if unknown)
+ * @return Folding type
+ */
+FoldType fold_type(u32char *type) {
+    FoldType ftype = {false, false, true, 64};
+    if (type == NULL) return ftype;
+
+    ftype.typed = true;
+
+    if      (u32isequal(type, U"int8"))    ftype.bits = 8;
+    else if (u32isequal(type, U"int16"))   ftype.bits = 16;
+    else if (u32isequal(type, U"int32"))   ftype.bits = 32;
+    else if (u32isequal(type, U"int"))     ftype.bits = 32;
+    else if (u32isequal(type, U"int64"))   ftype.bits = 64;
+    else if (u32isequal(type, U"int128"))  ftype.bits = 128;
+    else if (u32isequal(type, U"uint8"))   {ftype.bits = 8;   ftype.issigned = false;}
+    else if (u32isequal(type, U"uint16"))  {ftype.bits = 16;  ftype.issigned = false;}
+    else if (u32isequal(type, U"uint32"))  {ftype.bits = 32;  ftype.issigned = false;}
+    else if (u32isequal(type, U"uint"))    {ftype.bits = 32;  ftype.issigned = false;}
+    else if (u32isequal(type, U"uint64"))  {ftype.bits = 64;  ftype.issigned = false;}
+    else if (u32isequal(type, U"uint128")) {ftype.bits = 128; ftype.issigned = false;}
+    else if (u32isequal(type, U"float32")) {ftype.bits = 32;  ftype.floating = true;}
+    else if (u32isequal(type, U"float"))   {ftype.bits = 32;  ftype.floating = true;}
+    else if (u32isequal(type, U"float64")) {ftype.bits = 64;  ftype.floating = true;}
+    else ftype.typed = false;
+
+    return ftype;
+}
+
+/**
+ * @brief Bring an integer into the range of the folding type
+ *
+ * @param ftype Folding type
+ * @param value Value (already wrapped modulo 2^FOLD_MAXBITS)
+ * @param result Wrapped value
+ * @return false if the value can't be represented
+ */
+bool fold_wrap(FoldType ftype, foldint value, foldint *result) {
+    if (!ftype.typed) {
+        if (value < LONG_MIN || value > LONG_MAX) return false;
+    }
+    else if (ftype.bits > FOLD_MAXBITS) {
+        return false;
+    }
+    else if (ftype.bits < FOLD_MAXBITS) {
+        ufoldint mask = ((ufoldint)1 << ftype.bits) - 1;
+        ufoldint uvalue = (ufoldint)value & mask;
+
+        if (ftype.issigned && (uvalue >> (ftype.bits - 1)))
+            value = (foldint)(uvalue | ~mask);
+        else
+            value = (foldint)uvalue;
+    }
+
+    *result = value;
+    return true;
+}
+
+/**
+ * @brief Fold an integer operation
+ *
+ * @param op Operator
+ * @param a Left-hand value
+ * @param b Right-hand value
+ * @param ftype Folding type
+ * @param result Result of the operation
+ * @return false if the operation can't be folded
+ */
+bool fold_intop(OpType op, foldint a, foldint b, FoldType ftype, foldint *result) {
+    ufoldint ua = (ufoldint)a;
+    ufoldint ub = (ufoldint)b;
+    bool untyped = !ftype.typed;
+    long l;
+
+    // Full width unsigned values don't fit in foldint's sign
+    bool fullunsigned = (ftype.typed && !ftype.issigned && ftype.bits == FOLD_MAXBITS);
+
+    switch (op) {
+        case OpType_ADD:
+            if (untyped && __builtin_add_overflow((long)a, (long)b, &l)) return false;
+            return fold_wrap(ftype, (foldint)(ua + ub), result);
+
+        case OpType_SUB:
+            if (untyped && __builtin_sub_overflow((long)a, (long)b, &l)) return false;
+            return fold_wrap(ftype, (foldint)(ua - ub), result);
+
+        case OpType_MUL:
+            if (untyped && __builtin_mul_overflow((long)a, (long)b, &l)) return false;
+            return fold_wrap(ftype, (foldint)(ua * ub), result);
+
+        case OpType_DIV:
+        case OpType_MOD:
+            if (b == 0) return false;
+            if (fullunsigned && (a < 0 || b < 0)) return false;
+            if (b == -1 && a == (foldint)((ufoldint)1 << (FOLD_MAXBITS - 1))) return false;
+            if (untyped && b == -1 && a == LONG_MIN) return false;
+
+            if (op == OpType_DIV) return fold_wrap(ftype, a / b, result);
+            else return fold_wrap(ftype, a % b, result);
+
+        case OpType_POW: {
+            if (b < 0) return false;
+
+            ufoldint base = ua;
+            ufoldint acc = 1;
+            long lbase = (long)a;
+            long lacc = 1;
+
+            while (b > 0) {
+                if (b & 1) {
+                    if (untyped && __builtin_mul_overflow(lacc, lbase, &lacc)) return false;
+                    acc *= base;
+                }
+                b >>= 1;
+                if (b > 0) {
+                    if (untyped && __builtin_mul_overflow(lbase, lbase, &lbase)) return false;
+                    base *= base;
+                }
+            }
+
+            return fold_wrap(ftype, (foldint)acc, result);
+        }
+
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Fold a comparison between two integers
+ *
+ * @param op Operator
+ * @param a Left-hand value
+ * @param b Right-hand value
+ * @param ftype Folding type
+ * @param result Result of the comparison
+ * @return false if the operator is not a comparison
+ */
+bool fold_intcmp(OpType op, foldint a, foldint b, FoldType ftype, bool *result) {
+    if (ftype.typed && !ftype.issigned && ftype.bits == FOLD_MAXBITS) {
+        ufoldint ua = (ufoldint)a;
+        ufoldint ub = (ufoldint)b;
+
+        switch (op) {
+            case OpType_EQ:  *result = (ua == ub); return true;
+            case OpType_NEQ: *result = (ua != ub); return true;
+            case OpType_LT:  *result = (ua <  ub); return true;
+            case OpType_LE:  *result = (ua <= ub); return true;
+            case OpType_GT:  *result = (ua >  ub); return true;
+            case OpType_GE:  *result = (ua >= ub); return true;
+            default: return false;
+        }
+    }
+
+    switch (op) {
+        case OpType_EQ:  *result = (a == b); return true;
+        case OpType_NEQ: *result = (a != b); return true;
+        case OpType_LT:  *result = (a <  b); return true;
+        case OpType_LE:  *result = (a <= b); return true;
+        case OpType_GT:  *result = (a >  b); return true;
+        case OpType_GE:  *result = (a >= b); return true;
+        default: return false;
+    }
+}
+
+/**
+ * @brief Fold a float operation or comparison
+ *
+ * @param op Operator
+ * @param a Left-hand value
+ * @param b Right-hand value
+ * @param ftype Folding type
+ * @param result Result of the operation
+ * @param cmp Result of the comparison
+ * @return 1 if result was set, 2 if cmp was set, 0 if not foldable
+ */
+int fold_floatop(OpType op, double a, double b, FoldType ftype, double *result, bool *cmp) {
+    double r;
+
+    switch (op) {
+        case OpType_ADD: r = a + b; break;
+        case OpType_SUB: r = a - b; break;
+        case OpType_MUL: r = a * b; break;
+        case OpType_DIV: if (b == 0.0) return 0; r = a / b; break;
+        case OpType_MOD: if (b == 0.0) return 0; r = fmod(a, b); break;
+        case OpType_POW: r = pow(a, b); break;
+        case OpType_EQ:  *cmp = (a == b); return 2;
+        case OpType_NEQ: *cmp = (a != b); return 2;
+        case OpType_LT:  *cmp = (a <  b); return 2;
+        case OpType_LE:  *cmp = (a <= b); return 2;
+        case OpType_GT:  *cmp = (a >  b); return 2;
+        case OpType_GE:  *cmp = (a >= b); return 2;
+        default: return 0;
+    }
+
+    if (ftype.typed && ftype.bits == 32) r = (double)(float)r;
+
+    *result = r;
+    return 1;
+}
+
+/**
+ * @brief Checks if node is a boolean literal
+ *
+ * @param node Node to check
+ * @param value Value of the literal
+ * @return (bool) result
+ */
+bool fold_isbool(Node *node, bool *value) {
+    if (node->type != NodeType_VAR) return false;
+
+    if (u32isequal(node->variable, U"true")) {
+        *value = true;
+        return true;
+    }
+    else if (u32isequal(node->variable, U"false")) {
+        *value = false;
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Replace node's content with a literal, releasing its old children
+ */
+void fold_replace_int(Node *node, foldint value) {
+    if (node->type == NodeType_BINOP) {
+        Node_free(node->bin_left);
+        Node_free(node->bin_right);
+    }
+    else Node_free(node->unary_right);
+
+    node->type = NodeType_INTEGER;
+    node->integer = (long)value;
+}
+
+void fold_replace_float(Node *node, double value) {
+    if (node->type == NodeType_BINOP) {
+        Node_free(node->bin_left);
+        Node_free(node->bin_right);
+    }
+    else Node_free(node->unary_right);
+
+    node->type = NodeType_FLOAT;
+    node->floating = value;
+}
+
+void fold_replace_bool(Node *node, bool value) {
+    if (node->type == NodeType_BINOP) {
+        Node_free(node->bin_left);
+        Node_free(node->bin_right);
+    }
+    else Node_free(node->unary_right);
+
+    node->type = NodeType_VAR;
+    node->variable = value ? U"true" : U"false";
+    node->var_depth = NODE_UNRESOLVED;
+    node->var_slot = NODE_UNRESOLVED;
+}
+
+/**
+ * @brief Fold a node array in place
+ */
+void fold_array(NodeArray *node_array, u32char *type) {
+    size_t i;
+    for (i = 0; i < node_array->used; i++)
+        fold_expr(&(node_array->array[i]), type);
+}
+
+/**
+ * @brief Fold literal subtrees of an expression in place
+ *
+ * @param node Expression node
+ * @param type Declared type of the expression (NULL if not known)
+ */
+void fold_expr(Node *node, u32char *type) {
+    FoldType ftype = fold_type(type);
+
+    switch (node->type) {
+        case NodeType_ARRAY:
+            fold_array(node->array_nodearray, type);
+            return;
+
+        case NodeType_CALL:
+            if (node->call_args) fold_array(node->call_args, NULL);
+            return;
+
+        case NodeType_SUBSCRIPT:
+            fold_expr(node->subs_node, type);
+            fold_expr(node->subs_expr, NULL);
+            return;
+
+        case NodeType_UNARYOP: {
+            Node *right = node->unary_right;
+            bool boolean;
+            foldint value;
+
+            fold_expr(right, type);
+
+            if (node->unary_optype == OpType_NOT) {
+                if (fold_isbool(right, &boolean)) fold_replace_bool(node, !boolean);
+            }
+
+            else if (right->type == NodeType_INTEGER && !(ftype.typed && ftype.floating)) {
+                if (node->unary_optype == OpType_ADD) {
+                    if (fold_wrap(ftype, right->integer, &value)) fold_replace_int(node, value);
+                }
+                else if (node->unary_optype == OpType_SUB) {
+                    if (!ftype.typed && right->integer == LONG_MIN) return;
+                    if (fold_wrap(ftype, (foldint)(-(ufoldint)right->integer), &value) &&
+                        value >= LONG_MIN && value <= LONG_MAX) fold_replace_int(node, value);
+                }
+            }
+
+            else if (right->type == NodeType_FLOAT || right->type == NodeType_INTEGER) {
+                double fvalue = (right->type == NodeType_FLOAT) ? right->floating : (double)right->integer;
+                if (ftype.typed && !ftype.floating) return;
+
+                if (node->unary_optype == OpType_SUB) fvalue = -fvalue;
+                else if (node->unary_optype != OpType_ADD) return;
+
+                if (ftype.typed && ftype.bits == 32) fvalue = (double)(float)fvalue;
+                fold_replace_float(node, fvalue);
+            }
+            return;
+        }
+
+        case NodeType_BINOP: {
+            Node *left = node->bin_left;
+            Node *right = node->bin_right;
+            OpType op = node->bin_optype;
+
+            // Comparisons and logical operators have boolean results,
+            // their operands are not of the declared type
+            bool comparison = (op == OpType_EQ || op == OpType_NEQ ||
+                               op == OpType_LT || op == OpType_LE ||
+                               op == OpType_GT || op == OpType_GE);
+            bool logical = (op == OpType_AND || op == OpType_OR || op == OpType_XOR);
+            u32char *operand_type = (comparison || logical) ? NULL : type;
+
+            fold_expr(left, operand_type);
+            fold_expr(right, operand_type);
+
+            if (op == OpType_RANGE || op == OpType_IN) return;
+            if (comparison || logical) ftype = fold_type(NULL);
+
+            bool lbool, rbool;
+            if (fold_isbool(left, &lbool) && fold_isbool(right, &rbool)) {
+                switch (op) {
+                    case OpType_AND: fold_replace_bool(node, lbool && rbool); break;
+                    case OpType_OR:  fold_replace_bool(node, lbool || rbool); break;
+                    case OpType_XOR: fold_replace_bool(node, lbool != rbool); break;
+                    case OpType_EQ:  fold_replace_bool(node, lbool == rbool); break;
+                    case OpType_NEQ: fold_replace_bool(node, lbool != rbool); break;
+                    default: break;
+                }
+                return;
+            }
+
+            if (left->type == NodeType_INTEGER && right->type == NodeType_INTEGER &&
+                !(ftype.typed && ftype.floating)) {
+
+                foldint a, b, value;
+                bool cmp;
+
+                if (!fold_wrap(ftype, left->integer, &a) ||
+                    !fold_wrap(ftype, right->integer, &b)) return;
+
+                if (comparison) {
+                    if (fold_intcmp(op, a, b, ftype, &cmp)) fold_replace_bool(node, cmp);
+                }
+                else if (fold_intop(op, a, b, ftype, &value)) {
+                    if (value >= LONG_MIN && value <= LONG_MAX) fold_replace_int(node, value);
+                }
+                return;
+            }
+
+            if ((left->type == NodeType_INTEGER || left->type == NodeType_FLOAT) &&
+                (right->type == NodeType_INTEGER || right->type == NodeType_FLOAT)) {
+
+                if (ftype.typed && !ftype.floating) return;
+
+                double a = (left->type == NodeType_FLOAT) ? left->floating : (double)left->integer;
+                double b = (right->type == NodeType_FLOAT) ? right->floating : (double)right->integer;
+                double value;
+                bool cmp;
+
+                switch (fold_floatop(op, a, b, ftype, &value, &cmp)) {
+                    case 1: fold_replace_float(node, value); break;
+                    case 2: fold_replace_bool(node, cmp); break;
+                }
+            }
+            return;
+        }
+
+        default:
+            return;
+    }
+}
@@ -0,0 +1,669 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+
+  incremental.c  -  Incremental reparsing
+  -------------------------------------------------
+  A document keeps the source code, the tokens of each
+  top-level statement and the syntax tree together. The
+  tokens and nodes of a statement are placed relative to
+  its first token, so the statements after an edit are
+  moved by changing their base offset alone. An edit
+  between the braces of a body reparses that body only,
+  other edits lex and parse the top-level statements
+  touching them again. Everything else is reused.
+  Statements are parsed from copies of their tokens, so
+  their bodies are never deferred.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dust/ustring.h"
+#include "dust/error.h"
+#include "dust/source.h"
+#include "dust/tokenizer.h"
+#include "dust/parser.h"
+#include "dust/incremental.h"
+#include "dust/allocator.h"
+#include "dust/alloc.h"
+
+
+/**
+ * @brief Raise the error for a token array with unbalanced braces
+ *
+ * @param tokens Token array to check
+ */
+void document_raise_unbalanced(TokenArray *tokens) {
+    int depth = 0;
+    size_t i;
+
+    for (i = 0; i < tokens->used; i++) {
+        Token *token = &(tokens->array[i]);
+
+        if (token->type == TokenType_LCURLY) depth++;
+        else if (token->type == TokenType_RCURLY) depth--;
+
+        if (depth < 0) {
+            raise(ErrorType_Syntax, U"Unexpected }", token->offset);
+        }
+    }
+
+    raise(ErrorType_Syntax, U"Expected }", tokens->array[tokens->used - 1].offset);
+}
+
+static void document_shift_array(NodeArray *node_array, size_t from, long delta);
+
+/**
+ * @brief Move the nodes at or after an offset by delta characters
+ *
+ * @param node Node to move, with everything under it
+ * @param from Offset nodes before which stay where they are
+ * @param delta Characters inserted (or removed, if negative) before them
+ */
+void document_shift(Node *node, size_t from, long delta) {
+    if (node == NULL) return;
+
+    if (node->offset >= from) node->offset += delta;
+
+    switch (node->type) {
+        case NodeType_ARRAY: document_shift_array(node->array_nodearray, from, delta); break;
+        case NodeType_DECL: document_shift(node->decl_type, from, delta); document_shift(node->decl_expr, from, delta); break;
+        case NodeType_DECLN: document_shift(node->decln_type, from, delta); break;
+        case NodeType_ASSIGN: document_shift(node->assign_expr, from, delta); break;
+        case NodeType_BINOP: document_shift(node->bin_left, from, delta); document_shift(node->bin_right, from, delta); break;
+        case NodeType_UNARYOP:
+        case NodeType_RUNARYOP: document_shift(node->unary_right, from, delta); break;
+        case NodeType_CHILD: document_shift(node->chld_parent, from, delta); document_shift(node->chld_child, from, delta); break;
+        case NodeType_SUBSCRIPT: document_shift(node->subs_node, from, delta); document_shift(node->subs_expr, from, delta); break;
+        case NodeType_CALL: document_shift(node->call_base, from, delta); document_shift_array(node->call_args, from, delta); break;
+        case NodeType_ENUM: document_shift(node->enum_body, from, delta); break;
+        case NodeType_GENTYPE: document_shift_array(node->gentype, from, delta); break;
+        case NodeType_IF: document_shift(node->if_expr, from, delta); document_shift(node->if_body, from, delta); break;
+        case NodeType_ELIF: document_shift(node->elif_expr, from, delta); document_shift(node->elif_body, from, delta); break;
+        case NodeType_ELSE: document_shift(node->else_body, from, delta); break;
+        case NodeType_REPEAT: document_shift(node->repeat_expr, from, delta); document_shift(node->repeat_body, from, delta); break;
+        case NodeType_WHILE: document_shift(node->while_expr, from, delta); document_shift(node->while_body, from, delta); break;
+        case NodeType_FOR:
+            document_shift(node->for_var, from, delta);
+            document_shift(node->for_expr, from, delta);
+            document_shift(node->for_body, from, delta);
+            break;
+
+        case NodeType_CONVERT: document_shift(node->conv_expr, from, delta); break;
+
+        case NodeType_BODY: document_shift_array(node->body, from, delta); break;
+
+        default: break;
+    }
+}
+
+static void document_shift_array(NodeArray *node_array, size_t from, long delta) {
+    if (node_array == NULL) return;
+
+    for (size_t i = 0; i < node_array->used; i++) document_shift(&(node_array->array[i]), from, delta);
+}
+
+static void document_free_node(Node *node);
+
+static void document_free_array(NodeArray *node_array);
+
+/**
+ * @brief Release everything under a replaced node, the node itself
+ *        belongs to what holds it
+ *
+ * @param node Node to empty
+ */
+void document_free_contents(Node *node) {
+    switch (node->type) {
+        case NodeType_STRING: dust_free(node->string); break;
+        case NodeType_ARRAY: document_free_array(node->array_nodearray); break;
+        case NodeType_DECL: document_free_node(node->decl_type); document_free_node(node->decl_expr); break;
+        case NodeType_DECLN: document_free_node(node->decln_type); break;
+        case NodeType_ASSIGN: document_free_node(node->assign_expr); break;
+        case NodeType_BINOP: document_free_node(node->bin_left); document_free_node(node->bin_right); break;
+        case NodeType_UNARYOP:
+        case NodeType_RUNARYOP: document_free_node(node->unary_right); break;
+        case NodeType_CHILD: document_free_node(node->chld_parent); document_free_node(node->chld_child); break;
+        case NodeType_SUBSCRIPT: document_free_node(node->subs_node); document_free_node(node->subs_expr); break;
+        case NodeType_CALL: document_free_node(node->call_base); document_free_array(node->call_args); break;
+        case NodeType_ENUM: document_free_node(node->enum_body); break;
+        case NodeType_GENTYPE: document_free_array(node->gentype); break;
+        case NodeType_IF: document_free_node(node->if_expr); document_free_node(node->if_body); break;
+        case NodeType_ELIF: document_free_node(node->elif_expr); document_free_node(node->elif_body); break;
+        case NodeType_ELSE: document_free_node(node->else_body); break;
+        case NodeType_REPEAT: document_free_node(node->repeat_expr); document_free_node(node->repeat_body); break;
+        case NodeType_WHILE: document_free_node(node->while_expr); document_free_node(node->while_body); break;
+        case NodeType_FOR:
+            document_free_node(node->for_var);
+            document_free_node(node->for_expr);
+            document_free_node(node->for_body);
+            break;
+
+        case NodeType_CONVERT: document_free_node(node->conv_expr); break;
+
+        case NodeType_BODY: document_free_array(node->body); break;
+
+        default: break;
+    }
+}
+
+static void document_free_node(Node *node) {
+    if (node == NULL) return;
+
+    document_free_contents(node);
+    Node_release(node);
+}
+
+static void document_free_array(NodeArray *node_array) {
+    if (node_array == NULL) return;
+
+    for (size_t i = 0; i < node_array->used; i++) document_free_contents(&(node_array->array[i]));
+    NodeArray_free(node_array);
+}
+
+/**
+ * @brief Parse a top-level statement and place its tokens and nodes
+ *        relative to its first token
+ *
+ * @param tokens Token array the statement is in, offsets are in source
+ * @param start Index of the statement's first token
+ * @param end Index after the statement's last token
+ * @param statement Statement to fill
+ * @param nodes Node array to append the statement's node to
+ */
+void document_parse(TokenArray *tokens, size_t start, size_t end, DocumentStatement *statement, NodeArray *nodes) {
+    // Offsets are still in source while parsing, so errors point right
+    Node *node = parse_statement(tokens, start, end);
+    size_t base = tokens->array[start].offset;
+    size_t i;
+
+    statement->base = base;
+    statement->tokens = TokenArray_subslice(tokens, start, end);
+    for (i = 0; i < statement->tokens->used; i++) statement->tokens->array[i].offset -= base;
+
+    document_shift(node, 0, -(long)base);
+    NodeArray_append(nodes, node);
+    Node_release(node);
+}
+
+/**
+ * @brief Release the statements and the tree of the document
+ *
+ * @param document Document to clear
+ */
+void document_clear(Document *document) {
+    if (document->tree == NULL) return;
+
+    for (size_t i = 0; i < document->count; i++) TokenArray_free(document->statements[i].tokens);
+    dust_free(document->statements);
+
+    document_free_array(document->tree->body);
+    Node_release(document->tree);
+}
+
+/**
+ * @brief Tokenize and parse the whole document from scratch
+ *
+ * @param document Document to build
+ */
+void document_build(Document *document) {
+    TokenArray *tokens = tokenize(document->source);
+    size_t count;
+    size_t *bounds = split_statements(tokens, &count);
+
+    if (bounds == NULL) document_raise_unbalanced(tokens);
+
+    DocumentStatement *statements = (DocumentStatement *)dust_malloc(sizeof(DocumentStatement) * (count + 1));
+    NodeArray *node_array = NodeArray_new(count + 1);
+    size_t i;
+
+    for (i = 0; i < count; i++) document_parse(tokens, bounds[i], bounds[i+1], &(statements[i]), node_array);
+
+    TokenArray_free(tokens);
+    dust_free(bounds);
+    document_clear(document);
+
+    document->statements = statements;
+    document->count = count;
+    document->moved = 0;
+    document->delta = 0;
+    document->tree = NodeBody_new(node_array, 0);
+}
+
+/**
+ * @brief Create a new document
+ *
+ * @param source Source code (copied)
+ * @return Document's pointer
+ */
+Document *Document_new(u32char *source) {
+    Document *document = (Document *)dust_malloc(sizeof(Document));
+
+    document->length = u32len(source);
+    document->source = (u32char *)dust_malloc(sizeof(u32char) * (document->length + 1));
+    memcpy(document->source, source, sizeof(u32char) * (document->length + 1));
+
+    document->statements = NULL;
+    document->count = 0;
+    document->moved = 0;
+    document->delta = 0;
+    document->tree = NULL;
+
+    document_build(document);
+
+    return document;
+}
+
+/**
+ * @brief Release all resources used by the document
+ *
+ * @param document Document to free
+ */
+void Document_free(Document *document) {
+    if (CURRENT_SOURCE != NULL && CURRENT_SOURCE->raw == document->source) Source_free(CURRENT_SOURCE);
+    document_clear(document);
+    dust_free(document->source);
+    dust_free(document);
+}
+
+/**
+ * @brief Offset in source the tokens and nodes of a statement are
+ *        relative to
+ *
+ * @param document Document
+ * @param n Index of the statement
+ * @return Offset
+ */
+size_t Document_offset(Document *document, size_t n) {
+    return document->statements[n].base + (n >= document->moved ? document->delta : 0);
+}
+
+/**
+ * @brief Move the statements from an index on by delta characters
+ *
+ * The move is kept pending for every statement after the index, only
+ * the bases between it and the previously pending move are written.
+ * Successive edits close to each other stay cheap on long documents.
+ *
+ * @param document Document
+ * @param from Index of the first statement to move
+ * @param delta Characters inserted (or removed, if negative) before it
+ */
+void document_move(Document *document, size_t from, long delta) {
+    DocumentStatement *statements = document->statements;
+    size_t i;
+
+    if (from <= document->moved) {
+        for (i = from; i < document->moved; i++) statements[i].base += delta;
+    }
+    else {
+        for (i = document->moved; i < from; i++) statements[i].base += document->delta;
+        document->moved = from;
+    }
+
+    document->delta += delta;
+}
+
+/**
+ * @brief Offset in source where the statement's span starts
+ *        (a span also covers whitespaces and comments after the statement)
+ *
+ * @param document Document
+ * @param n Index of the statement
+ * @return Offset
+ */
+size_t document_span(Document *document, size_t n) {
+    if (n == 0) return 0;
+    if (n >= document->count) return document->length;
+    return Document_offset(document, n);
+}
+
+/**
+ * @brief Find the statement whose span contains the offset
+ *
+ * @param document Document
+ * @param offset Offset in source
+ * @return Index of the statement
+ */
+size_t document_find(Document *document, size_t offset) {
+    size_t lo = 0;
+    size_t hi = document->count - 1;
+
+    while (lo < hi) {
+        size_t mid = (lo + hi + 1) / 2;
+        if (document_span(document, mid) <= offset) lo = mid;
+        else hi = mid - 1;
+    }
+
+    return lo;
+}
+
+/**
+ * @brief Check if a part of source doesn't end inside a string or comment
+ *
+ * @param raw Source code
+ * @param start Start of the part
+ * @param end End of the part
+ * @return (bool) result
+ */
+bool document_is_closed(u32char *raw, size_t start, size_t end) {
+    size_t i = start;
+
+    while (i < end) {
+        if (raw[i] == U'"' || raw[i] == U'\'') {
+            u32char quote = raw[i++];
+            while (i < end && raw[i] != quote) i++;
+            if (i >= end) return false;
+        }
+
+        else if (raw[i] == U'/' && i+1 < end && raw[i+1] == U'/') {
+            while (i < end && raw[i] != U'\n') i++;
+            if (i >= end) return false;
+        }
+
+        else if (raw[i] == U'/' && i+1 < end && raw[i+1] == U'*') {
+            i += 2;
+            while (i+1 < end && !(raw[i] == U'*' && raw[i+1] == U'/')) i++;
+            if (i+1 >= end) return false;
+            i++;
+        }
+
+        i++;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Find the body opening at an offset under a statement
+ *
+ * @param node Node to search under
+ * @param offset Offset of the body's opening brace
+ * @return Body's node (NULL if it's not found)
+ */
+Node *document_find_body(Node *node, size_t offset) {
+    Node *body;
+
+    switch (node->type) {
+        case NodeType_BODY: body = node; break;
+        case NodeType_ENUM: body = node->enum_body; break;
+        case NodeType_IF: body = node->if_body; break;
+        case NodeType_ELIF: body = node->elif_body; break;
+        case NodeType_ELSE: body = node->else_body; break;
+        case NodeType_REPEAT: body = node->repeat_body; break;
+        case NodeType_WHILE: body = node->while_body; break;
+        case NodeType_FOR: body = node->for_body; break;
+        default: return NULL;
+    }
+
+    if (body == NULL || body->offset > offset) return NULL;
+    if (body->offset == offset) return body;
+
+    for (size_t i = 0; i < body->body->used; i++) {
+        Node *found = document_find_body(&(body->body->array[i]), offset);
+        if (found != NULL) return found;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Reparse only the innermost body around an edit that stays
+ *        between its braces
+ *
+ * @param document Document, its source is already edited
+ * @param n Index of the statement the edit is in
+ * @param offset Offset of the edit in source
+ * @param deleted Number of characters removed at offset
+ * @param delta Characters inserted minus characters removed
+ * @return false if the edit is not inside a body or leaves it unclosed,
+ *         the statement has to be reparsed whole then
+ */
+bool document_edit_body(Document *document, size_t n, size_t offset, size_t deleted, long delta) {
+    TokenArray *tokens = document->statements[n].tokens;
+    size_t base = Document_offset(document, n);
+    size_t open = tokens->used;
+    size_t end = tokens->used;
+    size_t i = 0;
+
+    if (offset <= base) return false;
+
+    size_t from = offset - base;
+    size_t to = from + deleted;
+
+    /* Descend into the bodies around the edit, skip the others whole */
+    while (i < end && tokens->array[i].offset < to) {
+        Token *token = &(tokens->array[i]);
+
+        if (token->type == TokenType_LCURLY && token->match > 0) {
+            if (token->offset < from && to <= tokens->array[i + token->match].offset) {
+                open = i;
+                end = i + token->match;
+            }
+            else {
+                i += token->match + 1;
+                continue;
+            }
+        }
+
+        i++;
+    }
+
+    if (open == tokens->used) return false;
+
+    Node *statement = &(document->tree->body->array[n]);
+    Node *body = document_find_body(statement, tokens->array[open].offset);
+    size_t close = open + tokens->array[open].match;
+    size_t closeat = tokens->array[close].offset;
+    size_t start = base + tokens->array[open].offset;
+    size_t stop = base + closeat + delta + 1;
+
+    if (body == NULL || !document_is_closed(document->source, start + 1, stop - 1)) return false;
+
+    u32char *text = (u32char *)dust_malloc(sizeof(u32char) * (stop - start + 1));
+    memcpy(text, document->source + start, sizeof(u32char) * (stop - start));
+    text[stop - start] = U'\0';
+
+    TokenArray *part = tokenize_part(text, start, NULL);
+    dust_free(text);
+
+    // The braces have to still pair up with each other
+    if (part->array[0].match != (int)part->used - 1) {
+        TokenArray_free(part);
+        return false;
+    }
+
+    // Parsed like the body was in place, with its braces
+    Node *parsed = parse_block(part, 0);
+
+    /* Nodes after the body move, the ones in it are replaced */
+    document_shift(statement, closeat, delta);
+    document_free_contents(body);
+    document_shift(parsed, 0, -(long)base);
+    body->body = parsed->body;
+    body->body_tokens = parsed->body_tokens;
+    Node_release(parsed);
+
+    /* Tokens of the body are replaced, the ones after it move */
+    long tdelta = (long)part->used - (long)(close - open + 1);
+
+    if (tokens->used + tdelta > tokens->size) {
+        while (tokens->used + tdelta > tokens->size) tokens->size *= 2;
+        tokens->array = dust_realloc(tokens->array, tokens->size * sizeof(Token));
+    }
+
+    memmove(tokens->array + close + 1 + tdelta, tokens->array + close + 1, (tokens->used - close - 1) * sizeof(Token));
+    for (i = 0; i < part->used; i++) {
+        tokens->array[open + i] = part->array[i];
+        tokens->array[open + i].offset -= base;
+    }
+    tokens->used += tdelta;
+
+    for (i = close + 1 + tdelta; i < tokens->used; i++) tokens->array[i].offset += delta;
+    tokenize_match(tokens);
+
+    TokenArray_free(part);
+    document_move(document, n + 1, delta);
+    return true;
+}
+
+/**
+ * @brief Apply a text edit on the document and reparse only the
+ *        innermost body or the top-level statements touching it
+ *
+ * Untouched statement nodes are kept as they are. If the edit
+ * breaks the statement structure around it (an unclosed string,
+ * comment or body), the reparsed part grows until it is whole again.
+ * Replaced tokens and nodes are freed.
+ *
+ * @param document Document to edit
+ * @param offset Offset of the edit in source
+ * @param deleted Number of characters removed at offset
+ * @param inserted String inserted at offset
+ */
+void Document_edit(Document *document, size_t offset, size_t deleted, u32char *inserted) {
+    size_t inslen = u32len(inserted);
+
+    if (offset > document->length) offset = document->length;
+    if (offset + deleted > document->length) deleted = document->length - offset;
+
+    long delta = (long)inslen - (long)deleted;
+
+    /* Affected statements are found on the old source */
+    size_t first = 0;
+    size_t last = 0;
+
+    if (document->count > 0) {
+        first = document_find(document, offset);
+        if (first > 0 && document_span(document, first) == offset) first--;
+        last = document_find(document, offset + deleted);
+    }
+
+    /* Apply the edit on source */
+    size_t tailstart = offset + deleted;
+    size_t taillen = document->length - tailstart;
+
+    if (delta > 0) {
+        document->source = dust_realloc(document->source, sizeof(u32char) * (document->length + delta + 1));
+    }
+    u32char *source = document->source;
+    memmove(source + offset + inslen, source + tailstart, sizeof(u32char) * (taillen + 1));
+    memcpy(source + offset, inserted, sizeof(u32char) * inslen);
+    document->length += delta;
+
+    // Source may have moved, its line breaks are indexed again when needed
+    source_use(Source_new(U"<stdin>", source, document->length));
+
+    if (document->count == 0) {
+        document_build(document);
+        return;
+    }
+
+    if (first == last && document_edit_body(document, first, offset, deleted, delta)) return;
+
+    size_t start = document_span(document, first);
+    size_t end;
+    TokenArray *part;
+    size_t *bounds;
+    size_t count;
+    bool atend;
+
+    /* Lex the affected part until it consists of whole statements */
+    while (1) {
+        atend = (last + 1 >= document->count);
+        end = atend ? document->length : document_span(document, last + 1) + delta;
+
+        if (!atend && !document_is_closed(source, start, end)) {
+            last++;
+            continue;
+        }
+
+        u32char *text = (u32char *)dust_malloc(sizeof(u32char) * (end - start + 1));
+        memcpy(text, source + start, sizeof(u32char) * (end - start));
+        text[end - start] = U'\0';
+
+        part = tokenize_part(text, start, NULL);
+        dust_free(text);
+
+        if (atend) tokenize_end(part);
+
+        bounds = split_statements(part, &count);
+        if (bounds != NULL) break;
+
+        TokenArray_free(part);
+
+        if (atend) {
+            document_build(document);
+            return;
+        }
+
+        last++;
+    }
+
+    /* Parse the new statements */
+    DocumentStatement *added = (DocumentStatement *)dust_malloc(sizeof(DocumentStatement) * (count + 1));
+    NodeArray *nodes = NodeArray_new(count + 1);
+    size_t i;
+
+    for (i = 0; i < count; i++) document_parse(part, bounds[i], bounds[i+1], &(added[i]), nodes);
+
+    /* Free the replaced statements */
+    DocumentStatement *statements = document->statements;
+    NodeArray *body = document->tree->body;
+
+    for (i = first; i <= last; i++) {
+        TokenArray_free(statements[i].tokens);
+        document_free_contents(&(body->array[i]));
+    }
+
+    /* A pending move doesn't start inside the replaced statements */
+    if (document->moved > first && document->moved <= last) {
+        for (i = document->moved; i <= last; i++) statements[i].base += document->delta;
+        document->moved = last + 1;
+    }
+
+    long pending = document->moved <= first ? document->delta : 0;
+    long sdelta = (long)count - (long)(last - first + 1);
+
+    /* Replace the old statements */
+    if (sdelta > 0) {
+        statements = dust_realloc(statements, sizeof(DocumentStatement) * (document->count + sdelta + 1));
+        document->statements = statements;
+    }
+
+    memmove(statements + last + 1 + sdelta, statements + last + 1,
+            sizeof(DocumentStatement) * (document->count - last - 1));
+    for (i = 0; i < count; i++) {
+        statements[first + i] = added[i];
+        statements[first + i].base -= pending;
+    }
+
+    if (document->moved > last) document->moved += sdelta;
+
+    /* Replace the old statement nodes */
+    size_t ntail = body->used - (last + 1);
+
+    if (body->used + sdelta > body->size) {
+        while (body->used + sdelta > body->size) body->size *= 2;
+        body->array = dust_realloc(body->array, body->size * sizeof(Node));
+    }
+
+    memmove(body->array + last + 1 + sdelta, body->array + last + 1, ntail * sizeof(Node));
+    memcpy(body->array + first, nodes->array, count * sizeof(Node));
+    body->used += sdelta;
+
+    document->count += sdelta;
+    document_move(document, first + count, delta);
+
+    NodeArray_free(nodes);
+    TokenArray_free(part);
+    dust_free(added);
+    dust_free(bounds);
+}
@@ -10,19 +10,269 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
 #include "dust/ustring.h"
 #include "dust/platform.h"
+#include "dust/io.h"
 
 #if OS == OS_WINDOWS
 #include <windows.h>
+#include <io.h>
 
-#elif OS == OS_LINUX
+#else
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #endif
 
+#include "dust/allocator.h"
+#include "dust/alloc.h"
+
+
+// Write every byte of the buffers, a write may take only a part of them
+static bool writer_writev(int fd, char *first, size_t first_size, char *second, size_t second_size) {
+    #if OS == OS_WINDOWS
+
+    char *data[2] = {first, second};
+    size_t sizes[2] = {first_size, second_size};
+
+    for (int i = 0; i < 2; i++) {
+        while (sizes[i] > 0) {
+            int written = _write(fd, data[i], sizes[i] > 0x40000000 ? 0x40000000 : (unsigned int)sizes[i]);
+            if (written <= 0) return false;
+            data[i] += written;
+            sizes[i] -= written;
+        }
+    }
+
+    return true;
+
+    #else
+
+    struct iovec parts[2] = {{first, first_size}, {second, second_size}};
+    struct iovec *part = parts;
+    int count = 2;
+
+    while (count > 0) {
+        if (part->iov_len == 0) {
+            part++;
+            count--;
+            continue;
+        }
+
+        ssize_t written = writev(fd, part, count);
+
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+
+        while (count > 0 && (size_t)written >= part->iov_len) {
+            written -= part->iov_len;
+            part++;
+            count--;
+        }
+
+        if (count > 0) {
+            part->iov_base = (char *)part->iov_base + written;
+            part->iov_len -= written;
+        }
+    }
+
+    return true;
+
+    #endif
+}
+
+/**
+ * @brief Open a writer
+ *
+ * Output to a file goes to a temporary file next to it first, which
+ * replaces the file when the writer is closed.
+ *
+ * @param path Path of the file (NULL for stdout)
+ * @return Writer's pointer (NULL if the file couldn't be created)
+ */
+Writer *Writer_open(char *path) {
+    int fd;
+    char *temp = NULL;
+
+    if (path == NULL) {
+        // Whatever was printed before comes first
+        fflush(stdout);
+        fd = 1;
+    }
+
+    else {
+        temp = (char *)dust_malloc(strlen(path) + 8);
+        strcpy(temp, path);
+
+        #if OS == OS_WINDOWS
+
+        strcat(temp, ".tmp");
+        fd = _open(temp, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+
+        #else
+
+        strcat(temp, ".XXXXXX");
+        fd = mkstemp(temp);
+
+        // mkstemp makes the file private, it gets the permissions a new file would
+        if (fd >= 0) {
+            mode_t mask = umask(0);
+            umask(mask);
+            fchmod(fd, 0666 & ~mask);
+        }
+
+        #endif
+
+        if (fd < 0) {
+            dust_free(temp);
+            return NULL;
+        }
+    }
+
+    Writer *writer = (Writer *)dust_malloc(sizeof(Writer));
+
+    writer->fd = fd;
+    writer->path = path;
+    writer->temp = temp;
+    writer->buffer = (char *)dust_malloc(WRITER_BUFFER_SIZE);
+    writer->used = 0;
+    writer->failed = false;
+
+    return writer;
+}
+
+/**
+ * @brief Write out everything buffered and free the writer
+ *
+ * @param writer Writer to close
+ * @return false if any write failed, the file is left as it was then
+ */
+bool Writer_close(Writer *writer) {
+    bool written = Writer_flush(writer);
+
+    if (writer->path != NULL) {
+        #if OS == OS_WINDOWS
+
+        written = _close(writer->fd) == 0 && written;
+        written = written && MoveFileExA(writer->temp, writer->path, MOVEFILE_REPLACE_EXISTING);
+
+        #else
+
+        written = close(writer->fd) == 0 && written;
+        written = written && rename(writer->temp, writer->path) == 0;
+
+        #endif
+
+        if (!written) remove(writer->temp);
+        dust_free(writer->temp);
+    }
+
+    dust_free(writer->buffer);
+    dust_free(writer);
+    return written;
+}
+
+/**
+ * @brief Write the buffered bytes out
+ *
+ * @param writer Writer
+ * @return false if any write failed
+ */
+bool Writer_flush(Writer *writer) {
+    if (writer->used > 0 && !writer->failed)
+        writer->failed = !writer_writev(writer->fd, writer->buffer, writer->used, NULL, 0);
+
+    writer->used = 0;
+    return !writer->failed;
+}
+
+/**
+ * @brief Write bytes
+ *
+ * @param writer Writer
+ * @param data Bytes to write
+ * @param size Number of bytes
+ */
+void Writer_write(Writer *writer, char *data, size_t size) {
+    if (writer->used + size <= WRITER_BUFFER_SIZE) {
+        memcpy(writer->buffer + writer->used, data, size);
+        writer->used += size;
+        return;
+    }
+
+    // Large writes go out with the buffer without being copied into it
+    if (size >= WRITER_BUFFER_SIZE) {
+        if (!writer->failed)
+            writer->failed = !writer_writev(writer->fd, writer->buffer, writer->used, data, size);
+
+        writer->used = 0;
+        return;
+    }
+
+    Writer_flush(writer);
+    memcpy(writer->buffer, data, size);
+    writer->used = size;
+}
+
+/**
+ * @brief Write the first n characters of a string encoded in UTF-8
+ *
+ * @param writer Writer
+ * @param string String to write
+ * @param n Number of characters
+ */
+void Writer_write_u32n(Writer *writer, u32char *string, size_t n) {
+    unsigned char *out = (unsigned char *)writer->buffer + writer->used;
+    unsigned char *end = (unsigned char *)writer->buffer + WRITER_BUFFER_SIZE - 4;
+
+    for (size_t i = 0; i < n; i++) {
+        u32char c = string[i];
+
+        if (out > end) {
+            writer->used = (char *)out - writer->buffer;
+            Writer_flush(writer);
+            out = (unsigned char *)writer->buffer;
+        }
+
+        if (c < 0x80) {
+            *out++ = c;
+        }
+        else if (c < 0x800) {
+            *out++ = 0xC0 | c >> 6;
+            *out++ = 0x80 | (c & 0x3F);
+        }
+        else if (c < 0x10000) {
+            *out++ = 0xE0 | c >> 12;
+            *out++ = 0x80 | (c >> 6 & 0x3F);
+            *out++ = 0x80 | (c & 0x3F);
+        }
+        else {
+            *out++ = 0xF0 | c >> 18;
+            *out++ = 0x80 | (c >> 12 & 0x3F);
+            *out++ = 0x80 | (c >> 6 & 0x3F);
+            *out++ = 0x80 | (c & 0x3F);
+        }
+    }
+
+    writer->used = (char *)out - writer->buffer;
+}
+
+/**
+ * @brief Write a string encoded in UTF-8
+ *
+ * @param writer Writer
+ * @param string String to write
+ */
+void Writer_write_u32(Writer *writer, u32char *string) {
+    Writer_write_u32n(writer, string, u32len(string));
+}
 
 /**
  * @brief Read file into multibyte UTF-8 encoded string
@@ -36,7 +286,7 @@ char *read_file(char *path) {
     long fsize = ftell(f);
     fseek(f, 0, SEEK_SET);
 
-    char *string = (char *)malloc(fsize + 1);
+    char *string = (char *)dust_malloc(fsize + 1);
     fread(string, 1, fsize, f);
     fclose(f);
 
@@ -46,12 +296,19 @@ char *read_file(char *path) {
 }
 
 /**
- * @brief Write string on file
+ * @brief Write string on file, the file is replaced at once so readers
+ *        never see it half written
  * 
  * @param path Path to file
+ * @param content String to write
+ * @return false if the file couldn't be written
  */
-void write_file(char *path, char *content) {
+bool write_file(char *path, char *content) {
+    Writer *writer = Writer_open(path);
+    if (writer == NULL) return false;
 
+    Writer_write(writer, content, strlen(content));
+    return Writer_close(writer);
 }
 
 /**
@@ -91,7 +348,7 @@ int create_dir(char *path) {
     else return 0;
 
 
-    #elif OS == OS_LINUX
+    #else
 
     if (!mkdir(path, 0777)) return 1;
     else return 0;
@@ -112,7 +369,7 @@ int remove_dir(char *path) {
     else return 0;
 
 
-    #elif OS == OS_LINUX
+    #else
 
     if (!rmdir(path)) return 1;
     else return 0;
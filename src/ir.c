@@ -0,0 +1,985 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+
+  ir.c  -  Intermediate representation
+  -------------------------------------------------
+  A program between the typed tree and the backends, in
+  SSA form: every value is defined by exactly one
+  instruction, before all of its uses, and values that
+  depend on the path taken are merged by phis at the top
+  of a block. Instructions are typed with the types of
+  typecheck.h, arrays are only read and written through
+  loads and stores. Passes change the program through
+  the functions here, then compact it to renumber what
+  is left and verify it. See lower.c for how a tree is
+  turned into it.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include "dust/ustring.h"
+#include "dust/typecheck.h"
+#include "dust/ir.h"
+#include "dust/allocator.h"
+#include "dust/alloc.h"
+
+
+/**
+ * @brief Create a new empty program
+ *
+ * @return IrProgram*
+ */
+IrProgram *IrProgram_new() {
+    IrProgram *program = (IrProgram *)dust_malloc(sizeof(IrProgram));
+
+    program->value_size = 64;
+    program->value_count = 0;
+    program->values = (IrInstr *)dust_malloc(sizeof(IrInstr) * program->value_size);
+
+    program->block_size = 16;
+    program->block_count = 0;
+    program->blocks = (IrBlock *)dust_malloc(sizeof(IrBlock) * program->block_size);
+
+    program->error_size = 8;
+    program->error_count = 0;
+    program->errors = (IrError *)dust_malloc(sizeof(IrError) * program->error_size);
+
+    return program;
+}
+
+static void ir_clear_errors(IrProgram *program) {
+    for (int i = 0; i < program->error_count; i++)
+        dust_free(program->errors[i].message);
+
+    program->error_count = 0;
+}
+
+/**
+ * @brief Free program
+ *
+ * Names and string constants point into the tree the program was
+ * lowered from, which must outlive it.
+ *
+ * @param program Program to free
+ */
+void IrProgram_free(IrProgram *program) {
+    for (int i = 0; i < program->value_count; i++) dust_free(program->values[i].args);
+
+    for (int i = 0; i < program->block_count; i++) {
+        dust_free(program->blocks[i].instrs);
+        dust_free(program->blocks[i].preds);
+    }
+
+    ir_clear_errors(program);
+    dust_free(program->values);
+    dust_free(program->blocks);
+    dust_free(program->errors);
+    dust_free(program);
+}
+
+/**
+ * @brief Add an empty block
+ *
+ * @param program Program
+ * @return Index of the block
+ */
+int IrProgram_block(IrProgram *program) {
+    if (program->block_count == program->block_size) {
+        program->block_size *= 2;
+        program->blocks = (IrBlock *)dust_realloc(program->blocks, sizeof(IrBlock) * program->block_size);
+    }
+
+    IrBlock *block = &program->blocks[program->block_count];
+    block->instr_size = 8;
+    block->instr_count = 0;
+    block->instrs = (int *)dust_malloc(sizeof(int) * block->instr_size);
+    block->pred_size = 2;
+    block->pred_count = 0;
+    block->preds = (int *)dust_malloc(sizeof(int) * block->pred_size);
+
+    return program->block_count++;
+}
+
+// New instruction that isn't in a block yet
+static int ir_value(IrProgram *program, int block, IrOp op, TypeId type, size_t offset) {
+    if (program->value_count == program->value_size) {
+        program->value_size *= 2;
+        program->values = (IrInstr *)dust_realloc(program->values, sizeof(IrInstr) * program->value_size);
+    }
+
+    IrInstr *instr = &program->values[program->value_count];
+    instr->op = op;
+    instr->type = type;
+    instr->block = block;
+    instr->offset = offset;
+    instr->args = NULL;
+    instr->arg_count = 0;
+    instr->arg_size = 0;
+    instr->targets[0] = IR_NONE;
+    instr->targets[1] = IR_NONE;
+    instr->integer = 0;
+
+    return program->value_count++;
+}
+
+static void ir_insert(IrProgram *program, int block, int index, int value) {
+    IrBlock *b = &program->blocks[block];
+
+    if (b->instr_count == b->instr_size) {
+        b->instr_size *= 2;
+        b->instrs = (int *)dust_realloc(b->instrs, sizeof(int) * b->instr_size);
+    }
+
+    memmove(&b->instrs[index + 1], &b->instrs[index], sizeof(int) * (b->instr_count - index));
+    b->instrs[index] = value;
+    b->instr_count++;
+}
+
+static void ir_pred(IrProgram *program, int block, int pred) {
+    IrBlock *b = &program->blocks[block];
+
+    if (b->pred_count == b->pred_size) {
+        b->pred_size *= 2;
+        b->preds = (int *)dust_realloc(b->preds, sizeof(int) * b->pred_size);
+    }
+
+    b->preds[b->pred_count++] = pred;
+}
+
+/**
+ * @brief Add an instruction at a place in a block
+ *
+ * @param program Program
+ * @param block Block to add to
+ * @param index Place in the block, instructions from there on move down
+ * @param op Operation
+ * @param type Type of the value it defines (Type_NONE if it defines none)
+ * @param offset Offset in source it was lowered from
+ * @return Index of the instruction's value
+ */
+int IrProgram_insert(IrProgram *program, int block, int index, IrOp op, TypeId type, size_t offset) {
+    int value = ir_value(program, block, op, type, offset);
+    ir_insert(program, block, index, value);
+    return value;
+}
+
+/**
+ * @brief Add an instruction at the end of a block, see IrProgram_insert
+ */
+int IrProgram_add(IrProgram *program, int block, IrOp op, TypeId type, size_t offset) {
+    return IrProgram_insert(program, block, program->blocks[block].instr_count, op, type, offset);
+}
+
+/**
+ * @brief Add a phi without operands after the phis of a block
+ *
+ * @param program Program
+ * @param block Block to add to
+ * @param type Type of the phi
+ * @param offset Offset in source it was lowered from
+ * @return Index of the phi's value
+ */
+int IrProgram_add_phi(IrProgram *program, int block, TypeId type, size_t offset) {
+    IrBlock *b = &program->blocks[block];
+    int index = 0;
+
+    while (index < b->instr_count && program->values[b->instrs[index]].op == IrOp_PHI) index++;
+
+    return IrProgram_insert(program, block, index, IrOp_PHI, type, offset);
+}
+
+/**
+ * @brief Add an operand to an instruction
+ *
+ * @param program Program
+ * @param value Instruction
+ * @param arg Value used as its next operand
+ */
+void IrProgram_arg(IrProgram *program, int value, int arg) {
+    IrInstr *instr = &program->values[value];
+
+    if (instr->arg_count == instr->arg_size) {
+        instr->arg_size = instr->arg_size == 0 ? 2 : instr->arg_size * 2;
+        instr->args = (int *)dust_realloc(instr->args, sizeof(int) * instr->arg_size);
+    }
+
+    instr->args[instr->arg_count++] = arg;
+}
+
+/**
+ * @brief End a block with a jump, the block becomes a predecessor of
+ *        the target
+ */
+void IrProgram_jump(IrProgram *program, int block, int target, size_t offset) {
+    int jump = IrProgram_add(program, block, IrOp_JUMP, Type_NONE, offset);
+    program->values[jump].targets[0] = target;
+    ir_pred(program, target, block);
+}
+
+/**
+ * @brief End a block with a conditional branch, the block becomes a
+ *        predecessor of both targets
+ */
+void IrProgram_branch(IrProgram *program, int block, int condition, int then, int otherwise, size_t offset) {
+    int branch = IrProgram_add(program, block, IrOp_BRANCH, Type_NONE, offset);
+    IrProgram_arg(program, branch, condition);
+    program->values[branch].targets[0] = then;
+    program->values[branch].targets[1] = otherwise;
+    ir_pred(program, then, block);
+    ir_pred(program, otherwise, block);
+}
+
+bool IrOp_isterminator(IrOp op) {
+    return op == IrOp_JUMP || op == IrOp_BRANCH || op == IrOp_RETURN;
+}
+
+char *IrOp_repr(IrOp op) {
+    static char *names[] = {
+        "const", "undef", "phi", "add", "sub", "mul", "div", "mod", "pow", "neg",
+        "and", "or", "xor", "not", "eq", "neq", "lt", "le", "gt", "ge",
+        "convert", "concat", "in", "range", "newarray", "load", "store", "length",
+        "call", "member", "import", "enum", "jump", "branch", "return"
+    };
+
+    return (op >= IrOp_CONST && op <= IrOp_RETURN) ? names[op] : "?";
+}
+
+// Number of successors of a block and the successors
+static int ir_successors(IrProgram *program, int block, int *successors) {
+    IrBlock *b = &program->blocks[block];
+    if (b->instr_count == 0) return 0;
+
+    IrInstr *last = &program->values[b->instrs[b->instr_count - 1]];
+    int count = 0;
+
+    if (last->op == IrOp_JUMP) count = 1;
+    else if (last->op == IrOp_BRANCH) count = 2;
+
+    for (int i = 0; i < count; i++) {
+        if (last->targets[i] < 0 || last->targets[i] >= program->block_count) return 0;
+        successors[i] = last->targets[i];
+    }
+
+    return count;
+}
+
+/**
+ * @brief Reachable blocks in reverse postorder
+ *
+ * The second successor of a branch is walked first, so the first one
+ * comes first in the order.
+ *
+ * @param program Program
+ * @param order Filled with the blocks (block_count items)
+ * @return Number of reachable blocks
+ */
+static int ir_reverse_postorder(IrProgram *program, int *order) {
+    int *stack = (int *)dust_malloc(sizeof(int) * (program->block_count + 1));
+    int *next = (int *)dust_malloc(sizeof(int) * (program->block_count + 1));
+    bool *seen = (bool *)dust_calloc(program->block_count + 1, sizeof(bool));
+    int depth = 0;
+    int count = 0;
+
+    if (program->block_count > 0) {
+        stack[depth] = 0;
+        next[depth] = 0;
+        seen[0] = true;
+        depth++;
+    }
+
+    while (depth > 0) {
+        int block = stack[depth - 1];
+        int successors[2];
+        int successor_count = ir_successors(program, block, successors);
+
+        if (next[depth - 1] == successor_count) {
+            order[count++] = block;
+            depth--;
+            continue;
+        }
+
+        int successor = successors[successor_count - 1 - next[depth - 1]++];
+
+        if (!seen[successor]) {
+            seen[successor] = true;
+            stack[depth] = successor;
+            next[depth] = 0;
+            depth++;
+        }
+    }
+
+    for (int i = 0; i < count / 2; i++) {
+        int swap = order[i];
+        order[i] = order[count - 1 - i];
+        order[count - 1 - i] = swap;
+    }
+
+    dust_free(stack);
+    dust_free(next);
+    dust_free(seen);
+    return count;
+}
+
+/**
+ * @brief Drop removed instructions, then number blocks in reverse
+ *        postorder and values in the order they run
+ *
+ * Unreachable blocks are kept after the others, so the verifier can
+ * point at them.
+ *
+ * @param program Program
+ */
+void IrProgram_compact(IrProgram *program) {
+    int *order = (int *)dust_malloc(sizeof(int) * (program->block_count + 1));
+    int *block_map = (int *)dust_malloc(sizeof(int) * (program->block_count + 1));
+    int *value_map = (int *)dust_malloc(sizeof(int) * (program->value_count + 1));
+    int reachable = ir_reverse_postorder(program, order);
+    int count = reachable;
+    int i, j;
+
+    for (i = 0; i < program->block_count; i++) block_map[i] = IR_NONE;
+    for (i = 0; i < reachable; i++) block_map[order[i]] = i;
+
+    for (i = 0; i < program->block_count; i++)
+        if (block_map[i] == IR_NONE) {
+            block_map[i] = count;
+            order[count++] = i;
+        }
+
+    for (i = 0; i < program->value_count; i++) value_map[i] = IR_NONE;
+
+    // Values of removed instructions aren't numbered
+    int value_count = 0;
+
+    for (i = 0; i < program->block_count; i++) {
+        IrBlock *block = &program->blocks[order[i]];
+        int kept = 0;
+
+        for (j = 0; j < block->instr_count; j++) {
+            int value = block->instrs[j];
+            if (program->values[value].block == IR_NONE) continue;
+
+            block->instrs[kept++] = value;
+            value_map[value] = value_count++;
+        }
+
+        block->instr_count = kept;
+    }
+
+    IrInstr *values = (IrInstr *)dust_malloc(sizeof(IrInstr) * (value_count > 0 ? value_count : 1));
+    IrBlock *blocks = (IrBlock *)dust_malloc(sizeof(IrBlock) * program->block_size);
+
+    for (i = 0; i < program->value_count; i++) {
+        IrInstr *instr = &program->values[i];
+
+        if (value_map[i] == IR_NONE) {
+            dust_free(instr->args);
+            continue;
+        }
+
+        for (j = 0; j < instr->arg_count; j++)
+            if (instr->args[j] >= 0 && instr->args[j] < program->value_count)
+                instr->args[j] = value_map[instr->args[j]];
+
+        for (j = 0; j < 2; j++)
+            if (instr->targets[j] >= 0 && instr->targets[j] < program->block_count)
+                instr->targets[j] = block_map[instr->targets[j]];
+
+        instr->block = block_map[instr->block];
+        values[value_map[i]] = *instr;
+    }
+
+    for (i = 0; i < program->block_count; i++) {
+        IrBlock *block = &program->blocks[order[i]];
+
+        for (j = 0; j < block->instr_count; j++) block->instrs[j] = value_map[block->instrs[j]];
+        for (j = 0; j < block->pred_count; j++) block->preds[j] = block_map[block->preds[j]];
+
+        blocks[i] = *block;
+    }
+
+    dust_free(program->values);
+    dust_free(program->blocks);
+    program->values = values;
+    program->value_count = value_count;
+    program->value_size = value_count > 0 ? value_count : 1;
+    program->blocks = blocks;
+
+    dust_free(order);
+    dust_free(block_map);
+    dust_free(value_map);
+}
+
+
+static void ir_error(IrProgram *program, int value, char *format, ...) {
+    char message[256];
+    va_list args;
+
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+
+    if (program->error_count == program->error_size) {
+        program->error_size *= 2;
+        program->errors = (IrError *)dust_realloc(program->errors, sizeof(IrError) * program->error_size);
+    }
+
+    program->errors[program->error_count].message = ascii_to_utf32(message);
+    program->errors[program->error_count].value = value;
+    program->error_count++;
+}
+
+// Types a value can be used as, anything dynamic goes
+static bool ir_compatible(TypeId a, TypeId b) {
+    if (a == b || a == Type_DYNAMIC || b == Type_DYNAMIC) return true;
+
+    return TYPE_DIMS(a) > 0 && TYPE_DIMS(a) == TYPE_DIMS(b) &&
+           (TYPE_BASE(a) == Type_DYNAMIC || TYPE_BASE(b) == Type_DYNAMIC);
+}
+
+static bool ir_isnumber(TypeId type) {
+    return Type_isint(type) || Type_isfloat(type) || type == Type_DYNAMIC;
+}
+
+// Type of the elements of an array or string (Type_NONE if it has none)
+static TypeId ir_element(TypeId type) {
+    if (TYPE_DIMS(type) > 0) return TYPE_ELEMENT(type);
+    if (type == Type_STRING || type == Type_DYNAMIC) return type;
+    return Type_NONE;
+}
+
+/**
+ * @brief Check operand counts and types of an instruction whose
+ *        operands are all values
+ */
+static void ir_verify_types(IrProgram *program, int value) {
+    IrInstr *instr = &program->values[value];
+    TypeId *types = (TypeId *)dust_malloc(sizeof(TypeId) * (instr->arg_count + 1));
+    int expected = -1;
+    bool valid = true;
+    int i;
+
+    for (i = 0; i < instr->arg_count; i++) types[i] = program->values[instr->args[i]].type;
+
+    switch (instr->op) {
+        case IrOp_CONST:
+        case IrOp_UNDEF:
+        case IrOp_IMPORT:
+        case IrOp_JUMP:
+        case IrOp_RETURN:
+            expected = 0;
+            break;
+
+        case IrOp_PHI:
+            expected = program->blocks[instr->block].pred_count;
+            for (i = 0; i < instr->arg_count; i++) valid = valid && ir_compatible(types[i], instr->type);
+            break;
+
+        case IrOp_ADD: case IrOp_SUB: case IrOp_MUL: case IrOp_DIV: case IrOp_MOD: case IrOp_POW:
+            expected = 2;
+            valid = ir_isnumber(instr->type);
+            for (i = 0; i < instr->arg_count; i++) valid = valid && ir_compatible(types[i], instr->type);
+            break;
+
+        case IrOp_NEG:
+        case IrOp_CONVERT:
+            expected = 1;
+            valid = ir_isnumber(instr->type) && (instr->arg_count < 1 || ir_isnumber(types[0]));
+            break;
+
+        case IrOp_AND: case IrOp_OR: case IrOp_XOR:
+            expected = 2;
+            valid = instr->type == Type_BOOL || ir_isnumber(instr->type);
+            for (i = 0; i < instr->arg_count; i++) valid = valid && ir_compatible(types[i], instr->type);
+            break;
+
+        case IrOp_NOT:
+            expected = 1;
+            valid = ir_compatible(instr->type, Type_BOOL) && (instr->arg_count < 1 || ir_compatible(types[0], Type_BOOL));
+            break;
+
+        case IrOp_EQ: case IrOp_NEQ: case IrOp_LT: case IrOp_LE: case IrOp_GT: case IrOp_GE:
+            expected = 2;
+            valid = instr->type == Type_BOOL && (instr->arg_count < 2 || ir_compatible(types[0], types[1]));
+            break;
+
+        case IrOp_CONCAT:
+            expected = 2;
+            valid = ir_compatible(instr->type, Type_STRING);
+            for (i = 0; i < instr->arg_count; i++) valid = valid && ir_compatible(types[i], Type_STRING);
+            break;
+
+        case IrOp_IN:
+            expected = 2;
+            valid = instr->type == Type_BOOL;
+            break;
+
+        case IrOp_RANGE:
+            expected = 2;
+            valid = ir_element(instr->type) != Type_NONE && (instr->arg_count < 2 || ir_compatible(types[0], types[1]));
+            break;
+
+        case IrOp_NEWARRAY:
+            expected = 1;
+            valid = ir_element(instr->type) != Type_NONE && (instr->arg_count < 1 || ir_isnumber(types[0]));
+            break;
+
+        case IrOp_LOAD:
+            expected = 2;
+            valid = instr->arg_count < 2 || (ir_element(types[0]) != Type_NONE &&
+                    ir_compatible(ir_element(types[0]), instr->type) && ir_isnumber(types[1]));
+            break;
+
+        case IrOp_STORE:
+            expected = 3;
+            valid = instr->arg_count < 3 || (ir_element(types[0]) != Type_NONE &&
+                    ir_compatible(ir_element(types[0]), types[2]) && ir_isnumber(types[1]));
+            break;
+
+        case IrOp_LENGTH:
+            expected = 1;
+            valid = instr->type == Type_INT64 && (instr->arg_count < 1 || ir_element(types[0]) != Type_NONE);
+            break;
+
+        case IrOp_CALL:
+            valid = instr->name != NULL || instr->arg_count > 0;
+            break;
+
+        case IrOp_MEMBER:
+            expected = 1;
+            valid = instr->name != NULL;
+            break;
+
+        case IrOp_ENUM:
+            valid = instr->name != NULL;
+            break;
+
+        case IrOp_BRANCH:
+            expected = 1;
+            valid = instr->arg_count < 1 || ir_compatible(types[0], Type_BOOL);
+            break;
+    }
+
+    if (expected >= 0 && instr->arg_count != expected)
+        ir_error(program, value, "%%%d (%s) has %d operands instead of %d", value, IrOp_repr(instr->op),
+                 instr->arg_count, expected);
+    else if (!valid)
+        ir_error(program, value, "%%%d (%s) has operands of the wrong type", value, IrOp_repr(instr->op));
+
+    dust_free(types);
+}
+
+/**
+ * @brief Immediate dominator of every reachable block
+ *
+ * The iterative algorithm of Cooper, Harvey and Kennedy, blocks are
+ * compared by their place in the reverse postorder.
+ *
+ * @param program Program
+ * @param order Reachable blocks in reverse postorder
+ * @param count Number of reachable blocks
+ * @param rank Place of each block in order (-1 if it is unreachable)
+ * @return Immediate dominators (the entry is its own)
+ */
+static int *ir_dominators(IrProgram *program, int *order, int count, int *rank) {
+    int *idom = (int *)dust_malloc(sizeof(int) * (program->block_count + 1));
+    bool changed = true;
+
+    for (int i = 0; i < program->block_count; i++) idom[i] = IR_NONE;
+    if (count > 0) idom[order[0]] = order[0];
+
+    while (changed) {
+        changed = false;
+
+        for (int i = 1; i < count; i++) {
+            IrBlock *block = &program->blocks[order[i]];
+            int dominator = IR_NONE;
+
+            for (int j = 0; j < block->pred_count; j++) {
+                int pred = block->preds[j];
+                if (rank[pred] < 0 || idom[pred] == IR_NONE) continue;
+
+                if (dominator == IR_NONE) {
+                    dominator = pred;
+                    continue;
+                }
+
+                int a = pred;
+                int b = dominator;
+
+                while (a != b) {
+                    while (rank[a] > rank[b]) a = idom[a];
+                    while (rank[b] > rank[a]) b = idom[b];
+                }
+                dominator = a;
+            }
+
+            if (dominator != IR_NONE && idom[order[i]] != dominator) {
+                idom[order[i]] = dominator;
+                changed = true;
+            }
+        }
+    }
+
+    return idom;
+}
+
+static bool ir_dominates(int *idom, int *rank, int a, int b) {
+    while (rank[b] > rank[a]) b = idom[b];
+    return a == b;
+}
+
+/**
+ * @brief Check that the program is well formed
+ *
+ * Every block ends with one terminator and starts with its phis, the
+ * predecessors of blocks are the blocks jumping to them, phis have an
+ * operand per predecessor, operands have the types their operations
+ * expect and every value is defined before all of its uses (definitions
+ * dominate uses, a phi's operand must reach the end of its predecessor).
+ *
+ * Errors of the previous run are freed, the ones of this run stay in
+ * program->errors until the next run or IrProgram_free.
+ *
+ * @param program Program
+ * @return true if the program is well formed
+ */
+bool IrProgram_verify(IrProgram *program) {
+    int *position = (int *)dust_malloc(sizeof(int) * (program->value_count + 1));
+    int *order = (int *)dust_malloc(sizeof(int) * (program->block_count + 1));
+    int *rank = (int *)dust_malloc(sizeof(int) * (program->block_count + 1));
+    int *edges = (int *)dust_calloc(program->block_count + 1, sizeof(int));
+    int i, j, k;
+
+    ir_clear_errors(program);
+
+    if (program->block_count == 0) ir_error(program, IR_NONE, "Program has no blocks");
+
+    for (i = 0; i < program->value_count; i++) position[i] = IR_NONE;
+
+    /* Shape of blocks */
+    for (i = 0; i < program->block_count; i++) {
+        IrBlock *block = &program->blocks[i];
+        bool phis = true;
+
+        if (block->instr_count == 0 || !IrOp_isterminator(program->values[block->instrs[block->instr_count - 1]].op))
+            ir_error(program, IR_NONE, "b%d doesn't end with a terminator", i);
+
+        for (j = 0; j < block->instr_count; j++) {
+            int value = block->instrs[j];
+
+            if (value < 0 || value >= program->value_count) {
+                ir_error(program, IR_NONE, "b%d has an instruction that doesn't exist", i);
+                continue;
+            }
+
+            IrInstr *instr = &program->values[value];
+
+            if (position[value] != IR_NONE || instr->block != i) {
+                ir_error(program, value, "%%%d isn't in exactly one block", value);
+                continue;
+            }
+            position[value] = j;
+
+            if (instr->op != IrOp_PHI) phis = false;
+            else if (!phis) ir_error(program, value, "%%%d is a phi after other instructions", value);
+
+            if (IrOp_isterminator(instr->op) && j != block->instr_count - 1)
+                ir_error(program, value, "%%%d is a terminator in the middle of b%d", value, i);
+
+            int targets = instr->op == IrOp_JUMP ? 1 : instr->op == IrOp_BRANCH ? 2 : 0;
+
+            for (k = 0; k < targets; k++) {
+                if (instr->targets[k] < 0 || instr->targets[k] >= program->block_count)
+                    ir_error(program, value, "%%%d jumps to a block that doesn't exist", value);
+                else if (instr->targets[k] == 0)
+                    ir_error(program, value, "%%%d jumps to the entry block", value);
+                else
+                    edges[instr->targets[k]]++;
+            }
+        }
+    }
+
+    for (i = 0; i < program->value_count; i++)
+        if (position[i] == IR_NONE && program->values[i].block != IR_NONE)
+            ir_error(program, i, "%%%d isn't in exactly one block", i);
+
+    // Every jump to a block is one of its predecessors
+    for (i = 0; i < program->block_count && program->error_count == 0; i++) {
+        IrBlock *block = &program->blocks[i];
+        bool matches = block->pred_count == edges[i];
+
+        for (j = 0; j < block->pred_count && matches; j++) {
+            int pred = block->preds[j];
+            int successors[2];
+            int successor_count = (pred >= 0 && pred < program->block_count) ?
+                                  ir_successors(program, pred, successors) : 0;
+
+            matches = false;
+            for (k = 0; k < successor_count; k++) matches = matches || successors[k] == i;
+        }
+
+        if (!matches) ir_error(program, IR_NONE, "Predecessors of b%d aren't the blocks jumping to it", i);
+    }
+
+    if (program->error_count > 0) goto done;
+
+    /* Operands and their types */
+    for (i = 0; i < program->value_count; i++) {
+        IrInstr *instr = &program->values[i];
+        bool defines = !(IrOp_isterminator(instr->op) || instr->op == IrOp_STORE);
+        bool valid = true;
+
+        if (defines != (instr->type != Type_NONE))
+            ir_error(program, i, defines ? "%%%d has no type" : "%%%d has a type but no value", i);
+
+        for (j = 0; j < instr->arg_count; j++) {
+            int arg = instr->args[j];
+
+            if (arg < 0 || arg >= program->value_count || program->values[arg].type == Type_NONE) {
+                ir_error(program, i, "%%%d uses something that isn't a value", i);
+                valid = false;
+            }
+        }
+
+        if (valid) ir_verify_types(program, i);
+    }
+
+    if (program->error_count > 0) goto done;
+
+    /* Definitions dominate uses */
+    int count = ir_reverse_postorder(program, order);
+
+    for (i = 0; i < program->block_count; i++) rank[i] = -1;
+    for (i = 0; i < count; i++) rank[order[i]] = i;
+
+    for (i = 0; i < program->block_count; i++)
+        if (rank[i] < 0) ir_error(program, IR_NONE, "b%d is unreachable", i);
+
+    if (program->error_count > 0) goto done;
+
+    int *idom = ir_dominators(program, order, count, rank);
+
+    for (i = 0; i < program->value_count; i++) {
+        IrInstr *instr = &program->values[i];
+
+        for (j = 0; j < instr->arg_count; j++) {
+            IrInstr *def = &program->values[instr->args[j]];
+            bool dominated;
+
+            if (instr->op == IrOp_PHI) {
+                int pred = program->blocks[instr->block].preds[j];
+                dominated = ir_dominates(idom, rank, def->block, pred);
+            }
+            else if (def->block == instr->block) {
+                dominated = position[instr->args[j]] < position[i];
+            }
+            else {
+                dominated = ir_dominates(idom, rank, def->block, instr->block);
+            }
+
+            if (!dominated)
+                ir_error(program, i, "%%%d uses %%%d before it is defined", i, instr->args[j]);
+        }
+    }
+
+    dust_free(idom);
+
+done:
+    dust_free(position);
+    dust_free(order);
+    dust_free(rank);
+    dust_free(edges);
+
+    return program->error_count == 0;
+}
+
+
+static void ir_append_ascii(StringBuilder *builder, char *string) {
+    for (; *string; string++) StringBuilder_push(builder, (u32char)*string);
+}
+
+static void ir_append_value(StringBuilder *builder, int value) {
+    char numstr[16];
+    sprintf(numstr, "%%%d", value);
+    ir_append_ascii(builder, numstr);
+}
+
+static void ir_append_block(StringBuilder *builder, int block) {
+    char numstr[16];
+    sprintf(numstr, "b%d", block);
+    ir_append_ascii(builder, numstr);
+}
+
+static void ir_append_args(StringBuilder *builder, IrInstr *instr, int first) {
+    for (int i = first; i < instr->arg_count; i++) {
+        if (i > first) StringBuilder_append(builder, U", ");
+        ir_append_value(builder, instr->args[i]);
+    }
+}
+
+static void ir_append_const(StringBuilder *builder, IrInstr *instr) {
+    char numstr[64];
+
+    if (instr->type == Type_BOOL) {
+        StringBuilder_append(builder, instr->integer ? U"true" : U"false");
+    }
+    else if (instr->type == Type_STRING) {
+        StringBuilder_push(builder, U'"');
+        StringBuilder_append(builder, instr->name);
+        StringBuilder_push(builder, U'"');
+    }
+    else if (Type_isfloat(instr->type)) {
+        sprintf(numstr, "%g", instr->floating);
+        ir_append_ascii(builder, numstr);
+    }
+    else {
+        sprintf(numstr, "%ld", instr->integer);
+        ir_append_ascii(builder, numstr);
+    }
+}
+
+static void ir_repr_instr(StringBuilder *builder, IrProgram *program, int value) {
+    IrInstr *instr = &program->values[value];
+
+    StringBuilder_append(builder, U"    ");
+
+    if (instr->type != Type_NONE) {
+        ir_append_value(builder, value);
+        StringBuilder_append(builder, U" = ");
+        Type_repr_build(builder, instr->type);
+        StringBuilder_push(builder, U' ');
+    }
+
+    ir_append_ascii(builder, IrOp_repr(instr->op));
+
+    switch (instr->op) {
+        case IrOp_CONST:
+            StringBuilder_push(builder, U' ');
+            ir_append_const(builder, instr);
+            break;
+
+        case IrOp_PHI:
+            for (int i = 0; i < instr->arg_count; i++) {
+                StringBuilder_append(builder, i > 0 ? U", [" : U" [");
+                ir_append_value(builder, instr->args[i]);
+                StringBuilder_append(builder, U", ");
+                ir_append_block(builder, program->blocks[instr->block].preds[i]);
+                StringBuilder_push(builder, U']');
+            }
+            break;
+
+        case IrOp_CALL:
+        case IrOp_ENUM:
+            StringBuilder_push(builder, U' ');
+            if (instr->name != NULL) StringBuilder_append(builder, instr->name);
+            else if (instr->arg_count > 0) ir_append_value(builder, instr->args[0]);
+
+            StringBuilder_push(builder, U'(');
+            ir_append_args(builder, instr, instr->name != NULL ? 0 : 1);
+            StringBuilder_push(builder, U')');
+            break;
+
+        case IrOp_MEMBER:
+            StringBuilder_push(builder, U' ');
+            ir_append_args(builder, instr, 0);
+            StringBuilder_push(builder, U'.');
+            StringBuilder_append(builder, instr->name);
+            break;
+
+        case IrOp_IMPORT:
+            StringBuilder_push(builder, U' ');
+            StringBuilder_append(builder, instr->name);
+            break;
+
+        case IrOp_JUMP:
+            StringBuilder_push(builder, U' ');
+            ir_append_block(builder, instr->targets[0]);
+            break;
+
+        case IrOp_BRANCH:
+            StringBuilder_push(builder, U' ');
+            ir_append_args(builder, instr, 0);
+            StringBuilder_append(builder, U", ");
+            ir_append_block(builder, instr->targets[0]);
+            StringBuilder_append(builder, U", ");
+            ir_append_block(builder, instr->targets[1]);
+            break;
+
+        default:
+            if (instr->arg_count > 0) StringBuilder_push(builder, U' ');
+            ir_append_args(builder, instr, 0);
+            break;
+    }
+
+    StringBuilder_push(builder, U'\n');
+}
+
+static void ir_repr_block(StringBuilder *builder, IrProgram *program, int block) {
+    IrBlock *b = &program->blocks[block];
+
+    ir_append_block(builder, block);
+    StringBuilder_push(builder, U':');
+
+    for (int i = 0; i < b->pred_count; i++) {
+        StringBuilder_append(builder, i > 0 ? U", " : U" ; preds ");
+        ir_append_block(builder, b->preds[i]);
+    }
+
+    StringBuilder_push(builder, U'\n');
+}
+
+/**
+ * @brief Text of a program, a block per paragraph
+ *
+ * @param program Program
+ * @return New string
+ */
+u32char *IrProgram_repr(IrProgram *program) {
+    StringBuilder *builder = StringBuilder_new(256);
+
+    for (int i = 0; i < program->block_count; i++) {
+        IrBlock *block = &program->blocks[i];
+
+        if (i > 0) StringBuilder_push(builder, U'\n');
+        ir_repr_block(builder, program, i);
+
+        for (int j = 0; j < block->instr_count; j++) ir_repr_instr(builder, program, block->instrs[j]);
+    }
+
+    return StringBuilder_finish(builder);
+}
+
+/**
+ * @brief Write the text of a program a block at a time
+ *
+ * @param program Program
+ * @param writer Writer
+ */
+void IrProgram_write(IrProgram *program, Writer *writer) {
+    StringBuilder *builder = StringBuilder_new(256);
+
+    for (int i = 0; i < program->block_count; i++) {
+        IrBlock *block = &program->blocks[i];
+
+        builder->length = 0;
+        if (i > 0) StringBuilder_push(builder, U'\n');
+        ir_repr_block(builder, program, i);
+
+        for (int j = 0; j < block->instr_count; j++) ir_repr_instr(builder, program, block->instrs[j]);
+
+        Writer_write_u32n(writer, builder->data, builder->length);
+    }
+
+    StringBuilder_free(builder);
+}
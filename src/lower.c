@@ -0,0 +1,961 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+
+  lower.c  -  Lowering trees into the IR
+  -------------------------------------------------
+  Turns a resolved and type checked tree into an SSA
+  program in one walk, building SSA form on the fly
+  (Braun et al., "Simple and Efficient Construction of
+  Static Single Assignment Form"): the value of a
+  variable is looked up in the block reading it, and
+  if it isn't written there, in its predecessors,
+  with a phi where paths meet. Blocks whose
+  predecessors aren't all known yet (loop headers)
+  get operandless phis that are filled in once the
+  block is sealed. Phis that turn out to merge one
+  value are replaced by it.
+
+  Control flow is lowered as:
+
+    if/elif/else     a branch per condition, every
+                     clause jumps to one end block
+    while            header (condition), body, exit
+    repeat n         counter from 0 while it is less than n
+    for x in a..b    counter from a while it is less than b
+    for x in array   counter from 0 while it is less than
+                     the length, x is loaded from the array
+
+  Names are identified by their (depth, slot) pairs like
+  in the type checker, each declaration is a variable
+  of its own.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include "dust/ustring.h"
+#include "dust/parser.h"
+#include "dust/typecheck.h"
+#include "dust/ir.h"
+#include "dust/allocator.h"
+#include "dust/alloc.h"
+
+
+/**
+ * @brief Value of a variable at the end of a block
+ */
+typedef struct {
+    uint64_t key;
+    int value;
+} LowerDef;
+
+/**
+ * @brief Phi of a block that wasn't sealed yet
+ */
+typedef struct {
+    int block;
+    int variable;
+    int phi;
+} LowerIncomplete;
+
+/**
+ * @param program Program being built
+ * @param block Block statements are lowered into
+ * @param variables Type of every variable
+ * @param slots Variable of every slot of the open scopes, innermost last
+ * @param frames First slot of each open scope, innermost last
+ * @param defs Value of variables at the end of blocks, by block and variable
+ * @param incomplete Phis waiting for their block to be sealed
+ * @param sealed Whether all predecessors of a block are known
+ * @param forward Value a removed phi was replaced by (IR_NONE if it wasn't)
+ */
+typedef struct {
+    IrProgram *program;
+    int block;
+    TypeId *variables;
+    size_t variable_count;
+    size_t variable_size;
+    int *slots;
+    size_t slot_count;
+    size_t slot_size;
+    size_t *frames;
+    size_t frame_count;
+    size_t frame_size;
+    LowerDef *defs;
+    size_t def_count;
+    size_t def_size;
+    LowerIncomplete *incomplete;
+    size_t incomplete_count;
+    size_t incomplete_size;
+    bool *sealed;
+    size_t sealed_size;
+    int *forward;
+    size_t forward_size;
+} Lowerer;
+
+
+static int lower_expr(Lowerer *lowerer, Node *node);
+static void lower_statements(Lowerer *lowerer, Node *body);
+
+
+/* Scopes and variables */
+
+static int lower_variable(Lowerer *lowerer, TypeId type) {
+    if (lowerer->variable_count == lowerer->variable_size) {
+        lowerer->variable_size *= 2;
+        lowerer->variables = (TypeId *)dust_realloc(lowerer->variables, sizeof(TypeId) * lowerer->variable_size);
+    }
+
+    lowerer->variables[lowerer->variable_count] = (type == Type_NONE) ? Type_DYNAMIC : type;
+    return (int)lowerer->variable_count++;
+}
+
+static void lower_push(Lowerer *lowerer, int slots) {
+    if (slots < 0) slots = 0;
+
+    if (lowerer->frame_count == lowerer->frame_size) {
+        lowerer->frame_size *= 2;
+        lowerer->frames = (size_t *)dust_realloc(lowerer->frames, sizeof(size_t) * lowerer->frame_size);
+    }
+
+    if (lowerer->slot_count + slots > lowerer->slot_size) {
+        while (lowerer->slot_count + slots > lowerer->slot_size) lowerer->slot_size *= 2;
+        lowerer->slots = (int *)dust_realloc(lowerer->slots, sizeof(int) * lowerer->slot_size);
+    }
+
+    lowerer->frames[lowerer->frame_count++] = lowerer->slot_count;
+    for (int i = 0; i < slots; i++) lowerer->slots[lowerer->slot_count++] = IR_NONE;
+}
+
+static void lower_pop(Lowerer *lowerer) {
+    lowerer->slot_count = lowerer->frames[--lowerer->frame_count];
+}
+
+/**
+ * @brief Variable of a resolved name (IR_NONE if it wasn't resolved or
+ *        declared)
+ */
+static int lower_lookup(Lowerer *lowerer, int depth, int slot) {
+    if (depth < 0 || slot < 0 || (size_t)depth >= lowerer->frame_count) return IR_NONE;
+
+    size_t frame = lowerer->frame_count - 1 - depth;
+    size_t end = (frame + 1 < lowerer->frame_count) ? lowerer->frames[frame + 1] : lowerer->slot_count;
+    size_t index = lowerer->frames[frame] + slot;
+
+    return index < end ? lowerer->slots[index] : IR_NONE;
+}
+
+/**
+ * @brief New variable for a slot of the innermost scope
+ */
+static int lower_declare(Lowerer *lowerer, int slot, TypeId type) {
+    int variable = lower_variable(lowerer, type);
+
+    if (slot >= 0) {
+        size_t index = lowerer->frames[lowerer->frame_count - 1] + slot;
+        if (index < lowerer->slot_count) lowerer->slots[index] = variable;
+    }
+
+    return variable;
+}
+
+
+/* SSA construction */
+
+static int lower_block(Lowerer *lowerer) {
+    int block = IrProgram_block(lowerer->program);
+
+    if ((size_t)block >= lowerer->sealed_size) {
+        size_t size = lowerer->sealed_size;
+        while ((size_t)block >= lowerer->sealed_size) lowerer->sealed_size *= 2;
+        lowerer->sealed = (bool *)dust_realloc(lowerer->sealed, sizeof(bool) * lowerer->sealed_size);
+        memset(&lowerer->sealed[size], 0, sizeof(bool) * (lowerer->sealed_size - size));
+    }
+
+    lowerer->sealed[block] = false;
+    return block;
+}
+
+// Value a value was replaced by, if it was a removed phi
+static int lower_resolve(Lowerer *lowerer, int value) {
+    while (value >= 0 && (size_t)value < lowerer->forward_size && lowerer->forward[value] != IR_NONE)
+        value = lowerer->forward[value];
+
+    return value;
+}
+
+static void lower_replace(Lowerer *lowerer, int phi, int value) {
+    if ((size_t)phi >= lowerer->forward_size) {
+        size_t size = lowerer->forward_size;
+        while ((size_t)phi >= lowerer->forward_size) lowerer->forward_size *= 2;
+        lowerer->forward = (int *)dust_realloc(lowerer->forward, sizeof(int) * lowerer->forward_size);
+        for (size_t i = size; i < lowerer->forward_size; i++) lowerer->forward[i] = IR_NONE;
+    }
+
+    lowerer->forward[phi] = value;
+    lowerer->program->values[phi].block = IR_NONE;
+}
+
+static LowerDef *lower_def(Lowerer *lowerer, int block, int variable) {
+    uint64_t key = ((uint64_t)(uint32_t)block << 32) | (uint32_t)variable;
+    size_t index = (size_t)((key * 0x9e3779b97f4a7c15ULL) >> 32) & (lowerer->def_size - 1);
+
+    while (lowerer->defs[index].value != IR_NONE && lowerer->defs[index].key != key)
+        index = (index + 1) & (lowerer->def_size - 1);
+
+    lowerer->defs[index].key = key;
+    return &lowerer->defs[index];
+}
+
+static void lower_write(Lowerer *lowerer, int variable, int block, int value) {
+    // Kept at most half full
+    if ((lowerer->def_count + 1) * 2 > lowerer->def_size) {
+        LowerDef *defs = lowerer->defs;
+        size_t size = lowerer->def_size;
+
+        lowerer->def_size *= 2;
+        lowerer->defs = (LowerDef *)dust_malloc(sizeof(LowerDef) * lowerer->def_size);
+        for (size_t i = 0; i < lowerer->def_size; i++) lowerer->defs[i].value = IR_NONE;
+
+        for (size_t i = 0; i < size; i++)
+            if (defs[i].value != IR_NONE)
+                lower_def(lowerer, (int)(defs[i].key >> 32), (int)(uint32_t)defs[i].key)->value = defs[i].value;
+
+        dust_free(defs);
+    }
+
+    LowerDef *def = lower_def(lowerer, block, variable);
+    if (def->value == IR_NONE) lowerer->def_count++;
+    def->value = value;
+}
+
+/**
+ * @brief Value of a variable read before it is ever written
+ */
+static int lower_undef(Lowerer *lowerer, TypeId type, size_t offset) {
+    return IrProgram_insert(lowerer->program, 0, 0, IrOp_UNDEF, type, offset);
+}
+
+/**
+ * @brief Replace a phi by the one value it merges, if it merges one
+ *
+ * @return The phi, or the value it was replaced by
+ */
+static int lower_trivial(Lowerer *lowerer, int phi) {
+    IrInstr *instr = &lowerer->program->values[phi];
+    int same = IR_NONE;
+
+    for (int i = 0; i < instr->arg_count; i++) {
+        int arg = lower_resolve(lowerer, instr->args[i]);
+        instr->args[i] = arg;
+
+        if (arg == same || arg == phi) continue;
+        if (same != IR_NONE) return phi;
+        same = arg;
+    }
+
+    if (same == IR_NONE) same = lower_undef(lowerer, lowerer->program->values[phi].type,
+                                            lowerer->program->values[phi].offset);
+
+    lower_replace(lowerer, phi, same);
+    return same;
+}
+
+static int lower_read(Lowerer *lowerer, int variable, int block);
+
+static int lower_phi_operands(Lowerer *lowerer, int variable, int phi) {
+    int block = lowerer->program->values[phi].block;
+
+    for (int i = 0; i < lowerer->program->blocks[block].pred_count; i++)
+        IrProgram_arg(lowerer->program, phi, lower_read(lowerer, variable, lowerer->program->blocks[block].preds[i]));
+
+    return lower_trivial(lowerer, phi);
+}
+
+static int lower_read(Lowerer *lowerer, int variable, int block) {
+    LowerDef *def = lower_def(lowerer, block, variable);
+    if (def->value != IR_NONE) return lower_resolve(lowerer, def->value);
+
+    IrProgram *program = lowerer->program;
+    TypeId type = lowerer->variables[variable];
+    int value;
+
+    if (!lowerer->sealed[block]) {
+        value = IrProgram_add_phi(program, block, type, 0);
+
+        if (lowerer->incomplete_count == lowerer->incomplete_size) {
+            lowerer->incomplete_size *= 2;
+            lowerer->incomplete = (LowerIncomplete *)dust_realloc(lowerer->incomplete,
+                                  sizeof(LowerIncomplete) * lowerer->incomplete_size);
+        }
+
+        lowerer->incomplete[lowerer->incomplete_count++] = (LowerIncomplete){block, variable, value};
+    }
+    else if (program->blocks[block].pred_count == 0) {
+        value = lower_undef(lowerer, type, 0);
+    }
+    else if (program->blocks[block].pred_count == 1) {
+        value = lower_read(lowerer, variable, program->blocks[block].preds[0]);
+    }
+    else {
+        // Written first so loops reading it again find the phi
+        value = IrProgram_add_phi(program, block, type, 0);
+        lower_write(lowerer, variable, block, value);
+        value = lower_phi_operands(lowerer, variable, value);
+    }
+
+    lower_write(lowerer, variable, block, value);
+    return value;
+}
+
+/**
+ * @brief Mark that every predecessor of a block is known and fill in
+ *        its waiting phis
+ */
+static void lower_seal(Lowerer *lowerer, int block) {
+    size_t i = 0;
+
+    while (i < lowerer->incomplete_count) {
+        LowerIncomplete incomplete = lowerer->incomplete[i];
+
+        if (incomplete.block != block) {
+            i++;
+            continue;
+        }
+
+        lowerer->incomplete[i] = lowerer->incomplete[--lowerer->incomplete_count];
+        lower_phi_operands(lowerer, incomplete.variable, incomplete.phi);
+    }
+
+    lowerer->sealed[block] = true;
+}
+
+/**
+ * @brief Remove phis made trivial by other removed phis and point
+ *        every operand at what is left
+ */
+static void lower_finish(Lowerer *lowerer) {
+    IrProgram *program = lowerer->program;
+    bool changed = true;
+
+    while (changed) {
+        changed = false;
+
+        for (int i = 0; i < program->value_count; i++) {
+            if (program->values[i].op != IrOp_PHI || program->values[i].block == IR_NONE) continue;
+            if (lower_trivial(lowerer, i) != i) changed = true;
+        }
+    }
+
+    for (int i = 0; i < program->value_count; i++) {
+        IrInstr *instr = &program->values[i];
+
+        for (int j = 0; j < instr->arg_count; j++)
+            instr->args[j] = lower_resolve(lowerer, instr->args[j]);
+    }
+}
+
+
+/* Expressions */
+
+static int lower_add(Lowerer *lowerer, IrOp op, TypeId type, size_t offset) {
+    return IrProgram_add(lowerer->program, lowerer->block, op, type, offset);
+}
+
+static int lower_op(Lowerer *lowerer, IrOp op, TypeId type, size_t offset, int left, int right) {
+    int value = lower_add(lowerer, op, type, offset);
+
+    IrProgram_arg(lowerer->program, value, left);
+    if (right != IR_NONE) IrProgram_arg(lowerer->program, value, right);
+    return value;
+}
+
+static int lower_integer(Lowerer *lowerer, TypeId type, long integer, size_t offset) {
+    int value = lower_add(lowerer, IrOp_CONST, Type_isint(type) ? type : Type_INT64, offset);
+    lowerer->program->values[value].integer = integer;
+    return value;
+}
+
+static TypeId lower_type(Node *node) {
+    return node->vtype == Type_NONE ? Type_DYNAMIC : node->vtype;
+}
+
+static IrOp lower_binop(OpType op) {
+    switch (op) {
+        case OpType_ADD: return IrOp_ADD;
+        case OpType_SUB: return IrOp_SUB;
+        case OpType_MUL: return IrOp_MUL;
+        case OpType_DIV: return IrOp_DIV;
+        case OpType_AND: return IrOp_AND;
+        case OpType_OR: return IrOp_OR;
+        case OpType_XOR: return IrOp_XOR;
+        case OpType_POW: return IrOp_POW;
+        case OpType_MOD: return IrOp_MOD;
+        case OpType_RANGE: return IrOp_RANGE;
+        case OpType_EQ: return IrOp_EQ;
+        case OpType_NEQ: return IrOp_NEQ;
+        case OpType_LT: return IrOp_LT;
+        case OpType_LE: return IrOp_LE;
+        case OpType_GT: return IrOp_GT;
+        case OpType_GE: return IrOp_GE;
+        case OpType_IN: return IrOp_IN;
+        default: return IrOp_UNDEF;
+    }
+}
+
+/**
+ * @brief Numeric literal, optionally signed, folded into one constant
+ */
+static int lower_literal(Lowerer *lowerer, Node *node) {
+    Node *number = (node->type == NodeType_UNARYOP) ? node->unary_right : node;
+    bool negative = node->type == NodeType_UNARYOP && node->unary_optype == OpType_SUB;
+    TypeId type = lower_type(node);
+
+    if (number->type == NodeType_FLOAT) {
+        int value = lower_add(lowerer, IrOp_CONST, Type_isfloat(type) ? type : Type_FLOAT64, node->offset);
+        lowerer->program->values[value].floating = negative ? -number->floating : number->floating;
+        return value;
+    }
+
+    return lower_integer(lowerer, type, negative ? -number->integer : number->integer, node->offset);
+}
+
+static int lower_call(Lowerer *lowerer, Node *node, int callee) {
+    IrProgram *program = lowerer->program;
+    int *args = NULL;
+    size_t count = (node->call_args != NULL) ? node->call_args->used : 0;
+
+    if (callee == IR_NONE && node->call_base->type != NodeType_FUNCBASE)
+        callee = lower_expr(lowerer, node->call_base);
+
+    // Operands are lowered before the call so they run first
+    if (count > 0) args = (int *)dust_malloc(sizeof(int) * count);
+    for (size_t i = 0; i < count; i++) args[i] = lower_expr(lowerer, &(node->call_args->array[i]));
+
+    int value = lower_add(lowerer, IrOp_CALL, lower_type(node), node->offset);
+
+    if (callee != IR_NONE) {
+        program->values[value].name = NULL;
+        IrProgram_arg(program, value, callee);
+    }
+    else {
+        program->values[value].name = node->call_base->func_base;
+    }
+
+    for (size_t i = 0; i < count; i++) IrProgram_arg(program, value, args[i]);
+
+    dust_free(args);
+    return value;
+}
+
+static int lower_member(Lowerer *lowerer, int parent, u32char *name, size_t offset) {
+    int value = lower_op(lowerer, IrOp_MEMBER, Type_DYNAMIC, offset, parent, IR_NONE);
+    lowerer->program->values[value].name = name;
+    return value;
+}
+
+/**
+ * @brief Child of a value, a.b.c(1) is a parent with the nested child b.c(1)
+ */
+static int lower_child(Lowerer *lowerer, int parent, Node *child) {
+    switch (child->type) {
+        case NodeType_VAR:
+            return lower_member(lowerer, parent, child->variable, child->offset);
+
+        case NodeType_CALL:
+            if (child->call_base->type == NodeType_FUNCBASE)
+                return lower_call(lowerer, child,
+                                  lower_member(lowerer, parent, child->call_base->func_base, child->offset));
+            return lower_call(lowerer, child, lower_child(lowerer, parent, child->call_base));
+
+        case NodeType_CHILD:
+            return lower_child(lowerer, lower_child(lowerer, parent, child->chld_parent), child->chld_child);
+
+        case NodeType_SUBSCRIPT: {
+            int base = lower_child(lowerer, parent, child->subs_node);
+            int index = lower_expr(lowerer, child->subs_expr);
+            return lower_op(lowerer, IrOp_LOAD, Type_DYNAMIC, child->offset, base, index);
+        }
+
+        default:
+            return lower_expr(lowerer, child);
+    }
+}
+
+static int lower_array(Lowerer *lowerer, Node *node) {
+    NodeArray *elements = node->array_nodearray;
+    size_t count = (elements != NULL) ? elements->used : 0;
+    int length = lower_integer(lowerer, Type_INT64, (long)count, node->offset);
+    int array = lower_op(lowerer, IrOp_NEWARRAY, lower_type(node), node->offset, length, IR_NONE);
+
+    for (size_t i = 0; i < count; i++) {
+        Node *element = &(elements->array[i]);
+        int value = lower_expr(lowerer, element);
+        int index = lower_integer(lowerer, Type_INT64, (long)i, element->offset);
+        int store = lower_op(lowerer, IrOp_STORE, Type_NONE, element->offset, array, index);
+        IrProgram_arg(lowerer->program, store, value);
+    }
+
+    return array;
+}
+
+/**
+ * @brief Lower an expression into the current block
+ *
+ * @param lowerer Lowerer
+ * @param node Expression
+ * @return Its value
+ */
+static int lower_expr(Lowerer *lowerer, Node *node) {
+    IrProgram *program = lowerer->program;
+    TypeId type = lower_type(node);
+    int value;
+
+    switch (node->type) {
+        case NodeType_INTEGER:
+        case NodeType_FLOAT:
+            return lower_literal(lowerer, node);
+
+        case NodeType_STRING:
+            value = lower_add(lowerer, IrOp_CONST, Type_STRING, node->offset);
+            program->values[value].name = node->string;
+            return value;
+
+        case NodeType_VAR: {
+            if (u32isequal(node->variable, U"true") || u32isequal(node->variable, U"false")) {
+                value = lower_add(lowerer, IrOp_CONST, Type_BOOL, node->offset);
+                program->values[value].integer = u32isequal(node->variable, U"true");
+                return value;
+            }
+
+            int variable = lower_lookup(lowerer, node->var_depth, node->var_slot);
+            if (variable == IR_NONE) return lower_add(lowerer, IrOp_UNDEF, Type_DYNAMIC, node->offset);
+            return lower_read(lowerer, variable, lowerer->block);
+        }
+
+        case NodeType_ARRAY:
+            return lower_array(lowerer, node);
+
+        case NodeType_BINOP: {
+            IrOp op = lower_binop(node->bin_optype);
+            int left = lower_expr(lowerer, node->bin_left);
+            int right = lower_expr(lowerer, node->bin_right);
+
+            if (op == IrOp_ADD && type == Type_STRING) op = IrOp_CONCAT;
+            return lower_op(lowerer, op, type, node->offset, left, right);
+        }
+
+        case NodeType_UNARYOP:
+        case NodeType_RUNARYOP:
+            if ((node->unary_optype == OpType_SUB || node->unary_optype == OpType_ADD) &&
+                (node->unary_right->type == NodeType_INTEGER || node->unary_right->type == NodeType_FLOAT))
+                return lower_literal(lowerer, node);
+
+            value = lower_expr(lowerer, node->unary_right);
+
+            if (node->unary_optype == OpType_ADD) return value;
+            return lower_op(lowerer, node->unary_optype == OpType_NOT ? IrOp_NOT : IrOp_NEG, type,
+                            node->offset, value, IR_NONE);
+
+        case NodeType_SUBSCRIPT: {
+            int base = lower_expr(lowerer, node->subs_node);
+            int index = lower_expr(lowerer, node->subs_expr);
+            return lower_op(lowerer, IrOp_LOAD, type, node->offset, base, index);
+        }
+
+        case NodeType_CALL:
+            return lower_call(lowerer, node, IR_NONE);
+
+        case NodeType_CHILD:
+            return lower_child(lowerer, lower_expr(lowerer, node->chld_parent), node->chld_child);
+
+        case NodeType_CONVERT:
+            value = lower_expr(lowerer, node->conv_expr);
+            return lower_op(lowerer, IrOp_CONVERT, type, node->offset, value, IR_NONE);
+
+        default:
+            return lower_add(lowerer, IrOp_UNDEF, Type_DYNAMIC, node->offset);
+    }
+}
+
+
+/* Statements */
+
+static void lower_body(Lowerer *lowerer, Node *body) {
+    lower_push(lowerer, body->body_slots);
+    lower_statements(lowerer, body);
+    lower_pop(lowerer);
+}
+
+/**
+ * @brief Lower an if statement and the elif and else statements after it
+ *
+ * @param lowerer Lowerer
+ * @param statements Statements of the body it is in
+ * @param index Index of the if statement
+ * @return Index of the last statement of the chain
+ */
+static size_t lower_if(Lowerer *lowerer, NodeArray *statements, size_t index) {
+    IrProgram *program = lowerer->program;
+    int end = lower_block(lowerer);
+    size_t i = index;
+
+    for (; i < statements->used; i++) {
+        Node *clause = &(statements->array[i]);
+
+        if (i > index && clause->type != NodeType_ELIF && clause->type != NodeType_ELSE) break;
+
+        if (clause->type == NodeType_ELSE) {
+            lower_body(lowerer, clause->else_body);
+            i++;
+            break;
+        }
+
+        Node *condition = (clause->type == NodeType_IF) ? clause->if_expr : clause->elif_expr;
+        Node *body = (clause->type == NodeType_IF) ? clause->if_body : clause->elif_body;
+        int value = lower_expr(lowerer, condition);
+        int then = lower_block(lowerer);
+        int next = lower_block(lowerer);
+
+        IrProgram_branch(program, lowerer->block, value, then, next, clause->offset);
+        lower_seal(lowerer, then);
+        lower_seal(lowerer, next);
+
+        lowerer->block = then;
+        lower_body(lowerer, body);
+        IrProgram_jump(program, lowerer->block, end, clause->offset);
+
+        lowerer->block = next;
+    }
+
+    IrProgram_jump(program, lowerer->block, end, statements->array[index].offset);
+    lower_seal(lowerer, end);
+    lowerer->block = end;
+
+    return i - 1;
+}
+
+static void lower_while(Lowerer *lowerer, Node *node) {
+    IrProgram *program = lowerer->program;
+    int header = lower_block(lowerer);
+
+    IrProgram_jump(program, lowerer->block, header, node->offset);
+    lowerer->block = header;
+
+    int condition = lower_expr(lowerer, node->while_expr);
+    int body = lower_block(lowerer);
+    int exit = lower_block(lowerer);
+
+    IrProgram_branch(program, header, condition, body, exit, node->offset);
+    lower_seal(lowerer, body);
+
+    lowerer->block = body;
+    lower_body(lowerer, node->while_body);
+    IrProgram_jump(program, lowerer->block, header, node->offset);
+
+    lower_seal(lowerer, header);
+    lower_seal(lowerer, exit);
+    lowerer->block = exit;
+}
+
+/**
+ * @brief Start a loop running while a counter is less than a limit, the
+ *        current block becomes its body
+ *
+ * @param lowerer Lowerer
+ * @param counter Hidden variable counting iterations, already written
+ * @param limit Value the counter stops at
+ * @param offset Offset of the loop statement
+ * @param exit Filled with the block after the loop
+ * @return Header block of the loop
+ */
+static int lower_loop_begin(Lowerer *lowerer, int counter, int limit, size_t offset, int *exit) {
+    IrProgram *program = lowerer->program;
+    int header = lower_block(lowerer);
+
+    IrProgram_jump(program, lowerer->block, header, offset);
+    lowerer->block = header;
+
+    int value = lower_read(lowerer, counter, header);
+    int condition = lower_op(lowerer, IrOp_LT, Type_BOOL, offset, value, limit);
+    int body = lower_block(lowerer);
+    *exit = lower_block(lowerer);
+
+    IrProgram_branch(program, header, condition, body, *exit, offset);
+    lower_seal(lowerer, body);
+    lowerer->block = body;
+
+    return header;
+}
+
+/**
+ * @brief Increment the counter at the end of the loop body and jump back
+ */
+static void lower_loop_end(Lowerer *lowerer, int counter, int header, int exit, size_t offset) {
+    TypeId type = lowerer->variables[counter];
+    int value = lower_read(lowerer, counter, lowerer->block);
+    int one = lower_integer(lowerer, type, 1, offset);
+
+    lower_write(lowerer, counter, lowerer->block, lower_op(lowerer, IrOp_ADD, type, offset, value, one));
+    IrProgram_jump(lowerer->program, lowerer->block, header, offset);
+
+    lower_seal(lowerer, header);
+    lower_seal(lowerer, exit);
+    lowerer->block = exit;
+}
+
+static void lower_repeat(Lowerer *lowerer, Node *node) {
+    int limit = lower_expr(lowerer, node->repeat_expr);
+    TypeId type = Type_isint(lower_type(node->repeat_expr)) ? lower_type(node->repeat_expr) : Type_INT64;
+    int counter = lower_variable(lowerer, type);
+    int exit;
+
+    lower_write(lowerer, counter, lowerer->block, lower_integer(lowerer, type, 0, node->offset));
+
+    int header = lower_loop_begin(lowerer, counter, limit, node->offset, &exit);
+    lower_body(lowerer, node->repeat_body);
+    lower_loop_end(lowerer, counter, header, exit, node->offset);
+}
+
+static void lower_for(Lowerer *lowerer, Node *node) {
+    Node *iterable = node->for_expr;
+    TypeId element = lower_type(node->for_var);
+    int counter, limit, array = IR_NONE, exit;
+
+    if (iterable->type == NodeType_BINOP && iterable->bin_optype == OpType_RANGE) {
+        TypeId range = lower_type(iterable);
+        int start = lower_expr(lowerer, iterable->bin_left);
+
+        limit = lower_expr(lowerer, iterable->bin_right);
+        counter = lower_variable(lowerer, TYPE_DIMS(range) > 0 ? TYPE_ELEMENT(range) : Type_DYNAMIC);
+        lower_write(lowerer, counter, lowerer->block, start);
+    }
+    else {
+        array = lower_expr(lowerer, iterable);
+        limit = lower_op(lowerer, IrOp_LENGTH, Type_INT64, iterable->offset, array, IR_NONE);
+        counter = lower_variable(lowerer, Type_INT64);
+        lower_write(lowerer, counter, lowerer->block, lower_integer(lowerer, Type_INT64, 0, node->offset));
+    }
+
+    int header = lower_loop_begin(lowerer, counter, limit, node->offset, &exit);
+    int value = lower_read(lowerer, counter, lowerer->block);
+
+    if (array != IR_NONE) value = lower_op(lowerer, IrOp_LOAD, element, node->for_var->offset, array, value);
+
+    lower_push(lowerer, node->for_body->body_slots);
+    lower_write(lowerer, lower_declare(lowerer, node->for_var->var_slot, element), lowerer->block, value);
+    lower_statements(lowerer, node->for_body);
+    lower_pop(lowerer);
+
+    lower_loop_end(lowerer, counter, header, exit, node->offset);
+}
+
+/**
+ * @brief Lower an enumeration, members without a value are one more
+ *        than the one before them (the first one is 0)
+ */
+static void lower_enum(Lowerer *lowerer, Node *node) {
+    IrProgram *program = lowerer->program;
+    NodeArray *members = Node_body(node->enum_body);
+    int *values = (int *)dust_malloc(sizeof(int) * (members->used + 1));
+    int previous = IR_NONE;
+    size_t count = 0;
+
+    lower_push(lowerer, node->enum_body->body_slots);
+
+    for (size_t i = 0; i < members->used; i++) {
+        Node *member = &(members->array[i]);
+        int slot;
+        int value;
+
+        if (member->type == NodeType_ASSIGN) {
+            value = lower_expr(lowerer, member->assign_expr);
+            slot = member->assign_slot;
+        }
+        else if (member->type == NodeType_VAR) {
+            if (previous == IR_NONE)
+                value = lower_integer(lowerer, Type_INT64, 0, member->offset);
+            else if (program->values[previous].op == IrOp_CONST)
+                value = lower_integer(lowerer, Type_INT64, program->values[previous].integer + 1, member->offset);
+            else
+                value = lower_op(lowerer, IrOp_ADD, Type_INT64, member->offset, previous,
+                                 lower_integer(lowerer, Type_INT64, 1, member->offset));
+            slot = member->var_slot;
+        }
+        else continue;
+
+        lower_write(lowerer, lower_declare(lowerer, slot, Type_INT64), lowerer->block, value);
+        values[count++] = value;
+        previous = value;
+    }
+
+    lower_pop(lowerer);
+
+    int enumeration = lower_add(lowerer, IrOp_ENUM, Type_DYNAMIC, node->offset);
+    program->values[enumeration].name = node->enum_name;
+    for (size_t i = 0; i < count; i++) IrProgram_arg(program, enumeration, values[i]);
+
+    lower_write(lowerer, lower_declare(lowerer, node->enum_slot, Type_DYNAMIC), lowerer->block, enumeration);
+    dust_free(values);
+}
+
+static void lower_assign(Lowerer *lowerer, Node *node) {
+    int variable = lower_lookup(lowerer, node->assign_depth, node->assign_slot);
+    int value = lower_expr(lowerer, node->assign_expr);
+
+    if (variable == IR_NONE) return;
+
+    if (!u32isequal(node->assign_op, U"=")) {
+        TypeId type = lowerer->variables[variable];
+        int current = lower_read(lowerer, variable, lowerer->block);
+        IrOp op = IrOp_ADD;
+
+        if (u32isequal(node->assign_op, U"-=")) op = IrOp_SUB;
+        else if (u32isequal(node->assign_op, U"*=")) op = IrOp_MUL;
+        else if (u32isequal(node->assign_op, U"/=")) op = IrOp_DIV;
+        else if (type == Type_STRING) op = IrOp_CONCAT;
+
+        value = lower_op(lowerer, op, type, node->offset, current, value);
+    }
+
+    lower_write(lowerer, variable, lowerer->block, value);
+}
+
+static void lower_import(Lowerer *lowerer, Node *node) {
+    int value = lower_add(lowerer, IrOp_IMPORT, Type_DYNAMIC, node->offset);
+    lowerer->program->values[value].name = node->import_module;
+
+    if (node->type == NodeType_IMPORTF) value = lower_member(lowerer, value, node->import_member, node->offset);
+
+    lower_write(lowerer, lower_declare(lowerer, node->import_slot, Type_DYNAMIC), lowerer->block, value);
+}
+
+static void lower_stmt(Lowerer *lowerer, Node *node) {
+    switch (node->type) {
+        case NodeType_DECL: {
+            int value = lower_expr(lowerer, node->decl_expr);
+            lower_write(lowerer, lower_declare(lowerer, node->decl_slot, lower_type(node)), lowerer->block, value);
+            break;
+        }
+
+        case NodeType_DECLN: {
+            int variable = lower_declare(lowerer, node->decln_slot, lower_type(node));
+            lower_write(lowerer, variable, lowerer->block,
+                        lower_add(lowerer, IrOp_UNDEF, lowerer->variables[variable], node->offset));
+            break;
+        }
+
+        case NodeType_ASSIGN:
+            lower_assign(lowerer, node);
+            break;
+
+        case NodeType_IMPORT:
+        case NodeType_IMPORTF:
+            lower_import(lowerer, node);
+            break;
+
+        case NodeType_ENUM:
+            lower_enum(lowerer, node);
+            break;
+
+        case NodeType_BODY:
+            lower_body(lowerer, node);
+            break;
+
+        case NodeType_WHILE:
+            lower_while(lowerer, node);
+            break;
+
+        case NodeType_REPEAT:
+            lower_repeat(lowerer, node);
+            break;
+
+        case NodeType_FOR:
+            lower_for(lowerer, node);
+            break;
+
+        // Only lowered for what they do, their values aren't used
+        default:
+            lower_expr(lowerer, node);
+            break;
+    }
+}
+
+static void lower_statements(Lowerer *lowerer, Node *body) {
+    NodeArray *statements = Node_body(body);
+
+    for (size_t i = 0; i < statements->used; i++) {
+        NodeType type = statements->array[i].type;
+
+        if (type == NodeType_IF || type == NodeType_ELIF || type == NodeType_ELSE)
+            i = lower_if(lowerer, statements, i);
+        else
+            lower_stmt(lowerer, &(statements->array[i]));
+    }
+}
+
+/**
+ * @brief Lower a body that was resolved with resolve() and checked with
+ *        typecheck() into a new program
+ *
+ * The program is compacted, its blocks are in reverse postorder. Names
+ * and strings of the program point into the tree.
+ *
+ * @param body Body node returned by the parser
+ * @return New program, verify it with IrProgram_verify
+ */
+IrProgram *ir_lower(Node *body) {
+    Lowerer lowerer;
+
+    lowerer.program = IrProgram_new();
+
+    lowerer.variable_size = 64;
+    lowerer.variable_count = 0;
+    lowerer.variables = (TypeId *)dust_malloc(sizeof(TypeId) * lowerer.variable_size);
+    lowerer.slot_size = 64;
+    lowerer.slot_count = 0;
+    lowerer.slots = (int *)dust_malloc(sizeof(int) * lowerer.slot_size);
+    lowerer.frame_size = 16;
+    lowerer.frame_count = 0;
+    lowerer.frames = (size_t *)dust_malloc(sizeof(size_t) * lowerer.frame_size);
+    lowerer.def_size = 256;
+    lowerer.def_count = 0;
+    lowerer.defs = (LowerDef *)dust_malloc(sizeof(LowerDef) * lowerer.def_size);
+    for (size_t i = 0; i < lowerer.def_size; i++) lowerer.defs[i].value = IR_NONE;
+    lowerer.incomplete_size = 16;
+    lowerer.incomplete_count = 0;
+    lowerer.incomplete = (LowerIncomplete *)dust_malloc(sizeof(LowerIncomplete) * lowerer.incomplete_size);
+    lowerer.sealed_size = 16;
+    lowerer.sealed = (bool *)dust_calloc(lowerer.sealed_size, sizeof(bool));
+    lowerer.forward_size = 64;
+    lowerer.forward = (int *)dust_malloc(sizeof(int) * lowerer.forward_size);
+    for (size_t i = 0; i < lowerer.forward_size; i++) lowerer.forward[i] = IR_NONE;
+
+    lowerer.block = lower_block(&lowerer);
+    lower_seal(&lowerer, lowerer.block);
+
+    lower_body(&lowerer, body);
+    lower_add(&lowerer, IrOp_RETURN, Type_NONE, 0);
+    lower_finish(&lowerer);
+
+    IrProgram_compact(lowerer.program);
+
+    dust_free(lowerer.variables);
+    dust_free(lowerer.slots);
+    dust_free(lowerer.frames);
+    dust_free(lowerer.defs);
+    dust_free(lowerer.incomplete);
+    dust_free(lowerer.sealed);
+    dust_free(lowerer.forward);
+
+    return lowerer.program;
+}
@@ -0,0 +1,1228 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+
+  module.c  -  Module loader
+  -------------------------------------------------
+  `import x;` names the file x.dust, looked up in the
+  importing file's directory and then in the directory
+  of the first loaded file. Every file is loaded once,
+  by its canonical path, however many modules import
+  it. A module is read and parsed by a task of the
+  shared scheduler that spawns a task for each new
+  module its imports name, so the import graph is
+  discovered and parsed at the same time and modules
+  that don't depend on each other are parsed in
+  parallel. Once every task is done, the graph is
+  walked from the loaded file to order the modules
+  after their imports and to report import cycles.
+
+  Parsed trees can be cached on disk, keyed by the
+  canonical path and checked against a hash of the
+  source, so unchanged modules aren't parsed again by
+  the next process.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <setjmp.h>
+#include <sys/stat.h>
+#include "dust/platform.h"
+#include "dust/ustring.h"
+#include "dust/error.h"
+#include "dust/source.h"
+#include "dust/tokenizer.h"
+#include "dust/parser.h"
+#include "dust/io.h"
+#include "dust/module.h"
+#include "dust/allocator.h"
+#include "dust/alloc.h"
+
+
+// Marks of the walk ordering modules after their imports
+#define MODULE_UNVISITED 0
+#define MODULE_VISITING 1
+#define MODULE_ORDERED 2
+
+// "DSTC", first word of a cached tree
+#define CACHE_MAGIC 0x43545344
+
+// Written in place of a missing node, string or array
+#define CACHE_NONE 0xffffffff
+
+// Words before the tree: magic, version, fold, source length, source hash, tree hash
+#define CACHE_HEADER 9
+
+
+/**
+ * @param loader Loader the module belongs to
+ * @param module Module to load
+ */
+typedef struct {
+    Loader *loader;
+    Module *module;
+} LoadJob;
+
+/**
+ * @param module Module being visited
+ * @param next Index of its next import to visit
+ */
+typedef struct {
+    Module *module;
+    size_t next;
+} LoadFrame;
+
+
+// FNV-1a, continued from hash
+static uint64_t module_hash(uint64_t hash, void *data, size_t size) {
+    unsigned char *bytes = (unsigned char *)data;
+
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+static char *module_strdup(char *string) {
+    char *copy = (char *)dust_malloc(strlen(string) + 1);
+    strcpy(copy, string);
+    return copy;
+}
+
+// Last separator of a path (NULL if it has none)
+static char *module_separator(char *path) {
+    char *slash = strrchr(path, '/');
+
+    #if OS == OS_WINDOWS
+    char *backslash = strrchr(path, '\\');
+    if (backslash != NULL && (slash == NULL || backslash > slash)) slash = backslash;
+    #endif
+
+    return slash;
+}
+
+// Directory part of a path ("" if it has none)
+static char *module_directory(char *path) {
+    char *slash = module_separator(path);
+    size_t length = 0;
+
+    // The root keeps its separator
+    if (slash != NULL) length = slash == path ? 1 : (size_t)(slash - path);
+
+    char *directory = (char *)dust_malloc(length + 1);
+    memcpy(directory, path, length);
+    directory[length] = '\0';
+    return directory;
+}
+
+// File name of a path without the .dust extension
+static char *module_name(char *path) {
+    char *slash = module_separator(path);
+    char *name = slash == NULL ? path : slash + 1;
+    size_t length = strlen(name);
+
+    if (length > 5 && !strcmp(name + length - 5, ".dust")) length -= 5;
+
+    char *copy = (char *)dust_malloc(length + 1);
+    memcpy(copy, name, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+static char *module_path(char *directory, char *name) {
+    char *path = (char *)dust_malloc(strlen(directory) + strlen(name) + 7);
+
+    if (directory[0] == '\0') sprintf(path, "%s.dust", name);
+    else sprintf(path, "%s/%s.dust", directory, name);
+
+    return path;
+}
+
+// Canonical path of a regular file (NULL if there is no such file)
+static char *module_canonical(char *path) {
+    struct stat info;
+    char *resolved;
+
+    if (stat(path, &info) != 0 || (info.st_mode & S_IFMT) != S_IFREG) return NULL;
+
+    #if OS == OS_WINDOWS
+    resolved = _fullpath(NULL, path, 0);
+    #else
+    resolved = realpath(path, NULL);
+    #endif
+
+    if (resolved == NULL) return NULL;
+
+    char *key = module_strdup(resolved);
+    free(resolved);
+    return key;
+}
+
+// Read a whole file as bytes
+static char *module_read(char *path, size_t *length) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return NULL;
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    if (size < 0) {
+        fclose(file);
+        return NULL;
+    }
+
+    char *data = (char *)dust_malloc(size + 1);
+    size_t read = fread(data, 1, size, file);
+    fclose(file);
+
+    if (read != (size_t)size) {
+        dust_free(data);
+        return NULL;
+    }
+
+    data[size] = '\0';
+    *length = size;
+    return data;
+}
+
+
+/**
+ * @brief Directory trees are cached in when --cache isn't given one,
+ *        $XDG_CACHE_HOME/dust or ~/.cache/dust (%LOCALAPPDATA%\dust)
+ *
+ * @return Path of the directory (NULL if there is no home to put it in)
+ */
+char *module_cache_dir() {
+    static char path[4096];
+
+    #if OS == OS_WINDOWS
+
+    char *local = getenv("LOCALAPPDATA");
+    if (local == NULL || strlen(local) + sizeof("\\dust") > sizeof(path)) return NULL;
+
+    snprintf(path, sizeof(path), "%s\\dust", local);
+
+    #else
+
+    char *cache = getenv("XDG_CACHE_HOME");
+    char *home = getenv("HOME");
+
+    if (cache != NULL && cache[0] != '\0' && strlen(cache) + sizeof("/dust") <= sizeof(path)) {
+        snprintf(path, sizeof(path), "%s/dust", cache);
+    }
+    else if (home != NULL && strlen(home) + sizeof("/.cache/dust") <= sizeof(path)) {
+        snprintf(path, sizeof(path), "%s/.cache", home);
+        create_dir(path);
+        snprintf(path, sizeof(path), "%s/.cache/dust", home);
+    }
+    else return NULL;
+
+    #endif
+
+    return path;
+}
+
+
+/**
+ * @brief Tree being written into a cache file, as 4 byte words so
+ *        names can be used where they are once it is read back
+ *
+ * @param words Written words
+ * @param used Number of words written
+ * @param size Allocated size of words
+ * @param failed The tree has a node that isn't cached
+ */
+typedef struct {
+    uint32_t *words;
+    size_t used;
+    size_t size;
+    bool failed;
+} CacheWriter;
+
+/**
+ * @brief Cache file being read back into a tree
+ *
+ * @param words Words of the file
+ * @param used Number of words read
+ * @param length Number of words of the file
+ * @param failed The file ended early or has a malformed node
+ * @param arena Arena the nodes are read into
+ * @param arrays Node arrays read so far, freed if reading fails
+ * @param array_count Number of node arrays
+ * @param array_size Allocated size of arrays
+ */
+typedef struct {
+    uint32_t *words;
+    size_t used;
+    size_t length;
+    bool failed;
+    NodeArena *arena;
+    NodeArray **arrays;
+    size_t array_count;
+    size_t array_size;
+} CacheReader;
+
+static void cache_word(CacheWriter *writer, uint32_t word) {
+    if (writer->used == writer->size) {
+        writer->size *= 2;
+        writer->words = (uint32_t *)dust_realloc(writer->words, sizeof(uint32_t) * writer->size);
+    }
+
+    writer->words[writer->used++] = word;
+}
+
+static void cache_wide(CacheWriter *writer, uint64_t value) {
+    cache_word(writer, (uint32_t)value);
+    cache_word(writer, (uint32_t)(value >> 32));
+}
+
+static void cache_string(CacheWriter *writer, u32char *string) {
+    if (string == NULL) {
+        cache_word(writer, CACHE_NONE);
+        return;
+    }
+
+    size_t length = u32len(string);
+    cache_word(writer, (uint32_t)length);
+
+    for (size_t i = 0; i < length; i++) cache_word(writer, string[i]);
+    cache_word(writer, 0);
+}
+
+static void cache_node(CacheWriter *writer, Node *node);
+
+static void cache_array(CacheWriter *writer, NodeArray *array) {
+    if (array == NULL) {
+        cache_word(writer, CACHE_NONE);
+        return;
+    }
+
+    cache_word(writer, (uint32_t)array->used);
+    for (size_t i = 0; i < array->used; i++) cache_node(writer, &array->array[i]);
+}
+
+static void cache_node(CacheWriter *writer, Node *node) {
+    if (node == NULL) {
+        cache_word(writer, CACHE_NONE);
+        return;
+    }
+
+    cache_word(writer, node->type);
+    cache_wide(writer, node->offset);
+
+    switch (node->type) {
+        case NodeType_INTEGER:
+            cache_wide(writer, (uint64_t)(int64_t)node->integer);
+            break;
+
+        case NodeType_FLOAT: {
+            uint64_t bits;
+            memcpy(&bits, &node->floating, sizeof(bits));
+            cache_wide(writer, bits);
+            break;
+        }
+
+        case NodeType_STRING: cache_string(writer, node->string); break;
+        case NodeType_VAR: cache_string(writer, node->variable); break;
+        case NodeType_PRIMITIVE: cache_string(writer, node->primitive); break;
+        case NodeType_FUNCBASE: cache_string(writer, node->func_base); break;
+
+        case NodeType_ARRAY:
+            cache_word(writer, node->array_empty);
+            cache_array(writer, node->array_nodearray);
+            break;
+
+        case NodeType_DECL:
+            cache_node(writer, node->decl_type);
+            cache_string(writer, node->decl_var);
+            cache_node(writer, node->decl_expr);
+            break;
+
+        case NodeType_DECLN:
+            cache_node(writer, node->decln_type);
+            cache_string(writer, node->decln_var);
+            break;
+
+        case NodeType_ASSIGN:
+            cache_string(writer, node->assign_var);
+            cache_string(writer, node->assign_op);
+            cache_node(writer, node->assign_expr);
+            break;
+
+        case NodeType_BINOP:
+            cache_word(writer, node->bin_optype);
+            cache_node(writer, node->bin_left);
+            cache_node(writer, node->bin_right);
+            break;
+
+        case NodeType_UNARYOP:
+        case NodeType_RUNARYOP:
+            cache_word(writer, node->unary_optype);
+            cache_node(writer, node->unary_right);
+            break;
+
+        case NodeType_IMPORT:
+            cache_string(writer, node->import_module);
+            break;
+
+        case NodeType_IMPORTF:
+            cache_string(writer, node->import_module);
+            cache_string(writer, node->import_member);
+            break;
+
+        case NodeType_CHILD:
+            cache_node(writer, node->chld_parent);
+            cache_node(writer, node->chld_child);
+            break;
+
+        case NodeType_SUBSCRIPT:
+            cache_node(writer, node->subs_node);
+            cache_node(writer, node->subs_expr);
+            break;
+
+        case NodeType_CALL:
+            cache_node(writer, node->call_base);
+            cache_array(writer, node->call_args);
+            break;
+
+        case NodeType_ENUM:
+            cache_string(writer, node->enum_name);
+            cache_node(writer, node->enum_body);
+            break;
+
+        case NodeType_BODY:
+            cache_word(writer, (uint32_t)node->body_tokens);
+            cache_array(writer, Node_body(node));
+            break;
+
+        case NodeType_GENTYPE:
+            cache_word(writer, (uint32_t)node->gentype_tokens);
+            cache_string(writer, node->gentype_base);
+            cache_array(writer, node->gentype);
+            break;
+
+        case NodeType_IF:
+        case NodeType_ELIF:
+        case NodeType_REPEAT:
+        case NodeType_WHILE:
+            // Same layout for all of them
+            cache_node(writer, node->if_expr);
+            cache_node(writer, node->if_body);
+            break;
+
+        case NodeType_ELSE:
+            cache_node(writer, node->else_body);
+            break;
+
+        case NodeType_FOR:
+            cache_node(writer, node->for_var);
+            cache_node(writer, node->for_expr);
+            cache_node(writer, node->for_body);
+            break;
+
+        // Only made by later stages, trees are cached right after parsing
+        default:
+            writer->failed = true;
+            break;
+    }
+}
+
+static uint32_t cache_read_word(CacheReader *reader) {
+    if (reader->used >= reader->length) {
+        reader->failed = true;
+        return 0;
+    }
+
+    return reader->words[reader->used++];
+}
+
+static uint64_t cache_read_wide(CacheReader *reader) {
+    uint64_t low = cache_read_word(reader);
+    uint64_t high = cache_read_word(reader);
+    return low | (high << 32);
+}
+
+// String in the file itself, it ends with a 0 word
+static u32char *cache_read_string(CacheReader *reader) {
+    uint32_t length = cache_read_word(reader);
+
+    if (reader->failed || length == CACHE_NONE) return NULL;
+
+    if (length >= reader->length - reader->used || reader->words[reader->used + length] != 0) {
+        reader->failed = true;
+        return NULL;
+    }
+
+    u32char *string = (u32char *)&reader->words[reader->used];
+    reader->used += length + 1;
+    return string;
+}
+
+static Node *cache_alloc(CacheReader *reader) {
+    if (reader->arena->used == reader->arena->size) {
+        NodeArena *chunk = NodeArena_new(reader->arena->size);
+        chunk->next = reader->arena;
+        reader->arena = chunk;
+    }
+
+    Node *node = &reader->arena->nodes[reader->arena->used++];
+    node->pooled = true;
+    node->vtype = 0;
+    return node;
+}
+
+static Node *cache_read_node(CacheReader *reader);
+
+static NodeArray *cache_read_array(CacheReader *reader) {
+    uint32_t count = cache_read_word(reader);
+
+    if (reader->failed || count == CACHE_NONE) return NULL;
+
+    // Every node takes 3 words at least
+    if (count > (reader->length - reader->used) / 3) {
+        reader->failed = true;
+        return NULL;
+    }
+
+    NodeArray *array = NodeArray_new(count > 0 ? count : 1);
+
+    if (reader->array_count == reader->array_size) {
+        reader->array_size *= 2;
+        reader->arrays = (NodeArray **)dust_realloc(reader->arrays, sizeof(NodeArray *) * reader->array_size);
+    }
+    reader->arrays[reader->array_count++] = array;
+
+    for (uint32_t i = 0; i < count; i++) {
+        Node *node = cache_read_node(reader);
+
+        if (node == NULL) {
+            reader->failed = true;
+            break;
+        }
+
+        NodeArray_append(array, node);
+    }
+
+    return array;
+}
+
+static Node *cache_read_node(CacheReader *reader) {
+    uint32_t type = cache_read_word(reader);
+
+    if (reader->failed || type == CACHE_NONE) return NULL;
+
+    if (type > NodeType_CONVERT) {
+        reader->failed = true;
+        return NULL;
+    }
+
+    Node *node = cache_alloc(reader);
+    node->type = (NodeType)type;
+    node->offset = (size_t)cache_read_wide(reader);
+
+    switch (node->type) {
+        case NodeType_INTEGER:
+            node->integer = (long)(int64_t)cache_read_wide(reader);
+            break;
+
+        case NodeType_FLOAT: {
+            uint64_t bits = cache_read_wide(reader);
+            memcpy(&node->floating, &bits, sizeof(bits));
+            break;
+        }
+
+        // Literals are freed with their node, so they get their own copy
+        case NodeType_STRING: {
+            node->string = NULL;
+            u32char *string = cache_read_string(reader);
+
+            if (string != NULL) {
+                size_t size = sizeof(u32char) * (u32len(string) + 1);
+                node->string = (u32char *)dust_malloc(size);
+                memcpy(node->string, string, size);
+            }
+            break;
+        }
+
+        case NodeType_VAR:
+            node->variable = cache_read_string(reader);
+            node->var_depth = NODE_UNRESOLVED;
+            node->var_slot = NODE_UNRESOLVED;
+            break;
+
+        case NodeType_PRIMITIVE: node->primitive = cache_read_string(reader); break;
+        case NodeType_FUNCBASE: node->func_base = cache_read_string(reader); break;
+
+        case NodeType_ARRAY:
+            node->array_empty = cache_read_word(reader) != 0;
+            node->array_nodearray = cache_read_array(reader);
+            break;
+
+        case NodeType_DECL:
+            node->decl_type = cache_read_node(reader);
+            node->decl_var = cache_read_string(reader);
+            node->decl_expr = cache_read_node(reader);
+            node->decl_slot = NODE_UNRESOLVED;
+            break;
+
+        case NodeType_DECLN:
+            node->decln_type = cache_read_node(reader);
+            node->decln_var = cache_read_string(reader);
+            node->decln_slot = NODE_UNRESOLVED;
+            break;
+
+        case NodeType_ASSIGN:
+            node->assign_var = cache_read_string(reader);
+            node->assign_op = cache_read_string(reader);
+            node->assign_expr = cache_read_node(reader);
+            node->assign_depth = NODE_UNRESOLVED;
+            node->assign_slot = NODE_UNRESOLVED;
+            break;
+
+        case NodeType_BINOP:
+            node->bin_optype = (OpType)cache_read_word(reader);
+            node->bin_left = cache_read_node(reader);
+            node->bin_right = cache_read_node(reader);
+            break;
+
+        case NodeType_UNARYOP:
+        case NodeType_RUNARYOP:
+            node->unary_optype = (OpType)cache_read_word(reader);
+            node->unary_right = cache_read_node(reader);
+            break;
+
+        case NodeType_IMPORT:
+            node->import_module = cache_read_string(reader);
+            node->import_member = NULL;
+            node->import_slot = NODE_UNRESOLVED;
+            break;
+
+        case NodeType_IMPORTF:
+            node->import_module = cache_read_string(reader);
+            node->import_member = cache_read_string(reader);
+            node->import_slot = NODE_UNRESOLVED;
+            break;
+
+        case NodeType_CHILD:
+            node->chld_parent = cache_read_node(reader);
+            node->chld_child = cache_read_node(reader);
+            break;
+
+        case NodeType_SUBSCRIPT:
+            node->subs_node = cache_read_node(reader);
+            node->subs_expr = cache_read_node(reader);
+            break;
+
+        case NodeType_CALL:
+            node->call_base = cache_read_node(reader);
+            node->call_args = cache_read_array(reader);
+            break;
+
+        case NodeType_ENUM:
+            node->enum_name = cache_read_string(reader);
+            node->enum_body = cache_read_node(reader);
+            node->enum_slot = NODE_UNRESOLVED;
+            break;
+
+        case NodeType_BODY:
+            node->body_tokens = (int)cache_read_word(reader);
+            node->body = cache_read_array(reader);
+            node->body_slots = 0;
+            node->body_lazy = NULL;
+            node->body_arena = NULL;
+            if (node->body == NULL) reader->failed = true;
+            break;
+
+        case NodeType_GENTYPE:
+            node->gentype_tokens = (int)cache_read_word(reader);
+            node->gentype_base = cache_read_string(reader);
+            node->gentype = cache_read_array(reader);
+            break;
+
+        case NodeType_IF:
+        case NodeType_ELIF:
+        case NodeType_REPEAT:
+        case NodeType_WHILE:
+            node->if_expr = cache_read_node(reader);
+            node->if_body = cache_read_node(reader);
+            break;
+
+        case NodeType_ELSE:
+            node->else_body = cache_read_node(reader);
+            break;
+
+        case NodeType_FOR:
+            node->for_var = cache_read_node(reader);
+            node->for_expr = cache_read_node(reader);
+            node->for_body = cache_read_node(reader);
+            break;
+
+        default:
+            reader->failed = true;
+            break;
+    }
+
+    return node;
+}
+
+// Release what was read before the file turned out to be malformed
+static void cache_read_free(CacheReader *reader) {
+    for (NodeArena *chunk = reader->arena; chunk != NULL; chunk = chunk->next)
+        for (size_t i = 0; i < chunk->used; i++)
+            if (chunk->nodes[i].type == NodeType_STRING) dust_free(chunk->nodes[i].string);
+
+    for (size_t i = 0; i < reader->array_count; i++) NodeArray_free(reader->arrays[i]);
+
+    NodeArena_free(reader->arena);
+    dust_free(reader->arrays);
+}
+
+static char *cache_path(Loader *loader, Module *module) {
+    char *path = (char *)dust_malloc(strlen(loader->cache_dir) + 24);
+    sprintf(path, "%s/%016llx.dustc", loader->cache_dir, (unsigned long long)module->hash);
+    return path;
+}
+
+/**
+ * @brief Read the tree of a module from the cache
+ *
+ * @param loader Loader
+ * @param module Module, its source is set
+ * @param hash Hash of the module's file
+ * @return false if the tree isn't cached or it was cached for another
+ *         version of the file
+ */
+static bool cache_restore(Loader *loader, Module *module, uint64_t hash) {
+    char *path = cache_path(loader, module);
+    size_t size;
+    char *data = module_read(path, &size);
+
+    dust_free(path);
+    if (data == NULL) return false;
+
+    uint32_t *words = (uint32_t *)data;
+    size_t length = size / sizeof(uint32_t);
+
+    if (size % sizeof(uint32_t) != 0 || length < CACHE_HEADER ||
+        words[0] != CACHE_MAGIC || words[1] != MODULE_CACHE_VERSION ||
+        words[2] != (uint32_t)PARSER_FOLD ||
+        ((uint64_t)words[3] | (uint64_t)words[4] << 32) != (uint64_t)module->source->length ||
+        ((uint64_t)words[5] | (uint64_t)words[6] << 32) != hash ||
+        ((uint64_t)words[7] | (uint64_t)words[8] << 32) !=
+            module_hash(0xcbf29ce484222325ULL, words + CACHE_HEADER, sizeof(uint32_t) * (length - CACHE_HEADER))) {
+        dust_free(data);
+        return false;
+    }
+
+    CacheReader reader;
+    reader.words = words;
+    reader.used = CACHE_HEADER;
+    reader.length = length;
+    reader.failed = false;
+    reader.arena = NodeArena_new(PARSER_ARENA_SIZE);
+    reader.arrays = (NodeArray **)dust_malloc(sizeof(NodeArray *) * 16);
+    reader.array_count = 0;
+    reader.array_size = 16;
+
+    Node *body = cache_read_node(&reader);
+
+    if (reader.failed || body == NULL || body->type != NodeType_BODY || reader.used != length) {
+        cache_read_free(&reader);
+        dust_free(data);
+        return false;
+    }
+
+    // The root owns the arena, like the ones parse_body_parallel returns
+    module->tree = NodeBody_new(body->body, body->body_tokens);
+    module->tree->offset = body->offset;
+    module->tree->body_arena = reader.arena;
+    module->cache = words;
+
+    dust_free(reader.arrays);
+    return true;
+}
+
+/**
+ * @brief Write the tree of a module into the cache, replacing the
+ *        file at once so other processes never read it half written
+ *
+ * @param loader Loader
+ * @param module Module, its tree is set
+ * @param hash Hash of the module's file
+ */
+static void cache_store(Loader *loader, Module *module, uint64_t hash) {
+    CacheWriter writer;
+    writer.size = 1024;
+    writer.words = (uint32_t *)dust_malloc(sizeof(uint32_t) * writer.size);
+    writer.used = 0;
+    writer.failed = false;
+
+    for (int i = 0; i < CACHE_HEADER; i++) cache_word(&writer, 0);
+    cache_node(&writer, module->tree);
+
+    if (!writer.failed) {
+        uint64_t tree = module_hash(0xcbf29ce484222325ULL, writer.words + CACHE_HEADER,
+                                    sizeof(uint32_t) * (writer.used - CACHE_HEADER));
+
+        writer.words[0] = CACHE_MAGIC;
+        writer.words[1] = MODULE_CACHE_VERSION;
+        writer.words[2] = (uint32_t)PARSER_FOLD;
+        writer.words[3] = (uint32_t)module->source->length;
+        writer.words[4] = (uint32_t)((uint64_t)module->source->length >> 32);
+        writer.words[5] = (uint32_t)hash;
+        writer.words[6] = (uint32_t)(hash >> 32);
+        writer.words[7] = (uint32_t)tree;
+        writer.words[8] = (uint32_t)(tree >> 32);
+
+        char *path = cache_path(loader, module);
+        Writer *out = Writer_open(path);
+
+        if (out != NULL) {
+            Writer_write(out, (char *)writer.words, sizeof(uint32_t) * writer.used);
+            Writer_close(out);
+        }
+
+        dust_free(path);
+    }
+
+    dust_free(writer.words);
+}
+
+
+static Module *Module_new(char *path, char *key, uint64_t hash) {
+    Module *module = (Module *)dust_malloc(sizeof(Module));
+    module->name = module_name(path);
+    module->path = module_strdup(path);
+    module->key = key;
+    module->hash = hash;
+    module->source = NULL;
+    module->tree = NULL;
+    module->tokens = NULL;
+    module->cache = NULL;
+    module->imports = NULL;
+    module->import_count = 0;
+    module->errors = NULL;
+    module->error_count = 0;
+    module->mark = MODULE_UNVISITED;
+    module->next = NULL;
+    return module;
+}
+
+static void Module_free(Module *module) {
+    if (module->tree != NULL) Node_free(module->tree);
+    if (module->tokens != NULL) TokenArray_free(module->tokens);
+    if (module->source != NULL) Source_free(module->source);
+
+    for (size_t i = 0; i < module->error_count; i++) dust_free(module->errors[i]);
+
+    dust_free(module->cache);
+    dust_free(module->errors);
+    dust_free(module->imports);
+    dust_free(module->name);
+    dust_free(module->path);
+    dust_free(module->key);
+    dust_free(module);
+}
+
+// Add a diagnostic that is already formatted
+static void module_report(Module *module, char *text) {
+    module->errors = (char **)dust_realloc(module->errors, sizeof(char *) * (module->error_count + 1));
+    module->errors[module->error_count++] = text;
+}
+
+// Add a diagnostic pointing at offset in the module's source
+static void module_error(Module *module, ErrorType type, char *message, size_t offset) {
+    u32char *text = utf8_to_utf32(message);
+    Source *source = CURRENT_SOURCE;
+
+    CURRENT_SOURCE = module->source;
+    module_report(module, report_text(type, text, offset, ERROR_ANSI));
+    CURRENT_SOURCE = source;
+
+    dust_free(text);
+}
+
+
+/**
+ * @brief Create a new loader
+ *
+ * @param cache_dir Directory parsed trees are cached in, created if it
+ *                  doesn't exist (NULL to not cache)
+ * @return Loader's pointer
+ */
+Loader *Loader_new(char *cache_dir) {
+    Loader *loader = (Loader *)dust_malloc(sizeof(Loader));
+
+    loader->root = NULL;
+    loader->cache_dir = NULL;
+    loader->lazy = false;
+
+    if (cache_dir != NULL) {
+        create_dir(cache_dir);
+        loader->cache_dir = module_strdup(cache_dir);
+    }
+
+    for (size_t i = 0; i < LOADER_BUCKETS; i++) loader->buckets[i] = NULL;
+
+    loader->size = 16;
+    loader->modules = (Module **)dust_malloc(sizeof(Module *) * loader->size);
+    loader->count = 0;
+    loader->order = NULL;
+    loader->order_count = 0;
+    loader->parsed = 0;
+    loader->cached = 0;
+    Mutex_init(&loader->lock);
+
+    return loader;
+}
+
+/**
+ * @brief Free loader along with every module it loaded
+ *
+ * @param loader Loader to free
+ */
+void Loader_free(Loader *loader) {
+    for (size_t i = 0; i < loader->count; i++) Module_free(loader->modules[i]);
+
+    Mutex_destroy(&loader->lock);
+    dust_free(loader->modules);
+    dust_free(loader->order);
+    dust_free(loader->root);
+    dust_free(loader->cache_dir);
+    dust_free(loader);
+}
+
+/**
+ * @brief Module of a file, added to the loader if it isn't in it yet
+ *
+ * @param loader Loader
+ * @param path Path of the file
+ * @param key Canonical path of the file (owned by the loader afterwards)
+ * @param added Set to whether the module is new
+ * @return Module's pointer
+ */
+static Module *loader_add(Loader *loader, char *path, char *key, bool *added) {
+    uint64_t hash = module_hash(0xcbf29ce484222325ULL, key, strlen(key));
+    Module **bucket = &loader->buckets[hash % LOADER_BUCKETS];
+    Module *module;
+
+    Mutex_lock(&loader->lock);
+
+    for (module = *bucket; module != NULL; module = module->next) {
+        if (module->hash == hash && !strcmp(module->key, key)) {
+            Mutex_unlock(&loader->lock);
+
+            dust_free(key);
+            *added = false;
+            return module;
+        }
+    }
+
+    module = Module_new(path, key, hash);
+    module->next = *bucket;
+    *bucket = module;
+
+    if (loader->count == loader->size) {
+        loader->size *= 2;
+        loader->modules = (Module **)dust_realloc(loader->modules, sizeof(Module *) * loader->size);
+    }
+    loader->modules[loader->count++] = module;
+
+    Mutex_unlock(&loader->lock);
+
+    *added = true;
+    return module;
+}
+
+static void load_task(TaskGroup *group, void *arg);
+
+// Module imported as name from a file in directory (NULL if there is no such file)
+static Module *loader_import(Loader *loader, TaskGroup *group, char *directory, char *name) {
+    char *path = module_path(directory, name);
+    char *key = module_canonical(path);
+
+    if (key == NULL && strcmp(directory, loader->root)) {
+        dust_free(path);
+        path = module_path(loader->root, name);
+        key = module_canonical(path);
+    }
+
+    if (key == NULL) {
+        dust_free(path);
+        return NULL;
+    }
+
+    bool added;
+    Module *module = loader_add(loader, path, key, &added);
+
+    if (added) {
+        LoadJob *job = (LoadJob *)dust_malloc(sizeof(LoadJob));
+        job->loader = loader;
+        job->module = module;
+        TaskGroup_spawn(group, load_task, job);
+    }
+
+    dust_free(path);
+    return module;
+}
+
+/**
+ * @brief Read the source of a module and parse it (or read its tree
+ *        from the cache)
+ *
+ * @param loader Loader
+ * @param module Module to parse
+ */
+static void module_parse(Loader *loader, Module *module) {
+    ErrorTrap *outer = ERROR_TRAP;
+    int lazy = PARSER_LAZY;
+    ErrorTrap trap;
+    size_t length;
+    char *content = module_read(module->path, &length);
+
+    if (content == NULL) {
+        char *text = (char *)dust_malloc(strlen(module->path) + 24);
+        sprintf(text, "Couldn't read file: %s\n", module->path);
+        module_report(module, text);
+        return;
+    }
+
+    uint64_t hash = module_hash(0xcbf29ce484222325ULL, content, length);
+    u32char *raw = utf8_to_utf32(content);
+    dust_free(content);
+
+    // Kept with the module, every diagnostic about it points into it
+    module->source = Source_new(utf8_to_utf32(module->path), raw, u32len(raw));
+    module->source->owned = true;
+    CURRENT_SOURCE = module->source;
+
+    if (loader->cache_dir != NULL && cache_restore(loader, module, hash)) {
+        Mutex_lock(&loader->lock);
+        loader->cached++;
+        Mutex_unlock(&loader->lock);
+        return;
+    }
+
+    ERROR_TRAP = &trap;
+    PARSER_LAZY = loader->lazy;
+
+    if (setjmp(trap.jump) == 0) {
+        module->tokens = tokenize(raw);
+        module->tree = parse_body_parallel(module->tokens, 0);
+
+        // Lazy bodies are parsed while the tree is written, errors are still caught
+        if (loader->cache_dir != NULL) cache_store(loader, module, hash);
+
+        Mutex_lock(&loader->lock);
+        loader->parsed++;
+        Mutex_unlock(&loader->lock);
+    }
+
+    else {
+        parse_reset();
+
+        if (module->tree != NULL) {
+            Node_free(module->tree);
+            module->tree = NULL;
+        }
+
+        if (module->tokens != NULL) {
+            TokenArray_free(module->tokens);
+            module->tokens = NULL;
+        }
+
+        module_report(module, report_text(trap.type, trap.message, trap.offset, ERROR_ANSI));
+    }
+
+    ERROR_TRAP = outer;
+    PARSER_LAZY = lazy;
+}
+
+/**
+ * @brief Load a module, then spawn the loading of the modules it
+ *        imports that aren't loaded yet
+ *
+ * @param group Group the loading tasks are in
+ * @param arg Load job, freed by the task
+ */
+static void load_task(TaskGroup *group, void *arg) {
+    LoadJob *job = (LoadJob *)arg;
+    Loader *loader = job->loader;
+    Module *module = job->module;
+
+    dust_free(job);
+    module_parse(loader, module);
+
+    if (module->tree == NULL) return;
+
+    NodeArray *statements = module->tree->body;
+    char *directory = module_directory(module->path);
+
+    for (size_t i = 0; i < statements->used; i++) {
+        Node *node = &statements->array[i];
+
+        if (node->type != NodeType_IMPORT && node->type != NodeType_IMPORTF) continue;
+
+        char *name = utf32_to_utf8(node->import_module);
+        Module *imported = loader_import(loader, group, directory, name);
+
+        if (imported == NULL) {
+            char *message = (char *)dust_malloc(strlen(name) + 20);
+            sprintf(message, "No module named %s", name);
+            module_error(module, ErrorType_Import, message, node->offset);
+            dust_free(message);
+        }
+        else {
+            module->imports = (ModuleImport *)dust_realloc(module->imports, sizeof(ModuleImport) * (module->import_count + 1));
+            module->imports[module->import_count].module = imported;
+            module->imports[module->import_count].offset = node->offset;
+            module->import_count++;
+        }
+
+        dust_free(name);
+    }
+
+    dust_free(directory);
+}
+
+/**
+ * @brief Report the cycle the import closes, the modules from the
+ *        imported one to the top of the stack import each other
+ *
+ * @param stack Modules being visited, each importing the next one
+ * @param depth Number of modules on the stack
+ * @param import Import of the top module that closes the cycle
+ */
+static void loader_cycle(LoadFrame *stack, size_t depth, ModuleImport *import) {
+    size_t first = depth - 1;
+    size_t size = sizeof("Import cycle ") + strlen(import->module->name);
+
+    while (stack[first].module != import->module) first--;
+
+    for (size_t i = first; i < depth; i++) size += strlen(stack[i].module->name) + 4;
+
+    char *message = (char *)dust_malloc(size);
+    strcpy(message, "Import cycle ");
+
+    for (size_t i = first; i < depth; i++) {
+        strcat(message, stack[i].module->name);
+        strcat(message, " -> ");
+    }
+    strcat(message, import->module->name);
+
+    module_error(stack[depth - 1].module, ErrorType_Import, message, import->offset);
+    dust_free(message);
+}
+
+/**
+ * @brief Order the modules reached from entry after the ones they
+ *        import, in the order of the import statements, and report
+ *        import cycles
+ *
+ * The walk keeps its own stack, import chains can be longer than the
+ * C stack is deep.
+ *
+ * @param loader Loader
+ * @param entry First module
+ */
+static void loader_order(Loader *loader, Module *entry) {
+    if (entry->mark != MODULE_UNVISITED) return;
+
+    loader->order = (Module **)dust_realloc(loader->order, sizeof(Module *) * loader->count);
+
+    LoadFrame *stack = (LoadFrame *)dust_malloc(sizeof(LoadFrame) * loader->count);
+    size_t depth = 0;
+
+    entry->mark = MODULE_VISITING;
+    stack[depth].module = entry;
+    stack[depth].next = 0;
+    depth++;
+
+    while (depth > 0) {
+        LoadFrame *frame = &stack[depth - 1];
+        Module *module = frame->module;
+
+        if (frame->next == module->import_count) {
+            module->mark = MODULE_ORDERED;
+            loader->order[loader->order_count++] = module;
+            depth--;
+            continue;
+        }
+
+        ModuleImport *import = &module->imports[frame->next++];
+
+        if (import->module->mark == MODULE_UNVISITED) {
+            import->module->mark = MODULE_VISITING;
+            stack[depth].module = import->module;
+            stack[depth].next = 0;
+            depth++;
+        }
+
+        else if (import->module->mark == MODULE_VISITING) {
+            loader_cycle(stack, depth, import);
+        }
+    }
+
+    dust_free(stack);
+}
+
+/**
+ * @brief Load a file and every module it imports, directly or not
+ *
+ * Modules loaded by a previous call aren't read or parsed again.
+ * Diagnostics are kept in the modules, see Loader_error_count.
+ *
+ * @param loader Loader
+ * @param path Path of the file
+ * @return Module of the file (NULL if there is no such file)
+ */
+Module *Loader_load(Loader *loader, char *path) {
+    char *key = module_canonical(path);
+    bool added;
+
+    if (key == NULL) return NULL;
+
+    if (loader->root == NULL) loader->root = module_directory(path);
+
+    Module *module = loader_add(loader, path, key, &added);
+
+    if (added) {
+        TaskGroup group;
+        TaskGroup_init(&group, scheduler_shared());
+
+        LoadJob *job = (LoadJob *)dust_malloc(sizeof(LoadJob));
+        job->loader = loader;
+        job->module = module;
+        TaskGroup_spawn(&group, load_task, job);
+
+        TaskGroup_wait(&group);
+    }
+
+    loader_order(loader, module);
+    return module;
+}
+
+/**
+ * @brief Number of diagnostics of the loaded modules
+ *
+ * @param loader Loader
+ * @return Number of diagnostics
+ */
+size_t Loader_error_count(Loader *loader) {
+    size_t count = 0;
+
+    for (size_t i = 0; i < loader->count; i++) count += loader->modules[i]->error_count;
+
+    return count;
+}
@@ -14,8 +14,145 @@
 #include "dust/error.h"
 #include "dust/tokenizer.h"
 #include "dust/parser.h"
+#include "dust/typecheck.h"
+#include "dust/fold.h"
+#include "dust/thread.h"
+#include "dust/scheduler.h"
+#include "dust/trace.h"
+#include "dust/allocator.h"
+#include "dust/alloc.h"
 
 
+// Arena of the current thread, nodes are allocated with malloc if NULL
+THREAD_LOCAL NodeArena *_node_arena = NULL;
+
+/**
+ * @brief Create a new node arena chunk
+ * 
+ * @param size Number of nodes the chunk holds
+ * @return Arena's pointer
+ */
+NodeArena *NodeArena_new(size_t size) {
+    NodeArena *arena = (NodeArena *)dust_malloc(sizeof(NodeArena));
+    arena->nodes = (Node *)dust_malloc(sizeof(Node) * size);
+    arena->size = size;
+    arena->used = 0;
+    arena->next = NULL;
+    return arena;
+}
+
+/**
+ * @brief Release an arena and every chunk linked to it
+ * 
+ * @param arena Arena to free
+ */
+void NodeArena_free(NodeArena *arena) {
+    while (arena != NULL) {
+        NodeArena *next = arena->next;
+        dust_free(arena->nodes);
+        dust_free(arena);
+        arena = next;
+    }
+}
+
+/**
+ * @brief Allocate a node from the current thread's arena
+ * 
+ * @return Node's pointer
+ */
+Node *Node_alloc() {
+    Node *node;
+
+    if (_node_arena == NULL) {
+        node = (Node *)dust_malloc(sizeof(Node));
+        node->pooled = false;
+        node->vtype = 0;
+        node->offset = 0;
+        return node;
+    }
+
+    if (_node_arena->used == _node_arena->size) {
+        NodeArena *chunk = NodeArena_new(_node_arena->size);
+        chunk->next = _node_arena;
+        _node_arena = chunk;
+    }
+
+    node = &(_node_arena->nodes[_node_arena->used++]);
+    node->pooled = true;
+    node->vtype = 0;
+    node->offset = 0;
+    return node;
+}
+
+/**
+ * @brief Set where a node is in the source
+ * 
+ * @param node Node
+ * @param offset Offset of the node's first token
+ * @return The node
+ */
+static Node *node_at(Node *node, size_t offset) {
+    node->offset = offset;
+    return node;
+}
+
+/**
+ * @brief End a slice of tokens with an EOF just past its last token, so
+ *        errors at the end of the slice point there
+ * 
+ * @param slice Slice to end
+ * @param tokens Token array the slice was taken from
+ * @param start Index of the slice's first token in tokens
+ */
+static void slice_end(TokenArray *slice, TokenArray *tokens, size_t start) {
+    Token eof = {.type = TokenType_EOF, .match = 0, .data = U"", .offset = 0};
+
+    if (slice->used > 0) {
+        Token *last = &(slice->array[slice->used - 1]);
+
+        // Quotes aren't in the data of strings
+        eof.offset = last->offset + u32len(last->data) + (last->type == TokenType_STRING ? 2 : 0);
+    }
+    else if (start < tokens->used) {
+        eof.offset = tokens->array[start].offset;
+    }
+
+    TokenArray_append(slice, &eof);
+}
+
+/**
+ * @brief Find where the statement ending at a token is continued from,
+ *        the last statement of a body can leave out its ;
+ * 
+ * @param tokens Token array of the body
+ * @param index Index of the token ending the statement
+ * @return Index of the token after the statement
+ */
+static size_t statement_end(TokenArray *tokens, size_t index) {
+    if (index >= tokens->used) return index;
+
+    Token *token = &(tokens->array[index]);
+
+    // Closing brace is left for the body
+    if (token->type == TokenType_RCURLY) return index;
+
+    if (!(token->type == TokenType_NEXTSTM || token->type == TokenType_EOF)) {
+        raise(ErrorType_Syntax, U"Expected ;", token->offset);
+    }
+
+    return index + 1;
+}
+
+/**
+ * @brief Release the node itself, but not its children
+ *        (arena nodes are released with their arena)
+ * 
+ * @param node Node to release
+ */
+void Node_release(Node *node) {
+    if (!node->pooled) dust_free(node);
+}
+
 /**
  * @brief Create a new integer node
  * 
@@ -23,7 +160,7 @@
  * @return Node's pointer
  */
 Node *NodeInteger_new(long integer) {
-    Node *node = (Node *)malloc(sizeof(Node));
+    Node *node = Node_alloc();
     node->type = NodeType_INTEGER;
     node->integer = integer;
     return node;
@@ -36,7 +173,7 @@ Node *NodeInteger_new(long integer) {
  * @return Node's pointer
  */
 Node *NodeFloat_new(double floating) {
-    Node *node = (Node *)malloc(sizeof(Node));
+    Node *node = Node_alloc();
     node->type = NodeType_FLOAT;
     node->floating = floating;
     return node;
@@ -49,7 +186,7 @@ Node *NodeFloat_new(double floating) {
  * @return Node's pointer
  */
 Node *NodeString_new(u32char *str) {
-    Node *node = (Node *)malloc(sizeof(Node));
+    Node *node = Node_alloc();
     node->type = NodeType_STRING;
     node->string = str;
     return node;
@@ -63,7 +200,7 @@ Node *NodeString_new(u32char *str) {
  * @return Node's pointer
  */
 Node *NodeCall_new(Node *call_base, NodeArray *call_args) {
-    Node *node = (Node *)malloc(sizeof(Node));
+    Node *node = Node_alloc();
     node->type = NodeType_CALL;
     node->call_base = call_base;
     node->call_args = call_args;
@@ -77,7 +214,7 @@ Node *NodeCall_new(Node *call_base, NodeArray *call_args) {
  * @return Node's pointer
  */
 Node *NodeFuncBase_new(u32char *func_base) {
-    Node *node = (Node *)malloc(sizeof(Node));
+    Node *node = Node_alloc();
     node->type = NodeType_FUNCBASE;
     node->func_base = func_base;
     return node;
@@ -90,9 +227,11 @@ Node *NodeFuncBase_new(u32char *func_base) {
  * @return Node's pointer
  */
 Node *NodeVar_new(u32char *variable) {
-    Node *node = (Node *)malloc(sizeof(Node));
+    Node *node = Node_alloc();
     node->type = NodeType_VAR;
     node->variable = variable;
+    node->var_depth = NODE_UNRESOLVED;
+    node->var_slot = NODE_UNRESOLVED;
     return node;
 }
 
@@ -105,11 +244,12 @@ Node *NodeVar_new(u32char *variable) {
  * @return Node's pointer
  */
 Node *NodeDecl_new(Node *type, u32char *variable, Node *expression) {
-    Node *node = (Node *)malloc(sizeof(Node));
+    Node *node = Node_alloc();
     node->type = NodeType_DECL;
     node->decl_type = type;
     node->decl_var  = variable;
     node->decl_expr = expression;
+    node->decl_slot = NODE_UNRESOLVED;
     return node;
 }
 
@@ -121,15 +261,16 @@ Node *NodeDecl_new(Node *type, u32char *variable, Node *expression) {
  * @return Node's pointer
  */
 Node *NodeDecln_new(Node *type, u32char *variable) {
-    Node *node = (Node *)malloc(sizeof(Node));
+    Node *node = Node_alloc();
     node->type = NodeType_DECLN;
-    node->decl_type = type;
-    node->decl_var  = variable;
+    node->decln_type = type;
+    node->decln_var  = variable;
+    node->decln_slot = NODE_UNRESOLVED;
     return node;
 }
 
 Node *NodePrimitive_new(u32char *primitive) {
-    Node *node = (Node *)malloc(sizeof(Node));
+    Node *node = Node_alloc();
     node->type = NodeType_PRIMITIVE;
     node->primitive = primitive;
     return node;
@@ -143,11 +284,13 @@ Node *NodePrimitive_new(u32char *primitive) {
  * @return Node's pointer
  */
 Node *NodeAssign_new(u32char *variable, u32char *op, Node *expression) {
-    Node *node = (Node *)malloc(sizeof(Node));
+    Node *node = Node_alloc();
     node->type = NodeType_ASSIGN;
     node->assign_var = variable;
     node->assign_op = op;
     node->assign_expr = expression;
+    node->assign_depth = NODE_UNRESOLVED;
+    node->assign_slot = NODE_UNRESOLVED;
     return node;
 }
 
@@ -160,7 +303,7 @@ Node *NodeAssign_new(u32char *variable, u32char *op, Node *expression) {
  * @return Node's pointer
  */
 Node *NodeBinOp_new(OpType op, Node *left, Node *right) {
-    Node *node = (Node *)malloc(sizeof(Node));
+    Node *node = Node_alloc();
     node->type = NodeType_BINOP;
     node->bin_optype = op;
     node->bin_left = left;
@@ -176,7 +319,7 @@ Node *NodeBinOp_new(OpType op, Node *left, Node *right) {
  * @return Node's pointer
  */
 Node *NodeUnaryOp_new(OpType op, Node *right) {
-    Node *node = (Node *)malloc(sizeof(Node));
+    Node *node = Node_alloc();
     node->type = NodeType_UNARYOP;
     node->unary_optype = op;
     node->unary_right = right;
@@ -190,9 +333,11 @@ Node *NodeUnaryOp_new(OpType op, Node *right) {
  * @return Node's pointer
  */
 Node *NodeImport_new(u32char *module) {
-    Node *node = (Node *)malloc(sizeof(Node));
+    Node *node = Node_alloc();
     node->type = NodeType_IMPORT;
     node->import_module = module;
+    node->import_member = NULL;
+    node->import_slot = NODE_UNRESOLVED;
     return node;
 }
 
@@ -204,10 +349,11 @@ Node *NodeImport_new(u32char *module) {
  * @return Node's pointer
  */
 Node *NodeImportFrom_new(u32char *module, u32char *member) {
-    Node *node = (Node *)malloc(sizeof(Node));
+    Node *node = Node_alloc();
     node->type = NodeType_IMPORTF;
     node->import_module = module;
     node->import_member = member;
+    node->import_slot = NODE_UNRESOLVED;
     return node;
 }
 
@@ -219,7 +365,7 @@ Node *NodeImportFrom_new(u32char *module, u32char *member) {
  * @return Node's pointer
  */
 Node *NodeSubscript_new(Node *snode, Node *expr) {
-    Node *node = (Node *)malloc(sizeof(Node));
+    Node *node = Node_alloc();
     node->type = NodeType_SUBSCRIPT;
     node->subs_node = snode;
     node->subs_expr = expr;
@@ -234,7 +380,7 @@ Node *NodeSubscript_new(Node *snode, Node *expr) {
  * @return Node's pointer
  */
 Node *NodeChild_new(Node *parent, Node *child) {
-    Node *node = (Node *)malloc(sizeof(Node));
+    Node *node = Node_alloc();
     node->type = NodeType_CHILD;
     node->chld_parent = parent;
     node->chld_child  = child;
@@ -249,10 +395,11 @@ Node *NodeChild_new(Node *parent, Node *child) {
  * @return Node's pointer
  */
 Node *NodeEnum_new(u32char *name, Node *body) {
-    Node *node = (Node *)malloc(sizeof(Node));
+    Node *node = Node_alloc();
     node->type = NodeType_ENUM;
     node->enum_name = name;
     node->enum_body = body;
+    node->enum_slot = NODE_UNRESOLVED;
     return node;
 }
 
@@ -264,10 +411,32 @@ Node *NodeEnum_new(u32char *name, Node *body) {
  * @return Node's pointer 
  */
 Node *NodeBody_new(NodeArray *node_array, int tokens) {
-    Node *node = (Node *)malloc(sizeof(Node));
+    Node *node = Node_alloc();
     node->type = NodeType_BODY;
     node->body = node_array;
     node->body_tokens = tokens;
+    node->body_slots = 0;
+    node->body_lazy = NULL;
+    node->body_arena = NULL;
+    return node;
+}
+
+/**
+ * @brief Create a new body node that is parsed on first access
+ * 
+ * @param tokens Token array the body is in, kept until the body is parsed
+ * @param start Index of the body's first token, after its opening brace
+ * @param body_tokens Number of tokens body contains
+ * @return Node's pointer 
+ */
+Node *NodeLazyBody_new(TokenArray *tokens, size_t start, int body_tokens) {
+    Node *node = Node_alloc();
+    node->type = NodeType_BODY;
+    node->body_start = start;
+    node->body_tokens = body_tokens;
+    node->body_slots = 0;
+    node->body_lazy = tokens;
+    node->body_arena = NULL;
     return node;
 }
 
@@ -279,10 +448,11 @@ Node *NodeBody_new(NodeArray *node_array, int tokens) {
  * @return Node's pointer 
  */
 Node *NodeGenType_new(NodeArray *node_array, int tokens) {
-    Node *node = (Node *)malloc(sizeof(Node));
+    Node *node = Node_alloc();
     node->type = NodeType_GENTYPE;
     node->gentype = node_array;
     node->gentype_tokens = tokens;
+    node->gentype_base = NULL;
     return node;
 }
 
@@ -294,7 +464,7 @@ Node *NodeGenType_new(NodeArray *node_array, int tokens) {
  * @return Node's pointer
  */
 Node *NodeIf_new(Node *expression, Node *body) {
-    Node *node = (Node *)malloc(sizeof(Node));
+    Node *node = Node_alloc();
     node->type = NodeType_IF;
     node->if_expr = expression;
     node->if_body = body;
@@ -309,7 +479,7 @@ Node *NodeIf_new(Node *expression, Node *body) {
  * @return Node's pointer
  */
 Node *NodeElif_new(Node *expression, Node *body) {
-    Node *node = (Node *)malloc(sizeof(Node));
+    Node *node = Node_alloc();
     node->type = NodeType_ELIF;
     node->elif_expr = expression;
     node->elif_body = body;
@@ -323,7 +493,7 @@ Node *NodeElif_new(Node *expression, Node *body) {
  * @return Node's pointer
  */
 Node *NodeElse_new(Node *body) {
-    Node *node = (Node *)malloc(sizeof(Node));
+    Node *node = Node_alloc();
     node->type = NodeType_ELSE;
     node->else_body = body;
     return node;
@@ -337,7 +507,7 @@ Node *NodeElse_new(Node *body) {
  * @return Node's pointer
  */
 Node *NodeRepeat_new(Node *expression, Node *body) {
-    Node *node = (Node *)malloc(sizeof(Node));
+    Node *node = Node_alloc();
     node->type = NodeType_REPEAT;
     node->repeat_expr = expression;
     node->repeat_body = body;
@@ -352,7 +522,7 @@ Node *NodeRepeat_new(Node *expression, Node *body) {
  * @return Node's pointer
  */
 Node *NodeWhile_new(Node *expression, Node *body) {
-    Node *node = (Node *)malloc(sizeof(Node));
+    Node *node = Node_alloc();
     node->type = NodeType_WHILE;
     node->while_expr = expression;
     node->while_body = body;
@@ -368,7 +538,7 @@ Node *NodeWhile_new(Node *expression, Node *body) {
  * @return Node's pointer
  */
 Node *NodeFor_new(Node *var, Node *iterator, Node *body) {
-    Node *node = (Node *)malloc(sizeof(Node));
+    Node *node = Node_alloc();
     node->type = NodeType_FOR;
     node->for_var = var;
     node->for_expr = iterator;
@@ -376,6 +546,27 @@ Node *NodeFor_new(Node *var, Node *iterator, Node *body) {
     return node;
 }
 
+/**
+ * @brief Turn a node into a conversion of what it was, in place
+ *
+ * The node's content moves into a new child, so every pointer to the
+ * node now points at the conversion.
+ *
+ * @param node Node to convert
+ * @param type Type to convert to
+ */
+void Node_convert(Node *node, unsigned short type) {
+    Node *expr = Node_alloc();
+    bool pooled = expr->pooled;
+
+    *expr = *node;
+    expr->pooled = pooled;
+
+    node->type = NodeType_CONVERT;
+    node->vtype = type;
+    node->conv_expr = expr;
+}
+
 /**
  * @brief Create a new array node
  * 
@@ -384,7 +575,7 @@ Node *NodeFor_new(Node *var, Node *iterator, Node *body) {
  * @return Node's pointer
  */
 Node *NodeNArray_new(NodeArray *node_array, bool empty) {
-    Node *node = (Node *)malloc(sizeof(Node));
+    Node *node = Node_alloc();
     node->type = NodeType_ARRAY;
     node->array_nodearray = node_array;
     node->array_empty = empty;
@@ -400,7 +591,7 @@ Node *NodeNArray_new(NodeArray *node_array, bool empty) {
 void Node_free(Node *node) {
     switch (node->type) {
         case NodeType_STRING:
-            free(node->string);
+            dust_free(node->string);
             break;
 
         case NodeType_BINOP:
@@ -411,288 +602,360 @@ void Node_free(Node *node) {
         case NodeType_UNARYOP:
             Node_free(node->unary_right);
             break;
+
+        case NodeType_CONVERT:
+            Node_free(node->conv_expr);
+            break;
+
+        case NodeType_BODY:
+            if (node->body_arena != NULL) NodeArena_free(node->body_arena);
+            break;
     }
 
-    free(node);
+    Node_release(node);
 }
 
 /**
- * @brief Represent node as a string
+ * @brief Operator as written in the source
  * 
- * @param node Node to return a repr. string of
- * @param ident Indentation
- * @return Representation string
+ * @param op Operator type
+ * @return Operator's string
  */
-u32char *Node_repr(Node *node, int ident) {
-    u32char *finalstr = U"";
+u32char *Node_repr_op(OpType op) {
+    switch (op) {
+        case OpType_ADD: return U"+";
+        case OpType_SUB: return U"-";
+        case OpType_MUL: return U"*";
+        case OpType_DIV: return U"/";
+        case OpType_POW: return U"^";
+        case OpType_MOD: return U"%";
+        case OpType_RANGE: return U"..";
+        case OpType_AND: return U"and";
+        case OpType_OR: return U"or";
+        case OpType_XOR: return U"xor";
+        case OpType_NOT: return U"not";
+        case OpType_EQ: return U"==";
+        case OpType_NEQ: return U"!=";
+        case OpType_LT: return U"<";
+        case OpType_LE: return U"<=";
+        case OpType_GT: return U">";
+        case OpType_GE: return U">=";
+        case OpType_IN: return U"in";
+    }
+
+    return NULL;
+}
 
+/**
+ * @brief Write the representation of a node into a string builder
+ * 
+ * @param builder String builder to write into
+ * @param node Node to represent
+ * @param ident Indentation
+ */
+static void Node_repr_build(StringBuilder *builder, Node *node, int ident) {
     char numstr[50];
-    u32char *identstr = U"";
-    identstr = u32fill(identstr, U"  ", (ident+1)*2);
+    size_t identlen = (ident+1)*4;
+    u32char *op;
 
     switch (node->type) {
         case NodeType_INTEGER:
             sprintf(numstr, "%ld", node->integer);
-            finalstr = u32join(u32join(finalstr, u32join(U"integer: ", ascii_to_utf32(numstr))), U"\n");
+            StringBuilder_append(builder, U"integer: ");
+            for (char *c = numstr; *c; c++) StringBuilder_push(builder, *c);
+            StringBuilder_push(builder, U'\n');
             break;
 
         case NodeType_FLOAT:
             sprintf(numstr, "%lf", node->floating);
-            finalstr = u32join(u32join(finalstr, u32join(U"float: ", ascii_to_utf32(numstr))), U"\n");
+            StringBuilder_append(builder, U"float: ");
+            for (char *c = numstr; *c; c++) StringBuilder_push(builder, *c);
+            StringBuilder_push(builder, U'\n');
             break;
 
         case NodeType_STRING:
-            finalstr = u32join(u32join(finalstr, u32join(U"string: ", node->string)), U"\n");
+            StringBuilder_append(builder, U"string: ");
+            StringBuilder_append(builder, node->string);
+            StringBuilder_push(builder, U'\n');
             break;
 
         case NodeType_VAR:
-            finalstr = u32join(u32join(finalstr, u32join(U"var: ", node->variable)), U"\n");
+            StringBuilder_append(builder, U"var: ");
+            StringBuilder_append(builder, node->variable);
+            StringBuilder_push(builder, U'\n');
             break;
 
         case NodeType_CALL:
-            finalstr = u32join(finalstr, U"call:\n");
-            finalstr = u32join(finalstr, u32join(identstr, Node_repr(node->call_base, ident+1)));
+            StringBuilder_append(builder, U"call:\n");
+            StringBuilder_fill(builder, U' ', identlen);
+            Node_repr_build(builder, node->call_base, ident+1);
             if (node->call_args) {
-                finalstr = u32join(finalstr, u32join(identstr, U"args:\n"));
-                int i = 0;
-                while (i < node->call_args->used) {
-                    finalstr = u32join(finalstr, u32join(u32join(identstr, U"    "), Node_repr(&(node->call_args->array[i]), ident+2)));
-                    i++;
+                StringBuilder_fill(builder, U' ', identlen);
+                StringBuilder_append(builder, U"args:\n");
+                for (size_t i = 0; i < node->call_args->used; i++) {
+                    StringBuilder_fill(builder, U' ', identlen + 4);
+                    Node_repr_build(builder, &(node->call_args->array[i]), ident+2);
                 }
             }
             else {
-                finalstr = u32join(finalstr, u32join(identstr, U"args: no args\n"));
+                StringBuilder_fill(builder, U' ', identlen);
+                StringBuilder_append(builder, U"args: no args\n");
             }
             break;
 
         case NodeType_FUNCBASE:
-            finalstr = u32join(finalstr, u32join(U"function: ", u32join(node->func_base, U"\n")));
+            StringBuilder_append(builder, U"function: ");
+            StringBuilder_append(builder, node->func_base);
+            StringBuilder_push(builder, U'\n');
             break;
 
         case NodeType_PRIMITIVE:
-            finalstr = u32join(finalstr, u32join(U"primitive: ", u32join(node->primitive, U"\n")));
+            StringBuilder_append(builder, U"primitive: ");
+            StringBuilder_append(builder, node->primitive);
+            StringBuilder_push(builder, U'\n');
             break;
 
         case NodeType_ARRAY:
-            finalstr = u32join(finalstr, U"array:\n");
-            
-            int i = 0;
-            while (i < node->array_nodearray->used) {
-                finalstr = u32join(finalstr, u32join(identstr, Node_repr(&(node->array_nodearray->array[i]), ident+1)));
-                i++;
+            StringBuilder_append(builder, U"array:\n");
+            for (size_t i = 0; i < node->array_nodearray->used; i++) {
+                StringBuilder_fill(builder, U' ', identlen);
+                Node_repr_build(builder, &(node->array_nodearray->array[i]), ident+1);
             }
             break;
 
         case NodeType_DECL:
-            finalstr = u32join(finalstr, U"declaration:\n");
-
-            finalstr = u32join(finalstr, u32join(identstr, u32join(U"type: ", Node_repr(node->decl_type, ident+1))));
-            finalstr = u32join(u32join(finalstr, u32join(identstr, u32join(U"var: ", node->decl_var))), U"\n");
-            finalstr = u32join(finalstr, u32join(identstr, u32join(U"expr: ", Node_repr(node->decl_expr, ident+1))));
+            StringBuilder_append(builder, U"declaration:\n");
+            StringBuilder_fill(builder, U' ', identlen);
+            StringBuilder_append(builder, U"type: ");
+            Node_repr_build(builder, node->decl_type, ident+1);
+            StringBuilder_fill(builder, U' ', identlen);
+            StringBuilder_append(builder, U"var: ");
+            StringBuilder_append(builder, node->decl_var);
+            StringBuilder_push(builder, U'\n');
+            StringBuilder_fill(builder, U' ', identlen);
+            StringBuilder_append(builder, U"expr: ");
+            Node_repr_build(builder, node->decl_expr, ident+1);
             break;
 
         case NodeType_DECLN:
-            finalstr = u32join(finalstr, U"declaration:\n");
-
-            finalstr = u32join(finalstr, u32join(identstr, u32join(U"type: ", Node_repr(node->decl_type, ident+1))));
-            finalstr = u32join(u32join(finalstr, u32join(identstr, u32join(U"var: ", node->decln_var))), U"\n");
+            StringBuilder_append(builder, U"declaration:\n");
+            StringBuilder_fill(builder, U' ', identlen);
+            StringBuilder_append(builder, U"type: ");
+            Node_repr_build(builder, node->decln_type, ident+1);
+            StringBuilder_fill(builder, U' ', identlen);
+            StringBuilder_append(builder, U"var: ");
+            StringBuilder_append(builder, node->decln_var);
+            StringBuilder_push(builder, U'\n');
             break;
 
         case NodeType_ASSIGN:
-            finalstr = u32join(finalstr, U"assignment:\n");
-            finalstr = u32join(u32join(finalstr, u32join(identstr, u32join(U"var: ", node->assign_var))), U"\n");
-            finalstr = u32join(u32join(finalstr, u32join(identstr, u32join(U"op: ", node->assign_op))), U"\n");
-            finalstr = u32join(finalstr, u32join(identstr, u32join(U"expr: ", Node_repr(node->assign_expr, ident+1))));
+            StringBuilder_append(builder, U"assignment:\n");
+            StringBuilder_fill(builder, U' ', identlen);
+            StringBuilder_append(builder, U"var: ");
+            StringBuilder_append(builder, node->assign_var);
+            StringBuilder_push(builder, U'\n');
+            StringBuilder_fill(builder, U' ', identlen);
+            StringBuilder_append(builder, U"op: ");
+            StringBuilder_append(builder, node->assign_op);
+            StringBuilder_push(builder, U'\n');
+            StringBuilder_fill(builder, U' ', identlen);
+            StringBuilder_append(builder, U"expr: ");
+            Node_repr_build(builder, node->assign_expr, ident+1);
             break;
 
         case NodeType_BINOP:
-            finalstr = u32join(finalstr, U"binop:\n");
-            
-            switch (node->bin_optype) {
-                case OpType_ADD:
-                    finalstr = u32join(finalstr, u32join(identstr, U"op: +\n"));
-                    break;
-
-                case OpType_SUB:
-                    finalstr = u32join(finalstr, u32join(identstr, U"op: -\n"));
-                    break;
-
-                case OpType_MUL:
-                    finalstr = u32join(finalstr, u32join(identstr, U"op: *\n"));
-                    break;
-
-                case OpType_DIV:
-                    finalstr = u32join(finalstr, u32join(identstr, U"op: /\n"));
-                    break;
-
-                case OpType_POW:
-                    finalstr = u32join(finalstr, u32join(identstr, U"op: ^\n"));
-                    break;
-
-                case OpType_MOD:
-                    finalstr = u32join(finalstr, u32join(identstr, U"op: %\n"));
-                    break;
-
-                case OpType_RANGE:
-                    finalstr = u32join(finalstr, u32join(identstr, U"op: ..\n"));
-                    break;
-
-                case OpType_AND:
-                    finalstr = u32join(finalstr, u32join(identstr, U"op: and\n"));
-                    break;
-
-                case OpType_OR:
-                    finalstr = u32join(finalstr, u32join(identstr, U"op: or\n"));
-                    break;
-
-                case OpType_XOR:
-                    finalstr = u32join(finalstr, u32join(identstr, U"op: xor\n"));
-                    break;
-
-                case OpType_EQ:
-                    finalstr = u32join(finalstr, u32join(identstr, U"op: ==\n"));
-                    break;
-
-                case OpType_NEQ:
-                    finalstr = u32join(finalstr, u32join(identstr, U"op: !=\n"));
-                    break;
-
-                case OpType_LT:
-                    finalstr = u32join(finalstr, u32join(identstr, U"op: <\n"));
-                    break;
-
-                case OpType_LE:
-                    finalstr = u32join(finalstr, u32join(identstr, U"op: <=\n"));
-                    break;
-
-                case OpType_GT:
-                    finalstr = u32join(finalstr, u32join(identstr, U"op: >\n"));
-                    break;
-
-                case OpType_GE:
-                    finalstr = u32join(finalstr, u32join(identstr, U"op: >=\n"));
-                    break;
-
-                case OpType_IN:
-                    finalstr = u32join(finalstr, u32join(identstr, U"op: in\n"));
-                    break;
+            StringBuilder_append(builder, U"binop:\n");
+            op = Node_repr_op(node->bin_optype);
+            if (op != NULL && node->bin_optype != OpType_NOT) {
+                StringBuilder_fill(builder, U' ', identlen);
+                StringBuilder_append(builder, U"op: ");
+                StringBuilder_append(builder, op);
+                StringBuilder_push(builder, U'\n');
             }
-
-            finalstr = u32join(finalstr, u32join(identstr, Node_repr(node->bin_left, ident+1)));
-            finalstr = u32join(finalstr, u32join(identstr, Node_repr(node->bin_right, ident+1)));
+            StringBuilder_fill(builder, U' ', identlen);
+            Node_repr_build(builder, node->bin_left, ident+1);
+            StringBuilder_fill(builder, U' ', identlen);
+            Node_repr_build(builder, node->bin_right, ident+1);
             break;
 
         case NodeType_UNARYOP:
-            finalstr = u32join(finalstr, U"unaryop:\n");
-            
-            switch (node->unary_optype) {
-                case OpType_ADD:
-                    finalstr = u32join(finalstr, u32join(identstr, U"op: +\n"));
-                    break;
-
-                case OpType_SUB:
-                    finalstr = u32join(finalstr, u32join(identstr, U"op: -\n"));
-                    break;
-
-                case OpType_NOT:
-                    finalstr = u32join(finalstr, u32join(identstr, U"op: not\n"));
-                    break;
+            StringBuilder_append(builder, U"unaryop:\n");
+            if (node->unary_optype == OpType_ADD ||
+                node->unary_optype == OpType_SUB ||
+                node->unary_optype == OpType_NOT) {
+                StringBuilder_fill(builder, U' ', identlen);
+                StringBuilder_append(builder, U"op: ");
+                StringBuilder_append(builder, Node_repr_op(node->unary_optype));
+                StringBuilder_push(builder, U'\n');
             }
-
-            finalstr = u32join(finalstr, u32join(identstr, Node_repr(node->unary_right, ident+1)));
+            StringBuilder_fill(builder, U' ', identlen);
+            Node_repr_build(builder, node->unary_right, ident+1);
             break;
 
         case NodeType_IMPORT:
-            finalstr = u32join(finalstr, U"import:\n");
-            finalstr = u32join(finalstr, u32join(identstr, u32join(U"module: ", u32join(node->import_module, U"\n"))));
+            StringBuilder_append(builder, U"import:\n");
+            StringBuilder_fill(builder, U' ', identlen);
+            StringBuilder_append(builder, U"module: ");
+            StringBuilder_append(builder, node->import_module);
+            StringBuilder_push(builder, U'\n');
             break;
 
         case NodeType_IMPORTF:
-            finalstr = u32join(finalstr, U"import:\n");
-            finalstr = u32join(finalstr, u32join(identstr, u32join(U"member: ", u32join(node->import_member, U"\n"))));
-            finalstr = u32join(finalstr, u32join(identstr, U"from:\n"));
-            finalstr = u32join(finalstr, u32join(identstr, u32join(U"    ", u32join(U"module: ", u32join(node->import_module, U"\n")))));
+            StringBuilder_append(builder, U"import:\n");
+            StringBuilder_fill(builder, U' ', identlen);
+            StringBuilder_append(builder, U"member: ");
+            StringBuilder_append(builder, node->import_member);
+            StringBuilder_push(builder, U'\n');
+            StringBuilder_fill(builder, U' ', identlen);
+            StringBuilder_append(builder, U"from:\n");
+            StringBuilder_fill(builder, U' ', identlen + 4);
+            StringBuilder_append(builder, U"module: ");
+            StringBuilder_append(builder, node->import_module);
+            StringBuilder_push(builder, U'\n');
             break;
 
         case NodeType_ENUM:
-            finalstr = u32join(finalstr, U"enum:\n");
-            finalstr = u32join(finalstr, u32join(identstr, u32join(U"name: ", u32join(node->enum_name, U"\n"))));
-            finalstr = u32join(finalstr, u32join(identstr, Node_repr(node->enum_body, ident+1)));
+            StringBuilder_append(builder, U"enum:\n");
+            StringBuilder_fill(builder, U' ', identlen);
+            StringBuilder_append(builder, U"name: ");
+            StringBuilder_append(builder, node->enum_name);
+            StringBuilder_push(builder, U'\n');
+            StringBuilder_fill(builder, U' ', identlen);
+            Node_repr_build(builder, node->enum_body, ident+1);
             break;
 
-        case NodeType_BODY:
-            finalstr = u32join(finalstr, U"body:\n");
-            
-            int t = 0;
-            while (t < node->body->used) {
-                finalstr = u32join(finalstr, u32join(identstr, Node_repr(&(node->body->array[t]), ident+1)));
-                t++;
+        case NodeType_BODY: {
+            StringBuilder_append(builder, U"body:\n");
+            NodeArray *statements = Node_body(node);
+            for (size_t t = 0; t < statements->used; t++) {
+                StringBuilder_fill(builder, U' ', identlen);
+                Node_repr_build(builder, &(statements->array[t]), ident+1);
             }
             break;
+        }
 
         case NodeType_GENTYPE:
-            finalstr = u32join(finalstr, U"generic type:\n");
-            
-            int j = 0;
-            while (j < node->gentype->used) {
-                finalstr = u32join(finalstr, u32join(identstr, Node_repr(&(node->gentype->array[j]), ident+1)));
-                j++;
+            StringBuilder_append(builder, U"generic type:\n");
+            for (size_t j = 0; j < node->gentype->used; j++) {
+                StringBuilder_fill(builder, U' ', identlen);
+                Node_repr_build(builder, &(node->gentype->array[j]), ident+1);
             }
             break;
 
         case NodeType_SUBSCRIPT:
-            finalstr = u32join(finalstr, U"subscript:\n");
-            finalstr = u32join(finalstr, u32join(identstr, u32join(U"node: ", Node_repr(node->subs_node, ident+1))));
-            finalstr = u32join(finalstr, u32join(identstr, u32join(U"expr: ", Node_repr(node->subs_expr, ident+1))));
+            StringBuilder_append(builder, U"subscript:\n");
+            StringBuilder_fill(builder, U' ', identlen);
+            StringBuilder_append(builder, U"node: ");
+            Node_repr_build(builder, node->subs_node, ident+1);
+            StringBuilder_fill(builder, U' ', identlen);
+            StringBuilder_append(builder, U"expr: ");
+            Node_repr_build(builder, node->subs_expr, ident+1);
             break;
 
         case NodeType_CHILD:
-            finalstr = u32join(finalstr, U"member:\n");
-            finalstr = u32join(finalstr, u32join(identstr, u32join(U"parent: ", Node_repr(node->subs_node, ident+1))));
-            finalstr = u32join(finalstr, u32join(identstr, u32join(U"child: ", Node_repr(node->subs_expr, ident+1))));
+            StringBuilder_append(builder, U"member:\n");
+            StringBuilder_fill(builder, U' ', identlen);
+            StringBuilder_append(builder, U"parent: ");
+            Node_repr_build(builder, node->subs_node, ident+1);
+            StringBuilder_fill(builder, U' ', identlen);
+            StringBuilder_append(builder, U"child: ");
+            Node_repr_build(builder, node->subs_expr, ident+1);
             break;
 
         case NodeType_IF:
-            finalstr = u32join(finalstr, U"if:\n");
-            finalstr = u32join(finalstr, u32join(identstr, U"condition:\n"));
-            finalstr = u32join(finalstr, u32join(identstr, Node_repr(node->if_expr, ident+1)));
-            finalstr = u32join(finalstr, u32join(identstr, Node_repr(node->if_body, ident+1)));
-            break;
-
         case NodeType_ELIF:
-            finalstr = u32join(finalstr, U"elif:\n");
-            finalstr = u32join(finalstr, u32join(identstr, U"condition:\n"));
-            finalstr = u32join(finalstr, u32join(identstr, Node_repr(node->if_expr, ident+1)));
-            finalstr = u32join(finalstr, u32join(identstr, Node_repr(node->if_body, ident+1)));
+            StringBuilder_append(builder, node->type == NodeType_IF ? U"if:\n" : U"elif:\n");
+            StringBuilder_fill(builder, U' ', identlen);
+            StringBuilder_append(builder, U"condition:\n");
+            StringBuilder_fill(builder, U' ', identlen);
+            Node_repr_build(builder, node->if_expr, ident+1);
+            StringBuilder_fill(builder, U' ', identlen);
+            Node_repr_build(builder, node->if_body, ident+1);
             break;
 
         case NodeType_ELSE:
-            finalstr = u32join(finalstr, U"else:\n");
-            finalstr = u32join(finalstr, u32join(identstr, Node_repr(node->if_body, ident+1)));
+            StringBuilder_append(builder, U"else:\n");
+            StringBuilder_fill(builder, U' ', identlen);
+            Node_repr_build(builder, node->else_body, ident+1);
             break;
 
         case NodeType_REPEAT:
-            finalstr = u32join(finalstr, U"repeat:\n");
-            finalstr = u32join(finalstr, u32join(identstr, Node_repr(node->repeat_expr, ident+1)));
-            finalstr = u32join(finalstr, u32join(identstr, Node_repr(node->repeat_body, ident+1)));
+            StringBuilder_append(builder, U"repeat:\n");
+            StringBuilder_fill(builder, U' ', identlen);
+            Node_repr_build(builder, node->repeat_expr, ident+1);
+            StringBuilder_fill(builder, U' ', identlen);
+            Node_repr_build(builder, node->repeat_body, ident+1);
             break;
 
         case NodeType_WHILE:
-            finalstr = u32join(finalstr, U"while:\n");
-            finalstr = u32join(finalstr, u32join(identstr, Node_repr(node->while_expr, ident+1)));
-            finalstr = u32join(finalstr, u32join(identstr, Node_repr(node->while_body, ident+1)));
+            StringBuilder_append(builder, U"while:\n");
+            StringBuilder_fill(builder, U' ', identlen);
+            Node_repr_build(builder, node->while_expr, ident+1);
+            StringBuilder_fill(builder, U' ', identlen);
+            Node_repr_build(builder, node->while_body, ident+1);
             break;
 
         case NodeType_FOR:
-            finalstr = u32join(finalstr, U"for:\n");
-            finalstr = u32join(finalstr, u32join(identstr, Node_repr(node->for_var, ident+1)));
-            finalstr = u32join(finalstr, u32join(identstr, Node_repr(node->for_expr, ident+1)));
-            finalstr = u32join(finalstr, u32join(identstr, Node_repr(node->for_body, ident+1)));
+            StringBuilder_append(builder, U"for:\n");
+            StringBuilder_fill(builder, U' ', identlen);
+            Node_repr_build(builder, node->for_var, ident+1);
+            StringBuilder_fill(builder, U' ', identlen);
+            Node_repr_build(builder, node->for_expr, ident+1);
+            StringBuilder_fill(builder, U' ', identlen);
+            Node_repr_build(builder, node->for_body, ident+1);
             break;
-        
+
+        case NodeType_CONVERT:
+            StringBuilder_append(builder, U"convert: ");
+            Type_repr_build(builder, node->vtype);
+            StringBuilder_push(builder, U'\n');
+            StringBuilder_fill(builder, U' ', identlen);
+            Node_repr_build(builder, node->conv_expr, ident+1);
+            break;
+    }
+}
+
+/**
+ * @brief Represent node as a string
+ * 
+ * @param node Node to return a repr. string of
+ * @param ident Indentation
+ * @return Representation string
+ */
+u32char *Node_repr(Node *node, int ident) {
+    StringBuilder *builder = StringBuilder_new(256);
+    Node_repr_build(builder, node, ident);
+    return StringBuilder_finish(builder);
+}
+
+/**
+ * @brief Write the representation of a node, a body is written a
+ *        statement at a time instead of being built whole first
+ * 
+ * @param node Node to write
+ * @param writer Writer
+ */
+void Node_write(Node *node, Writer *writer) {
+    StringBuilder *builder = StringBuilder_new(256);
+
+    if (node->type != NodeType_BODY) {
+        Node_repr_build(builder, node, 0);
+        Writer_write_u32n(writer, builder->data, builder->length);
+        StringBuilder_free(builder);
+        return;
+    }
+
+    NodeArray *statements = Node_body(node);
+    Writer_write(writer, "body:\n", 6);
+
+    for (size_t t = 0; t < statements->used; t++) {
+        builder->length = 0;
+        StringBuilder_fill(builder, U' ', 4);
+        Node_repr_build(builder, &(statements->array[t]), 1);
+        Writer_write_u32n(writer, builder->data, builder->length);
     }
 
-    return finalstr;
+    StringBuilder_free(builder);
 }
 
 
@@ -703,9 +966,9 @@ u32char *Node_repr(Node *node, int ident) {
  * @return Node array's pointer
  */
 NodeArray *NodeArray_new(size_t def_size) {
-    NodeArray *node_array = (NodeArray *)malloc(sizeof(NodeArray));
+    NodeArray *node_array = (NodeArray *)dust_malloc(sizeof(NodeArray));
 
-    node_array->array = malloc(def_size * sizeof(Node));
+    node_array->array = dust_malloc(def_size * sizeof(Node));
     node_array->used = 0;
     node_array->size = def_size;
 
@@ -718,11 +981,11 @@ NodeArray *NodeArray_new(size_t def_size) {
  * @param node_array Node array to free
  */
 void NodeArray_free(NodeArray *node_array) {
-    free(node_array->array);
+    dust_free(node_array->array);
     node_array->array = NULL;
     node_array->used = 0;
     node_array->size = 0;
-    free(node_array);
+    dust_free(node_array);
 }
 
 /**
@@ -734,16 +997,88 @@ void NodeArray_free(NodeArray *node_array) {
 void NodeArray_append(NodeArray *node_array, Node *node) {
     if (node_array->used == node_array->size) {
         node_array->size *= 2;
-        node_array->array = realloc(node_array->array, node_array->size * sizeof(Node));
+        node_array->array = dust_realloc(node_array->array, node_array->size * sizeof(Node));
     }
 
     node_array->array[node_array->used++] = *node;
 }
 
 
-size_t _token_index = 0;
-size_t _last_token_count = 0;
-int _body_count = 0;
+// Parser state is per thread, so statements can be parsed in parallel
+THREAD_LOCAL size_t _token_index = 0;
+THREAD_LOCAL size_t _last_token_count = 0;
+THREAD_LOCAL int _body_count = 0;
+
+int PARSER_FOLD = 0;
+THREAD_LOCAL u32char *_fold_type = NULL;
+
+// Bodies are parsed on first access, their tokens have to be kept until then.
+// Set per thread, parse_body_parallel passes it on to its jobs
+THREAD_LOCAL int PARSER_LAZY = 0;
+
+// Token array deferred bodies view, and the index in it of the first token
+// of the array being parsed (bodies are parsed at once if it is NULL)
+THREAD_LOCAL TokenArray *_lazy_tokens = NULL;
+THREAD_LOCAL Token *_lazy_first = NULL;
+THREAD_LOCAL size_t _lazy_start = 0;
+
+
+/**
+ * @brief Reset the parser state of the current thread, after a parse
+ *        was left by an error caught with ERROR_TRAP
+ */
+void parse_reset() {
+    _token_index = 0;
+    _last_token_count = 0;
+    _body_count = 0;
+    _fold_type = NULL;
+    _node_arena = NULL;
+    _lazy_tokens = NULL;
+    _lazy_first = NULL;
+    _lazy_start = 0;
+}
+
+
+/**
+ * @brief Get statements of a body node, parsing them if it is deferred
+ * 
+ * @param node Body node
+ * @return Array of statement nodes
+ */
+NodeArray *Node_body(Node *node) {
+    if (node->body_lazy != NULL) {
+        size_t token_index = _token_index;
+        size_t last_token_count = _last_token_count;
+        TokenArray *lazy_tokens = _lazy_tokens;
+        Token *lazy_first = _lazy_first;
+        size_t lazy_start = _lazy_start;
+        int lazy = PARSER_LAZY;
+
+        // Bodies in it are deferred again, into the same tokens
+        TokenArray slice = TokenArray_view(node->body_lazy, node->body_start,
+                                           node->body_start + node->body_tokens + 1);
+        _lazy_tokens = node->body_lazy;
+        _lazy_first = node->body_lazy->array;
+        _lazy_start = 0;
+        PARSER_LAZY = 1;
+
+        _body_count++;
+        Node *body = parse_body(&slice);
+
+        _token_index = token_index;
+        _last_token_count = last_token_count;
+        _lazy_tokens = lazy_tokens;
+        _lazy_first = lazy_first;
+        _lazy_start = lazy_start;
+        PARSER_LAZY = lazy;
+
+        node->body_lazy = NULL;
+        node->body = body->body;
+        Node_release(body);
+    }
+
+    return node->body;
+}
 
 
 /**
@@ -768,12 +1103,12 @@ Node *parse_enum(TokenArray *tokens) {
         }
 
         else if (token->type == TokenType_NEXTSTM) {
-            raise(ErrorType_Syntax, U"Unexpected symbol ; in enumeration", U"<stdin>", token->x, token->y);
+            raise(ErrorType_Syntax, U"Unexpected symbol ; in enumeration", token->offset);
         }
 
         else if (token->type == TokenType_COMMA) {
             if (tokens->array[i-1].type == TokenType_COMMA) {
-                raise(ErrorType_Syntax, U"Statement expected before ,", U"<stdin>", token->x, token->y);
+                raise(ErrorType_Syntax, U"Statement expected before ,", token->offset);
             }
             i++;
             continue;
@@ -788,12 +1123,11 @@ Node *parse_enum(TokenArray *tokens) {
                 
                 u32char *var = (&(tokens->array[i]))->data;
 
-                TokenArray *slice = TokenArray_slice(tokens, i+2);
-                TokenArray_append(slice, Token_new(TokenType_EOF, U""));
-                Node *expr = parse_expr(slice);
-                TokenArray_free(slice);
+                // the field's expression ends at , or }
+                TokenArray slice = TokenArray_view(tokens, i+2, tokens->used);
+                Node *expr = parse_expr(&slice);
 
-                NodeArray_append(node_array, NodeAssign_new(var, U"=", expr));
+                NodeArray_append(node_array, node_at(NodeAssign_new(var, U"=", expr), token->offset));
 
                 i += _last_token_count+1;
                 continue;
@@ -801,14 +1135,14 @@ Node *parse_enum(TokenArray *tokens) {
             
             else if (tokens->array[i+1].type == TokenType_COMMA ||
                      tokens->array[i+1].type == TokenType_RCURLY) {
-                NodeArray_append(node_array, NodeVar_new(token->data));
+                NodeArray_append(node_array, node_at(NodeVar_new(token->data), token->offset));
                 i += 2;
                 continue;
             }
         }
 
         else {
-            raise(ErrorType_Syntax, U"Unexpected field in enumeration", U"<stdin>", token->x, token->y);
+            raise(ErrorType_Syntax, U"Unexpected field in enumeration", token->offset);
         }
 
         i++;
@@ -840,20 +1174,19 @@ Node *parse_generic(TokenArray *tokens) {
             continue;
         }
         else if (token->type != TokenType_IDENTIFIER) {
-            raise(ErrorType_Syntax, U"Expected type or >", U"<stdin>", token->x, token->y);
+            raise(ErrorType_Syntax, U"Expected type or >", token->offset);
         }
 
-        TokenArray *slice = TokenArray_slice(tokens, i);
+        TokenArray slice = TokenArray_view(tokens, i, tokens->used);
         _last_token_count = _token_index+1;
         _token_index = 0;
-        Node *factor = parse_expr_FACTOR(slice);
+        Node *factor = parse_expr_FACTOR(&slice);
         if (factor->type == NodeType_VAR) {
             u32char *data = factor->variable;
             Node_free(factor);
-            factor = NodePrimitive_new(data);
+            factor = node_at(NodePrimitive_new(data), token->offset);
         }
         NodeArray_append(node_array, factor);
-        TokenArray_free(slice);
 
         i += _token_index;
     }
@@ -863,6 +1196,38 @@ Node *parse_generic(TokenArray *tokens) {
 }
 
 
+/**
+ * @brief Parse a body starting with a curly brace
+ * 
+ * The closing brace is found from the token's match distance and the
+ * body is parsed in place, nested bodies don't copy their tokens. When
+ * PARSER_LAZY is set the body only keeps where its tokens are, and is
+ * not parsed until its statements are accessed with Node_body. The
+ * body is at its opening brace. A brace that isn't closed in the
+ * tokens is an error, like check_block reports it.
+ * 
+ * @param tokens Token array to parse
+ * @param index Index of the opening curly brace
+ * @return Node's pointer
+ */
+Node *parse_block(TokenArray *tokens, size_t index) {
+    Token *token = &(tokens->array[index]);
+    TokenArray slice;
+
+    if (token->match <= 0 || index + token->match >= tokens->used) {
+        raise(ErrorType_Syntax, U"Expected }", token->offset);
+    }
+
+    if (PARSER_LAZY && _lazy_tokens != NULL)
+        return node_at(NodeLazyBody_new(_lazy_tokens, _lazy_start + (size_t)(token + 1 - _lazy_first), token->match-1),
+                       token->offset);
+
+    _body_count++;
+    slice = TokenArray_view(tokens, index+1, index+token->match+1);
+    return node_at(parse_body(&slice), token->offset);
+}
+
+
 /**
  * @brief Parse a body
  * 
@@ -873,17 +1238,28 @@ Node *parse_body(TokenArray *tokens) {
     size_t i = 0;
     NodeArray *node_array = NodeArray_new(1);
 
+    // Statements outside of any block are traced one by one
+    bool top = _body_count == 0;
+    TRACE_SPAN(statement);
+
+    // Deferred bodies view the tokens of a parse that starts here
+    bool root = top && _lazy_first == NULL;
+    if (root) {
+        _lazy_tokens = tokens;
+        _lazy_first = tokens->array;
+        _lazy_start = 0;
+    }
+
     while (i < tokens->used) {
         Token *token = &(tokens->array[i]);
 
+        if (top && token->type != TokenType_NEXTSTM && token->type != TokenType_EOF)
+            TRACE_BEGIN(statement, "statement", token->offset);
+
         /* BODY   {statement; statement; ...} */
         if (token->type == TokenType_LCURLY) {
-            _body_count++;
-
-            TokenArray *slice = TokenArray_slice(tokens, i+1);
-            Node *body = parse_body(slice);
+            Node *body = parse_block(tokens, i);
             NodeArray_append(node_array, body);
-            TokenArray_free(slice);
 
             i += body->body_tokens+2;
             continue;
@@ -891,8 +1267,9 @@ Node *parse_body(TokenArray *tokens) {
 
         /* End of body */
         else if (token->type == TokenType_RCURLY) {
-            if (_body_count < 0) {
-                raise(ErrorType_Syntax, U"Unexpected }", U"<stdin>", token->x, token->y);
+            // Only a body opened with parse_block is closed here
+            if (_body_count <= 0) {
+                raise(ErrorType_Syntax, U"Unexpected }", token->offset);
             }
 
             _body_count--;
@@ -904,8 +1281,8 @@ Node *parse_body(TokenArray *tokens) {
         }
 
         else if (token->type == TokenType_NEXTSTM) {
-            if (tokens->array[i-1].type == TokenType_NEXTSTM) {
-                raise(ErrorType_Syntax, U"Statement expected before ;", U"<stdin>", token->x, token->y);
+            if (i == 0 || tokens->array[i-1].type == TokenType_NEXTSTM) {
+                raise(ErrorType_Syntax, U"Statement expected before ;", token->offset);
             }
             i++;
             continue;
@@ -920,7 +1297,7 @@ Node *parse_body(TokenArray *tokens) {
                     (tokens->array[i+2].type == TokenType_NEXTSTM   ||
                      tokens->array[i+2].type == TokenType_EOF)) {
 
-                        NodeArray_append(node_array, NodeImport_new(tokens->array[i+1].data));
+                        NodeArray_append(node_array, node_at(NodeImport_new(tokens->array[i+1].data), tokens->array[i+1].offset));
                         
                         i += 2;
                         continue;
@@ -934,14 +1311,15 @@ Node *parse_body(TokenArray *tokens) {
                          (tokens->array[i+4].type == TokenType_NEXTSTM   ||
                           tokens->array[i+4].type == TokenType_EOF)) {
 
-                        NodeArray_append(node_array, NodeImportFrom_new(tokens->array[i+3].data, tokens->array[i+1].data));
+                        NodeArray_append(node_array, node_at(NodeImportFrom_new(tokens->array[i+3].data, tokens->array[i+1].data),
+                                                             tokens->array[i+1].offset));
 
                         i += 4;
                         continue;
                      }
 
                 else {
-                    raise(ErrorType_Syntax, U"Invalid import scheme", U"<stdin>", token->x, token->y);
+                    raise(ErrorType_Syntax, U"Invalid import scheme", token->offset);
                 }
             }
 
@@ -950,10 +1328,10 @@ Node *parse_body(TokenArray *tokens) {
                      (tokens->array[i+2].type == TokenType_NEXTSTM ||
                       tokens->array[i+2].type == TokenType_EOF)) {
 
-                Node *primitive = NodePrimitive_new(tokens->array[i].data);
+                Node *primitive = node_at(NodePrimitive_new(tokens->array[i].data), tokens->array[i].offset);
                 u32char *var = (&(tokens->array[i+1]))->data;
 
-                NodeArray_append(node_array, NodeDecln_new(primitive, var));
+                NodeArray_append(node_array, node_at(NodeDecln_new(primitive, var), tokens->array[i+1].offset));
                 i += 3;
                 continue;
             }
@@ -963,24 +1341,21 @@ Node *parse_body(TokenArray *tokens) {
                     (&(tokens->array[i+2]))->type == TokenType_OPERATOR   &&
                     u32isequal((&(tokens->array[i+2]))->data, U"=")) {
                     
-                Node *primitive = NodePrimitive_new(tokens->array[i].data);
+                Node *primitive = node_at(NodePrimitive_new(tokens->array[i].data), tokens->array[i].offset);
                 u32char *var = (&(tokens->array[i+1]))->data;
+                size_t at = tokens->array[i+1].offset;
 
                 TokenArray *slice = TokenArray_slicet(tokens, i+3);
-                TokenArray_append(slice, Token_new(TokenType_EOF, U""));
+                slice_end(slice, tokens, i+3);
+                _fold_type = primitive->primitive;
                 Node *expr = parse_expr(slice);
+                _fold_type = NULL;
                 TokenArray_free(slice);
+                size_t end = statement_end(tokens, i+3 + _last_token_count-1);
 
-                NodeArray_append(node_array, NodeDecl_new(primitive, var, expr));
+                NodeArray_append(node_array, node_at(NodeDecl_new(primitive, var, expr), at));
 
-                // end of the expression
-                int a = 0;
-                while (i+a < tokens->used) {
-                    if ((&(tokens->array[a+i]))->type == TokenType_NEXTSTM ||
-                        (&(tokens->array[a+i]))->type == TokenType_EOF) break;
-                    a++;
-                }
-                i += a+1;
+                i = end;
                 continue;
             }
 
@@ -988,9 +1363,12 @@ Node *parse_body(TokenArray *tokens) {
             else if(tokens->array[i+1].type == TokenType_OPERATOR &&
                     u32isequal(tokens->array[i+1].data, U"<")) {
 
+                u32char *base = tokens->array[i].data;
+
                 TokenArray *slice = TokenArray_slicet(tokens, i+2);
-                TokenArray_append(slice, Token_new(TokenType_EOF, U""));
-                Node *generic = parse_generic(slice);
+                slice_end(slice, tokens, i+2);
+                Node *generic = node_at(parse_generic(slice), tokens->array[i].offset);
+                generic->gentype_base = base;
                 TokenArray_free(slice);
 
                 i += generic->gentype_tokens+2;
@@ -1003,7 +1381,7 @@ Node *parse_body(TokenArray *tokens) {
                         tokens->array[i+1].type == TokenType_EOF) {
 
 
-                        NodeArray_append(node_array, NodeDecln_new(generic, var));
+                        NodeArray_append(node_array, node_at(NodeDecln_new(generic, var), tokens->array[i].offset));
                         i += 2;
                         continue;
                     }
@@ -1011,35 +1389,33 @@ Node *parse_body(TokenArray *tokens) {
                     else if (tokens->array[i+1].type == TokenType_OPERATOR &&
                             u32isequal(tokens->array[i+1].data, U"=")) {
 
+                        size_t at = tokens->array[i].offset;
                         TokenArray *sliceb = TokenArray_slicet(tokens, i+2);
-                        TokenArray_append(sliceb, Token_new(TokenType_EOF, U""));
+                        slice_end(sliceb, tokens, i+2);
+
+                        // array literals are folded with their element type
+                        if (u32isequal(base, U"array") && generic->gentype->used > 0 &&
+                            generic->gentype->array[0].type == NodeType_PRIMITIVE)
+                            _fold_type = generic->gentype->array[0].primitive;
+
                         Node *exprz = parse_expr(sliceb);
+                        _fold_type = NULL;
                         TokenArray_free(sliceb);
+                        size_t end = statement_end(tokens, i+2 + _last_token_count-1);
 
-                        NodeArray_append(node_array, NodeDecl_new(generic, var, exprz));
+                        NodeArray_append(node_array, node_at(NodeDecl_new(generic, var, exprz), at));
 
-                        // end of the expression
-                        int a = 0;
-                        while (i+a < tokens->used) {
-                            if ((&(tokens->array[a+i]))->type == TokenType_NEXTSTM ||
-                                (&(tokens->array[a+i]))->type == TokenType_EOF) break;
-                            a++;
-                        }
-                        i += a+1;
+                        i = end;
                         continue;
 
                     }
                     else {
-                        raise(ErrorType_Syntax, U"Expected either = or ; after identifier", U"<stdin>",
-                        tokens->array[i+1].x,
-                        tokens->array[i+1].y);
+                        raise(ErrorType_Syntax, U"Expected either = or ; after identifier", tokens->array[i+1].offset);
                     }
 
                 }
                 else {
-                    raise(ErrorType_Syntax, U"Identifier expected", U"<stdin>",
-                          tokens->array[i].x,
-                          tokens->array[i].y);
+                    raise(ErrorType_Syntax, U"Identifier expected", tokens->array[i].offset);
                 }
 
                 continue;
@@ -1053,9 +1429,10 @@ Node *parse_body(TokenArray *tokens) {
                     u32char *var = (&(tokens->array[i]))->data;
 
                     TokenArray *slice = TokenArray_slicet(tokens, i+2);
-                    TokenArray_append(slice, Token_new(TokenType_EOF, U""));
+                    slice_end(slice, tokens, i+2);
                     Node *expr = parse_expr(slice);
                     TokenArray_free(slice);
+                    size_t end = statement_end(tokens, i+2 + _last_token_count-1);
 
                     u32char *op;
                     if (u32isequal(tokens->array[i+1].data, U"=")) {
@@ -1080,20 +1457,12 @@ Node *parse_body(TokenArray *tokens) {
                         op = U"%=";
                     }
                     else {
-                        raise(ErrorType_Syntax, U"Invalid assignment operator", U"<stdin>",
-                              tokens->array[i+1].x, tokens->array[i+1].y);
+                        raise(ErrorType_Syntax, U"Invalid assignment operator", tokens->array[i+1].offset);
                     }
 
-                    NodeArray_append(node_array, NodeAssign_new(var, op, expr));
+                    NodeArray_append(node_array, node_at(NodeAssign_new(var, op, expr), token->offset));
 
-                    // end of the expression
-                    int a = 0;
-                    while (i+a < tokens->used) {
-                        if ((&(tokens->array[a+i]))->type == TokenType_NEXTSTM ||
-                            (&(tokens->array[a+i]))->type == TokenType_EOF) break;
-                        a++;
-                    }
-                    i += a+1;
+                    i = end;
                     continue;
             }
 
@@ -1101,35 +1470,29 @@ Node *parse_body(TokenArray *tokens) {
             else if (u32isequal(token->data, U"enum")) {
 
                 u32char *name;
+                size_t at = tokens->array[i+1].offset;
                 if (tokens->array[i+1].type == TokenType_IDENTIFIER) {
                     name = tokens->array[i+1].data;
                 }
                 else {
-                    raise(ErrorType_Syntax, U"Identifier expected after enum", U"<stdin>",
-                          tokens->array[i+1].x,
-                          tokens->array[i+1].y);
+                    raise(ErrorType_Syntax, U"Identifier expected after enum", tokens->array[i+1].offset);
                 }
 
                 if (!(tokens->array[i+2].type == TokenType_LCURLY)) {
-                    raise(ErrorType_Syntax, U"Expected }", U"<stdin>",
-                          tokens->array[i+2].x,
-                          tokens->array[i+2].y);
+                    raise(ErrorType_Syntax, U"Expected }", tokens->array[i+2].offset);
                 }
 
-                TokenArray *slice = TokenArray_slice(tokens, i+3);
-                Node *body = parse_enum(slice);
-                TokenArray_free(slice);
-                i += body->body_tokens+4;
+                if (tokens->array[i+2].match <= 0 || i+2 + tokens->array[i+2].match >= tokens->used) {
+                    raise(ErrorType_Syntax, U"Expected }", tokens->array[i+2].offset);
+                }
 
-                if (!(tokens->array[i].type == TokenType_NEXTSTM ||
-                      tokens->array[i].type == TokenType_EOF)) {
+                TokenArray slice = TokenArray_view(tokens, i+3, i+3+tokens->array[i+2].match);
+                Node *body = parse_enum(&slice);
 
-                    raise(ErrorType_Syntax, U"Expected ;", U"<stdin>",
-                          tokens->array[i+2].x,
-                          tokens->array[i+2].y);
-                }
+                // continue after the closing brace
+                i = statement_end(tokens, i + tokens->array[i+2].match+3);
 
-                NodeArray_append(node_array, NodeEnum_new(name, body));
+                NodeArray_append(node_array, node_at(NodeEnum_new(name, body), at));
 
                 continue;
             }
@@ -1137,18 +1500,15 @@ Node *parse_body(TokenArray *tokens) {
             /* IF   if expression body */
             else if (u32isequal(token->data, U"if")) {
 
-                TokenArray *slice = TokenArray_slicet(tokens, i+1);
-                TokenArray_append(slice, Token_new(TokenType_EOF, U""));
-                Node *expr = parse_expr(slice);
-                TokenArray_free(slice);
+                // the condition ends at the body's {, read it in place
+                TokenArray slice = TokenArray_view(tokens, i+1, tokens->used);
+                Node *expr = parse_expr(&slice);
                 i += _last_token_count;
 
-                TokenArray *slice2 = TokenArray_slice(tokens, i+1);
-                Node *body = parse_body(slice2);
-                TokenArray_free(slice2);
+                Node *body = parse_block(tokens, i);
                 i += body->body_tokens+2;
 
-                NodeArray_append(node_array, NodeIf_new(expr, body));
+                NodeArray_append(node_array, node_at(NodeIf_new(expr, body), token->offset));
 
                 continue;
             }
@@ -1156,18 +1516,15 @@ Node *parse_body(TokenArray *tokens) {
             /* ELIF   elif expression body */
             else if (u32isequal(token->data, U"elif")) {
 
-                TokenArray *slice = TokenArray_slicet(tokens, i+1);
-                TokenArray_append(slice, Token_new(TokenType_EOF, U""));
-                Node *expr = parse_expr(slice);
-                TokenArray_free(slice);
+                // the condition ends at the body's {, read it in place
+                TokenArray slice = TokenArray_view(tokens, i+1, tokens->used);
+                Node *expr = parse_expr(&slice);
                 i += _last_token_count;
 
-                TokenArray *slice2 = TokenArray_slice(tokens, i+1);
-                Node *body = parse_body(slice2);
-                TokenArray_free(slice2);
+                Node *body = parse_block(tokens, i);
                 i += body->body_tokens+2;
 
-                NodeArray_append(node_array, NodeElif_new(expr, body));
+                NodeArray_append(node_array, node_at(NodeElif_new(expr, body), token->offset));
 
                 continue;
             }
@@ -1176,16 +1533,13 @@ Node *parse_body(TokenArray *tokens) {
             else if (u32isequal(token->data, U"else")) {
 
                 if (tokens->array[i+1].type != TokenType_LCURLY) {
-                    raise(ErrorType_Syntax, U"Expected {", U"<stdin>",
-                          tokens->array[i+1].x, tokens->array[i+1].y);
+                    raise(ErrorType_Syntax, U"Expected {", tokens->array[i+1].offset);
                 }
 
-                TokenArray *slice = TokenArray_slice(tokens, i+1);
-                Node *body = parse_body(slice);
-                TokenArray_free(slice);
-                i += body->body_tokens+2;
+                Node *body = parse_block(tokens, i+1);
+                i += body->body_tokens+3;
 
-                NodeArray_append(node_array, NodeElse_new(body));
+                NodeArray_append(node_array, node_at(NodeElse_new(body), token->offset));
 
                 continue;
             }
@@ -1193,24 +1547,19 @@ Node *parse_body(TokenArray *tokens) {
             /* REPEAT   repeat expression body */
             else if (u32isequal(token->data, U"repeat")) {
 
-                TokenArray *slice = TokenArray_slicet(tokens, i+1);
-                TokenArray_append(slice, Token_new(TokenType_EOF, U""));
-                Node *expr = parse_expr(slice);
-                TokenArray_free(slice);
+                // the condition ends at the body's {, read it in place
+                TokenArray slice = TokenArray_view(tokens, i+1, tokens->used);
+                Node *expr = parse_expr(&slice);
                 i += _last_token_count;
 
                 if (tokens->array[i].type != TokenType_LCURLY) {
-                    raise(ErrorType_Syntax, U"Expected {", U"<stdin>",
-                          tokens->array[i].x, tokens->array[i].y);
+                    raise(ErrorType_Syntax, U"Expected {", tokens->array[i].offset);
                 }
 
-                TokenArray *slice2 = TokenArray_slice(tokens, i+1);
-                _body_count++;
-                Node *body = parse_body(slice2);
-                TokenArray_free(slice2);
+                Node *body = parse_block(tokens, i);
                 i += body->body_tokens+2;
 
-                NodeArray_append(node_array, NodeRepeat_new(expr, body));
+                NodeArray_append(node_array, node_at(NodeRepeat_new(expr, body), token->offset));
 
                 continue;
             }
@@ -1218,24 +1567,19 @@ Node *parse_body(TokenArray *tokens) {
             /* WHILE   while expression body */
             else if (u32isequal(token->data, U"while")) {
 
-                TokenArray *slice = TokenArray_slicet(tokens, i+1);
-                TokenArray_append(slice, Token_new(TokenType_EOF, U""));
-                Node *expr = parse_expr(slice);
-                TokenArray_free(slice);
+                // the condition ends at the body's {, read it in place
+                TokenArray slice = TokenArray_view(tokens, i+1, tokens->used);
+                Node *expr = parse_expr(&slice);
                 i += _last_token_count;
 
                 if (tokens->array[i].type != TokenType_LCURLY) {
-                    raise(ErrorType_Syntax, U"Expected {", U"<stdin>",
-                          tokens->array[i].x, tokens->array[i].y);
+                    raise(ErrorType_Syntax, U"Expected {", tokens->array[i].offset);
                 }
 
-                TokenArray *slice2 = TokenArray_slice(tokens, i+1);
-                _body_count++;
-                Node *body = parse_body(slice2);
-                TokenArray_free(slice2);
+                Node *body = parse_block(tokens, i);
                 i += body->body_tokens+2;
 
-                NodeArray_append(node_array, NodeWhile_new(expr, body));
+                NodeArray_append(node_array, node_at(NodeWhile_new(expr, body), token->offset));
 
                 continue;
             }
@@ -1247,66 +1591,352 @@ Node *parse_body(TokenArray *tokens) {
                     if (tokens->array[i+2].type == TokenType_OPERATOR &&
                             u32isequal(tokens->array[i+2].data, U"in")) {
 
-                        Node *var = NodeVar_new(tokens->array[i+1].data);
+                        Node *var = node_at(NodeVar_new(tokens->array[i+1].data), tokens->array[i+1].offset);
                         
-                        TokenArray *slice = TokenArray_slicet(tokens, i+3);
-                        TokenArray_append(slice, Token_new(TokenType_EOF, U""));
-                        Node *expr = parse_expr(slice);
-                        TokenArray_free(slice);
+                        TokenArray slice = TokenArray_view(tokens, i+3, tokens->used);
+                        Node *expr = parse_expr(&slice);
                         i += _last_token_count+2;
 
                         if (tokens->array[i].type != TokenType_LCURLY) {
-                            raise(ErrorType_Syntax, U"Expected {", U"<stdin>",
-                                tokens->array[i].x, tokens->array[i].y);
+                            raise(ErrorType_Syntax, U"Expected {", tokens->array[i].offset);
                         }
 
-                        TokenArray *slice2 = TokenArray_slice(tokens, i+1);
-                        _body_count++;
-                        Node *body = parse_body(slice2);
-                        TokenArray_free(slice2);
+                        Node *body = parse_block(tokens, i);
                         i += body->body_tokens+1;
 
-                        NodeArray_append(node_array, NodeFor_new(var, expr, body));
+                        NodeArray_append(node_array, node_at(NodeFor_new(var, expr, body), token->offset));
                     }
                     else {
-                        raise(ErrorType_Syntax, U"Missing in keyword", U"<stdin>", token->x, token->y);
+                        raise(ErrorType_Syntax, U"Missing in keyword", token->offset);
                     }
                 }
                 else {
-                    raise(ErrorType_Syntax, U"Non-identifier after for", U"<stdin>", token->x, token->y);
+                    raise(ErrorType_Syntax, U"Non-identifier after for", token->offset);
                 }
             }
 
             else {  
-                TokenArray *slice = TokenArray_slice(tokens, i);
-                Node *expr = parse_expr(slice);
-                TokenArray_free(slice);
+                TokenArray slice = TokenArray_view(tokens, i, tokens->used);
+                Node *expr = parse_expr(&slice);
 
                 NodeArray_append(node_array, expr);
 
-                i += _last_token_count;
+                i = statement_end(tokens, i + _last_token_count-1);
                 continue;
             }
         }
 
         else {
-            TokenArray *slice = TokenArray_slice(tokens, i);
-            Node *expr = parse_expr(slice);
-            TokenArray_free(slice);
+            TokenArray slice = TokenArray_view(tokens, i, tokens->used);
+            Node *expr = parse_expr(&slice);
 
             NodeArray_append(node_array, expr);
 
-            i += _last_token_count;
+            i = statement_end(tokens, i + _last_token_count-1);
             continue;
         }
 
     i++;
     }
 
+    if (root) {
+        _lazy_tokens = NULL;
+        _lazy_first = NULL;
+    }
+
+    TRACE_END(statement);
     return NodeBody_new(node_array, i);
 }
 
 
+/**
+ * @brief Find the top-level statement boundaries of a token array
+ * 
+ * A statement ends with ; at brace depth 0 or with a } that closes
+ * back to depth 0. A ; or EOF right after such } belongs to the same
+ * statement, so each statement parses into exactly one node.
+ * 
+ * @param tokens Token array to split
+ * @param count Number of statements found
+ * @return Array of count+1 token indices (NULL if braces are unbalanced
+ *         or the last statement is not terminated), statement n covers
+ *         tokens [bounds[n], bounds[n+1])
+ */
+size_t *split_statements(TokenArray *tokens, size_t *count) {
+    size_t *bounds = (size_t *)dust_malloc(sizeof(size_t) * (tokens->used + 1));
+    size_t n = 0;
+    size_t i = 0;
+    int depth = 0;
+
+    bounds[0] = 0;
+
+    while (i < tokens->used) {
+        TokenType type = tokens->array[i].type;
+
+        if (type == TokenType_LCURLY) {
+            depth++;
+        }
+
+        else if (type == TokenType_RCURLY) {
+            depth--;
+            if (depth < 0) break;
+
+            if (depth == 0) {
+                if (i+1 < tokens->used &&
+                    (tokens->array[i+1].type == TokenType_NEXTSTM ||
+                     tokens->array[i+1].type == TokenType_EOF)) i++;
+
+                bounds[++n] = i+1;
+            }
+        }
+
+        else if (depth == 0 && (type == TokenType_NEXTSTM || type == TokenType_EOF)) {
+            // A lone EOF closes the previous statement
+            if (type == TokenType_EOF && bounds[n] == i && n > 0) bounds[n] = i+1;
+            else bounds[++n] = i+1;
+        }
+
+        i++;
+    }
+
+    if (depth != 0 || bounds[n] != tokens->used) {
+        dust_free(bounds);
+        *count = 0;
+        return NULL;
+    }
+
+    *count = n;
+    return bounds;
+}
+
+/**
+ * @brief Parse a single top-level statement
+ * 
+ * The statement is parsed from a copy of its tokens. Its bodies are
+ * deferred only while the tokens are kept, see parse_job.
+ * 
+ * @param tokens Token array that contains the statement
+ * @param start Index of the statement's first token
+ * @param end Index after the statement's last token
+ * @return Statement's node (copy it before freeing)
+ */
+Node *parse_statement(TokenArray *tokens, size_t start, size_t end) {
+    TokenArray *slice = TokenArray_new(end - start + 1);
+    size_t i;
+
+    if (tokens->array[start].type == TokenType_NEXTSTM) {
+        raise(ErrorType_Syntax, U"Statement expected before ;", tokens->array[start].offset);
+    }
+
+    for (i = start; i < end; i++) TokenArray_append(slice, &(tokens->array[i]));
+
+    if (tokens->array[end-1].type != TokenType_EOF) slice_end(slice, tokens, start);
+
+    TokenArray *lazy_tokens = _lazy_tokens;
+    Token *lazy_first = _lazy_first;
+    size_t lazy_start = _lazy_start;
+
+    // Deferred bodies view the statement where it is in tokens, not the copy
+    _lazy_tokens = (lazy_tokens == tokens) ? tokens : NULL;
+    _lazy_first = slice->array;
+    _lazy_start = start;
+
+    Node *body = parse_body(slice);
+    TokenArray_free(slice);
+
+    _lazy_tokens = lazy_tokens;
+    _lazy_first = lazy_first;
+    _lazy_start = lazy_start;
+
+    if (body->body->used != 1) {
+        raise(ErrorType_Syntax, U"Invalid statement", tokens->array[start].offset);
+    }
+
+    Node *node = Node_alloc();
+    bool pooled = node->pooled;
+    *node = body->body->array[0];
+    node->pooled = pooled;
+    NodeArray_free(body->body);
+    Node_release(body);
+
+    return node;
+}
+
+/**
+ * @param tokens Token array the statements are in
+ * @param bounds Statement bounds from split_statements
+ * @param first Index of the first statement to parse
+ * @param last Index after the last statement to parse
+ * @param lazy PARSER_LAZY of the thread that started the parse
+ * @param nodes Parsed statements (NULL if the range wasn't parsed)
+ * @param arena Arena that holds the parsed nodes
+ * @param error Error the range failed with
+ */
+typedef struct {
+    TokenArray *tokens;
+    size_t *bounds;
+    size_t first;
+    size_t last;
+    int lazy;
+    NodeArray *nodes;
+    NodeArena *arena;
+    ErrorTrap error;
+} ParseJob;
+
+/**
+ * @brief Parse a range of top-level statements into the job's own arena
+ * 
+ * @param index Index of the range
+ * @param arg Parse jobs of every range
+ * @return false if the range has a syntax error
+ */
+static bool parse_job(size_t index, void *arg) {
+    ParseJob *job = &((ParseJob *)arg)[index];
+    NodeArena *previous = _node_arena;
+    int body_count = _body_count;
+    TokenArray *lazy_tokens = _lazy_tokens;
+    int lazy = PARSER_LAZY;
+    ErrorTrap *outer = ERROR_TRAP;
+    ErrorTrap trap;
+    bool parsed;
+    size_t i;
+
+    TRACE_SPAN(span);
+    TRACE_BEGIN(span, "parse job", job->tokens->array[job->bounds[job->first]].offset);
+
+    _node_arena = NodeArena_new(PARSER_ARENA_SIZE);
+    _body_count = 0;
+    // The tokens are kept with the tree, so deferred bodies can view them
+    _lazy_tokens = job->tokens;
+    PARSER_LAZY = job->lazy;
+    job->nodes = NodeArray_new(job->last - job->first + 1);
+    ERROR_TRAP = &trap;
+
+    if (setjmp(trap.jump) == 0) {
+        for (i = job->first; i < job->last; i++) {
+            Node *node = parse_statement(job->tokens, job->bounds[i], job->bounds[i+1]);
+            NodeArray_append(job->nodes, node);
+            Node_release(node);
+        }
+
+        job->arena = _node_arena;
+        parsed = true;
+    }
+
+    // Raised again by the caller once the ranges before this one are parsed
+    else {
+        job->arena = _node_arena;
+        job->error = trap;
+        parsed = false;
+        parse_reset();
+    }
+
+    ERROR_TRAP = outer;
+    _node_arena = previous;
+    _body_count = body_count;
+    _lazy_tokens = lazy_tokens;
+    PARSER_LAZY = lazy;
+
+    TRACE_END(span);
+    return parsed;
+}
+
+/**
+ * @brief Parse top-level statements on the shared scheduler
+ * 
+ * Statements are split at brace depth 0 and divided into ranges of
+ * about the same token count, a few per job so threads that finish
+ * early can steal the rest. Each range is parsed into its own node
+ * arena, and the results are merged in order. The arenas are owned
+ * by the returned body node.
+ * 
+ * A syntax error cancels the ranges after it, the first one in the
+ * source is raised on the calling thread like parse_body would.
+ * Deferred bodies view tokens, like the ones parse_body defers, if
+ * PARSER_LAZY is set on the calling thread.
+ * 
+ * @param tokens Token array to parse
+ * @param jobs Number of jobs to split the statements for
+ *             (0 for the shared scheduler's)
+ * @return Node's pointer
+ */
+Node *parse_body_parallel(TokenArray *tokens, int jobs) {
+    size_t count;
+    size_t *bounds = split_statements(tokens, &count);
+    size_t ranges;
+    size_t failed;
+    size_t i;
+    size_t j;
+
+    if (jobs < 1) jobs = scheduler_shared()->jobs;
+
+    // Small and malformed sources are parsed serially, errors stay the same
+    if (bounds == NULL || jobs == 1 || count < PARSER_PARALLEL_MIN) {
+        dust_free(bounds);
+        return parse_body(tokens);
+    }
+
+    ranges = (size_t)jobs * PARSER_PARALLEL_SPLIT;
+    if (ranges > count) ranges = count;
+
+    ParseJob *job = (ParseJob *)dust_malloc(sizeof(ParseJob) * ranges);
+    size_t first = 0;
+
+    for (j = 0; j < ranges; j++) {
+        size_t target = bounds[0] + (bounds[count] - bounds[0]) * (j+1) / ranges;
+        size_t last = first;
+
+        while (last < count && bounds[last] < target) last++;
+        if (j == ranges - 1) last = count;
+
+        job[j].tokens = tokens;
+        job[j].bounds = bounds;
+        job[j].first = first;
+        job[j].last = last;
+        job[j].lazy = PARSER_LAZY;
+        job[j].nodes = NULL;
+        job[j].arena = NULL;
+
+        first = last;
+    }
+
+    failed = Scheduler_for(scheduler_shared(), 0, ranges, parse_job, job);
+
+    /* Merge results in order, ranges cancelled by an error were never parsed */
+    NodeArray *node_array = NodeArray_new(count + 1);
+    NodeArena *arenas = NULL;
+
+    for (j = 0; j < ranges; j++) {
+        if (job[j].nodes == NULL) continue;
+
+        for (i = 0; i < job[j].nodes->used; i++)
+            NodeArray_append(node_array, &(job[j].nodes->array[i]));
+        NodeArray_free(job[j].nodes);
+
+        NodeArena *tail = job[j].arena;
+        while (tail->next != NULL) tail = tail->next;
+        tail->next = arenas;
+        arenas = job[j].arena;
+    }
+
+    Node *body = NodeBody_new(node_array, tokens->used - 1);
+    body->body_arena = arenas;
+
+    dust_free(bounds);
+
+    if (failed < ranges) {
+        ErrorTrap error = job[failed].error;
+
+        dust_free(job);
+        Node_free(body);
+        raise(error.type, error.message, error.offset);
+    }
+
+    dust_free(job);
+    return body;
+}
+
+
 OpType get_optype(u32char *tokenval) {
     if (u32isequal(tokenval, U"+")) {
         return OpType_ADD;
@@ -1385,11 +2015,12 @@ char expect_token(TokenArray *tokens, TokenType type) {
 
 Node *parse_child(TokenArray *tokens, Node *node) {
     if (current_token(tokens)->type == TokenType_PERIOD) {
+        size_t at = current_token(tokens)->offset;
         next_token(tokens);
 
         Node *child = parse_expr_FACTOR(tokens);
 
-        return NodeChild_new(node, child);
+        return node_at(NodeChild_new(node, child), at);
     }
     else {
         return node;
@@ -1398,13 +2029,13 @@ Node *parse_child(TokenArray *tokens, Node *node) {
 
 Node *parse_subscript(TokenArray *tokens, Node *node) {
     if (current_token(tokens)->type == TokenType_LSQRB) {
+        size_t at = current_token(tokens)->offset;
         next_token(tokens);
 
         /* Instant close [] */
         if (current_token(tokens)->type == TokenType_RSQRB) {
-            raise(ErrorType_Syntax, U"Subscripting with nothing", U"<stdin>",
-                    current_token(tokens)->x,
-                    current_token(tokens)->y);
+            raise(ErrorType_Syntax, U"Subscripting with nothing",
+                    current_token(tokens)->offset);
         }
 
         Node *expr = parse_expr_EXPR(tokens);
@@ -1413,12 +2044,11 @@ Node *parse_subscript(TokenArray *tokens, Node *node) {
             next_token(tokens);
             return parse_subscript(tokens,
                    parse_call(tokens,
-                   parse_child(tokens, NodeSubscript_new(node, expr))));
+                   parse_child(tokens, node_at(NodeSubscript_new(node, expr), at))));
         }
         else {
-            raise(ErrorType_Syntax, U"Expected ]", U"<stdin>",
-                    current_token(tokens)->x,
-                    current_token(tokens)->y);
+            raise(ErrorType_Syntax, U"Expected ]",
+                    current_token(tokens)->offset);
         }
     }
 
@@ -1439,13 +2069,13 @@ Node *parse_call(TokenArray *tokens, Node *node) {
             next_valid += expect_token(tokens, TokenType_OPERATOR);
             next_valid += expect_token(tokens, TokenType_PERIOD);
             if (!next_valid) {
-                raise(ErrorType_Syntax, u32join(U"Unexpected symbol '", u32join(tokens->array[_token_index+1].data, U"' after function call")), U"<stdin>", 0, 0);
+                raise(ErrorType_Syntax, u32join(U"Unexpected symbol '", u32join(tokens->array[_token_index+1].data, U"' after function call")), tokens->array[_token_index+1].offset);
             }
 
             next_token(tokens);
             return parse_call(tokens,
                    parse_subscript(tokens,
-                   parse_child(tokens, NodeCall_new(node, NULL))));
+                   parse_child(tokens, node_at(NodeCall_new(node, NULL), node->offset))));
         }
 
         /* Arguments (arg1, arg2, ...) */
@@ -1462,12 +2092,11 @@ Node *parse_call(TokenArray *tokens, Node *node) {
             next_token(tokens);
             return parse_call(tokens,
                     parse_subscript(tokens,
-                    parse_child(tokens, NodeCall_new(node, args))));
+                    parse_child(tokens, node_at(NodeCall_new(node, args), node->offset))));
         }
         else {
-            raise(ErrorType_Syntax, U"Expected ;", U"<stdin>",
-                    current_token(tokens)->x,
-                    current_token(tokens)->y);
+            raise(ErrorType_Syntax, U"Expected ;",
+                    current_token(tokens)->offset);
         }
     }
 
@@ -1481,10 +2110,17 @@ Node *parse_call(TokenArray *tokens, Node *node) {
  * @return Node's pointer
  */
 Node *parse_expr(TokenArray *tokens) {
+    // nested expressions (call arguments etc.) don't have the declared type
+    u32char *fold_type = _fold_type;
+    _fold_type = NULL;
+
     _token_index = 0;
     Node *expr = parse_expr_EXPR(tokens);
     _last_token_count = _token_index+1;
     _token_index = 0;
+
+    if (PARSER_FOLD) fold_expr(expr, fold_type);
+
     return expr;
 }
 
@@ -1498,7 +2134,7 @@ Node *parse_expr_FACTOR(TokenArray *tokens) {
         u32isequal(token->data, U"not"))) {
 
             next_token(tokens);
-            return NodeUnaryOp_new(get_optype(token->data), parse_expr_FACTOR(tokens));
+            return node_at(NodeUnaryOp_new(get_optype(token->data), parse_expr_FACTOR(tokens)), token->offset);
     }
 
     /* String literal */
@@ -1510,9 +2146,8 @@ Node *parse_expr_FACTOR(TokenArray *tokens) {
 
             /* Instant close [] */
             if (current_token(tokens)->type == TokenType_RSQRB) {
-                raise(ErrorType_Syntax, U"Subscripting with nothing", U"<stdin>",
-                      current_token(tokens)->x,
-                      current_token(tokens)->y);
+                raise(ErrorType_Syntax, U"Subscripting with nothing",
+                      current_token(tokens)->offset);
             }
 
             Node *expr = parse_expr_EXPR(tokens);
@@ -1520,36 +2155,45 @@ Node *parse_expr_FACTOR(TokenArray *tokens) {
             if (current_token(tokens)->type == TokenType_RSQRB) {
                 next_token(tokens);
                 return parse_subscript(tokens,
-                       parse_child(tokens, NodeSubscript_new(NodeString_new(token->data), expr)));
+                       parse_child(tokens, node_at(NodeSubscript_new(node_at(NodeString_new(token->data), token->offset), expr),
+                                                   token->offset)));
             }
             else {
-                raise(ErrorType_Syntax, U"Expected ]", U"<stdin>",
-                      current_token(tokens)->x,
-                      current_token(tokens)->y);
+                raise(ErrorType_Syntax, U"Expected ]",
+                      current_token(tokens)->offset);
             }
         }
         else {
             return parse_subscript(tokens,
-                   parse_child(tokens, NodeString_new(token->data)));
+                   parse_child(tokens, node_at(NodeString_new(token->data), token->offset)));
         }
     }
 
     /* Integer/Float literal */
     else if (token->type == TokenType_NUMERIC) {
         u32char *intdata = current_token(tokens)->data;
-        Node *integernode = NodeInteger_new(u32toint(current_token(tokens)->data, 10));
+        long integer;
+
+        if (intdata[0] == U'0' && intdata[1] == U'x')
+            integer = u32toint(intdata+2, 16);
+        else if (intdata[0] == U'0' && intdata[1] == U'b')
+            integer = u32toint(intdata+2, 2);
+        else
+            integer = u32toint(intdata, 10);
+
+        Node *integernode = node_at(NodeInteger_new(integer), token->offset);
 
         next_token(tokens);
         if (current_token(tokens)->type == TokenType_PERIOD) {
             next_token(tokens);
             
             if (current_token(tokens)->type != TokenType_NUMERIC) {
-                raise(ErrorType_Syntax, U"Can't subscript integer literal", U"<stdin>",
-                current_token(tokens)->x,
-                current_token(tokens)->y);
+                raise(ErrorType_Syntax, U"Can't subscript integer literal",
+                current_token(tokens)->offset);
             }
 
-            Node *floatnode = NodeFloat_new(u32tofloat(u32join(intdata, u32join(U".", current_token(tokens)->data))));
+            Node *floatnode = node_at(NodeFloat_new(u32tofloat(u32join(intdata, u32join(U".", current_token(tokens)->data)))),
+                                      token->offset);
             next_token(tokens);
             return floatnode;
         }
@@ -1575,13 +2219,14 @@ Node *parse_expr_FACTOR(TokenArray *tokens) {
                 next_valid += expect_token(tokens, TokenType_OPERATOR);
                 next_valid += expect_token(tokens, TokenType_PERIOD);
                 if (!next_valid) {
-                    raise(ErrorType_Syntax, u32join(U"Unexpected symbol '", u32join(tokens->array[_token_index+1].data, U"' after function calU")), U"<stdin>", 0, 0);
+                    raise(ErrorType_Syntax, u32join(U"Unexpected symbol '", u32join(tokens->array[_token_index+1].data, U"' after function calU")), tokens->array[_token_index+1].offset);
                 }
 
                 next_token(tokens);
                 return parse_call(tokens,
                        parse_subscript(tokens,
-                       parse_child(tokens, NodeCall_new(NodeFuncBase_new(token->data), NULL))));
+                       parse_child(tokens, node_at(NodeCall_new(node_at(NodeFuncBase_new(token->data), token->offset), NULL),
+                                                   token->offset))));
             }
 
             /* Arguments (arg1, arg2, ...) */
@@ -1598,17 +2243,17 @@ Node *parse_expr_FACTOR(TokenArray *tokens) {
                 next_token(tokens);
                 return parse_call(tokens,
                        parse_subscript(tokens,
-                       parse_child(tokens, NodeCall_new(NodeFuncBase_new(token->data), args))));
+                       parse_child(tokens, node_at(NodeCall_new(node_at(NodeFuncBase_new(token->data), token->offset), args),
+                                                   token->offset))));
             }
             else {
-                raise(ErrorType_Syntax, U"Expected ;", U"<stdin>",
-                      current_token(tokens)->x,
-                      current_token(tokens)->y);
+                raise(ErrorType_Syntax, U"Expected ;",
+                      current_token(tokens)->offset);
             }
         }
         else {
             return parse_subscript(tokens,
-                   parse_child(tokens, NodeVar_new(token->data)));
+                   parse_child(tokens, node_at(NodeVar_new(token->data), token->offset)));
         }
     }
 
@@ -1618,7 +2263,7 @@ Node *parse_expr_FACTOR(TokenArray *tokens) {
 
         /* Instant close () */
         if (current_token(tokens)->type == TokenType_RPAREN) {
-            raise(ErrorType_Syntax, U"Expression expected between parantheses", U"<stdin>", token->x, token->y);
+            raise(ErrorType_Syntax, U"Expression expected between parantheses", token->offset);
         }
 
         Node *expr = parse_expr_EXPR(tokens);
@@ -1628,7 +2273,7 @@ Node *parse_expr_FACTOR(TokenArray *tokens) {
             return parse_subscript(tokens, expr);
         }
         else {
-            raise(ErrorType_Syntax, U"Expected )", U"<stdin>", current_token(tokens)->x, current_token(tokens)->y);
+            raise(ErrorType_Syntax, U"Expected )", current_token(tokens)->offset);
         }
     }
 
@@ -1638,7 +2283,7 @@ Node *parse_expr_FACTOR(TokenArray *tokens) {
 
         /* Instant close () */
         if (current_token(tokens)->type == TokenType_RPAREN) {
-            raise(ErrorType_Syntax, U"Expression expected between square parantheses", U"<stdin>", token->x, token->y);
+            raise(ErrorType_Syntax, U"Expression expected between square parantheses", token->offset);
         }
 
         /* Expressions [expr1, expr2, ...] */
@@ -1654,14 +2299,17 @@ Node *parse_expr_FACTOR(TokenArray *tokens) {
         if (current_token(tokens)->type == TokenType_RSQRB) {
             next_token(tokens);
             return parse_subscript(tokens,
-                   parse_child(tokens, NodeNArray_new(content, false)));
+                   parse_child(tokens, node_at(NodeNArray_new(content, false), token->offset)));
         }
         else {
-            raise(ErrorType_Syntax, U"Expected ;", U"<stdin>",
-                    current_token(tokens)->x,
-                    current_token(tokens)->y);
+            raise(ErrorType_Syntax, U"Expected ;",
+                    current_token(tokens)->offset);
         }
     }
+
+    // Nothing that starts an expression, like a missing operand
+    raise(ErrorType_Syntax, U"Expression expected", token->offset);
+    return NULL;
 }
 
 Node *parse_expr_POW(TokenArray *tokens) {
@@ -1672,8 +2320,9 @@ Node *parse_expr_POW(TokenArray *tokens) {
                u32isequal(current_token(tokens)->data, U"%")) {
 
             OpType optype = get_optype(current_token(tokens)->data);
+            size_t at = current_token(tokens)->offset;
             next_token(tokens);
-            left = NodeBinOp_new(optype, left, parse_expr_FACTOR(tokens));
+            left = node_at(NodeBinOp_new(optype, left, parse_expr_FACTOR(tokens)), at);
         }
     }
 
@@ -1694,8 +2343,9 @@ Node *parse_expr_TERM(TokenArray *tokens) {
                u32isequal(current_token(tokens)->data, U">=")) {
 
                     OpType optype = get_optype(current_token(tokens)->data);
+                    size_t at = current_token(tokens)->offset;
                     next_token(tokens);
-                    left = NodeBinOp_new(optype, left, parse_expr_POW(tokens));
+                    left = node_at(NodeBinOp_new(optype, left, parse_expr_POW(tokens)), at);
                 }
     }
 
@@ -1715,8 +2365,9 @@ Node *parse_expr_EXPR(TokenArray *tokens) {
                u32isequal(current_token(tokens)->data, U"in")) {
 
                     OpType optype = get_optype(current_token(tokens)->data);
+                    size_t at = current_token(tokens)->offset;
                     next_token(tokens);
-                    left = NodeBinOp_new(optype, left, parse_expr_TERM(tokens));
+                    left = node_at(NodeBinOp_new(optype, left, parse_expr_TERM(tokens)), at);
             }
     }
 
@@ -1728,10 +2379,7 @@ Node *parse_expr_EXPR(TokenArray *tokens) {
           current_token(tokens)->type == TokenType_COMMA   ||
           current_token(tokens)->type == TokenType_RSQRB)) {
 
-            printf("failed tok: %s\n", utf32_to_utf8(Token_repr(current_token(tokens))));
-        //if (!(current_token(tokens)->type == TokenType_OPERATOR && u32isequal(current_token(tokens)->data, U">"))) {
-            raise(ErrorType_Syntax, U"Expected ;", U"<stdin>", current_token(tokens)->x, current_token(tokens)->y);
-        //}
+            raise(ErrorType_Syntax, U"Expected ;", current_token(tokens)->offset);
     }
 
     return left;
@@ -0,0 +1,206 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+
+  perf.c  -  Performance counters
+  -------------------------------------------------
+  Counts cycles, instructions, cache misses, branch
+  mispredictions and page faults of the calling thread
+  with Linux perf_event_open. Every counter is opened
+  on its own so the ones the machine or its settings
+  don't allow are skipped (VMs often have no PMU,
+  and perf_event_paranoid can forbid all of them).
+  On other platforms no counter is available.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dust/platform.h"
+#include "dust/perf.h"
+
+#if OS == OS_LINUX
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+
+char *PERF_COUNTER_NAMES[PerfCounter_COUNT] = {
+    "cycles",
+    "instructions",
+    "l1d_misses",
+    "llc_misses",
+    "branch_misses",
+    "page_faults"
+};
+
+
+#if OS == OS_LINUX
+
+static int perf_event_open(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// Explain the usual reasons of perf_event_open failing
+static char *perf_error(int error) {
+    switch (error) {
+        case ENOENT:
+        case EOPNOTSUPP:
+            return "event not supported by this machine (virtual machines often have no PMU)";
+
+        case EACCES:
+        case EPERM:
+            return "not permitted, see /proc/sys/kernel/perf_event_paranoid";
+
+        case ENOSYS:
+            return "kernel has no perf_event_open";
+
+        default:
+            return strerror(error);
+    }
+}
+
+#endif
+
+
+/**
+ * @brief Open the performance counters of the calling thread
+ *
+ * @param perf Counters to open
+ * @return false if no counter is available
+ */
+bool Perf_open(Perf *perf) {
+    perf->opened = 0;
+    perf->error = NULL;
+    for (size_t i = 0; i < PerfCounter_COUNT; i++) perf->fds[i] = -1;
+
+    #if OS == OS_LINUX
+
+    uint64_t cache_miss = PERF_COUNT_HW_CACHE_L1D |
+                          (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+    struct { uint32_t type; uint64_t config; } events[PerfCounter_COUNT] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HW_CACHE, cache_miss},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS}
+    };
+    int first_error = 0;
+
+    for (size_t i = 0; i < PerfCounter_COUNT; i++) {
+        perf->fds[i] = perf_event_open(events[i].type, events[i].config);
+
+        if (perf->fds[i] >= 0) perf->opened++;
+        else if (first_error == 0) first_error = errno;
+    }
+
+    if (first_error != 0) perf->error = perf_error(first_error);
+
+    #else
+
+    perf->error = "performance counters are only supported on Linux";
+
+    #endif
+
+    return perf->opened > 0;
+}
+
+/**
+ * @brief Close the performance counters
+ *
+ * @param perf Counters to close
+ */
+void Perf_close(Perf *perf) {
+    #if OS == OS_LINUX
+
+    for (size_t i = 0; i < PerfCounter_COUNT; i++) {
+        if (perf->fds[i] >= 0) close(perf->fds[i]);
+        perf->fds[i] = -1;
+    }
+
+    #endif
+
+    perf->opened = 0;
+}
+
+/**
+ * @brief Whether a counter is available
+ */
+bool Perf_has(Perf *perf, PerfCounter counter) {
+    return perf->fds[counter] >= 0;
+}
+
+/**
+ * @brief Reset and start counting
+ *
+ * @param perf Counters to start
+ */
+void Perf_start(Perf *perf) {
+    #if OS == OS_LINUX
+
+    for (size_t i = 0; i < PerfCounter_COUNT; i++) {
+        if (perf->fds[i] < 0) continue;
+        ioctl(perf->fds[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(perf->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    #endif
+}
+
+/**
+ * @brief Stop counting and read the counts since the last start
+ *
+ * Counts are scaled up when the kernel multiplexed a counter and it only
+ * ran part of the time.
+ *
+ * @param perf Counters to stop
+ * @param values Counts (0 for counters that aren't available)
+ */
+void Perf_stop(Perf *perf, uint64_t values[PerfCounter_COUNT]) {
+    for (size_t i = 0; i < PerfCounter_COUNT; i++) values[i] = 0;
+
+    #if OS == OS_LINUX
+
+    for (size_t i = 0; i < PerfCounter_COUNT; i++) {
+        if (perf->fds[i] < 0) continue;
+        ioctl(perf->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+    }
+
+    for (size_t i = 0; i < PerfCounter_COUNT; i++) {
+        // value, time enabled, time running
+        uint64_t data[3];
+
+        if (perf->fds[i] < 0) continue;
+        if (read(perf->fds[i], data, sizeof(data)) != sizeof(data)) continue;
+
+        if (data[2] > 0 && data[2] < data[1])
+            values[i] = (uint64_t)((double)data[0] * (double)data[1] / (double)data[2]);
+        else
+            values[i] = data[0];
+    }
+
+    #endif
+}
@@ -0,0 +1,274 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+
+  pipeline.c  -  Pipelined tokenizing and parsing
+  -------------------------------------------------
+  The lexer runs on its own thread and cuts the source
+  into chunks at line ends after a statement or brace,
+  outside of strings and comments. Token batches of each
+  chunk are passed to the parser through a bounded ring,
+  and the parser parses every top-level statement as soon
+  as its last token arrives. Only the tokens of the
+  statement being completed are kept in memory.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dust/ustring.h"
+#include "dust/error.h"
+#include "dust/source.h"
+#include "dust/tokenizer.h"
+#include "dust/parser.h"
+#include "dust/thread.h"
+#include "dust/pipeline.h"
+#include "dust/trace.h"
+#include "dust/allocator.h"
+#include "dust/alloc.h"
+
+
+/**
+ * @param raw Source code
+ * @param length Length of the source code
+ * @param ring Ring the token batches are pushed into
+ */
+typedef struct {
+    u32char *raw;
+    size_t length;
+    Ring *ring;
+} Pipeline;
+
+
+/**
+ * @brief Find where the next chunk of source should end
+ *
+ * @param raw Source code
+ * @param start Start of the chunk (not inside a string or comment)
+ * @param length Length of the source code
+ * @return End of the chunk
+ */
+size_t pipeline_cut(u32char *raw, size_t start, size_t length) {
+    size_t min = start + PIPELINE_CHUNK;
+    size_t i = start;
+
+    while (i < length) {
+        u32char chr = raw[i];
+
+        if (chr == U'"' || chr == U'\'') {
+            i++;
+            while (i < length && raw[i] != chr) i++;
+        }
+
+        else if (chr == U'/' && raw[i+1] == U'/') {
+            while (i < length && raw[i] != U'\n') i++;
+        }
+
+        else if (chr == U'/' && raw[i+1] == U'*') {
+            i += 2;
+            while (i < length && !(raw[i] == U'*' && raw[i+1] == U'/')) i++;
+            i++;
+        }
+
+        else if (chr == U'\n') {
+            // Identifiers are not split by line breaks, so only cut after ; { }
+            if (i + 1 >= min && i > 0 &&
+                (raw[i-1] == U';' || raw[i-1] == U'{' || raw[i-1] == U'}'))
+                return i + 1;
+        }
+
+        i++;
+    }
+
+    return length;
+}
+
+/**
+ * @brief Lexer thread, pushes token batches and NULL at the end
+ *
+ * @param arg Pipeline
+ * @return NULL
+ */
+void *pipeline_lex(void *arg) {
+    Pipeline *pipeline = (Pipeline *)arg;
+    size_t start = 0;
+
+    TRACE_SPAN(span);
+    TRACE_THREAD("lexer");
+
+    while (start < pipeline->length) {
+        size_t end = pipeline_cut(pipeline->raw, start, pipeline->length);
+
+        TRACE_BEGIN(span, "tokenize", start);
+
+        u32char *chunk = (u32char *)dust_malloc(sizeof(u32char) * (end - start + 1));
+        memcpy(chunk, pipeline->raw + start, sizeof(u32char) * (end - start));
+        chunk[end - start] = U'\0';
+
+        TokenArray *batch = tokenize_part(chunk, start, NULL);
+        dust_free(chunk);
+
+        if (end == pipeline->length) tokenize_end(batch);
+
+        // Time spent waiting for the parser to catch up
+        TRACE_BEGIN(span, "wait", TRACE_NOARG);
+        Ring_push_wait(pipeline->ring, batch);
+        TRACE_END(span);
+
+        start = end;
+    }
+
+    Ring_push_wait(pipeline->ring, NULL);
+
+    return NULL;
+}
+
+// Take the next batch of tokens, time spent waiting for the lexer is traced
+static TokenArray *pipeline_pop(Pipeline *pipeline) {
+    TRACE_SPAN(span);
+    TRACE_BEGIN(span, "wait", TRACE_NOARG);
+
+    TokenArray *batch = (TokenArray *)Ring_pop_wait(pipeline->ring);
+
+    TRACE_END(span);
+    return batch;
+}
+
+/**
+ * @brief Parse a source code while it is being tokenized on another thread
+ *
+ * @param raw Source code
+ * @return Body node of the top-level statements
+ */
+Node *parse_pipelined(u32char *raw) {
+    Pipeline pipeline;
+    pipeline.raw = raw;
+    pipeline.length = u32len(raw);
+    pipeline.ring = Ring_new(PIPELINE_RING);
+
+    // Line breaks are indexed only if a diagnostic needs them
+    source_of(raw, pipeline.length);
+
+    Thread lexer;
+    if (!Thread_start(&lexer, pipeline_lex, &pipeline)) {
+        Ring_free(pipeline.ring);
+        return parse_body(tokenize(raw));
+    }
+
+    NodeArray *node_array = NodeArray_new(16);
+    TokenArray *pending = TokenArray_new(64);
+    size_t stacksize = 16;
+    size_t *stack = (size_t *)dust_malloc(sizeof(size_t) * stacksize);
+    size_t depth = 0;
+    size_t start = 0;       // first token of the current statement
+    size_t consumed = 0;    // tokens dropped from pending so far
+    bool closed = false;    // a body just closed at depth 0
+    TokenArray *batch;
+    size_t i;
+
+    while ((batch = pipeline_pop(&pipeline)) != NULL) {
+        for (i = 0; i < batch->used; i++) {
+            Token *token = &(batch->array[i]);
+            bool end = (token->type == TokenType_NEXTSTM || token->type == TokenType_EOF);
+
+            // A statement ending with a body also takes the ; after it
+            if (closed && !end) {
+                Node *node = parse_statement(pending, start, pending->used);
+                NodeArray_append(node_array, node);
+                Node_release(node);
+                start = pending->used;
+            }
+            closed = false;
+
+            TokenArray_append(pending, token);
+            size_t index = pending->used - 1;
+            token = &(pending->array[index]);
+
+            // Braces may pair across batches, so matches are set here
+            if (token->type == TokenType_LCURLY) {
+                if (depth == stacksize) {
+                    stacksize *= 2;
+                    stack = (size_t *)dust_realloc(stack, sizeof(size_t) * stacksize);
+                }
+                stack[depth++] = index;
+            }
+
+            else if (token->type == TokenType_RCURLY) {
+                if (depth == 0) {
+                    raise(ErrorType_Syntax, U"Unexpected }", token->offset);
+                }
+
+                size_t pair = stack[--depth];
+                pending->array[pair].match = index - pair;
+                token->match = -(int)(index - pair);
+
+                if (depth == 0) closed = true;
+            }
+
+            else if (end && depth == 0) {
+                Node *node = parse_statement(pending, start, pending->used);
+                NodeArray_append(node_array, node);
+                Node_release(node);
+                start = pending->used;
+            }
+        }
+
+        TokenArray_free(batch);
+
+        // Drop the tokens of parsed statements
+        if (start > 0) {
+            memmove(pending->array, pending->array + start, sizeof(Token) * (pending->used - start));
+            pending->used -= start;
+            for (i = 0; i < depth; i++) stack[i] -= start;
+            consumed += start;
+            start = 0;
+        }
+    }
+
+    Thread_join(&lexer);
+    Ring_free(pipeline.ring);
+
+    if (closed) {
+        Node *node = parse_statement(pending, start, pending->used);
+        NodeArray_append(node_array, node);
+        Node_release(node);
+        start = pending->used;
+    }
+
+    if (start < pending->used) {
+        Token *last = &(pending->array[pending->used - 1]);
+
+        if (depth > 0) raise(ErrorType_Syntax, U"Expected }", last->offset);
+        else raise(ErrorType_Syntax, U"Expected ;", last->offset);
+    }
+
+    consumed += pending->used;
+
+    TokenArray_free(pending);
+    dust_free(stack);
+
+    return NodeBody_new(node_array, consumed > 0 ? consumed - 1 : 0);
+}
+
+/**
+ * @brief Parse a file while it is being tokenized on another thread
+ *
+ * @param filepath Path of the file
+ * @return Body node of the top-level statements
+ */
+Node *parse_file_pipelined(char *filepath) {
+    u32char *filecontent = u32readfile(filepath);
+
+    // Source code is kept for diagnostics
+    Source *source = Source_new(utf8_to_utf32(filepath), filecontent, u32len(filecontent));
+    source->owned = true;
+    source_use(source);
+
+    return parse_pipelined(filecontent);
+}
@@ -10,9 +10,13 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
 #include "dust/ustring.h"
 #include "dust/error.h"
 #include "dust/platform.h"
+#include "dust/structural.h"
+#include "dust/thread.h"
 
 #if OS == OS_WINDOWS
 #include <winsock2.h>
@@ -20,6 +24,7 @@
 
 #elif OS == OS_LINUX
 #include <sys/utsname.h>
+#include <unistd.h>
 
 #elif OS == OS_MACOS
 #include <CoreServices/CoreServices.h>
@@ -27,13 +32,50 @@
 
 #endif
 
+#if defined(SIMD_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(SIMD_X86)
+#include <cpuid.h>
+#endif
 
-/**
- * @brief Get platform information
- * 
- * @return Platform object
- */
-Platform get_platform() {
+#include "dust/alloc.h"
+
+
+static void structural_classify_resolve(u32char *block, uint64_t masks[6]);
+
+static size_t utf8_ascii_resolve(char *str, size_t n, u32char *out);
+
+// Entries resolve themselves on their first call
+DispatchTable DISPATCH = {
+    SIMDLevel_SCALAR,
+    structural_classify_resolve,
+    utf8_ascii_resolve
+};
+
+static atomic_int platform_state = 0;
+static atomic_int cpuinfo_state = 0;
+static atomic_int dispatch_state = 0;
+
+static Platform platform_cache;
+static CPUInfo cpuinfo_cache;
+
+
+// True for the one caller that has to compute the value, others wait for it
+static bool platform_once(atomic_int *state) {
+    int expected = 0;
+
+    if (atomic_load_explicit(state, memory_order_acquire) == 2) return false;
+    if (atomic_compare_exchange_strong(state, &expected, 1)) return true;
+
+    while (atomic_load_explicit(state, memory_order_acquire) != 2) thread_yield();
+    return false;
+}
+
+static void platform_done(atomic_int *state) {
+    atomic_store_explicit(state, 2, memory_order_release);
+}
+
+static Platform platform_read() {
     Platform platform;
 
     #if OS == OS_WINDOWS
@@ -128,7 +170,7 @@ Platform get_platform() {
         fclose(fp);
     }
     else {
-        platform.version = utf8_to_utf32(uts.release)
+        platform.version = utf8_to_utf32(uts.release);
     }
     
     platform.kernel = utf8_to_utf32(uts.sysname);
@@ -225,4 +267,276 @@ Platform get_platform() {
     #endif
 
     return platform;
+}
+
+/**
+ * @brief Get platform information, read on the first call only
+ * 
+ * @return Platform object
+ */
+Platform get_platform() {
+    if (platform_once(&platform_state)) {
+        platform_cache = platform_read();
+        platform_done(&platform_state);
+    }
+
+    return platform_cache;
+}
+
+#if defined(SIMD_X86)
+
+static void cpuid(unsigned int leaf, unsigned int subleaf, unsigned int regs[4]) {
+    #if defined(_MSC_VER)
+
+    int out[4];
+    __cpuidex(out, (int)leaf, (int)subleaf);
+    for (int i = 0; i < 4; i++) regs[i] = (unsigned int)out[i];
+
+    #else
+
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+
+    #endif
+}
+
+// Register states the OS saves on context switches
+static unsigned long long xgetbv() {
+    #if defined(_MSC_VER)
+
+    return _xgetbv(0);
+
+    #else
+
+    unsigned int eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((unsigned long long)edx << 32) | eax;
+
+    #endif
+}
+
+// Sizes from the deterministic cache parameters leaf (4 on Intel, 0x8000001D on AMD)
+static void cpuid_caches(CPUInfo *info, unsigned int leaf) {
+    unsigned int regs[4];
+
+    for (unsigned int i = 0; i < 16; i++) {
+        cpuid(leaf, i, regs);
+
+        unsigned int type = regs[0] & 0x1F;
+        unsigned int level = (regs[0] >> 5) & 0x7;
+        if (type == 0) break;
+
+        size_t ways = ((regs[1] >> 22) & 0x3FF) + 1;
+        size_t partitions = ((regs[1] >> 12) & 0x3FF) + 1;
+        size_t line = (regs[1] & 0xFFF) + 1;
+        size_t sets = (size_t)regs[2] + 1;
+        size_t size = ways * partitions * line * sets;
+
+        // Instruction caches are left out
+        if (type == 2) continue;
+
+        if (level == 1) info->l1_size = size;
+        else if (level == 2) info->l2_size = size;
+        else if (level == 3) info->l3_size = size;
+
+        if (info->cache_line == 0) info->cache_line = line;
+    }
+}
+
+static void cpuid_detect(CPUInfo *info) {
+    unsigned int regs[4];
+    unsigned int max_leaf, max_extended;
+    char vendor[13];
+    char brand[49];
+    int smt = 1;
+
+    cpuid(0, 0, regs);
+    max_leaf = regs[0];
+    memcpy(vendor, &regs[1], 4);
+    memcpy(vendor + 4, &regs[3], 4);
+    memcpy(vendor + 8, &regs[2], 4);
+    vendor[12] = '\0';
+
+    cpuid(0x80000000, 0, regs);
+    max_extended = regs[0];
+
+    if (max_extended >= 0x80000004) {
+        for (unsigned int i = 0; i < 3; i++) {
+            cpuid(0x80000002 + i, 0, regs);
+            memcpy(brand + i * 16, regs, 16);
+        }
+
+        brand[48] = '\0';
+
+        char *start = brand;
+        while (*start == ' ') start++;
+        // utf8_to_utf32 would wait for the dispatch this detection is for
+        info->name = u32strip(ascii_to_utf32(start));
+    }
+
+    if (max_leaf >= 1) {
+        cpuid(1, 0, regs);
+
+        bool sse2 = regs[3] & (1 << 26);
+        bool sse42 = regs[2] & (1 << 20);
+        bool osxsave = regs[2] & (1 << 27);
+        bool avx = regs[2] & (1 << 28);
+        unsigned long long xcr0 = osxsave ? xgetbv() : 0;
+
+        // CLFLUSH line size, in 8 byte units
+        info->cache_line = ((regs[1] >> 8) & 0xFF) * 8;
+
+        if (sse2) info->simd = SIMDLevel_SSE2;
+        if (sse2 && sse42) info->simd = SIMDLevel_SSE42;
+
+        // Wide registers are usable only if the OS saves them
+        if (max_leaf >= 7 && avx && (xcr0 & 0x6) == 0x6) {
+            cpuid(7, 0, regs);
+
+            if (info->simd == SIMDLevel_SSE42 && (regs[1] & (1 << 5))) {
+                info->simd = SIMDLevel_AVX2;
+
+                if ((regs[1] & (1 << 16)) && (xcr0 & 0xE0) == 0xE0) info->simd = SIMDLevel_AVX512;
+            }
+        }
+    }
+
+    bool amd = !strcmp(vendor, "AuthenticAMD") || !strcmp(vendor, "HygonGenuine");
+    bool topology = false;
+
+    if (max_extended >= 0x80000001) {
+        cpuid(0x80000001, 0, regs);
+        topology = regs[2] & (1 << 22);
+    }
+
+    if (amd && topology && max_extended >= 0x8000001D) cpuid_caches(info, 0x8000001D);
+    else if (max_leaf >= 4) cpuid_caches(info, 4);
+
+    // Threads of a core, from the SMT level of the topology leaf
+    if (max_leaf >= 0xB) {
+        cpuid(0xB, 0, regs);
+        if (((regs[2] >> 8) & 0xFF) == 1 && (regs[1] & 0xFFFF) > 0) smt = regs[1] & 0xFFFF;
+    }
+    else if (amd && topology && max_extended >= 0x8000001E) {
+        cpuid(0x8000001E, 0, regs);
+        smt = ((regs[1] >> 8) & 0xFF) + 1;
+    }
+
+    info->physical_cores = info->logical_cores / smt;
+}
+
+#endif
+
+/**
+ * @brief Get CPU information, detected on the first call only
+ * 
+ * @return CPU information (owned by Dust)
+ */
+CPUInfo *get_cpuinfo() {
+    if (!platform_once(&cpuinfo_state)) return &cpuinfo_cache;
+
+    CPUInfo *info = &cpuinfo_cache;
+
+    info->name = U"unknown";
+    info->simd = SIMDLevel_SCALAR;
+    info->cache_line = 0;
+    info->l1_size = 0;
+    info->l2_size = 0;
+    info->l3_size = 0;
+    info->logical_cores = thread_count();
+    info->physical_cores = info->logical_cores;
+
+    #if defined(SIMD_X86)
+    cpuid_detect(info);
+    #endif
+
+    #if defined(_SC_LEVEL1_DCACHE_SIZE)
+    if (info->l1_size == 0 && sysconf(_SC_LEVEL1_DCACHE_SIZE) > 0) info->l1_size = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+    if (info->l2_size == 0 && sysconf(_SC_LEVEL2_CACHE_SIZE) > 0) info->l2_size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    if (info->l3_size == 0 && sysconf(_SC_LEVEL3_CACHE_SIZE) > 0) info->l3_size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (info->cache_line == 0 && sysconf(_SC_LEVEL1_DCACHE_LINESIZE) > 0)
+        info->cache_line = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+    #endif
+
+    if (info->cache_line == 0) info->cache_line = 64;
+    if (info->physical_cores < 1) info->physical_cores = 1;
+
+    platform_done(&cpuinfo_state);
+    return info;
+}
+
+/**
+ * @brief Name of a SIMD level
+ * 
+ * @param level SIMD level
+ * @return Name
+ */
+char *SIMDLevel_repr(SIMDLevel level) {
+    switch (level) {
+        case SIMDLevel_SSE2: return "SSE2";
+        case SIMDLevel_SSE42: return "SSE4.2";
+        case SIMDLevel_AVX2: return "AVX2";
+        case SIMDLevel_AVX512: return "AVX-512";
+        default: return "scalar";
+    }
+}
+
+/**
+ * @brief Point the dispatch table at the kernels of a SIMD level,
+ *        levels the CPU doesn't support are lowered to one it does
+ * 
+ * @param level SIMD level
+ */
+void dispatch_use(SIMDLevel level) {
+    void (*structural_classify)(u32char *, uint64_t *) = structural_classify_scalar;
+    size_t (*utf8_ascii)(char *, size_t, u32char *) = utf8_ascii_scalar;
+
+    if (level > get_cpuinfo()->simd) level = get_cpuinfo()->simd;
+
+    #if defined(SIMD_X86)
+
+    if (level >= SIMDLevel_SSE2) {
+        structural_classify = structural_classify_sse2;
+        utf8_ascii = utf8_ascii_sse2;
+    }
+
+    if (level >= SIMDLevel_AVX2) {
+        structural_classify = structural_classify_avx2;
+        utf8_ascii = utf8_ascii_avx2;
+    }
+
+    if (level >= SIMDLevel_AVX512) {
+        structural_classify = structural_classify_avx512;
+        utf8_ascii = utf8_ascii_avx512;
+    }
+
+    #else
+
+    level = SIMDLevel_SCALAR;
+
+    #endif
+
+    // Every kernel computes the same result, so readers may see any mix
+    atomic_store_explicit(&DISPATCH.structural_classify, structural_classify, memory_order_relaxed);
+    atomic_store_explicit(&DISPATCH.utf8_ascii, utf8_ascii, memory_order_relaxed);
+    atomic_store_explicit(&DISPATCH.level, level, memory_order_relaxed);
+}
+
+/**
+ * @brief Pick the best kernels for the CPU, does nothing after the first call
+ */
+void dispatch_init() {
+    if (platform_once(&dispatch_state)) {
+        dispatch_use(get_cpuinfo()->simd);
+        platform_done(&dispatch_state);
+    }
+}
+
+static void structural_classify_resolve(u32char *block, uint64_t masks[6]) {
+    dispatch_init();
+    atomic_load_explicit(&DISPATCH.structural_classify, memory_order_relaxed)(block, masks);
+}
+
+static size_t utf8_ascii_resolve(char *str, size_t n, u32char *out) {
+    dispatch_init();
+    return atomic_load_explicit(&DISPATCH.utf8_ascii, memory_order_relaxed)(str, n, out);
 }
\ No newline at end of file
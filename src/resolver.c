@@ -0,0 +1,464 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+
+  resolver.c  -  Name resolution
+  -------------------------------------------------
+  Walks a parsed body once and gives every name a
+  (depth, slot) pair, see the comment above Node in
+  parser.h. Bodies, the blocks of if, elif, else,
+  while, repeat and for, and enumerations are scopes
+  and a name is visible from its declaration to the
+  end of the scope declaring it. Undefined and
+  duplicate names are collected instead of raised, so
+  all of them are reported in one run.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "dust/ustring.h"
+#include "dust/parser.h"
+#include "dust/resolver.h"
+#include "dust/allocator.h"
+#include "dust/alloc.h"
+
+
+void resolve_stmt(Resolver *resolver, Node *node);
+void resolve_expr(Resolver *resolver, Node *node);
+
+
+/**
+ * @brief Create a new resolver
+ *
+ * @return Resolver*
+ */
+Resolver *Resolver_new() {
+    Resolver *resolver = (Resolver *)dust_malloc(sizeof(Resolver));
+
+    resolver->name_size = RESOLVER_TABLE_SIZE;
+    resolver->name_count = 0;
+    resolver->names = (ResolveName *)dust_malloc(sizeof(ResolveName) * resolver->name_size);
+
+    resolver->table_size = RESOLVER_TABLE_SIZE;
+    resolver->table = (int *)dust_malloc(sizeof(int) * resolver->table_size);
+    memset(resolver->table, -1, sizeof(int) * resolver->table_size);
+
+    resolver->binding_size = RESOLVER_TABLE_SIZE;
+    resolver->binding_count = 0;
+    resolver->bindings = (ResolveBinding *)dust_malloc(sizeof(ResolveBinding) * resolver->binding_size);
+
+    resolver->scope_size = 16;
+    resolver->scope_count = 0;
+    resolver->scopes = (ResolveScope *)dust_malloc(sizeof(ResolveScope) * resolver->scope_size);
+
+    resolver->error_size = 8;
+    resolver->error_count = 0;
+    resolver->errors = (ResolveError *)dust_malloc(sizeof(ResolveError) * resolver->error_size);
+
+    return resolver;
+}
+
+static void resolver_clear_errors(Resolver *resolver) {
+    for (size_t i = 0; i < resolver->error_count; i++)
+        dust_free(resolver->errors[i].message);
+
+    resolver->error_count = 0;
+}
+
+/**
+ * @brief Free resolver and its errors
+ *
+ * @param resolver Resolver to free
+ */
+void Resolver_free(Resolver *resolver) {
+    resolver_clear_errors(resolver);
+    dust_free(resolver->names);
+    dust_free(resolver->table);
+    dust_free(resolver->bindings);
+    dust_free(resolver->scopes);
+    dust_free(resolver->errors);
+    dust_free(resolver);
+}
+
+// FNV-1a
+static uint32_t resolver_hash(u32char *name) {
+    uint32_t hash = 0x811c9dc5;
+
+    for (; *name != 0; name++) {
+        hash ^= (uint32_t)*name;
+        hash *= 0x01000193;
+    }
+
+    return hash;
+}
+
+static void resolver_grow_table(Resolver *resolver) {
+    size_t mask;
+
+    dust_free(resolver->table);
+    resolver->table_size *= 2;
+    resolver->table = (int *)dust_malloc(sizeof(int) * resolver->table_size);
+    memset(resolver->table, -1, sizeof(int) * resolver->table_size);
+    mask = resolver->table_size - 1;
+
+    for (size_t i = 0; i < resolver->name_count; i++) {
+        size_t j = resolver->names[i].hash & mask;
+        while (resolver->table[j] != -1) j = (j + 1) & mask;
+        resolver->table[j] = (int)i;
+    }
+}
+
+/**
+ * @brief Index of a name in names, added if it wasn't seen before
+ */
+static int resolver_name(Resolver *resolver, u32char *name) {
+    uint32_t hash = resolver_hash(name);
+    size_t mask = resolver->table_size - 1;
+    size_t j = hash & mask;
+
+    while (resolver->table[j] != -1) {
+        ResolveName *entry = &resolver->names[resolver->table[j]];
+        if (entry->hash == hash && u32isequal(entry->name, name)) return resolver->table[j];
+        j = (j + 1) & mask;
+    }
+
+    if (resolver->name_count == resolver->name_size) {
+        resolver->name_size *= 2;
+        resolver->names = (ResolveName *)dust_realloc(resolver->names, sizeof(ResolveName) * resolver->name_size);
+    }
+
+    int index = (int)resolver->name_count++;
+    resolver->names[index].name = name;
+    resolver->names[index].hash = hash;
+    resolver->names[index].binding = -1;
+
+    // Kept under 3/4 full so probes stay short
+    if (resolver->name_count * 4 > resolver->table_size * 3) resolver_grow_table(resolver);
+    else resolver->table[j] = index;
+
+    return index;
+}
+
+static void resolver_error(Resolver *resolver, u32char *message, u32char *name, size_t offset) {
+    if (resolver->error_count == resolver->error_size) {
+        resolver->error_size *= 2;
+        resolver->errors = (ResolveError *)dust_realloc(resolver->errors, sizeof(ResolveError) * resolver->error_size);
+    }
+
+    resolver->errors[resolver->error_count].message = u32join(message, name);
+    resolver->errors[resolver->error_count].offset = offset;
+    resolver->error_count++;
+}
+
+static void resolver_push(Resolver *resolver) {
+    if (resolver->scope_count == resolver->scope_size) {
+        resolver->scope_size *= 2;
+        resolver->scopes = (ResolveScope *)dust_realloc(resolver->scopes, sizeof(ResolveScope) * resolver->scope_size);
+    }
+
+    resolver->scopes[resolver->scope_count].first = resolver->binding_count;
+    resolver->scopes[resolver->scope_count].slots = 0;
+    resolver->scope_count++;
+}
+
+/**
+ * @brief Close the innermost scope, names it shadowed are visible again
+ *
+ * @return Number of slots of the scope's frame
+ */
+static int resolver_pop(Resolver *resolver) {
+    ResolveScope *scope = &resolver->scopes[--resolver->scope_count];
+
+    while (resolver->binding_count > scope->first) {
+        ResolveBinding *binding = &resolver->bindings[--resolver->binding_count];
+        resolver->names[binding->name].binding = binding->shadowed;
+    }
+
+    return scope->slots;
+}
+
+/**
+ * @brief Declare a name in the innermost scope
+ *
+ * @param resolver Resolver
+ * @param name Name to declare
+ * @param offset Offset of the declaration
+ * @return Slot of the name
+ */
+static int resolver_declare(Resolver *resolver, u32char *name, size_t offset) {
+    int level = (int)resolver->scope_count - 1;
+    ResolveScope *scope = &resolver->scopes[level];
+    int index = resolver_name(resolver, name);
+    int current = resolver->names[index].binding;
+
+    // The first declaration keeps the slot
+    if (current != -1 && resolver->bindings[current].level == level) {
+        resolver_error(resolver, U"Duplicate name ", name, offset);
+        return resolver->bindings[current].slot;
+    }
+
+    if (resolver->binding_count == resolver->binding_size) {
+        resolver->binding_size *= 2;
+        resolver->bindings = (ResolveBinding *)dust_realloc(resolver->bindings, sizeof(ResolveBinding) * resolver->binding_size);
+    }
+
+    ResolveBinding *binding = &resolver->bindings[resolver->binding_count];
+    binding->name = index;
+    binding->level = level;
+    binding->slot = scope->slots++;
+    binding->shadowed = current;
+
+    resolver->names[index].binding = (int)resolver->binding_count++;
+    return binding->slot;
+}
+
+/**
+ * @brief Look up a name from the innermost scope
+ *
+ * @param resolver Resolver
+ * @param name Name to look up
+ * @param offset Offset of the use
+ * @param depth Set to the number of scopes between the use and the declaration
+ * @param slot Set to the slot of the name
+ */
+static void resolver_lookup(Resolver *resolver, u32char *name, size_t offset, int *depth, int *slot) {
+    // Looking the name up might grow names
+    int index = resolver_name(resolver, name);
+    int binding = resolver->names[index].binding;
+
+    if (binding == -1) {
+        resolver_error(resolver, U"Undefined name ", name, offset);
+        *depth = NODE_UNRESOLVED;
+        *slot = NODE_UNRESOLVED;
+        return;
+    }
+
+    *depth = (int)resolver->scope_count - 1 - resolver->bindings[binding].level;
+    *slot = resolver->bindings[binding].slot;
+}
+
+static void resolve_array(Resolver *resolver, NodeArray *node_array) {
+    if (node_array == NULL) return;
+
+    for (size_t i = 0; i < node_array->used; i++)
+        resolve_expr(resolver, &(node_array->array[i]));
+}
+
+/**
+ * @brief Resolve the operands of a member, a.b.c(x) is a parent with the
+ *        nested child b.c(x), only x is looked up in scopes
+ */
+static void resolve_child(Resolver *resolver, Node *child) {
+    switch (child->type) {
+        case NodeType_CALL:
+            if (child->call_base->type != NodeType_FUNCBASE) resolve_child(resolver, child->call_base);
+            resolve_array(resolver, child->call_args);
+            break;
+
+        case NodeType_CHILD:
+            resolve_child(resolver, child->chld_parent);
+            resolve_child(resolver, child->chld_child);
+            break;
+
+        case NodeType_SUBSCRIPT:
+            resolve_child(resolver, child->subs_node);
+            resolve_expr(resolver, child->subs_expr);
+            break;
+
+        default:
+            break;
+    }
+}
+
+void resolve_expr(Resolver *resolver, Node *node) {
+    if (node == NULL) return;
+
+    switch (node->type) {
+        case NodeType_VAR:
+            // Booleans are parsed as names
+            if (u32isequal(node->variable, U"true") || u32isequal(node->variable, U"false")) break;
+            resolver_lookup(resolver, node->variable, node->offset, &node->var_depth, &node->var_slot);
+            break;
+
+        case NodeType_ARRAY:
+            resolve_array(resolver, node->array_nodearray);
+            break;
+
+        case NodeType_BINOP:
+            resolve_expr(resolver, node->bin_left);
+            resolve_expr(resolver, node->bin_right);
+            break;
+
+        case NodeType_UNARYOP:
+        case NodeType_RUNARYOP:
+            resolve_expr(resolver, node->unary_right);
+            break;
+
+        // Members are looked up in what the parent is, not in scopes
+        case NodeType_CHILD:
+            resolve_expr(resolver, node->chld_parent);
+            resolve_child(resolver, node->chld_child);
+            break;
+
+        case NodeType_SUBSCRIPT:
+            resolve_expr(resolver, node->subs_node);
+            resolve_expr(resolver, node->subs_expr);
+            break;
+
+        // Functions can't be declared yet, so their names are left unresolved
+        case NodeType_CALL:
+            if (node->call_base->type != NodeType_FUNCBASE) resolve_expr(resolver, node->call_base);
+            resolve_array(resolver, node->call_args);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Resolve the statements of a body in a scope that is already open
+ */
+static void resolve_statements(Resolver *resolver, Node *body) {
+    NodeArray *statements = Node_body(body);
+
+    for (size_t i = 0; i < statements->used; i++)
+        resolve_stmt(resolver, &(statements->array[i]));
+}
+
+static void resolve_body(Resolver *resolver, Node *body) {
+    resolver_push(resolver);
+    resolve_statements(resolver, body);
+    body->body_slots = resolver_pop(resolver);
+}
+
+/**
+ * @brief Resolve an enumeration, its members are the slots of its scope
+ */
+static void resolve_enum(Resolver *resolver, Node *body) {
+    NodeArray *members = Node_body(body);
+
+    resolver_push(resolver);
+
+    for (size_t i = 0; i < members->used; i++) {
+        Node *member = &(members->array[i]);
+
+        if (member->type == NodeType_ASSIGN) {
+            resolve_expr(resolver, member->assign_expr);
+            member->assign_depth = 0;
+            member->assign_slot = resolver_declare(resolver, member->assign_var, member->offset);
+        }
+        else if (member->type == NodeType_VAR) {
+            member->var_depth = 0;
+            member->var_slot = resolver_declare(resolver, member->variable, member->offset);
+        }
+    }
+
+    body->body_slots = resolver_pop(resolver);
+}
+
+void resolve_stmt(Resolver *resolver, Node *node) {
+    switch (node->type) {
+        // A declaration's own name isn't visible in its expression
+        case NodeType_DECL:
+            resolve_expr(resolver, node->decl_expr);
+            node->decl_slot = resolver_declare(resolver, node->decl_var, node->offset);
+            break;
+
+        case NodeType_DECLN:
+            node->decln_slot = resolver_declare(resolver, node->decln_var, node->offset);
+            break;
+
+        case NodeType_ASSIGN:
+            resolve_expr(resolver, node->assign_expr);
+            resolver_lookup(resolver, node->assign_var, node->offset, &node->assign_depth, &node->assign_slot);
+            break;
+
+        case NodeType_IMPORT:
+            node->import_slot = resolver_declare(resolver, node->import_module, node->offset);
+            break;
+
+        case NodeType_IMPORTF:
+            node->import_slot = resolver_declare(resolver, node->import_member, node->offset);
+            break;
+
+        case NodeType_ENUM:
+            node->enum_slot = resolver_declare(resolver, node->enum_name, node->offset);
+            resolve_enum(resolver, node->enum_body);
+            break;
+
+        case NodeType_BODY:
+            resolve_body(resolver, node);
+            break;
+
+        case NodeType_IF:
+            resolve_expr(resolver, node->if_expr);
+            resolve_body(resolver, node->if_body);
+            break;
+
+        case NodeType_ELIF:
+            resolve_expr(resolver, node->elif_expr);
+            resolve_body(resolver, node->elif_body);
+            break;
+
+        case NodeType_ELSE:
+            resolve_body(resolver, node->else_body);
+            break;
+
+        case NodeType_REPEAT:
+            resolve_expr(resolver, node->repeat_expr);
+            resolve_body(resolver, node->repeat_body);
+            break;
+
+        case NodeType_WHILE:
+            resolve_expr(resolver, node->while_expr);
+            resolve_body(resolver, node->while_body);
+            break;
+
+        // The loop variable is the first slot of the loop's scope
+        case NodeType_FOR:
+            resolve_expr(resolver, node->for_expr);
+            resolver_push(resolver);
+            node->for_var->var_depth = 0;
+            node->for_var->var_slot = resolver_declare(resolver, node->for_var->variable, node->for_var->offset);
+            resolve_statements(resolver, node->for_body);
+            node->for_body->body_slots = resolver_pop(resolver);
+            break;
+
+        default:
+            resolve_expr(resolver, node);
+            break;
+    }
+}
+
+/**
+ * @brief Resolve every name of a parsed body
+ *
+ * Errors of the previous run are freed, the ones of this run stay in
+ * resolver->errors until the next run or Resolver_free.
+ *
+ * @param resolver Resolver
+ * @param body Body node returned by the parser
+ * @return true if every name was resolved
+ */
+bool resolve(Resolver *resolver, Node *body) {
+    resolver_clear_errors(resolver);
+
+    // Names point into the previous tree, which might be freed by now
+    resolver->name_count = 0;
+    resolver->binding_count = 0;
+    resolver->scope_count = 0;
+    memset(resolver->table, -1, sizeof(int) * resolver->table_size);
+
+    resolve_body(resolver, body);
+
+    return resolver->error_count == 0;
+}
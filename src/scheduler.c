@@ -0,0 +1,684 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+
+  scheduler.c  -  Work-stealing scheduler
+  -------------------------------------------------
+  Every parallel stage runs its tasks on a scheduler
+  instead of starting threads of its own. Each worker
+  has a Chase–Lev deque: it pushes and takes its own
+  tasks at the bottom (newest first, while they are
+  still in cache) and steals from the top of the
+  others' (oldest first, which are the biggest ranges
+  of a split loop). Tasks spawned from outside the
+  workers go to a shared deque that is stolen from
+  the same way.
+
+  A scheduler of N jobs starts N - 1 workers, the
+  thread waiting on a group runs tasks until the
+  group is done. Idle workers spin for a while, then
+  sleep until a task is spawned.
+
+  Workers are sized from the topology of get_cpuinfo,
+  one per physical core by default, and can be pinned
+  to one thread of each core before the cores' second
+  threads are used.
+
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "dust/platform.h"
+#include "dust/thread.h"
+#include "dust/scheduler.h"
+#include "dust/source.h"
+#include "dust/trace.h"
+
+#if OS == OS_LINUX
+#include <sched.h>
+#endif
+
+#include "dust/allocator.h"
+#include "dust/alloc.h"
+
+
+int SCHEDULER_JOBS = 0;
+int SCHEDULER_PIN = 0;
+
+// Worker of the current thread (NULL if it isn't one)
+static THREAD_LOCAL Worker *_worker = NULL;
+
+
+static DequeArray *DequeArray_new(size_t capacity) {
+    DequeArray *array = (DequeArray *)malloc(sizeof(DequeArray) + sizeof(Task *) * capacity);
+    array->capacity = capacity;
+    array->previous = NULL;
+    return array;
+}
+
+/**
+ * @brief Create a new deque
+ *
+ * @param capacity Minimum number of slots (rounded up to a power of two)
+ * @return Deque's pointer
+ */
+Deque *Deque_new(size_t capacity) {
+    Deque *deque = (Deque *)malloc(sizeof(Deque));
+    size_t size = 1;
+
+    while (size < capacity) size *= 2;
+
+    atomic_init(&deque->top, 0);
+    atomic_init(&deque->bottom, 0);
+    atomic_init(&deque->array, DequeArray_new(size));
+
+    return deque;
+}
+
+/**
+ * @brief Release all resources used by the deque (not the tasks in it)
+ *
+ * @param deque Deque to free
+ */
+void Deque_free(Deque *deque) {
+    DequeArray *array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+
+    while (array != NULL) {
+        DequeArray *previous = array->previous;
+        free(array);
+        array = previous;
+    }
+
+    free(deque);
+}
+
+// Copy the tasks into an array twice the size
+static DequeArray *Deque_grow(Deque *deque, DequeArray *array, long long top, long long bottom) {
+    DequeArray *grown = DequeArray_new(array->capacity * 2);
+    long long i;
+
+    for (i = top; i < bottom; i++) {
+        Task *task = atomic_load_explicit(&array->slots[i & (array->capacity - 1)], memory_order_relaxed);
+        atomic_store_explicit(&grown->slots[i & (grown->capacity - 1)], task, memory_order_relaxed);
+    }
+
+    grown->previous = array;
+    atomic_store_explicit(&deque->array, grown, memory_order_release);
+    return grown;
+}
+
+/**
+ * @brief Push a task to the bottom, must only be called by the owner
+ *
+ * @param deque Deque to push to
+ * @param task Task to push
+ */
+void Deque_push(Deque *deque, Task *task) {
+    long long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    long long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    DequeArray *array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+
+    if (bottom - top > (long long)array->capacity - 1)
+        array = Deque_grow(deque, array, top, bottom);
+
+    atomic_store_explicit(&array->slots[bottom & (array->capacity - 1)], task, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+}
+
+/**
+ * @brief Take the newest task, must only be called by the owner
+ *
+ * @param deque Deque to take from
+ * @return Task (NULL if the deque is empty)
+ */
+Task *Deque_take(Deque *deque) {
+    long long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    DequeArray *array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+    Task *task = NULL;
+
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long long top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if (top <= bottom) {
+        task = atomic_load_explicit(&array->slots[bottom & (array->capacity - 1)], memory_order_relaxed);
+
+        // Last task, a thief might be stealing it
+        if (top == bottom) {
+            if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                                         memory_order_seq_cst, memory_order_relaxed))
+                task = NULL;
+            atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        }
+    }
+    else atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+
+    return task;
+}
+
+/**
+ * @brief Steal the oldest task, can be called by any thread
+ *
+ * @param deque Deque to steal from
+ * @param contended Set to true if another thread took the task first
+ * @return Task (NULL if there was none or it was lost)
+ */
+Task *Deque_steal(Deque *deque, bool *contended) {
+    long long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long long bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+
+    if (top >= bottom) return NULL;
+
+    DequeArray *array = atomic_load_explicit(&deque->array, memory_order_acquire);
+    Task *task = atomic_load_explicit(&array->slots[top & (array->capacity - 1)], memory_order_relaxed);
+
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed)) {
+        *contended = true;
+        return NULL;
+    }
+
+    return task;
+}
+
+
+// First logical core of the physical core a logical core belongs to
+static int scheduler_sibling(int cpu) {
+    #if OS == OS_LINUX
+
+    char path[96];
+    int first = cpu;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+    FILE *file = fopen(path, "r");
+
+    if (file != NULL) {
+        if (fscanf(file, "%d", &first) != 1) first = cpu;
+        fclose(file);
+    }
+
+    return first;
+
+    #else
+
+    return cpu;
+
+    #endif
+}
+
+/**
+ * @brief Logical cores the process can run on, one thread of each
+ *        physical core first, then the cores' other threads
+ *
+ * @param cpus Logical core numbers
+ * @param max Size of cpus
+ * @return Number of cores (0 if they couldn't be read)
+ */
+static int scheduler_cores(int *cpus, int max) {
+    int count = 0;
+    int cpu;
+
+    #if OS == OS_LINUX
+
+    cpu_set_t set;
+    int seconds[CPU_SETSIZE];
+    int second_count = 0;
+
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) return 0;
+
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &set)) continue;
+        if (scheduler_sibling(cpu) == cpu) {
+            if (count < max) cpus[count++] = cpu;
+        }
+        else seconds[second_count++] = cpu;
+    }
+
+    for (int i = 0; i < second_count && count < max; i++) cpus[count++] = seconds[i];
+
+    #elif OS == OS_WINDOWS
+
+    DWORD_PTR process;
+    DWORD_PTR system;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &process, &system)) return 0;
+
+    for (cpu = 0; cpu < (int)sizeof(DWORD_PTR) * 8 && count < max; cpu++)
+        if (process & ((DWORD_PTR)1 << cpu)) cpus[count++] = cpu;
+
+    #else
+
+    (void)cpu;
+    (void)cpus;
+    (void)max;
+
+    #endif
+
+    return count;
+}
+
+// Pin the current thread to a logical core
+static void scheduler_pin(int cpu) {
+    #if OS == OS_LINUX
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+
+    #elif OS == OS_WINDOWS
+
+    SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu);
+
+    #else
+
+    (void)cpu;
+
+    #endif
+}
+
+/**
+ * @brief Number of jobs a scheduler is created with
+ *
+ * @param jobs Requested number of jobs (0 for one per physical core
+ *             the process can run on)
+ * @return Number of jobs (at least 1)
+ */
+int scheduler_jobs(int jobs) {
+    if (jobs > 0) return jobs;
+
+    CPUInfo *cpu = get_cpuinfo();
+    int cpus[1024];
+    int allowed = scheduler_cores(cpus, 1024);
+
+    jobs = cpu->physical_cores;
+    if (allowed > 0 && allowed < jobs) jobs = allowed;
+
+    return jobs > 0 ? jobs : 1;
+}
+
+
+// Next victim of a worker, xorshift so workers don't all pick the same one
+static uint32_t worker_random(Worker *worker) {
+    uint32_t x = worker->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    worker->seed = x;
+    return x;
+}
+
+/**
+ * @brief Find a task to run: the worker's own newest one, or one stolen
+ *        from the spawned-outside deque or another worker
+ *
+ * @param scheduler Scheduler to look in
+ * @param self Worker of the current thread (NULL if it isn't one)
+ * @return Task (NULL if there wasn't any)
+ */
+static Task *scheduler_find(Scheduler *scheduler, Worker *self) {
+    int count = scheduler->jobs - 1;
+    Task *task = NULL;
+    bool contended;
+
+    if (self != NULL) task = Deque_take(self->deque);
+
+    while (task == NULL) {
+        contended = false;
+        task = Deque_steal(scheduler->inject, &contended);
+
+        if (task == NULL && count > 0) {
+            int start = self != NULL ? (int)(worker_random(self) % count) : 0;
+
+            for (int i = 0; i < count && task == NULL; i++) {
+                Worker *victim = &scheduler->workers[(start + i) % count];
+                if (victim != self) task = Deque_steal(victim->deque, &contended);
+            }
+        }
+
+        // Only give up once every deque was seen empty
+        if (!contended) break;
+    }
+
+    if (task != NULL) atomic_fetch_sub(&scheduler->queued, 1);
+    return task;
+}
+
+// Run a task with the allocator and source of the thread that spawned it
+static void task_run(Task *task) {
+    TaskGroup *group = task->group;
+    DustAllocator *allocator = dust_allocator_use(task->allocator);
+    Source *source = CURRENT_SOURCE;
+
+    CURRENT_SOURCE = task->source;
+
+    if (!atomic_load_explicit(&group->cancelled, memory_order_acquire))
+        task->func(group, task->arg);
+
+    CURRENT_SOURCE = source;
+    dust_allocator_use(allocator);
+    free(task);
+
+    // Group can be gone as soon as its waiter sees this
+    atomic_fetch_sub_explicit(&group->pending, 1, memory_order_acq_rel);
+}
+
+static void *worker_main(void *arg) {
+    Worker *worker = (Worker *)arg;
+    Scheduler *scheduler = worker->scheduler;
+    int spins = 0;
+
+    _worker = worker;
+    TRACE_THREAD("worker");
+    if (worker->cpu >= 0) scheduler_pin(worker->cpu);
+
+    while (!atomic_load(&scheduler->stopping)) {
+        Task *task = scheduler_find(scheduler, worker);
+
+        if (task != NULL) {
+            task_run(task);
+            spins = 0;
+            continue;
+        }
+
+        if (++spins < SCHEDULER_SPINS) {
+            thread_yield();
+            continue;
+        }
+
+        // Spawning increments queued before it checks sleeping, so either
+        // this sees the task or the spawner sees this worker sleeping
+        Mutex_lock(&scheduler->lock);
+        atomic_fetch_add(&scheduler->sleeping, 1);
+
+        while (atomic_load(&scheduler->queued) == 0 && !atomic_load(&scheduler->stopping))
+            Condition_wait(&scheduler->wake, &scheduler->lock);
+
+        atomic_fetch_sub(&scheduler->sleeping, 1);
+        Mutex_unlock(&scheduler->lock);
+        spins = 0;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Create a new scheduler and start its workers
+ *
+ * @param jobs Number of threads running tasks, the waiting one included
+ *             (0 for one per physical core)
+ * @param pin Pin each worker to a logical core
+ * @return Scheduler's pointer
+ */
+Scheduler *Scheduler_new(int jobs, bool pin) {
+    Scheduler *scheduler = (Scheduler *)malloc(sizeof(Scheduler));
+    int cpus[1024];
+    int cpu_count = pin ? scheduler_cores(cpus, 1024) : 0;
+    int i;
+
+    scheduler->jobs = scheduler_jobs(jobs);
+    scheduler->workers = (Worker *)malloc(sizeof(Worker) * scheduler->jobs);
+    scheduler->inject = Deque_new(DEQUE_SIZE);
+    atomic_flag_clear(&scheduler->inject_lock);
+    atomic_init(&scheduler->queued, 0);
+    atomic_init(&scheduler->sleeping, 0);
+    atomic_init(&scheduler->stopping, false);
+    Mutex_init(&scheduler->lock);
+    Condition_init(&scheduler->wake);
+
+    // Workers are set up before any starts, they steal from each other
+    for (i = 0; i < scheduler->jobs - 1; i++) {
+        Worker *worker = &scheduler->workers[i];
+        worker->scheduler = scheduler;
+        worker->deque = Deque_new(DEQUE_SIZE);
+        worker->started = false;
+        worker->seed = 2463534242u + (uint32_t)i * 2654435761u;
+
+        // The waiting thread runs on the first core
+        worker->cpu = cpu_count > 0 ? cpus[(i + 1) % cpu_count] : -1;
+    }
+
+    for (i = 0; i < scheduler->jobs - 1; i++) {
+        Worker *worker = &scheduler->workers[i];
+        worker->started = Thread_start(&worker->thread, worker_main, worker);
+    }
+
+    return scheduler;
+}
+
+/**
+ * @brief Stop the workers and release all resources used by the
+ *        scheduler, no group must be running on it
+ *
+ * @param scheduler Scheduler to free
+ */
+void Scheduler_free(Scheduler *scheduler) {
+    int i;
+
+    Mutex_lock(&scheduler->lock);
+    atomic_store(&scheduler->stopping, true);
+    Condition_wake_all(&scheduler->wake);
+    Mutex_unlock(&scheduler->lock);
+
+    // Deques are freed only once no worker can be stealing from them
+    for (i = 0; i < scheduler->jobs - 1; i++)
+        if (scheduler->workers[i].started) Thread_join(&scheduler->workers[i].thread);
+
+    for (i = 0; i < scheduler->jobs - 1; i++) Deque_free(scheduler->workers[i].deque);
+
+    Deque_free(scheduler->inject);
+    Mutex_destroy(&scheduler->lock);
+    Condition_destroy(&scheduler->wake);
+    free(scheduler->workers);
+    free(scheduler);
+}
+
+static Scheduler *scheduler_instance = NULL;
+static atomic_int scheduler_state = 0;
+
+/**
+ * @brief Scheduler shared by every parallel stage, created with
+ *        SCHEDULER_JOBS and SCHEDULER_PIN the first time it is needed
+ *
+ * @return Scheduler's pointer
+ */
+Scheduler *scheduler_shared() {
+    int expected = 0;
+
+    if (atomic_load_explicit(&scheduler_state, memory_order_acquire) != 2) {
+        if (atomic_compare_exchange_strong(&scheduler_state, &expected, 1)) {
+            scheduler_instance = Scheduler_new(SCHEDULER_JOBS, SCHEDULER_PIN);
+            atomic_store_explicit(&scheduler_state, 2, memory_order_release);
+        }
+
+        while (atomic_load_explicit(&scheduler_state, memory_order_acquire) != 2) thread_yield();
+    }
+
+    return scheduler_instance;
+}
+
+
+/**
+ * @brief Initialize an empty task group
+ *
+ * @param group Group to initialize
+ * @param scheduler Scheduler its tasks run on
+ */
+void TaskGroup_init(TaskGroup *group, Scheduler *scheduler) {
+    group->scheduler = scheduler;
+    atomic_init(&group->pending, 0);
+    atomic_init(&group->cancelled, false);
+}
+
+/**
+ * @brief Spawn a task, it can run on any thread of the scheduler
+ *        with the allocator and source of the current thread
+ *
+ * @param group Group the task belongs to
+ * @param func Function to run
+ * @param arg Argument passed to the function
+ */
+void TaskGroup_spawn(TaskGroup *group, TaskFunc func, void *arg) {
+    Scheduler *scheduler = group->scheduler;
+    Task *task = (Task *)malloc(sizeof(Task));
+
+    task->func = func;
+    task->arg = arg;
+    task->group = group;
+    task->allocator = DUST_ALLOCATOR;
+    task->source = CURRENT_SOURCE;
+
+    atomic_fetch_add(&group->pending, 1);
+    atomic_fetch_add(&scheduler->queued, 1);
+
+    if (_worker != NULL && _worker->scheduler == scheduler) {
+        Deque_push(_worker->deque, task);
+    }
+    // Outside threads share one deque, they take turns being its owner
+    else {
+        while (atomic_flag_test_and_set_explicit(&scheduler->inject_lock, memory_order_acquire))
+            thread_yield();
+        Deque_push(scheduler->inject, task);
+        atomic_flag_clear_explicit(&scheduler->inject_lock, memory_order_release);
+    }
+
+    if (atomic_load(&scheduler->sleeping) > 0) {
+        Mutex_lock(&scheduler->lock);
+        Condition_wake(&scheduler->wake);
+        Mutex_unlock(&scheduler->lock);
+    }
+}
+
+/**
+ * @brief Run tasks until every task of the group is done
+ *
+ * @param group Group to wait for
+ * @return false if the group was cancelled
+ */
+bool TaskGroup_wait(TaskGroup *group) {
+    Scheduler *scheduler = group->scheduler;
+    Worker *self = (_worker != NULL && _worker->scheduler == scheduler) ? _worker : NULL;
+
+    while (atomic_load_explicit(&group->pending, memory_order_acquire) > 0) {
+        Task *task = scheduler_find(scheduler, self);
+
+        if (task != NULL) task_run(task);
+        else thread_yield();
+    }
+
+    return !atomic_load(&group->cancelled);
+}
+
+/**
+ * @brief Cancel a group, its tasks that haven't started are skipped
+ *        and running ones can stop early by checking TaskGroup_cancelled
+ *
+ * @param group Group to cancel
+ */
+void TaskGroup_cancel(TaskGroup *group) {
+    atomic_store_explicit(&group->cancelled, true, memory_order_release);
+}
+
+/**
+ * @brief Whether the group was cancelled
+ */
+bool TaskGroup_cancelled(TaskGroup *group) {
+    return atomic_load_explicit(&group->cancelled, memory_order_acquire);
+}
+
+
+/**
+ * @param func Body of the loop
+ * @param arg Argument passed to the body
+ * @param first First index of the range
+ * @param last Index after the last one of the range
+ * @param failed Lowest index that failed so far (end of the loop if none)
+ */
+typedef struct {
+    ForFunc func;
+    void *arg;
+    size_t first;
+    size_t last;
+    atomic_size_t *failed;
+} ForRange;
+
+static void for_range(TaskGroup *group, void *arg) {
+    ForRange *range = (ForRange *)arg;
+    size_t i;
+
+    if (range->first > atomic_load_explicit(range->failed, memory_order_acquire)) {
+        free(range);
+        return;
+    }
+
+    // Upper halves are left for thieves, the lower half is split further
+    while (range->last - range->first > 1) {
+        ForRange *half = (ForRange *)malloc(sizeof(ForRange));
+        *half = *range;
+        half->first = range->first + (range->last - range->first) / 2;
+        range->last = half->first;
+        TaskGroup_spawn(group, for_range, half);
+    }
+
+    for (i = range->first; i < range->last; i++) {
+        size_t failed = atomic_load_explicit(range->failed, memory_order_acquire);
+
+        // Iterations after a failed one are cancelled
+        if (i > failed) break;
+
+        if (!range->func(i, range->arg)) {
+            while (i < failed && !atomic_compare_exchange_weak(range->failed, &failed, i));
+            break;
+        }
+    }
+
+    free(range);
+}
+
+/**
+ * @brief Run func for every index of [first, last) on the scheduler
+ *
+ * Once an iteration fails, the iterations after it are cancelled
+ * while the ones before it still run, so the failure returned is
+ * the same one a serial loop stops at.
+ *
+ * @param scheduler Scheduler to run on
+ * @param first First index
+ * @param last Index after the last one
+ * @param func Body of the loop, returns false to fail the iteration
+ * @param arg Argument passed to func
+ * @return Lowest failed index (last if every iteration succeeded)
+ */
+size_t Scheduler_for(Scheduler *scheduler, size_t first, size_t last, ForFunc func, void *arg) {
+    TaskGroup group;
+    atomic_size_t failed;
+
+    if (first >= last) return last;
+
+    atomic_init(&failed, last);
+    TaskGroup_init(&group, scheduler);
+
+    ForRange *range = (ForRange *)malloc(sizeof(ForRange));
+    range->func = func;
+    range->arg = arg;
+    range->first = first;
+    range->last = last;
+    range->failed = &failed;
+
+    TaskGroup_spawn(&group, for_range, range);
+    TaskGroup_wait(&group);
+
+    return atomic_load(&failed);
+}
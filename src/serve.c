@@ -0,0 +1,698 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+
+  serve.c  -  Compile daemon
+  -------------------------------------------------
+  `dust serve` listens on a Unix domain socket and
+  answers tokenize, parse, check and transpile requests
+  with exactly what the command would have printed.
+  A fixed pool of workers accepts connections from the
+  same socket. Tokens, trees and outputs of recently
+  requested sources are cached by a hash of the source,
+  so a request for an unchanged file only reads and
+  hashes it. Each cache entry lives in its own arena and
+  errors are caught with ERROR_TRAP, a bad source never
+  takes the server down.
+
+  A request is a list of fields, each written as its
+  length in decimal, a line break and its bytes, until
+  the client shuts its side of the connection down:
+  the command, the options ("n" for no color), then a
+  name and a path for each source file, or "-c" and the
+  source code. The response is the exit status on a
+  line, followed by the output until the server closes
+  the connection.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "dust/platform.h"
+#include "dust/ansi.h"
+#include "dust/ustring.h"
+#include "dust/error.h"
+#include "dust/source.h"
+#include "dust/tokenizer.h"
+#include "dust/parser.h"
+#include "dust/check.h"
+#include "dust/transpiler.h"
+#include "dust/thread.h"
+#include "dust/serve.h"
+
+#if OS != OS_WINDOWS
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Writing to a closed connection must not end the process with SIGPIPE
+#ifdef MSG_NOSIGNAL
+#define SERVE_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SERVE_SEND_FLAGS 0
+#endif
+
+#endif
+
+#include "dust/allocator.h"
+#include "dust/alloc.h"
+
+
+char *SERVE_COMMAND_NAMES[ServeCommand_COUNT] = {
+    "tokenize",
+    "parse",
+    "check",
+    "transpile",
+    "stop"
+};
+
+/**
+ * @brief Default socket path of the server
+ *
+ * @return Path in $XDG_RUNTIME_DIR, or in /tmp for the current user
+ */
+char *serve_socket() {
+    static char path[108];
+
+    #if OS != OS_WINDOWS
+
+    char *runtime = getenv("XDG_RUNTIME_DIR");
+
+    if (runtime != NULL && strlen(runtime) + sizeof("/dust.sock") <= sizeof(path))
+        snprintf(path, sizeof(path), "%s/dust.sock", runtime);
+    else
+        snprintf(path, sizeof(path), "/tmp/dust-%d.sock", (int)getuid());
+
+    #endif
+
+    return path;
+}
+
+
+#if OS != OS_WINDOWS
+
+static ServeEntry *serve_cache[SERVE_CACHE_SIZE];
+static atomic_flag serve_cache_lock = ATOMIC_FLAG_INIT;
+static atomic_bool serve_stopping = false;
+
+
+static void serve_lock(atomic_flag *lock) {
+    while (atomic_flag_test_and_set_explicit(lock, memory_order_acquire)) thread_yield();
+}
+
+static void serve_unlock(atomic_flag *lock) {
+    atomic_flag_clear_explicit(lock, memory_order_release);
+}
+
+// FNV-1a, continued from hash
+static uint64_t serve_hash(uint64_t hash, void *data, size_t size) {
+    unsigned char *bytes = (unsigned char *)data;
+
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+static void ServeEntry_free(ServeEntry *entry) {
+    Arena_free(entry->arena);
+    free(entry);
+}
+
+// New entry holding a copy of the source
+static ServeEntry *ServeEntry_new(uint64_t hash, u32char *name, u32char *raw, size_t length) {
+    ServeEntry *entry = (ServeEntry *)malloc(sizeof(ServeEntry));
+
+    entry->hash = hash;
+    entry->refs = 1;
+    atomic_flag_clear(&entry->lock);
+    entry->arena = Arena_new(0);
+    entry->tokens = NULL;
+    entry->root = NULL;
+    entry->tokenize_error = NULL;
+    entry->parse_error = NULL;
+
+    for (int i = 0; i < ServeCommand_COUNT; i++) {
+        entry->outputs[i] = NULL;
+        entry->statuses[i] = 0;
+    }
+
+    DustAllocator *previous = dust_allocator_use(&entry->arena->allocator);
+
+    u32char *copy = (u32char *)dust_malloc(sizeof(u32char) * (length + 1));
+    u32char *name_copy = (u32char *)dust_malloc(sizeof(u32char) * (u32len(name) + 1));
+    memcpy(copy, raw, sizeof(u32char) * (length + 1));
+    u32copy(name_copy, name);
+    entry->source = Source_new(name_copy, copy, length);
+
+    dust_allocator_use(previous);
+    return entry;
+}
+
+// Cached entry of the hash, a new one replaces whatever was in its slot
+static ServeEntry *serve_acquire(uint64_t hash, u32char *name, u32char *raw, size_t length) {
+    ServeEntry **slot = &serve_cache[hash % SERVE_CACHE_SIZE];
+    ServeEntry *entry;
+
+    serve_lock(&serve_cache_lock);
+    entry = *slot;
+    if (entry != NULL && entry->hash == hash) entry->refs++;
+    else entry = NULL;
+    serve_unlock(&serve_cache_lock);
+
+    if (entry != NULL) return entry;
+
+    // Source is copied outside the lock, another request may cache it meanwhile
+    ServeEntry *fresh = ServeEntry_new(hash, name, raw, length);
+    ServeEntry *stale = NULL;
+
+    serve_lock(&serve_cache_lock);
+    entry = *slot;
+
+    if (entry != NULL && entry->hash == hash) {
+        entry->refs++;
+        stale = fresh;
+    }
+    else {
+        // Previous entry is freed once the requests using it are done
+        if (entry != NULL && --entry->refs == 0) stale = entry;
+
+        fresh->refs = 2;
+        *slot = fresh;
+        entry = fresh;
+    }
+
+    serve_unlock(&serve_cache_lock);
+
+    if (stale != NULL) ServeEntry_free(stale);
+    return entry;
+}
+
+static void serve_release(ServeEntry *entry) {
+    serve_lock(&serve_cache_lock);
+    bool last = --entry->refs == 0;
+    serve_unlock(&serve_cache_lock);
+
+    if (last) ServeEntry_free(entry);
+}
+
+// Tokenize or parse the entry, a raised error is returned as its diagnostic
+static char *serve_stage(ServeEntry *entry, bool parse, bool nocolor) {
+    ErrorTrap *outer = ERROR_TRAP;
+    ErrorTrap trap;
+    char *error = NULL;
+
+    ERROR_TRAP = &trap;
+
+    if (setjmp(trap.jump) == 0) {
+        if (parse) entry->root = parse_body(entry->tokens);
+        else entry->tokens = tokenize(entry->source->raw);
+    }
+
+    else {
+        parse_reset();
+        error = report_text(trap.type, trap.message, trap.offset, !nocolor);
+    }
+
+    ERROR_TRAP = outer;
+    return error;
+}
+
+// Output of a command, made the first time it is requested for the entry
+static char *serve_run(ServeEntry *entry, ServeCommand command, bool nocolor, int *status) {
+    bool tree = command == ServeCommand_PARSE || command == ServeCommand_TRANSPILE;
+    char *output = NULL;
+    char *error;
+
+    if (entry->outputs[command] != NULL) {
+        *status = entry->statuses[command];
+        return entry->outputs[command];
+    }
+
+    if (entry->tokens == NULL && entry->tokenize_error == NULL)
+        entry->tokenize_error = serve_stage(entry, false, nocolor);
+
+    if (tree && entry->tokenize_error == NULL && entry->root == NULL && entry->parse_error == NULL)
+        entry->parse_error = serve_stage(entry, true, nocolor);
+
+    error = entry->tokenize_error;
+    if (error == NULL && tree) error = entry->parse_error;
+
+    *status = error != NULL;
+
+    switch (command) {
+        case ServeCommand_TOKENIZE:
+            output = error != NULL ? error : utf32_to_utf8(TokenArray_repr(entry->tokens));
+            break;
+
+        case ServeCommand_PARSE:
+            output = error != NULL ? error : utf32_to_utf8(Node_repr(entry->root, 0));
+            break;
+
+        case ServeCommand_CHECK: {
+            CheckError check_error;
+            output = error;
+
+            if (error == NULL && !check(entry->tokens, &check_error)) {
+                output = report_text(ErrorType_Syntax, check_error.message, check_error.offset, !nocolor);
+                *status = 1;
+            }
+            else if (error == NULL) output = "";
+            break;
+        }
+
+        case ServeCommand_TRANSPILE: {
+            char *warning = nocolor ? "WARNING: " : ANSI_FG_LIGHTRED "WARNING" ANSI_END ": ";
+            char *code = error != NULL ? error : utf32_to_utf8(transpile_source(entry->root->body));
+            char *message = "Transpiler is still experimental and might be depreceated in the future.\n";
+
+            output = (char *)dust_malloc(strlen(warning) + strlen(message) + strlen(code) + 1);
+            strcpy(output, warning);
+            strcat(output, message);
+            strcat(output, code);
+            break;
+        }
+
+        default:
+            output = "";
+            break;
+    }
+
+    entry->outputs[command] = output;
+    entry->statuses[command] = *status;
+    return output;
+}
+
+/**
+ * @brief Append a source's output of a command to a response
+ *
+ * @param response Response (reallocated)
+ * @param length Length of the response
+ * @param command Command
+ * @param nocolor Diagnostics have no ANSI colors
+ * @param name Name of the source shown in diagnostics
+ * @param raw Source code
+ * @param tokenized Set to whether the source could be tokenized
+ * @return Exit status of the command
+ */
+static int serve_source(char **response, size_t *length, ServeCommand command, bool nocolor,
+                        u32char *name, u32char *raw, bool *tokenized) {
+    size_t size = u32len(raw);
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    int status;
+
+    hash = serve_hash(hash, name, sizeof(u32char) * u32len(name));
+    hash = serve_hash(hash, raw, sizeof(u32char) * size);
+    hash = serve_hash(hash, &nocolor, sizeof(nocolor));
+
+    ServeEntry *entry = serve_acquire(hash, name, raw, size);
+    serve_lock(&entry->lock);
+
+    DustAllocator *previous = dust_allocator_use(&entry->arena->allocator);
+    Source *current = CURRENT_SOURCE;
+    CURRENT_SOURCE = entry->source;
+
+    char *output = serve_run(entry, command, nocolor, &status);
+    size_t output_length = strlen(output);
+    *tokenized = entry->tokenize_error == NULL;
+
+    CURRENT_SOURCE = current;
+    dust_allocator_use(previous);
+
+    *response = (char *)realloc(*response, *length + output_length + 1);
+    memcpy(*response + *length, output, output_length + 1);
+    *length += output_length;
+
+    serve_unlock(&entry->lock);
+    serve_release(entry);
+    return status;
+}
+
+// Platforms without MSG_NOSIGNAL turn SIGPIPE off per socket
+static void serve_nosigpipe(int fd) {
+    #ifdef SO_NOSIGPIPE
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+    #endif
+}
+
+static int serve_connect(char *socket_path) {
+    struct sockaddr_un address;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socket_path, sizeof(address.sun_path) - 1);
+
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    serve_nosigpipe(fd);
+
+    return fd;
+}
+
+static bool serve_write(int fd, char *data, size_t length) {
+    while (length > 0) {
+        ssize_t written = send(fd, data, length, SERVE_SEND_FLAGS);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+
+        data += written;
+        length -= written;
+    }
+
+    return true;
+}
+
+static bool serve_write_field(int fd, char *data, size_t length) {
+    char header[32];
+    int header_length = snprintf(header, sizeof(header), "%zu\n", length);
+    return serve_write(fd, header, header_length) && serve_write(fd, data, length);
+}
+
+// Read until the other side shuts down, NULL if it is too large
+static char *serve_read(int fd, size_t *length) {
+    size_t size = 4096;
+    char *data = (char *)malloc(size);
+    *length = 0;
+
+    while (true) {
+        if (*length + 1 == size) {
+            if (size >= SERVE_REQUEST_MAX) {
+                free(data);
+                return NULL;
+            }
+            size *= 2;
+            data = (char *)realloc(data, size);
+        }
+
+        ssize_t got = read(fd, data + *length, size - *length - 1);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) break;
+        *length += got;
+    }
+
+    data[*length] = '\0';
+    return data;
+}
+
+// Fields of a request, each copied into its own string
+static char **serve_fields(char *request, size_t length, int *count) {
+    char **fields = (char **)malloc(sizeof(char *) * (length / 2 + 1));
+    char *cursor = request;
+    char *end = request + length;
+
+    *count = 0;
+
+    while (cursor < end) {
+        char *newline = memchr(cursor, '\n', end - cursor);
+        if (newline == NULL) break;
+
+        size_t size = strtoull(cursor, NULL, 10);
+        char *field = newline + 1;
+        if (size > (size_t)(end - field)) break;
+
+        fields[*count] = (char *)malloc(size + 1);
+        memcpy(fields[*count], field, size);
+        fields[(*count)++][size] = '\0';
+
+        cursor = field + size;
+    }
+
+    return fields;
+}
+
+// Append a line to a response
+static void serve_append(char **response, size_t *length, char *line) {
+    size_t size = strlen(line);
+    *response = (char *)realloc(*response, *length + size + 1);
+    memcpy(*response + *length, line, size + 1);
+    *length += size;
+}
+
+// Answer the request of a connection
+static void serve_connection(int fd, char *socket_path, int workers) {
+    size_t length;
+    char *request = serve_read(fd, &length);
+    char *response = (char *)malloc(1);
+    size_t response_length = 0;
+    int command = ServeCommand_COUNT;
+    int status = 1;
+    int count = 0;
+    char **fields = NULL;
+
+    response[0] = '\0';
+
+    if (request != NULL) fields = serve_fields(request, length, &count);
+
+    for (int i = 0; count >= 2 && i < ServeCommand_COUNT; i++)
+        if (!strcmp(fields[0], SERVE_COMMAND_NAMES[i])) command = i;
+
+    if (command == ServeCommand_STOP) {
+        status = 0;
+        atomic_store(&serve_stopping, true);
+    }
+
+    else if (command != ServeCommand_COUNT) {
+        bool nocolor = strchr(fields[1], 'n') != NULL;
+        status = 0;
+
+        for (int i = 2; i + 1 < count; i += 2) {
+            bool tokenized = true;
+            u32char *name;
+            u32char *raw;
+
+            if (!strcmp(fields[i], "-c")) {
+                name = utf8_to_utf32("<stdin>");
+                raw = utf8_to_utf32(fields[i+1]);
+            }
+            else {
+                FILE *f = fopen(fields[i+1], "rb");
+
+                if (f == NULL) {
+                    serve_append(&response, &response_length, "Couldn't read file: ");
+                    serve_append(&response, &response_length, fields[i]);
+                    serve_append(&response, &response_length, "\n");
+                    status = 1;
+                    break;
+                }
+
+                fclose(f);
+                name = utf8_to_utf32(fields[i]);
+                raw = u32readfile(fields[i+1]);
+            }
+
+            int result = serve_source(&response, &response_length, command, nocolor, name, raw, &tokenized);
+            if (result > status) status = result;
+
+            dust_free(raw);
+            dust_free(name);
+
+            // Like the commands, only check takes more sources and tokenizer errors end it
+            if (command != ServeCommand_CHECK || !tokenized) break;
+        }
+    }
+
+    char header[16];
+    snprintf(header, sizeof(header), "%d\n", status);
+    if (serve_write(fd, header, strlen(header))) serve_write(fd, response, response_length);
+
+    close(fd);
+
+    for (int i = 0; i < count; i++) free(fields[i]);
+    free(fields);
+    free(request);
+    free(response);
+
+    // Wake every worker blocked in accept so they see the server is stopping
+    if (command == ServeCommand_STOP) {
+        for (int i = 0; i < workers; i++) {
+            int wake = serve_connect(socket_path);
+            if (wake >= 0) close(wake);
+        }
+    }
+}
+
+typedef struct {
+    int fd;
+    char *socket_path;
+    int workers;
+} ServeWorker;
+
+static void *serve_worker(void *arg) {
+    ServeWorker *worker = (ServeWorker *)arg;
+
+    while (!atomic_load(&serve_stopping)) {
+        int fd = accept(worker->fd, NULL, NULL);
+
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+
+        if (atomic_load(&serve_stopping)) {
+            close(fd);
+            break;
+        }
+
+        serve_nosigpipe(fd);
+        serve_connection(fd, worker->socket_path, worker->workers);
+    }
+
+    return NULL;
+}
+
+#endif
+
+
+/**
+ * @brief Serve requests on a socket until a stop request
+ *
+ * @param socket_path Path of the Unix domain socket
+ * @param workers Number of worker threads (0 for core count)
+ * @return Exit status
+ */
+int serve(char *socket_path, int workers) {
+    #if OS == OS_WINDOWS
+
+    printf("dust serve is not supported on Windows\n");
+    return 1;
+
+    #else
+
+    struct sockaddr_un address;
+
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        printf("Socket path is too long: %s\n", socket_path);
+        return 1;
+    }
+
+    // A socket nothing answers on is left from a server that didn't stop
+    int running = serve_connect(socket_path);
+    if (running >= 0) {
+        close(running);
+        printf("A server is already running on %s\n", socket_path);
+        return 1;
+    }
+    unlink(socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_path);
+
+    if (fd < 0 || bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(fd, 64) < 0) {
+        printf("Couldn't listen on %s: %s\n", socket_path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+
+    if (workers < 1) workers = thread_count();
+    atomic_store(&serve_stopping, false);
+
+    ServeWorker worker = {fd, socket_path, workers};
+    Thread *threads = (Thread *)malloc(sizeof(Thread) * workers);
+    bool *started = (bool *)malloc(sizeof(bool) * workers);
+
+    printf("Serving on %s with %d workers\n", socket_path, workers);
+    fflush(stdout);
+
+    // Calling thread is a worker too
+    for (int i = 1; i < workers; i++) started[i] = Thread_start(&threads[i], serve_worker, &worker);
+    serve_worker(&worker);
+
+    for (int i = 1; i < workers; i++)
+        if (started[i]) Thread_join(&threads[i]);
+
+    close(fd);
+    unlink(socket_path);
+    free(threads);
+    free(started);
+
+    for (int i = 0; i < SERVE_CACHE_SIZE; i++) {
+        if (serve_cache[i] != NULL) ServeEntry_free(serve_cache[i]);
+        serve_cache[i] = NULL;
+    }
+
+    return 0;
+
+    #endif
+}
+
+/**
+ * @brief Run a command on the server and print its output
+ *
+ * @param socket_path Path of the Unix domain socket
+ * @param command Name of the command
+ * @param nocolor Diagnostics have no ANSI colors
+ * @param ispath Sources are file paths, not source code
+ * @param paths Sources
+ * @param count Number of sources
+ * @return Exit status of the command (-1 if no server answered)
+ */
+int serve_client(char *socket_path, char *command, bool nocolor, bool ispath, char **paths, int count) {
+    #if OS == OS_WINDOWS
+
+    return -1;
+
+    #else
+
+    int fd = serve_connect(socket_path);
+    if (fd < 0) return -1;
+
+    bool sent = serve_write_field(fd, command, strlen(command)) &&
+                serve_write_field(fd, nocolor ? "n" : "", nocolor ? 1 : 0);
+
+    for (int i = 0; sent && i < count; i++) {
+        if (ispath) {
+            // Server may run in another directory
+            char *resolved = realpath(paths[i], NULL);
+            char *path = resolved != NULL ? resolved : paths[i];
+
+            sent = serve_write_field(fd, paths[i], strlen(paths[i])) &&
+                   serve_write_field(fd, path, strlen(path));
+            free(resolved);
+        }
+        else {
+            sent = serve_write_field(fd, "-c", 2) &&
+                   serve_write_field(fd, paths[i], strlen(paths[i]));
+        }
+    }
+
+    shutdown(fd, SHUT_WR);
+
+    size_t length;
+    char *response = sent ? serve_read(fd, &length) : NULL;
+    close(fd);
+
+    char *output = response != NULL ? strchr(response, '\n') : NULL;
+    if (output == NULL) {
+        free(response);
+        return -1;
+    }
+
+    int status = atoi(response);
+    output++;
+    fwrite(output, 1, length - (output - response), stdout);
+    fflush(stdout);
+
+    free(response);
+    return status;
+
+    #endif
+}
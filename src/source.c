@@ -0,0 +1,181 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+
+  source.c  -  Source files
+  -------------------------------------------------
+  Tokens only keep the offset of their first character.
+  Each source keeps a sorted table of its line break
+  offsets, filled by the tokenizer from the structural
+  index (or on the first lookup), and lines and columns
+  are found by binary search when a diagnostic needs them.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dust/ustring.h"
+#include "dust/structural.h"
+#include "dust/source.h"
+#include "dust/allocator.h"
+#include "dust/alloc.h"
+
+
+// Source diagnostics of the current thread are resolved against
+THREAD_LOCAL Source *CURRENT_SOURCE = NULL;
+
+
+/**
+ * @brief Create a new source
+ *
+ * @param name Name shown in diagnostics
+ * @param raw Source code (not copied)
+ * @param length Length of the source code
+ * @return Source's pointer
+ */
+Source *Source_new(u32char *name, u32char *raw, size_t length) {
+    Source *source = (Source *)dust_malloc(sizeof(Source));
+
+    source->name = name;
+    source->raw = raw;
+    source->length = length;
+    source->line_size = 16;
+    source->lines = (size_t *)dust_malloc(sizeof(size_t) * source->line_size);
+    source->line_count = 0;
+    source->indexed = false;
+    source->owned = false;
+
+    return source;
+}
+
+/**
+ * @brief Release all resources used by the source
+ *
+ * @param source Source to free
+ */
+void Source_free(Source *source) {
+    if (source == CURRENT_SOURCE) CURRENT_SOURCE = NULL;
+    if (source->owned) dust_free(source->raw);
+    dust_free(source->lines);
+    dust_free(source);
+}
+
+/**
+ * @brief Add the line breaks of an indexed part of the source
+ *        (parts must be added in order)
+ *
+ * @param source Source
+ * @param index Structural index of the part
+ * @param offset Offset of the part in source
+ */
+void Source_add_lines(Source *source, StructuralIndex *index, size_t offset) {
+    size_t pos = StructuralIndex_next(index, index->newline, 0);
+
+    while (pos < index->length) {
+        if (source->line_count == source->line_size) {
+            source->line_size *= 2;
+            source->lines = (size_t *)dust_realloc(source->lines, sizeof(size_t) * source->line_size);
+        }
+
+        source->lines[source->line_count++] = offset + pos;
+        pos = StructuralIndex_next(index, index->newline, pos + 1);
+    }
+}
+
+/**
+ * @brief Fill the line break table from the whole source if it isn't yet
+ *
+ * @param source Source
+ */
+void Source_index(Source *source) {
+    if (source->indexed) return;
+
+    StructuralIndex *index = StructuralIndex_new(source->raw, source->length);
+    source->line_count = 0;
+    Source_add_lines(source, index, 0);
+    StructuralIndex_free(index);
+
+    source->indexed = true;
+}
+
+/**
+ * @brief Resolve an offset into its line and column
+ *
+ * @param source Source
+ * @param offset Offset in source
+ * @param x Column (from 0)
+ * @param y Line (from 0)
+ */
+void Source_position(Source *source, size_t offset, int *x, int *y) {
+    Source_index(source);
+
+    // Number of line breaks before offset
+    size_t lo = 0;
+    size_t hi = source->line_count;
+
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (source->lines[mid] < offset) lo = mid + 1;
+        else hi = mid;
+    }
+
+    size_t start = (lo == 0) ? 0 : source->lines[lo - 1] + 1;
+
+    *y = (int)lo;
+    *x = (int)(offset - start);
+}
+
+/**
+ * @brief Text of a line
+ *
+ * @param source Source
+ * @param y Line (from 0)
+ * @return Line without its line break
+ */
+u32char *Source_line(Source *source, int y) {
+    Source_index(source);
+
+    if (y < 0 || (size_t)y > source->line_count) return U"";
+
+    size_t start = (y == 0) ? 0 : source->lines[y - 1] + 1;
+    size_t end = ((size_t)y < source->line_count) ? source->lines[y] : source->length;
+
+    u32char *line = (u32char *)dust_malloc(sizeof(u32char) * (end - start + 1));
+    memcpy(line, source->raw + start, sizeof(u32char) * (end - start));
+    line[end - start] = U'\0';
+
+    return line;
+}
+
+/**
+ * @brief Resolve diagnostics against a source from now on
+ *        (the previous source is freed)
+ *
+ * @param source Source to use
+ */
+void source_use(Source *source) {
+    if (CURRENT_SOURCE != NULL && CURRENT_SOURCE != source) Source_free(CURRENT_SOURCE);
+    CURRENT_SOURCE = source;
+}
+
+/**
+ * @brief Source of a source code, the current one is reused if it is
+ *        the same source code, otherwise a new <stdin> source is used
+ *
+ * @param raw Source code
+ * @param length Length of the source code
+ * @return Source's pointer
+ */
+Source *source_of(u32char *raw, size_t length) {
+    if (CURRENT_SOURCE != NULL && CURRENT_SOURCE->raw == raw && CURRENT_SOURCE->length == length)
+        return CURRENT_SOURCE;
+
+    source_use(Source_new(U"<stdin>", raw, length));
+    return CURRENT_SOURCE;
+}
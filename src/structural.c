@@ -0,0 +1,353 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+
+  structural.c  -  Structural character index
+  -------------------------------------------------
+  Classifies the source in blocks of 64 characters
+  into bitmasks before tokenizing, so the tokenizer
+  can jump over strings, comments, whitespace and
+  identifiers instead of looking at every character.
+
+  Every vector backend (AVX-512, AVX2, SSE2) is
+  compiled in and DISPATCH picks the widest one the
+  CPU supports at runtime, scalar everywhere else.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "dust/ustring.h"
+#include "dust/platform.h"
+#include "dust/structural.h"
+
+#if defined(SIMD_X86)
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "dust/allocator.h"
+#include "dust/alloc.h"
+
+
+// Order of masks in one classified block
+enum {
+    STRUCTURAL_QUOTE,
+    STRUCTURAL_SPACE,
+    STRUCTURAL_NEWLINE,
+    STRUCTURAL_STAR,
+    STRUCTURAL_STRUCTURAL,
+    STRUCTURAL_DELIM
+};
+
+
+/**
+ * @brief Classify a block of 64 characters one by one
+ *
+ * @param block 64 characters
+ * @param masks Output masks (in the order of StructuralIndex fields)
+ */
+void structural_classify_scalar(u32char *block, uint64_t masks[6]) {
+    for (size_t i = 0; i < 6; i++) masks[i] = 0;
+
+    for (size_t i = 0; i < 64; i++) {
+        uint64_t bit = (uint64_t)1 << i;
+
+        switch (block[i]) {
+            case U'"': case U'\'':
+                masks[STRUCTURAL_QUOTE] |= bit;
+                break;
+
+            case U' ':
+                masks[STRUCTURAL_SPACE] |= bit;
+                break;
+
+            case U'\n':
+                masks[STRUCTURAL_NEWLINE] |= bit;
+                break;
+
+            case U'*':
+                masks[STRUCTURAL_STAR] |= bit;
+                break;
+
+            case U'{': case U'}': case U'(': case U')': case U'[': case U']':
+            case U';': case U',': case U'.':
+                masks[STRUCTURAL_STRUCTURAL] |= bit;
+                break;
+
+            case U'+': case U'-': case U'/': case U'^': case U'=': case U'>':
+            case U'<': case U'!': case U'%': case (u32char)EOF:
+                masks[STRUCTURAL_DELIM] |= bit;
+                break;
+        }
+    }
+
+    masks[STRUCTURAL_DELIM] |= masks[STRUCTURAL_QUOTE] | masks[STRUCTURAL_SPACE] |
+                               masks[STRUCTURAL_NEWLINE] | masks[STRUCTURAL_STAR] |
+                               masks[STRUCTURAL_STRUCTURAL];
+}
+
+
+#if defined(SIMD_X86)
+
+/*
+  Body of a vector kernel, VEC_* are defined for the
+  instruction set of each kernel before it
+*/
+#define STRUCTURAL_CLASSIFY_BODY                                                           \
+    for (size_t i = 0; i < 6; i++) masks[i] = 0;                                           \
+                                                                                           \
+    for (size_t i = 0; i < 64; i += VEC_WIDTH) {                                           \
+        VEC_INT v = VEC_LOAD(block + i);                                                   \
+                                                                                           \
+        VEC_BOOL quote = VEC_OR(VEC_EQ(v, U'"'), VEC_EQ(v, U'\''));                        \
+        VEC_BOOL space = VEC_EQ(v, U' ');                                                  \
+        VEC_BOOL newline = VEC_EQ(v, U'\n');                                               \
+        VEC_BOOL star = VEC_EQ(v, U'*');                                                   \
+                                                                                           \
+        VEC_BOOL structural = VEC_OR(                                                      \
+            VEC_OR(VEC_OR(VEC_EQ(v, U'{'), VEC_EQ(v, U'}')),                               \
+                   VEC_OR(VEC_EQ(v, U'('), VEC_EQ(v, U')'))),                              \
+            VEC_OR(VEC_OR(VEC_EQ(v, U'['), VEC_EQ(v, U']')),                               \
+                   VEC_OR(VEC_OR(VEC_EQ(v, U';'), VEC_EQ(v, U',')), VEC_EQ(v, U'.'))));    \
+                                                                                           \
+        VEC_BOOL op = VEC_OR(                                                              \
+            VEC_OR(VEC_OR(VEC_EQ(v, U'+'), VEC_EQ(v, U'-')),                               \
+                   VEC_OR(VEC_EQ(v, U'/'), VEC_EQ(v, U'^'))),                              \
+            VEC_OR(VEC_OR(VEC_OR(VEC_EQ(v, U'='), VEC_EQ(v, U'>')),                        \
+                          VEC_OR(VEC_EQ(v, U'<'), VEC_EQ(v, U'!'))),                       \
+                   VEC_OR(VEC_EQ(v, U'%'), VEC_EQ(v, (u32char)EOF))));                     \
+                                                                                           \
+        VEC_BOOL delim = VEC_OR(VEC_OR(VEC_OR(quote, space), VEC_OR(newline, star)),       \
+                                VEC_OR(structural, op));                                   \
+                                                                                           \
+        masks[STRUCTURAL_QUOTE] |= VEC_MASK(quote) << i;                                   \
+        masks[STRUCTURAL_SPACE] |= VEC_MASK(space) << i;                                   \
+        masks[STRUCTURAL_NEWLINE] |= VEC_MASK(newline) << i;                               \
+        masks[STRUCTURAL_STAR] |= VEC_MASK(star) << i;                                     \
+        masks[STRUCTURAL_STRUCTURAL] |= VEC_MASK(structural) << i;                         \
+        masks[STRUCTURAL_DELIM] |= VEC_MASK(delim) << i;                                   \
+    }
+
+#define VEC_WIDTH 4
+#define VEC_LOAD(p) _mm_loadu_si128((const __m128i *)(p))
+#define VEC_EQ(v, c) _mm_castsi128_ps(_mm_cmpeq_epi32(v, _mm_set1_epi32((int)(c))))
+#define VEC_OR(a, b) _mm_or_ps(a, b)
+#define VEC_MASK(v) ((uint64_t)(unsigned)_mm_movemask_ps(v))
+#define VEC_INT __m128i
+#define VEC_BOOL __m128
+
+/**
+ * @brief Classify a block of 64 characters with SSE2 compares
+ *
+ * @param block 64 characters
+ * @param masks Output masks (in the order of StructuralIndex fields)
+ */
+SIMD_TARGET("sse2") void structural_classify_sse2(u32char *block, uint64_t masks[6]) {
+    STRUCTURAL_CLASSIFY_BODY
+}
+
+#undef VEC_WIDTH
+#undef VEC_LOAD
+#undef VEC_EQ
+#undef VEC_OR
+#undef VEC_MASK
+#undef VEC_INT
+#undef VEC_BOOL
+
+#define VEC_WIDTH 8
+#define VEC_LOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+#define VEC_EQ(v, c) _mm256_castsi256_ps(_mm256_cmpeq_epi32(v, _mm256_set1_epi32((int)(c))))
+#define VEC_OR(a, b) _mm256_or_ps(a, b)
+#define VEC_MASK(v) ((uint64_t)(unsigned)_mm256_movemask_ps(v))
+#define VEC_INT __m256i
+#define VEC_BOOL __m256
+
+/**
+ * @brief Classify a block of 64 characters with AVX2 compares
+ *
+ * @param block 64 characters
+ * @param masks Output masks (in the order of StructuralIndex fields)
+ */
+SIMD_TARGET("avx2") void structural_classify_avx2(u32char *block, uint64_t masks[6]) {
+    STRUCTURAL_CLASSIFY_BODY
+}
+
+#undef VEC_WIDTH
+#undef VEC_LOAD
+#undef VEC_EQ
+#undef VEC_OR
+#undef VEC_MASK
+#undef VEC_INT
+#undef VEC_BOOL
+
+// Compares give bitmasks directly
+#define VEC_WIDTH 16
+#define VEC_LOAD(p) _mm512_loadu_si512((const void *)(p))
+#define VEC_EQ(v, c) _mm512_cmpeq_epi32_mask(v, _mm512_set1_epi32((int)(c)))
+#define VEC_OR(a, b) ((__mmask16)((a) | (b)))
+#define VEC_MASK(v) ((uint64_t)(v))
+#define VEC_INT __m512i
+#define VEC_BOOL __mmask16
+
+/**
+ * @brief Classify a block of 64 characters with AVX-512 compares
+ *
+ * @param block 64 characters
+ * @param masks Output masks (in the order of StructuralIndex fields)
+ */
+SIMD_TARGET("avx512f") void structural_classify_avx512(u32char *block, uint64_t masks[6]) {
+    STRUCTURAL_CLASSIFY_BODY
+}
+
+#undef VEC_WIDTH
+#undef VEC_LOAD
+#undef VEC_EQ
+#undef VEC_OR
+#undef VEC_MASK
+#undef VEC_INT
+#undef VEC_BOOL
+
+#endif
+
+
+/**
+ * @brief Name of the backend the index is built with
+ */
+char *structural_backend() {
+    dispatch_init();
+
+    switch (atomic_load_explicit(&DISPATCH.level, memory_order_relaxed)) {
+        case SIMDLevel_AVX512: return "avx512";
+        case SIMDLevel_AVX2: return "avx2";
+        case SIMDLevel_SSE2:
+        case SIMDLevel_SSE42: return "sse2";
+        default: return "scalar";
+    }
+}
+
+/**
+ * @brief Build the structural index of a source
+ *
+ * @param raw Source to index
+ * @param length Length of the source
+ * @return Index's pointer
+ */
+StructuralIndex *StructuralIndex_new(u32char *raw, size_t length) {
+    StructuralIndex *index = (StructuralIndex *)dust_malloc(sizeof(StructuralIndex));
+    size_t words = length / 64 + 1;
+    uint64_t *storage = (uint64_t *)dust_malloc(sizeof(uint64_t) * words * 6);
+    uint64_t masks[6];
+
+    // Resolve the kernel first, the stub would resolve again on every block
+    dispatch_init();
+    void (*classify)(u32char *, uint64_t *) = atomic_load_explicit(&DISPATCH.structural_classify, memory_order_relaxed);
+
+    index->length = length;
+    index->words = words;
+    index->quote = storage;
+    index->space = storage + words;
+    index->newline = storage + words * 2;
+    index->star = storage + words * 3;
+    index->structural = storage + words * 4;
+    index->delim = storage + words * 5;
+
+    for (size_t w = 0; w < words; w++) {
+        size_t base = w * 64;
+
+        if (base + 64 <= length) {
+            classify(raw + base, masks);
+        }
+        // Zero-pad the last partial block, NUL belongs to no class
+        else {
+            u32char block[64] = {0};
+            if (length > base) memcpy(block, raw + base, sizeof(u32char) * (length - base));
+            classify(block, masks);
+        }
+
+        index->quote[w] = masks[STRUCTURAL_QUOTE];
+        index->space[w] = masks[STRUCTURAL_SPACE];
+        index->newline[w] = masks[STRUCTURAL_NEWLINE];
+        index->star[w] = masks[STRUCTURAL_STAR];
+        index->structural[w] = masks[STRUCTURAL_STRUCTURAL];
+        index->delim[w] = masks[STRUCTURAL_DELIM];
+    }
+
+    return index;
+}
+
+/**
+ * @brief Release all resources used by the index
+ *
+ * @param index Index to free
+ */
+void StructuralIndex_free(StructuralIndex *index) {
+    dust_free(index->quote);
+    dust_free(index);
+}
+
+static inline size_t structural_ctz(uint64_t bits) {
+    #if defined(_MSC_VER)
+    unsigned long pos;
+    _BitScanForward64(&pos, bits);
+    return pos;
+    #else
+    return __builtin_ctzll(bits);
+    #endif
+}
+
+/**
+ * @brief Position of the first set bit at or after from
+ *
+ * @param index Index the mask belongs to
+ * @param mask One of the index's masks
+ * @param from Position to start searching at
+ * @return Position, or the source length if there is none
+ */
+size_t StructuralIndex_next(StructuralIndex *index, uint64_t *mask, size_t from) {
+    if (from >= index->length) return index->length;
+
+    size_t w = from / 64;
+    uint64_t bits = mask[w] & (~(uint64_t)0 << (from % 64));
+
+    while (bits == 0) {
+        if (++w >= index->words) return index->length;
+        bits = mask[w];
+    }
+
+    size_t pos = w * 64 + structural_ctz(bits);
+    return pos < index->length ? pos : index->length;
+}
+
+/**
+ * @brief Position of the first clear bit at or after from
+ *
+ * @param index Index the mask belongs to
+ * @param mask One of the index's masks
+ * @param from Position to start searching at
+ * @return Position, or the source length if there is none
+ */
+size_t StructuralIndex_next_clear(StructuralIndex *index, uint64_t *mask, size_t from) {
+    if (from >= index->length) return index->length;
+
+    size_t w = from / 64;
+    uint64_t bits = ~mask[w] & (~(uint64_t)0 << (from % 64));
+
+    while (bits == 0) {
+        if (++w >= index->words) return index->length;
+        bits = ~mask[w];
+    }
+
+    size_t pos = w * 64 + structural_ctz(bits);
+    return pos < index->length ? pos : index->length;
+}
@@ -0,0 +1,322 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+
+  thread.c  -  Threads
+  -------------------------------------------------
+  Thin layer over Win32 threads and POSIX threads
+  (threads, mutexes and condition variables), and a
+  single-producer single-consumer ring buffer to pass
+  work between two threads.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "dust/platform.h"
+#include "dust/thread.h"
+#include "dust/allocator.h"
+#include "dust/source.h"
+
+#if OS != OS_WINDOWS
+#include <unistd.h>
+#include <sched.h>
+#endif
+
+#include "dust/alloc.h"
+
+
+#if OS == OS_WINDOWS
+
+DWORD WINAPI thread_entry(LPVOID param) {
+    Thread *thread = (Thread *)param;
+    dust_allocator_use(thread->allocator);
+    CURRENT_SOURCE = thread->source;
+    thread->result = thread->func(thread->arg);
+    return 0;
+}
+
+#else
+
+void *thread_entry(void *param) {
+    Thread *thread = (Thread *)param;
+    dust_allocator_use(thread->allocator);
+    CURRENT_SOURCE = thread->source;
+    thread->result = thread->func(thread->arg);
+    return NULL;
+}
+
+#endif
+
+
+/**
+ * @brief Start a new thread
+ *
+ * @param thread Thread to start (must stay valid until joined)
+ * @param func Function to run
+ * @param arg Argument passed to the function
+ * @return false if the thread couldn't be created
+ */
+bool Thread_start(Thread *thread, ThreadFunc func, void *arg) {
+    thread->func = func;
+    thread->arg = arg;
+    thread->result = NULL;
+    thread->allocator = DUST_ALLOCATOR;
+    thread->source = CURRENT_SOURCE;
+
+    #if OS == OS_WINDOWS
+
+    thread->handle = CreateThread(NULL, 0, thread_entry, thread, 0, NULL);
+    return thread->handle != NULL;
+
+    #else
+
+    return pthread_create(&thread->handle, NULL, thread_entry, thread) == 0;
+
+    #endif
+}
+
+/**
+ * @brief Wait for a thread to finish
+ *
+ * @param thread Thread to wait for
+ * @return Value returned from the thread's function
+ */
+void *Thread_join(Thread *thread) {
+    #if OS == OS_WINDOWS
+
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+
+    #else
+
+    pthread_join(thread->handle, NULL);
+
+    #endif
+
+    return thread->result;
+}
+
+/**
+ * @brief Number of threads that can run at the same time
+ *
+ * @return Count of online logical cores (at least 1)
+ */
+int thread_count() {
+    #if OS == OS_WINDOWS
+
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+
+    #else
+
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+
+    #endif
+}
+
+/**
+ * @brief Give the rest of the time slice to other threads
+ */
+void thread_yield() {
+    #if OS == OS_WINDOWS
+
+    SwitchToThread();
+
+    #else
+
+    sched_yield();
+
+    #endif
+}
+
+
+/**
+ * @brief Initialize a mutex
+ */
+void Mutex_init(Mutex *mutex) {
+    #if OS == OS_WINDOWS
+    InitializeSRWLock(&mutex->handle);
+    #else
+    pthread_mutex_init(&mutex->handle, NULL);
+    #endif
+}
+
+/**
+ * @brief Release a mutex, it must not be locked
+ */
+void Mutex_destroy(Mutex *mutex) {
+    #if OS != OS_WINDOWS
+    pthread_mutex_destroy(&mutex->handle);
+    #endif
+}
+
+/**
+ * @brief Lock a mutex, waiting while another thread holds it
+ */
+void Mutex_lock(Mutex *mutex) {
+    #if OS == OS_WINDOWS
+    AcquireSRWLockExclusive(&mutex->handle);
+    #else
+    pthread_mutex_lock(&mutex->handle);
+    #endif
+}
+
+/**
+ * @brief Unlock a mutex locked by the current thread
+ */
+void Mutex_unlock(Mutex *mutex) {
+    #if OS == OS_WINDOWS
+    ReleaseSRWLockExclusive(&mutex->handle);
+    #else
+    pthread_mutex_unlock(&mutex->handle);
+    #endif
+}
+
+/**
+ * @brief Initialize a condition variable
+ */
+void Condition_init(Condition *condition) {
+    #if OS == OS_WINDOWS
+    InitializeConditionVariable(&condition->handle);
+    #else
+    pthread_cond_init(&condition->handle, NULL);
+    #endif
+}
+
+/**
+ * @brief Release a condition variable, no thread must be waiting on it
+ */
+void Condition_destroy(Condition *condition) {
+    #if OS != OS_WINDOWS
+    pthread_cond_destroy(&condition->handle);
+    #endif
+}
+
+/**
+ * @brief Unlock the mutex and sleep until woken, then lock it again
+ *        (wakeups can be spurious, the caller checks its condition again)
+ *
+ * @param condition Condition to wait on
+ * @param mutex Mutex locked by the current thread
+ */
+void Condition_wait(Condition *condition, Mutex *mutex) {
+    #if OS == OS_WINDOWS
+    SleepConditionVariableSRW(&condition->handle, &mutex->handle, INFINITE, 0);
+    #else
+    pthread_cond_wait(&condition->handle, &mutex->handle);
+    #endif
+}
+
+/**
+ * @brief Wake one thread waiting on the condition
+ */
+void Condition_wake(Condition *condition) {
+    #if OS == OS_WINDOWS
+    WakeConditionVariable(&condition->handle);
+    #else
+    pthread_cond_signal(&condition->handle);
+    #endif
+}
+
+/**
+ * @brief Wake every thread waiting on the condition
+ */
+void Condition_wake_all(Condition *condition) {
+    #if OS == OS_WINDOWS
+    WakeAllConditionVariable(&condition->handle);
+    #else
+    pthread_cond_broadcast(&condition->handle);
+    #endif
+}
+
+
+/**
+ * @brief Create a new ring buffer
+ *
+ * @param capacity Minimum number of slots (rounded up to a power of two)
+ * @return Ring's pointer
+ */
+Ring *Ring_new(size_t capacity) {
+    Ring *ring = (Ring *)malloc(sizeof(Ring));
+    size_t size = 1;
+
+    while (size < capacity) size *= 2;
+
+    ring->slots = (void **)malloc(sizeof(void *) * size);
+    ring->capacity = size;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+
+    return ring;
+}
+
+/**
+ * @brief Release all resources used by the ring (not the items in it)
+ *
+ * @param ring Ring to free
+ */
+void Ring_free(Ring *ring) {
+    free(ring->slots);
+    free(ring);
+}
+
+/**
+ * @brief Push an item, must only be called from the producer thread
+ *
+ * @param ring Ring to push to
+ * @param item Item to push
+ * @return false if the ring is full
+ */
+bool Ring_push(Ring *ring, void *item) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    if (tail - head == ring->capacity) return false;
+
+    ring->slots[tail & (ring->capacity - 1)] = item;
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+/**
+ * @brief Pop an item, must only be called from the consumer thread
+ *
+ * @param ring Ring to pop from
+ * @param item Popped item
+ * @return false if the ring is empty
+ */
+bool Ring_pop(Ring *ring, void **item) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if (head == tail) return false;
+
+    *item = ring->slots[head & (ring->capacity - 1)];
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return true;
+}
+
+/**
+ * @brief Push an item, waiting while the ring is full
+ */
+void Ring_push_wait(Ring *ring, void *item) {
+    while (!Ring_push(ring, item)) thread_yield();
+}
+
+/**
+ * @brief Pop an item, waiting while the ring is empty
+ */
+void *Ring_pop_wait(Ring *ring) {
+    void *item;
+    while (!Ring_pop(ring, &item)) thread_yield();
+    return item;
+}
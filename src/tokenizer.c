@@ -10,8 +10,15 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "dust/ustring.h"
 #include "dust/error.h"
+#include "dust/structural.h"
+#include "dust/source.h"
+#include "dust/io.h"
+#include "dust/trace.h"
+#include "dust/allocator.h"
+#include "dust/alloc.h"
 
 
 typedef enum {
@@ -34,13 +41,16 @@ typedef enum {
 
 /**
  * @param type Type of the token
+ * @param match Distance to the matching curly brace (0 if not a brace)
  * @param data Token's data
- * @param xy Corresponding position of token in file
+ * @param offset Index of the token's first character in source
+ *               (line and column are resolved from it, see source.c)
  */
 typedef struct {
     TokenType type;
+    int match;
     u32char *data;
-    int x, y;
+    size_t offset;
 } Token;
 
 
@@ -52,12 +62,12 @@ typedef struct {
  * @return Token's pointer
  */
 Token *Token_new(TokenType type, u32char *data) {
-    Token *token = (Token *)malloc(sizeof(Token));
+    Token *token = (Token *)dust_malloc(sizeof(Token));
     
     token->type = type;
     token->data = data;
-    token->x = 0;
-    token->y = 0;
+    token->offset = 0;
+    token->match = 0;
 
     return token;
 }
@@ -68,8 +78,8 @@ Token *Token_new(TokenType type, u32char *data) {
  * @param token Token to free
  */
 void Token_free(Token *token) {
-    free(token->data);
-    free(token);
+    dust_free(token->data);
+    dust_free(token);
 }
 
 /**
@@ -143,9 +153,9 @@ typedef struct {
  * @return Token array's pointer
  */
 TokenArray *TokenArray_new(size_t def_size) {
-    TokenArray *token_array = (TokenArray *)malloc(sizeof(TokenArray));
+    TokenArray *token_array = (TokenArray *)dust_malloc(sizeof(TokenArray));
 
-    token_array->array = malloc(def_size * sizeof(Token));
+    token_array->array = dust_malloc(def_size * sizeof(Token));
     token_array->used = 0;
     token_array->size = def_size;
 
@@ -158,11 +168,11 @@ TokenArray *TokenArray_new(size_t def_size) {
  * @param token_array Token array to free
  */
 void TokenArray_free(TokenArray *token_array) {
-    free(token_array->array);
+    dust_free(token_array->array);
     token_array->array = NULL;
     token_array->used = 0;
     token_array->size = 0;
-    free(token_array);
+    dust_free(token_array);
 }
 
 /**
@@ -174,7 +184,7 @@ void TokenArray_free(TokenArray *token_array) {
 void TokenArray_append(TokenArray *token_array, Token *token) {
     if (token_array->used == token_array->size) {
         token_array->size *= 2;
-        token_array->array = realloc(token_array->array, token_array->size * sizeof(Token));
+        token_array->array = dust_realloc(token_array->array, token_array->size * sizeof(Token));
     }
 
     token_array->array[token_array->used++] = *token;
@@ -218,6 +228,47 @@ TokenArray *TokenArray_slicet(TokenArray *token_array, int index) {
     return slice_array;
 }
 
+/**
+ * @brief Get a bounded slice of the token array
+ * 
+ * @param token_array Token array to slice
+ * @param start Index to start slicing from
+ * @param end Index to stop slicing at (exclusive)
+ * @return Sliced token array's pointer
+ */
+TokenArray *TokenArray_subslice(TokenArray *token_array, size_t start, size_t end) {
+    if (end > token_array->used) end = token_array->used;
+    if (start > end) start = end;
+
+    TokenArray *slice_array = TokenArray_new(end - start + 1);
+    memcpy(slice_array->array, token_array->array + start, (end - start) * sizeof(Token));
+    slice_array->used = end - start;
+
+    return slice_array;
+}
+
+/**
+ * @brief Get a bounded slice of the token array without copying,
+ *        the view must not be appended to or freed
+ * 
+ * @param token_array Token array to view
+ * @param start Index the view starts from
+ * @param end Index the view ends at (exclusive)
+ * @return View of the token array
+ */
+TokenArray TokenArray_view(TokenArray *token_array, size_t start, size_t end) {
+    TokenArray view;
+
+    if (end > token_array->used) end = token_array->used;
+    if (start > end) start = end;
+
+    view.array = token_array->array + start;
+    view.used = end - start;
+    view.size = view.used;
+
+    return view;
+}
+
 /**
  * @brief Represent token array as string
  * 
@@ -225,28 +276,64 @@ TokenArray *TokenArray_slicet(TokenArray *token_array, int index) {
  * @return Representation string
  */
 u32char *TokenArray_repr(TokenArray *token_array) {
-    unsigned short i = 0;
-    u32char *finalstr = U"";
-    for (i = 0; i < token_array->used; ++i) {
-        finalstr = u32join(u32join(finalstr, Token_repr( &(token_array->array[i]) )), U"\n");
+    StringBuilder *builder = StringBuilder_new(token_array->used * 32);
+
+    for (size_t i = 0; i < token_array->used; ++i) {
+        u32char *repr = Token_repr(&(token_array->array[i]));
+        StringBuilder_append(builder, repr);
+        StringBuilder_push(builder, U'\n');
+        dust_free(repr);
     }
 
-    return finalstr;
+    return StringBuilder_finish(builder);
+}
+
+/**
+ * @brief Write the representation of a token array, a token at a time
+ * 
+ * @param token_array Token array to write
+ * @param writer Writer
+ */
+void TokenArray_write(TokenArray *token_array, Writer *writer) {
+    for (size_t i = 0; i < token_array->used; ++i) {
+        u32char *repr = Token_repr(&(token_array->array[i]));
+        Writer_write_u32(writer, repr);
+        Writer_write(writer, "\n", 1);
+        dust_free(repr);
+    }
 }
 
 
+/**
+ * @brief Append a run of characters to a token's data
+ *
+ * @param data Current data
+ * @param run First character of the run
+ * @param n Length of the run
+ * @return New data
+ */
+u32char *tokenize_extend(u32char *data, u32char *run, size_t n) {
+    size_t len = u32len(data);
+    u32char *result = (u32char *)dust_malloc(sizeof(u32char) * (len + n + 1));
+
+    memcpy(result, data, sizeof(u32char) * len);
+    memcpy(result + len, run, sizeof(u32char) * n);
+    result[len + n] = U'\0';
+
+    return result;
+}
+
 /**
  * @brief Helper function to tokenize
  */
-void tokenize_append(Token* token, TokenArray *tokens, int x, int y) {
+void tokenize_append(Token* token, TokenArray *tokens, size_t offset) {
     u32char *t = u32replace(u32strip(token->data), U"\n", U"");
+    token->offset = offset;
 
     // Decimal integer literal
     if (u32isdigit(t)) {
         token->type = TokenType_NUMERIC;
         token->data = t;
-        token->x = x;
-        token->y = y;
         TokenArray_append(tokens, token);
     }
 
@@ -254,8 +341,6 @@ void tokenize_append(Token* token, TokenArray *tokens, int x, int y) {
     else if (t[0] == U'0' && t[1] == U'x' && u32isxdigit(u32slice(t, 2, u32len(t)))) {
         token->type = TokenType_NUMERIC;
         token->data = t;
-        token->x = x;
-        token->y = y;
         TokenArray_append(tokens, token);
     }
 
@@ -263,8 +348,6 @@ void tokenize_append(Token* token, TokenArray *tokens, int x, int y) {
     else if (t[0] == U'0' && t[1] == U'b' && u32isbdigit(u32slice(t, 2, u32len(t)))) {
         token->type = TokenType_NUMERIC;
         token->data = t;
-        token->x = x;
-        token->y = y;
         TokenArray_append(tokens, token);
     }
 
@@ -280,8 +363,6 @@ void tokenize_append(Token* token, TokenArray *tokens, int x, int y) {
                         case U'}': token->type = TokenType_RCURLY; break;
                     }
                 token->data = t;
-                token->x = x;
-                token->y = y;
 
                 TokenArray_append(tokens, token);
     }
@@ -297,7 +378,7 @@ void tokenize_append(Token* token, TokenArray *tokens, int x, int y) {
         //     printf(U"%lc %d\n", t[4], !!iswalnum(t[4]));
         //     printf(U"%lc %d\n", t[5], !!iswalnum(t[5]));
         //     u32char *errmsg = u32join(u32join(U"Invalid identifier '", t), U"'");
-        //     raise(ErrorType_Syntax, errmsg, U"<raw>", x, y);
+        //     raise(ErrorType_Syntax, errmsg, offset);
         // }
 
         token->type = TokenType_IDENTIFIER;
@@ -309,97 +390,111 @@ void tokenize_append(Token* token, TokenArray *tokens, int x, int y) {
             }
 
         token->data = t;
-        token->x = x;
-        token->y = y;
 
         TokenArray_append(tokens, token);
     }
 }
 
 /**
- * @brief Tokenize a source code of string
+ * @brief Link every curly brace to its pair, so parser can jump
+ *        over a body without scanning it
+ * 
+ * @param tokens Token array to index
+ */
+void tokenize_match(TokenArray *tokens) {
+    size_t *stack = (size_t *)dust_malloc(sizeof(size_t) * (tokens->used + 1));
+    size_t depth = 0;
+    size_t i;
+
+    for (i = 0; i < tokens->used; i++) {
+        Token *token = &(tokens->array[i]);
+
+        if (token->type == TokenType_LCURLY) {
+            stack[depth++] = i;
+        }
+        else if (token->type == TokenType_RCURLY && depth > 0) {
+            size_t pair = stack[--depth];
+            tokens->array[pair].match = i - pair;
+            token->match = -(int)(i - pair);
+        }
+    }
+
+    dust_free(stack);
+}
+
+/**
+ * @brief Tokenize a part of source code without closing the token stream
  * 
  * @param raw String to tokenize
+ * @param offset Offset of the string in the whole source
+ * @param source Source to add the line breaks of the string to (or NULL)
  * @return Token array's pointer
  */
-TokenArray *tokenize(u32char *raw){
+TokenArray *tokenize_part(u32char *raw, size_t offset, Source *source) {
     TokenArray *tokens = TokenArray_new(1);
-    //raw = u32replace(u32strip(raw), U"\n", U"");
-    //raw = u32strip(raw);
-    if (u32len(raw) == 0) return tokens;
+    size_t len = u32len(raw);
+    if (len == 0) return tokens;
     Token *token = Token_new(TokenType_EOF, U"");
 
-    int x = 0;
-    int y = 0;
     u32char chr = U'\0';
     int i = 0;
+    size_t start = 0;
+    size_t next = 0;
     u32char string_type = U'\0';
+    StructuralIndex *index = StructuralIndex_new(raw, len);
+    if (source != NULL) Source_add_lines(source, index, offset);
 
-    while (i < u32len(raw) && raw[i] != EOF) {
+    while (i < len && raw[i] != EOF) {
         chr = raw[i];
 
         if (chr == U'"' || chr == U'\'') {
             string_type = chr;
-            chr = U'\0';
-            token->data = U"";
+            token->offset = offset + i;
 
-            while (chr != string_type) {
-                i++;
-                x++;
-
-                if (i > u32len(raw)) {
-                    raise(ErrorType_Syntax, U"String not closed", U"<stdin>", x, y);
-                }
+            next = StructuralIndex_next(index, index->quote, i + 1);
+            while (next < len && raw[next] != string_type)
+                next = StructuralIndex_next(index, index->quote, next + 1);
 
-                if (raw[i] == string_type) break;
-                chr = raw[i];
-                token->data = u32pushl(token->data, chr);
+            if (next >= len) {
+                raise(ErrorType_Syntax, U"String not closed", token->offset);
             }
 
+            token->data = tokenize_extend(U"", raw + i + 1, next - i - 1);
             token->type = TokenType_STRING;
-            token->x = x - u32len(token->data) - 1;
-            token->y = y;
 
             TokenArray_append(tokens, token);
             token = Token_new(TokenType_EOF, U"");
 
-            i++;
-            x++;
+            i = next + 1;
             continue;
         }
 
         if (chr == U'\n') {
-            x = 0;
-            y++;
             i++;
             continue;
         }
 
         else if (chr == U' ') {
             if (u32len(token->data) > 0) {
-                tokenize_append(token, tokens, x, y);
+                tokenize_append(token, tokens, start);
                 token = Token_new(TokenType_EOF, U"");
             }
-            i++;
-            x++;
+            i = StructuralIndex_next_clear(index, index->space, i);
             continue;
         }
 
         else if (chr == U'/' && raw[i+1] == U'/') {
-            while (raw[i] != U'\n') i++;
-
-            i++;
-            x = 0;
-            y += 1;
+            i = StructuralIndex_next(index, index->newline, i) + 1;
             continue;
         }
 
         else if (chr == U'/' && raw[i+1] == U'*') {
             i+=2;
-            while (!(raw[i] == U'*' && raw[i+1] == U'/')) i++;
+            next = StructuralIndex_next(index, index->star, i);
+            while (next < len && raw[next+1] != U'/')
+                next = StructuralIndex_next(index, index->star, next + 1);
 
-            i+=2;
-            x++;
+            i = next + 2;
             continue;
         }
 
@@ -409,10 +504,12 @@ TokenArray *tokenize(u32char *raw){
                  chr == U'%') {
 
             if (u32len(token->data) > 0) {
-                tokenize_append(token, tokens, x, y);
+                tokenize_append(token, tokens, start);
                 token = Token_new(TokenType_EOF, U"");
             }
 
+            token->offset = offset + i;
+
             if (chr == U'=' && raw[i+1] == U'=') {
                 token->data = U"==";
                 i++;
@@ -459,14 +556,11 @@ TokenArray *tokenize(u32char *raw){
             }
 
             token->type = TokenType_OPERATOR;
-            token->x = x;
-            token->y = y;
             
             TokenArray_append(tokens, token);
             token = Token_new(TokenType_EOF, U"");
 
             i++;
-            x++;
             continue;
         }
 
@@ -474,7 +568,7 @@ TokenArray *tokenize(u32char *raw){
                  chr == U']' || chr == U'{' || chr == U'}') {
 
                     if (u32len(token->data) > 0) {
-                        tokenize_append(token, tokens, x, y);
+                        tokenize_append(token, tokens, start);
                         token = Token_new(TokenType_EOF, U"");
                     }
 
@@ -487,42 +581,40 @@ TokenArray *tokenize(u32char *raw){
                         case U'}': token->type = TokenType_RCURLY; break;
                     }
                     token->data = u32pushl(token->data, chr);
-                    token->x = x;
-                    token->y = y;
+                    token->offset = offset + i;
 
                     TokenArray_append(tokens, token);
                     token = Token_new(TokenType_EOF, U"");
 
                     i++;
-                    x++;
                     continue;
                  }
 
         else if (chr == U',') {
             if (u32len(token->data) > 0) {
-                tokenize_append(token, tokens, x, y);
+                tokenize_append(token, tokens, start);
                 token = Token_new(TokenType_EOF, U"");
             }
 
             token->type = TokenType_COMMA;
             token->data = u32pushl(token->data, chr);
-            token->x = x;
-            token->y = y;
+            token->offset = offset + i;
 
             TokenArray_append(tokens, token);
             token = Token_new(TokenType_EOF, U"");
 
             i++;
-            x++;
             continue;
         }
 
         else if (chr == U'.') {
             if (u32len(token->data) > 0) {
-                tokenize_append(token, tokens, x, y);
+                tokenize_append(token, tokens, start);
                 token = Token_new(TokenType_EOF, U"");
             }
 
+            token->offset = offset + i;
+
             if (raw[i+1] == U'.') {
                 token->type = TokenType_OPERATOR;
                 token->data = U"..";
@@ -532,59 +624,93 @@ TokenArray *tokenize(u32char *raw){
                 token->type = TokenType_PERIOD;
                 token->data = u32pushl(token->data, chr);
             }
-            token->x = x;
-            token->y = y;
 
             TokenArray_append(tokens, token);
             token = Token_new(TokenType_EOF, U"");
 
             i++;
-            x++;
             continue;
         }
 
         else if (chr == U';') {
             if (u32len(token->data) > 0) {
-                tokenize_append(token, tokens, x, y);
+                tokenize_append(token, tokens, start);
                 token = Token_new(TokenType_EOF, U"");
             }
 
             token->type = TokenType_NEXTSTM;
             token->data = U"";
-            token->x = x;
-            token->y = y;
+            token->offset = offset + i;
 
             TokenArray_append(tokens, token);
             token = Token_new(TokenType_EOF, U"");
 
             i++;
-            x++;
             continue;
         }
 
-        token->data = u32pushl(token->data, chr);
-        x++;
-        i++;
+        // Take the whole run up to the next delimiter at once
+        if (token->data[0] == U'\0') start = offset + i;
+        next = StructuralIndex_next(index, index->delim, i);
+        token->data = tokenize_extend(token->data, raw + i, next - i);
+        i = next;
     }
 
+    StructuralIndex_free(index);
+
     if (u32len(token->data) > 0) {
-        tokenize_append(token, tokens, x, y);
+        tokenize_append(token, tokens, start);
     }
-    
+
+    tokenize_match(tokens);
+
+    return tokens;
+}
+
+/**
+ * @brief Close a token stream by ending it with an EOF token
+ * 
+ * @param tokens Token array to close
+ */
+void tokenize_end(TokenArray *tokens) {
+    if (tokens->used == 0) return;
+
+    Token *last = &(tokens->array[tokens->used - 1]);
+    Token *eof = Token_new(TokenType_EOF, U"");
+
     // Change last NEXTSTM token to EOF token
-    if (tokens->array[tokens->used - 1].type == TokenType_NEXTSTM) {
-        tokens->array[tokens->used - 1] = *Token_new(TokenType_EOF, U"");
+    if (last->type == TokenType_NEXTSTM) {
+        eof->offset = last->offset;
+        tokens->array[tokens->used - 1] = *eof;
     }
     // Add EOF token if necessary
-    else if (tokens->array[tokens->used - 1].type == TokenType_RCURLY) {
-        TokenArray_append(tokens, Token_new(TokenType_EOF, U""));
+    else if (last->type == TokenType_RCURLY) {
+        eof->offset = last->offset + 1;
+        TokenArray_append(tokens, eof);
     }
     else {
-        raise(ErrorType_Syntax, U"Expected ;", U"<stdin>",
-           tokens->array[tokens->used - 1].x,
-           tokens->array[tokens->used - 1].y);
+        raise(ErrorType_Syntax, U"Expected ;", last->offset);
     }
 
+    dust_free(eof);
+}
+
+/**
+ * @brief Tokenize a source code of string
+ * 
+ * @param raw String to tokenize
+ * @return Token array's pointer
+ */
+TokenArray *tokenize(u32char *raw) {
+    TRACE_SPAN(span);
+    TRACE_BEGIN(span, "tokenize", TRACE_NOARG);
+
+    Source *source = source_of(raw, u32len(raw));
+    TokenArray *tokens = tokenize_part(raw, 0, source->indexed ? NULL : source);
+    source->indexed = true;
+    tokenize_end(tokens);
+
+    TRACE_END(span);
     return tokens;
 }
 
@@ -597,7 +723,10 @@ TokenArray *tokenize(u32char *raw){
 TokenArray *tokenize_file(char *filepath) {
     u32char *filecontent = u32readfile(filepath);
 
-    TokenArray *token_array = tokenize(filecontent);
-    free(filecontent);
-    return token_array;
+    // Source code is kept for diagnostics
+    Source *source = Source_new(utf8_to_utf32(filepath), filecontent, u32len(filecontent));
+    source->owned = true;
+    source_use(source);
+
+    return tokenize(filecontent);
 }
\ No newline at end of file
@@ -0,0 +1,185 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+
+  trace.c  -  Tracing spans
+  -------------------------------------------------
+  Records spans of the front-end's stages into a ring
+  buffer of each thread and dumps them in the Chrome
+  Trace Event format, which can be opened in Perfetto
+  or chrome://tracing. Recording a span takes no lock,
+  every thread only writes its own buffer and buffers
+  are added to a lock-free list when a thread records
+  its first span.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "dust/thread.h"
+#include "dust/bench.h"
+#include "dust/trace.h"
+
+
+static _Atomic(TraceBuffer *) trace_buffers = NULL;
+static atomic_int trace_tids = 0;
+
+static THREAD_LOCAL TraceBuffer *trace_buffer = NULL;
+
+static char *trace_path = NULL;
+
+
+// Buffer of the calling thread, made on its first span
+static TraceBuffer *trace_local() {
+    if (trace_buffer != NULL) return trace_buffer;
+
+    TraceBuffer *buffer = (TraceBuffer *)malloc(sizeof(TraceBuffer));
+    atomic_init(&buffer->count, 0);
+    buffer->tid = atomic_fetch_add(&trace_tids, 1) + 1;
+    buffer->name = NULL;
+
+    buffer->next = atomic_load(&trace_buffers);
+    while (!atomic_compare_exchange_weak(&trace_buffers, &buffer->next, buffer));
+
+    trace_buffer = buffer;
+    return buffer;
+}
+
+/**
+ * @brief Begin a span, ending the span first if it is open
+ *
+ * @param span Span to begin
+ * @param name Name of the span (must outlive the trace)
+ * @param arg Source offset or size the span is about (TRACE_NOARG if none)
+ */
+void trace_begin(TraceSpan *span, char *name, size_t arg) {
+    if (span->name != NULL) trace_end(span);
+
+    span->name = name;
+    span->arg = arg;
+    span->start = bench_clock();
+}
+
+/**
+ * @brief End a span and record it, does nothing if it isn't open
+ *
+ * @param span Span to end
+ */
+void trace_end(TraceSpan *span) {
+    if (span->name == NULL) return;
+
+    double end = bench_clock();
+    TraceBuffer *buffer = trace_local();
+    size_t count = atomic_load_explicit(&buffer->count, memory_order_relaxed);
+    TraceEvent *event = &buffer->events[count % TRACE_BUFFER_SIZE];
+
+    event->name = span->name;
+    event->start = span->start;
+    event->duration = end - span->start;
+    event->arg = span->arg;
+
+    // Published after the event is written, for the thread dumping the trace
+    atomic_store_explicit(&buffer->count, count + 1, memory_order_release);
+
+    span->name = NULL;
+}
+
+/**
+ * @brief Name the calling thread in the trace
+ *
+ * @param name Name of the thread (must outlive the trace)
+ */
+void trace_thread(char *name) {
+    trace_local()->name = name;
+}
+
+/**
+ * @brief Write every recorded span as Chrome trace JSON
+ *
+ * Should be called when no other thread is recording.
+ *
+ * @param path Path of the JSON file
+ * @return false if the file couldn't be written
+ */
+bool trace_dump(char *path) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) return false;
+
+    double origin = -1.0;
+    bool first = true;
+
+    // Timestamps start from the earliest span
+    for (TraceBuffer *buffer = atomic_load(&trace_buffers); buffer != NULL; buffer = buffer->next) {
+        size_t count = atomic_load_explicit(&buffer->count, memory_order_acquire);
+        size_t kept = count < TRACE_BUFFER_SIZE ? count : TRACE_BUFFER_SIZE;
+
+        for (size_t i = count - kept; i < count; i++) {
+            double start = buffer->events[i % TRACE_BUFFER_SIZE].start;
+            if (origin < 0.0 || start < origin) origin = start;
+        }
+    }
+
+    fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+    for (TraceBuffer *buffer = atomic_load(&trace_buffers); buffer != NULL; buffer = buffer->next) {
+        size_t count = atomic_load_explicit(&buffer->count, memory_order_acquire);
+        size_t kept = count < TRACE_BUFFER_SIZE ? count : TRACE_BUFFER_SIZE;
+
+        fprintf(f, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+                   "\"args\": {\"name\": \"%s\"}}",
+                first ? "" : ",\n", buffer->tid, buffer->name != NULL ? buffer->name : "worker");
+        first = false;
+
+        if (kept < count)
+            fprintf(f, ",\n{\"name\": \"dropped %zu spans\", \"ph\": \"i\", \"s\": \"t\", \"pid\": 1, "
+                       "\"tid\": %d, \"ts\": 0}", count - kept, buffer->tid);
+
+        for (size_t i = count - kept; i < count; i++) {
+            TraceEvent *event = &buffer->events[i % TRACE_BUFFER_SIZE];
+
+            fprintf(f, ",\n{\"name\": \"%s\", \"cat\": \"dust\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+                       "\"ts\": %.3f, \"dur\": %.3f",
+                    event->name, buffer->tid,
+                    (event->start - origin) * 1e6, event->duration * 1e6);
+
+            if (event->arg != TRACE_NOARG) fprintf(f, ", \"args\": {\"offset\": %zu}", event->arg);
+
+            fprintf(f, "}");
+        }
+    }
+
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    return true;
+}
+
+static void trace_dump_exit() {
+    if (!trace_dump(trace_path)) fprintf(stderr, "Couldn't write trace: %s\n", trace_path);
+}
+
+/**
+ * @brief Dump the trace when the program exits
+ *
+ * @param path Path of the JSON file
+ */
+void trace_dump_at_exit(char *path) {
+    if (trace_path == NULL) atexit(trace_dump_exit);
+    trace_path = path;
+}
+
+/**
+ * @brief Forget every recorded span
+ *
+ * Should be called when no other thread is recording.
+ */
+void trace_reset() {
+    for (TraceBuffer *buffer = atomic_load(&trace_buffers); buffer != NULL; buffer = buffer->next)
+        atomic_store(&buffer->count, 0);
+}
@@ -15,32 +15,93 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "dust/ustring.h"
 #include "dust/parser.h"
+#include "dust/typecheck.h"
 #include "dust/transpiler.h"
+#include "dust/trace.h"
+#include "dust/allocator.h"
+#include "dust/alloc.h"
+
+
+// Start of every transpiled source
+#define TRANSPILE_HEADER "/* Transpiled from Dust */\n\n#include <stdint.h>\n\n\n"
+
+/**
+ * @brief Translate a body into C code
+ *
+ * @param node_array Body's nodes
+ * @return C source
+ */
+u32char *transpile_source(NodeArray *node_array) {
+    StringBuilder *builder = StringBuilder_new(256);
+    size_t i = 0;
 
+    TRACE_SPAN(span);
+    TRACE_BEGIN(span, "transpile", TRACE_NOARG);
 
-void transpile(NodeArray *node_array) {
-    u32char *final = U"";
-    size_t i = 0;
+    StringBuilder_append(builder, U"" TRANSPILE_HEADER);
 
     while (i < node_array->used) {
         Node *node = &(node_array->array[i]);
 
         switch (node->type) {
             case NodeType_DECL:
-                final = u32join(final, u32join(translate_decl(node), U"\n"));
+                StringBuilder_append(builder, translate_decl(node));
+                StringBuilder_push(builder, U'\n');
+                break;
         }
 
         i++;
     }
 
-    printf("/* Transpiled from Dust */\n\n#include <stdint.h>\n\n\n%s", utf32_to_utf8(final));
+    TRACE_END(span);
+    return StringBuilder_finish(builder);
+}
+
+/**
+ * @brief Translate a body into C code and write it a statement at a time
+ *
+ * @param node_array Body's nodes
+ * @param writer Writer
+ */
+void transpile_write(NodeArray *node_array, Writer *writer) {
+    TRACE_SPAN(span);
+    TRACE_BEGIN(span, "transpile", TRACE_NOARG);
+
+    Writer_write(writer, TRANSPILE_HEADER, strlen(TRANSPILE_HEADER));
+
+    for (size_t i = 0; i < node_array->used; i++) {
+        Node *node = &(node_array->array[i]);
+
+        switch (node->type) {
+            case NodeType_DECL: {
+                u32char *decl = translate_decl(node);
+                Writer_write_u32(writer, decl);
+                Writer_write(writer, "\n", 1);
+                dust_free(decl);
+                break;
+            }
+        }
+    }
+
+    TRACE_END(span);
+}
+
+void transpile(NodeArray *node_array) {
+    Writer *writer = Writer_open(NULL);
+
+    transpile_write(node_array, writer);
+
+    TRACE_SPAN(span);
+    TRACE_BEGIN(span, "write", TRACE_NOARG);
+    Writer_close(writer);
+    TRACE_END(span);
 }
 
 u32char *translate_expr(Node *node) {
-    char transtr[15];
-    char tmp[15];
+    char tmp[32];
 
     switch (node->type) {
         case NodeType_INTEGER:
@@ -57,21 +118,30 @@ u32char *translate_expr(Node *node) {
             return node->string;
             break;
 
+        case NodeType_VAR:
+            return node->variable;
+            break;
+
         case NodeType_BINOP:
-            sprintf(transtr, "(%s%s%s)",
-                    utf32_to_utf8(translate_expr(node->bin_left)),
-                    utf32_to_utf8(translate_op(node->bin_optype)),
-                    utf32_to_utf8(translate_expr(node->bin_right)));
+            return u32join(U"(", u32join(translate_expr(node->bin_left),
+                   u32join(translate_op(node->bin_optype),
+                   u32join(translate_expr(node->bin_right), U")"))));
             break;
 
         case NodeType_UNARYOP:
-            sprintf(transtr, "(%s%s)",
-                    utf32_to_utf8(translate_op(node->unary_optype)),
-                    utf32_to_utf8(translate_expr(node->unary_right)));
+            return u32join(U"(", u32join(translate_op(node->unary_optype),
+                   u32join(translate_expr(node->unary_right), U")")));
+            break;
+
+        case NodeType_CONVERT:
+            if (Type_ctype(node->vtype) == NULL) return translate_expr(node->conv_expr);
+            return u32join(U"((", u32join(ascii_to_utf32(Type_ctype(node->vtype)),
+                   u32join(U")", u32join(translate_expr(node->conv_expr), U")"))));
             break;
     }
 
-    return utf8_to_utf32(transtr);
+    // Not supported by the transpiler yet
+    return U"0";
 }
 
 u32char *translate_op(OpType op) {
@@ -94,14 +164,14 @@ u32char *translate_op(OpType op) {
         case OpType_GE: return U">="; break;
         case OpType_IN: return U"in"; break;
     }
+
+    return U"";
 }
 
 u32char *translate_decl(Node *node) {
-    char transtr[15];
-
-    sprintf(transtr, "int32_t %s = %s;",
-            utf32_to_utf8(node->decl_var),
-            utf32_to_utf8(translate_expr(node->decl_expr)));
+    // Declarations that weren't type checked are int32_t
+    u32char *ctype = Type_ctype(node->vtype) != NULL ? ascii_to_utf32(Type_ctype(node->vtype)) : U"int32_t";
 
-    return utf8_to_utf32(transtr);
+    return u32join(ctype, u32join(U" ", u32join(node->decl_var,
+           u32join(U" = ", u32join(translate_expr(node->decl_expr), U";")))));
 }
\ No newline at end of file
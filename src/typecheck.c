@@ -0,0 +1,906 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+
+  typecheck.c  -  Type checking
+  -------------------------------------------------
+  Gives every expression of a resolved tree a concrete
+  type in one walk, starting from the declared types of
+  names. Operands of different numeric types meet at a
+  common type:
+
+    int + int        the wider one
+    int + uint       the signed one if it is wider, otherwise
+                     a signed one twice as wide as the uint
+                     (none for uint128, which is a mismatch)
+    int + float      the float one
+    float + float    the wider one
+
+  and a conversion node is inserted wherever a value
+  changes width, signedness or becomes a float, so later
+  stages never have to look at operand types again.
+  Integer literals take the type of the operand they
+  meet, or the type they are used as when every operand
+  is a literal, and are checked to fit in it. Anything only known at
+  runtime (calls, imports, members) is dynamic and
+  accepted everywhere. Mismatches are collected instead
+  of raised, so all of them are reported in one run.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "dust/ustring.h"
+#include "dust/parser.h"
+#include "dust/typecheck.h"
+#include "dust/allocator.h"
+#include "dust/alloc.h"
+
+
+TypeId typecheck_expr(TypeChecker *checker, Node *node, TypeId expected);
+void typecheck_stmt(TypeChecker *checker, Node *node);
+
+
+bool Type_isint(TypeId type) {
+    return type >= Type_INT8 && type <= Type_UINT128;
+}
+
+bool Type_issigned(TypeId type) {
+    return type >= Type_INT8 && type <= Type_INT128;
+}
+
+bool Type_isfloat(TypeId type) {
+    return type == Type_FLOAT32 || type == Type_FLOAT64;
+}
+
+static bool Type_isnumber(TypeId type) {
+    return Type_isint(type) || Type_isfloat(type);
+}
+
+/**
+ * @brief Width of a numeric type
+ *
+ * @param type Type
+ * @return Number of bits (0 if the type isn't numeric)
+ */
+int Type_bits(TypeId type) {
+    switch (type) {
+        case Type_INT8: case Type_UINT8: return 8;
+        case Type_INT16: case Type_UINT16: return 16;
+        case Type_INT32: case Type_UINT32: case Type_FLOAT32: return 32;
+        case Type_INT64: case Type_UINT64: case Type_FLOAT64: return 64;
+        case Type_INT128: case Type_UINT128: return 128;
+        default: return 0;
+    }
+}
+
+static TypeId type_int(bool issigned, int bits) {
+    switch (bits) {
+        case 8: return issigned ? Type_INT8 : Type_UINT8;
+        case 16: return issigned ? Type_INT16 : Type_UINT16;
+        case 32: return issigned ? Type_INT32 : Type_UINT32;
+        case 64: return issigned ? Type_INT64 : Type_UINT64;
+        default: return issigned ? Type_INT128 : Type_UINT128;
+    }
+}
+
+/**
+ * @brief Get the type a declaration's type node stands for
+ *
+ * Names the checker doesn't know (and generics other than array) are
+ * dynamic. int, uint and float are 32 bits wide, as when folding.
+ *
+ * @param node Primitive or generic type node
+ * @return Type
+ */
+TypeId Type_parse(Node *node) {
+    if (node->type == NodeType_GENTYPE) {
+        if (node->gentype_base == NULL || !u32isequal(node->gentype_base, U"array") ||
+            node->gentype->used != 1)
+            return Type_DYNAMIC;
+
+        TypeId element = Type_parse(&(node->gentype->array[0]));
+        return TYPE_DIMS(element) < 0xff ? TYPE_ARRAY(element) : Type_DYNAMIC;
+    }
+
+    if (node->type != NodeType_PRIMITIVE) return Type_DYNAMIC;
+
+    u32char *name = node->primitive;
+
+    if      (u32isequal(name, U"int8"))    return Type_INT8;
+    else if (u32isequal(name, U"int16"))   return Type_INT16;
+    else if (u32isequal(name, U"int32"))   return Type_INT32;
+    else if (u32isequal(name, U"int"))     return Type_INT32;
+    else if (u32isequal(name, U"int64"))   return Type_INT64;
+    else if (u32isequal(name, U"int128"))  return Type_INT128;
+    else if (u32isequal(name, U"uint8"))   return Type_UINT8;
+    else if (u32isequal(name, U"uint16"))  return Type_UINT16;
+    else if (u32isequal(name, U"uint32"))  return Type_UINT32;
+    else if (u32isequal(name, U"uint"))    return Type_UINT32;
+    else if (u32isequal(name, U"uint64"))  return Type_UINT64;
+    else if (u32isequal(name, U"uint128")) return Type_UINT128;
+    else if (u32isequal(name, U"float32")) return Type_FLOAT32;
+    else if (u32isequal(name, U"float"))   return Type_FLOAT32;
+    else if (u32isequal(name, U"float64")) return Type_FLOAT64;
+    else if (u32isequal(name, U"bool"))    return Type_BOOL;
+    else if (u32isequal(name, U"string"))  return Type_STRING;
+    else if (u32isequal(name, U"str"))     return Type_STRING;
+
+    return Type_DYNAMIC;
+}
+
+/**
+ * @brief Write the name of a type into a string builder
+ *
+ * @param builder String builder to write into
+ * @param type Type
+ */
+void Type_repr_build(StringBuilder *builder, TypeId type) {
+    static u32char *names[] = {
+        U"none", U"dynamic", U"bool", U"string",
+        U"int8", U"int16", U"int32", U"int64", U"int128",
+        U"uint8", U"uint16", U"uint32", U"uint64", U"uint128",
+        U"float32", U"float64"
+    };
+    int dims = TYPE_DIMS(type);
+    int base = TYPE_BASE(type);
+
+    for (int i = 0; i < dims; i++) StringBuilder_append(builder, U"array<");
+    StringBuilder_append(builder, base <= Type_FLOAT64 ? names[base] : U"?");
+    for (int i = 0; i < dims; i++) StringBuilder_push(builder, U'>');
+}
+
+/**
+ * @brief Name of a type
+ *
+ * @param type Type
+ * @return New string
+ */
+u32char *Type_repr(TypeId type) {
+    StringBuilder *builder = StringBuilder_new(16);
+    Type_repr_build(builder, type);
+    return StringBuilder_finish(builder);
+}
+
+/**
+ * @brief C type of a scalar type
+ *
+ * @param type Type
+ * @return C type name (NULL if the type has no C counterpart)
+ */
+char *Type_ctype(TypeId type) {
+    switch (type) {
+        case Type_BOOL: return "_Bool";
+        case Type_INT8: return "int8_t";
+        case Type_INT16: return "int16_t";
+        case Type_INT32: return "int32_t";
+        case Type_INT64: return "int64_t";
+        case Type_INT128: return "__int128";
+        case Type_UINT8: return "uint8_t";
+        case Type_UINT16: return "uint16_t";
+        case Type_UINT32: return "uint32_t";
+        case Type_UINT64: return "uint64_t";
+        case Type_UINT128: return "unsigned __int128";
+        case Type_FLOAT32: return "float";
+        case Type_FLOAT64: return "double";
+        default: return NULL;
+    }
+}
+
+
+/**
+ * @brief Create a new type checker
+ *
+ * @return TypeChecker*
+ */
+TypeChecker *TypeChecker_new() {
+    TypeChecker *checker = (TypeChecker *)dust_malloc(sizeof(TypeChecker));
+
+    checker->slot_size = 64;
+    checker->slot_count = 0;
+    checker->slots = (TypeId *)dust_malloc(sizeof(TypeId) * checker->slot_size);
+
+    checker->frame_size = 16;
+    checker->frame_count = 0;
+    checker->frames = (size_t *)dust_malloc(sizeof(size_t) * checker->frame_size);
+
+    checker->error_size = 8;
+    checker->error_count = 0;
+    checker->errors = (TypeError *)dust_malloc(sizeof(TypeError) * checker->error_size);
+
+    return checker;
+}
+
+static void typecheck_clear_errors(TypeChecker *checker) {
+    for (size_t i = 0; i < checker->error_count; i++)
+        dust_free(checker->errors[i].message);
+
+    checker->error_count = 0;
+}
+
+/**
+ * @brief Free type checker and its errors
+ *
+ * @param checker Type checker to free
+ */
+void TypeChecker_free(TypeChecker *checker) {
+    typecheck_clear_errors(checker);
+    dust_free(checker->slots);
+    dust_free(checker->frames);
+    dust_free(checker->errors);
+    dust_free(checker);
+}
+
+static void typecheck_error(TypeChecker *checker, StringBuilder *message, size_t offset) {
+    if (checker->error_count == checker->error_size) {
+        checker->error_size *= 2;
+        checker->errors = (TypeError *)dust_realloc(checker->errors, sizeof(TypeError) * checker->error_size);
+    }
+
+    checker->errors[checker->error_count].message = StringBuilder_finish(message);
+    checker->errors[checker->error_count].offset = offset;
+    checker->error_count++;
+}
+
+/**
+ * @brief Record an error of the form "<before><a><middle><b><after>"
+ *
+ * Parts that are NULL (or Type_NONE) are left out.
+ */
+static void typecheck_mismatch(TypeChecker *checker, size_t offset, u32char *before, TypeId a,
+                               u32char *middle, TypeId b, u32char *after) {
+    StringBuilder *message = StringBuilder_new(64);
+
+    StringBuilder_append(message, before);
+    Type_repr_build(message, a);
+    if (middle != NULL) {
+        StringBuilder_append(message, middle);
+        Type_repr_build(message, b);
+    }
+    if (after != NULL) StringBuilder_append(message, after);
+
+    typecheck_error(checker, message, offset);
+}
+
+static void typecheck_push(TypeChecker *checker, int slots) {
+    if (slots < 0) slots = 0;
+
+    if (checker->frame_count == checker->frame_size) {
+        checker->frame_size *= 2;
+        checker->frames = (size_t *)dust_realloc(checker->frames, sizeof(size_t) * checker->frame_size);
+    }
+
+    if (checker->slot_count + slots > checker->slot_size) {
+        while (checker->slot_count + slots > checker->slot_size) checker->slot_size *= 2;
+        checker->slots = (TypeId *)dust_realloc(checker->slots, sizeof(TypeId) * checker->slot_size);
+    }
+
+    checker->frames[checker->frame_count++] = checker->slot_count;
+    for (int i = 0; i < slots; i++) checker->slots[checker->slot_count++] = Type_NONE;
+}
+
+static void typecheck_pop(TypeChecker *checker) {
+    checker->slot_count = checker->frames[--checker->frame_count];
+}
+
+/**
+ * @brief Type of a resolved name, dynamic if it wasn't resolved
+ */
+static TypeId typecheck_lookup(TypeChecker *checker, int depth, int slot) {
+    if (depth < 0 || slot < 0 || (size_t)depth >= checker->frame_count) return Type_DYNAMIC;
+
+    size_t frame = checker->frame_count - 1 - depth;
+    size_t end = (frame + 1 < checker->frame_count) ? checker->frames[frame + 1] : checker->slot_count;
+    size_t index = checker->frames[frame] + slot;
+
+    if (index >= end || checker->slots[index] == Type_NONE) return Type_DYNAMIC;
+    return checker->slots[index];
+}
+
+/**
+ * @brief Set the type of a slot of the innermost scope
+ */
+static void typecheck_declare(TypeChecker *checker, int slot, TypeId type) {
+    if (slot < 0) return;
+
+    size_t index = checker->frames[checker->frame_count - 1] + slot;
+    if (index < checker->slot_count) checker->slots[index] = type;
+}
+
+/**
+ * @brief Check if a node is an integer literal, optionally negated
+ */
+static bool typecheck_isliteral(Node *node) {
+    if (node->type == NodeType_INTEGER) return true;
+
+    return node->type == NodeType_UNARYOP &&
+           (node->unary_optype == OpType_SUB || node->unary_optype == OpType_ADD) &&
+           node->unary_right->type == NodeType_INTEGER;
+}
+
+/**
+ * @brief Check if an expression is made of integer literals only
+ */
+static bool typecheck_isconstant(Node *node) {
+    if (typecheck_isliteral(node)) return true;
+    if (node->type != NodeType_BINOP) return false;
+
+    OpType op = node->bin_optype;
+    if (op != OpType_ADD && op != OpType_SUB && op != OpType_MUL &&
+        op != OpType_DIV && op != OpType_MOD && op != OpType_POW)
+        return false;
+
+    return typecheck_isconstant(node->bin_left) && typecheck_isconstant(node->bin_right);
+}
+
+/**
+ * @brief Check if an integer fits in an integer type
+ */
+static bool typecheck_fits(long value, TypeId type) {
+    int bits = Type_bits(type);
+
+    if (Type_issigned(type)) {
+        if (bits >= 64) return true;
+        return value >= -(1L << (bits - 1)) && value <= (1L << (bits - 1)) - 1;
+    }
+
+    if (value < 0) return false;
+    return bits >= 64 || value <= (1L << bits) - 1;
+}
+
+/**
+ * @brief Type an integer literal as the type it is used as
+ *
+ * @param checker Type checker
+ * @param node Integer literal, optionally negated
+ * @param expected Type the literal is used as (int64 if it isn't numeric)
+ * @return Type of the literal
+ */
+static TypeId typecheck_literal(TypeChecker *checker, Node *node, TypeId expected) {
+    Node *integer = (node->type == NodeType_INTEGER) ? node : node->unary_right;
+    long value = (node->type == NodeType_UNARYOP && node->unary_optype == OpType_SUB) ?
+                 -integer->integer : integer->integer;
+
+    if (Type_isfloat(expected)) {
+        integer->type = NodeType_FLOAT;
+        integer->floating = (double)integer->integer;
+    }
+    else if (Type_isint(expected)) {
+        if (!typecheck_fits(value, expected)) {
+            char numstr[32];
+            StringBuilder *message = StringBuilder_new(64);
+
+            sprintf(numstr, "%ld", value);
+            StringBuilder_append(message, U"Integer ");
+            for (char *c = numstr; *c; c++) StringBuilder_push(message, *c);
+            StringBuilder_append(message, U" doesn't fit in ");
+            Type_repr_build(message, expected);
+            typecheck_error(checker, message, node->offset);
+        }
+    }
+    else expected = Type_INT64;
+
+    integer->vtype = expected;
+    node->vtype = expected;
+    return expected;
+}
+
+/**
+ * @brief Common type two numeric types meet at, see the top of the file
+ *
+ * @return Common type, Type_NONE if no type can hold both of them
+ */
+static TypeId typecheck_common(TypeId a, TypeId b) {
+    if (a == b) return a;
+
+    if (Type_isfloat(a) || Type_isfloat(b)) {
+        if (!Type_isfloat(a)) return b;
+        if (!Type_isfloat(b)) return a;
+        return Type_FLOAT64;
+    }
+
+    if (Type_issigned(a) == Type_issigned(b))
+        return Type_bits(a) >= Type_bits(b) ? a : b;
+
+    TypeId s = Type_issigned(a) ? a : b;
+    TypeId u = Type_issigned(a) ? b : a;
+
+    if (Type_bits(s) > Type_bits(u)) return s;
+
+    // No signed type is wider than uint128
+    if (Type_bits(u) >= 128) return Type_NONE;
+    return type_int(true, Type_bits(u) * 2);
+}
+
+/**
+ * @brief Make a checked numeric node a value of another numeric type
+ */
+static void typecheck_convert(TypeChecker *checker, Node *node, TypeId type) {
+    if (node->vtype == type || !Type_isnumber(node->vtype) || !Type_isnumber(type)) return;
+
+    if (typecheck_isliteral(node)) typecheck_literal(checker, node, type);
+    else if (node->type == NodeType_FLOAT && Type_isfloat(type)) node->vtype = type;
+    else Node_convert(node, type);
+}
+
+/**
+ * @brief Check that a checked node can be stored as a type, converting
+ *        it if it needs to
+ *
+ * @param checker Type checker
+ * @param node Checked node
+ * @param type Type it is stored as
+ */
+static void typecheck_assign(TypeChecker *checker, Node *node, TypeId type) {
+    TypeId from = node->vtype;
+
+    if (from == type || type == Type_NONE || type == Type_DYNAMIC ||
+        from == Type_NONE || from == Type_DYNAMIC)
+        return;
+
+    if (Type_isnumber(type) && (Type_isint(from) || (Type_isfloat(from) && Type_isfloat(type)))) {
+        typecheck_convert(checker, node, type);
+        return;
+    }
+
+    // Elements of empty arrays and of arrays of dynamic values are unknown
+    if (TYPE_DIMS(from) > 0 && TYPE_DIMS(from) == TYPE_DIMS(type) && TYPE_BASE(from) == Type_DYNAMIC)
+        return;
+
+    typecheck_mismatch(checker, node->offset, U"Can't convert ", from, U" to ", type, NULL);
+}
+
+static TypeId typecheck_array(TypeChecker *checker, Node *node, TypeId expected) {
+    NodeArray *elements = node->array_nodearray;
+    TypeId element = Type_NONE;
+    size_t i;
+
+    if (TYPE_DIMS(expected) > 0) {
+        element = TYPE_ELEMENT(expected);
+
+        for (i = 0; i < elements->used; i++) {
+            typecheck_expr(checker, &(elements->array[i]), element);
+            typecheck_assign(checker, &(elements->array[i]), element);
+        }
+
+        return expected;
+    }
+
+    for (i = 0; i < elements->used; i++) {
+        Node *item = &(elements->array[i]);
+        TypeId type = typecheck_expr(checker, item, Type_NONE);
+
+        if (element == Type_NONE || element == Type_DYNAMIC || type == Type_DYNAMIC) {
+            if (element != Type_DYNAMIC) element = type;
+        }
+        else if (Type_isnumber(element) && Type_isnumber(type) && typecheck_common(element, type) != Type_NONE) {
+            element = typecheck_common(element, type);
+        }
+        else if (element != type) {
+            typecheck_mismatch(checker, item->offset, U"Mismatched types ", element, U" and ", type, U" in array");
+            element = Type_DYNAMIC;
+        }
+    }
+
+    if (element == Type_NONE) element = Type_DYNAMIC;
+
+    if (Type_isnumber(element)) {
+        for (i = 0; i < elements->used; i++) typecheck_convert(checker, &(elements->array[i]), element);
+    }
+
+    return TYPE_DIMS(element) < 0xff ? TYPE_ARRAY(element) : Type_DYNAMIC;
+}
+
+static TypeId typecheck_binop(TypeChecker *checker, Node *node, TypeId expected) {
+    OpType op = node->bin_optype;
+    bool arithmetic = op == OpType_ADD || op == OpType_SUB || op == OpType_MUL ||
+                      op == OpType_DIV || op == OpType_MOD || op == OpType_POW;
+    Node *left = node->bin_left;
+    Node *right = node->bin_right;
+    TypeId l, r;
+
+    if (op == OpType_IN) {
+        r = typecheck_expr(checker, right, Type_NONE);
+
+        if (TYPE_DIMS(r) > 0) {
+            typecheck_expr(checker, left, TYPE_ELEMENT(r));
+            typecheck_assign(checker, left, TYPE_ELEMENT(r));
+        }
+        else {
+            l = typecheck_expr(checker, left, r == Type_STRING ? Type_STRING : Type_NONE);
+
+            if (r == Type_STRING && l != Type_STRING && l != Type_DYNAMIC)
+                typecheck_mismatch(checker, node->offset, U"Mismatched types ", l, U" and ", r, U" for in");
+            else if (r != Type_STRING && r != Type_DYNAMIC)
+                typecheck_mismatch(checker, node->offset, U"Can't look for a value in ", r, NULL, Type_NONE, NULL);
+        }
+
+        return Type_BOOL;
+    }
+
+    // Literals take the type of the operand they meet, the type the
+    // expression is used as only reaches them if there is no such operand
+    TypeId context = (arithmetic && Type_isnumber(expected)) ? expected : Type_NONE;
+
+    if (typecheck_isconstant(left) && !typecheck_isconstant(right)) {
+        r = typecheck_expr(checker, right, context);
+        l = typecheck_expr(checker, left, Type_isnumber(r) ? r : context);
+    }
+    else {
+        l = typecheck_expr(checker, left, context);
+        r = typecheck_expr(checker, right,
+                           (typecheck_isconstant(right) && !typecheck_isconstant(left) && Type_isnumber(l)) ? l : context);
+    }
+
+    bool comparison = op == OpType_EQ || op == OpType_NEQ || op == OpType_LT ||
+                      op == OpType_LE || op == OpType_GT || op == OpType_GE;
+    bool logical = op == OpType_AND || op == OpType_OR || op == OpType_XOR;
+
+    if (l == Type_DYNAMIC || r == Type_DYNAMIC) {
+        if (comparison) return Type_BOOL;
+        if (logical && (l == Type_BOOL || r == Type_BOOL)) return Type_BOOL;
+        if (op == OpType_RANGE) return TYPE_ARRAY(Type_isint(l) ? l : Type_isint(r) ? r : Type_DYNAMIC);
+        return Type_DYNAMIC;
+    }
+
+    bool ints = Type_isint(l) && Type_isint(r);
+    bool numbers = Type_isnumber(l) && Type_isnumber(r);
+
+    TypeId common = ((arithmetic || comparison || op == OpType_RANGE || logical) &&
+                     ((op == OpType_RANGE || logical) ? ints : numbers)) ? typecheck_common(l, r) : Type_NONE;
+
+    if (common != Type_NONE) {
+        typecheck_convert(checker, left, common);
+        typecheck_convert(checker, right, common);
+
+        if (comparison) return Type_BOOL;
+        if (op == OpType_RANGE) return TYPE_ARRAY(common);
+        return common;
+    }
+
+    if (logical && l == Type_BOOL && r == Type_BOOL) return Type_BOOL;
+    if ((op == OpType_EQ || op == OpType_NEQ) && l == r) return Type_BOOL;
+    if (op == OpType_ADD && l == Type_STRING && r == Type_STRING) return Type_STRING;
+
+    StringBuilder *after = StringBuilder_new(8);
+    StringBuilder_append(after, U" for ");
+    StringBuilder_append(after, Node_repr_op(op));
+    u32char *suffix = StringBuilder_finish(after);
+
+    typecheck_mismatch(checker, node->offset, U"Mismatched types ", l, U" and ", r, suffix);
+    dust_free(suffix);
+
+    return comparison ? Type_BOOL : Type_DYNAMIC;
+}
+
+static TypeId typecheck_unaryop(TypeChecker *checker, Node *node, TypeId expected) {
+    if (typecheck_isliteral(node))
+        return typecheck_literal(checker, node, Type_isnumber(expected) ? expected : Type_NONE);
+
+    if (node->unary_optype == OpType_NOT) {
+        TypeId type = typecheck_expr(checker, node->unary_right, Type_BOOL);
+
+        if (type != Type_BOOL && type != Type_DYNAMIC)
+            typecheck_mismatch(checker, node->offset, U"Can't use not on ", type, NULL, Type_NONE, NULL);
+        return Type_BOOL;
+    }
+
+    TypeId type = typecheck_expr(checker, node->unary_right, Type_isnumber(expected) ? expected : Type_NONE);
+
+    if (!Type_isnumber(type) && type != Type_DYNAMIC) {
+        typecheck_mismatch(checker, node->offset, U"Can't negate ", type, NULL, Type_NONE, NULL);
+        return Type_DYNAMIC;
+    }
+
+    return type;
+}
+
+/**
+ * @brief Check the operands of a member, members themselves are dynamic
+ */
+static void typecheck_child(TypeChecker *checker, Node *child) {
+    switch (child->type) {
+        case NodeType_CALL:
+            if (child->call_base->type != NodeType_FUNCBASE) typecheck_child(checker, child->call_base);
+
+            if (child->call_args != NULL) {
+                for (size_t i = 0; i < child->call_args->used; i++)
+                    typecheck_expr(checker, &(child->call_args->array[i]), Type_NONE);
+            }
+            break;
+
+        case NodeType_CHILD:
+            typecheck_child(checker, child->chld_parent);
+            typecheck_child(checker, child->chld_child);
+            break;
+
+        case NodeType_SUBSCRIPT: {
+            TypeId index = typecheck_expr(checker, child->subs_expr, Type_NONE);
+
+            typecheck_child(checker, child->subs_node);
+            if (!Type_isint(index) && index != Type_DYNAMIC)
+                typecheck_mismatch(checker, child->subs_expr->offset, U"Index must be an integer, not ", index,
+                                   NULL, Type_NONE, NULL);
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    child->vtype = Type_DYNAMIC;
+}
+
+/**
+ * @brief Check an expression and give its nodes their types
+ *
+ * @param checker Type checker
+ * @param node Expression
+ * @param expected Type the expression is used as (Type_NONE if unknown),
+ *                 only literals follow it
+ * @return Type of the expression
+ */
+TypeId typecheck_expr(TypeChecker *checker, Node *node, TypeId expected) {
+    TypeId type = Type_DYNAMIC;
+
+    if (node == NULL) return Type_NONE;
+
+    switch (node->type) {
+        case NodeType_INTEGER:
+            return typecheck_literal(checker, node, expected);
+
+        case NodeType_FLOAT:
+            type = (expected == Type_FLOAT32) ? Type_FLOAT32 : Type_FLOAT64;
+            break;
+
+        case NodeType_STRING:
+            type = Type_STRING;
+            break;
+
+        case NodeType_VAR:
+            if (u32isequal(node->variable, U"true") || u32isequal(node->variable, U"false"))
+                type = Type_BOOL;
+            else
+                type = typecheck_lookup(checker, node->var_depth, node->var_slot);
+            break;
+
+        case NodeType_ARRAY:
+            type = typecheck_array(checker, node, expected);
+            break;
+
+        case NodeType_BINOP:
+            type = typecheck_binop(checker, node, expected);
+            break;
+
+        case NodeType_UNARYOP:
+        case NodeType_RUNARYOP:
+            type = typecheck_unaryop(checker, node, expected);
+            break;
+
+        case NodeType_CHILD:
+            typecheck_expr(checker, node->chld_parent, Type_NONE);
+            typecheck_child(checker, node->chld_child);
+            break;
+
+        case NodeType_SUBSCRIPT: {
+            TypeId base = typecheck_expr(checker, node->subs_node, Type_NONE);
+            TypeId index = typecheck_expr(checker, node->subs_expr, Type_NONE);
+
+            if (!Type_isint(index) && index != Type_DYNAMIC)
+                typecheck_mismatch(checker, node->subs_expr->offset, U"Index must be an integer, not ", index,
+                                   NULL, Type_NONE, NULL);
+
+            if (TYPE_DIMS(base) > 0) type = TYPE_ELEMENT(base);
+            else if (base == Type_STRING) type = Type_STRING;
+            else if (base != Type_DYNAMIC)
+                typecheck_mismatch(checker, node->offset, U"Can't index ", base, NULL, Type_NONE, NULL);
+            break;
+        }
+
+        case NodeType_CALL:
+            if (node->call_base->type != NodeType_FUNCBASE) typecheck_expr(checker, node->call_base, Type_NONE);
+
+            if (node->call_args != NULL) {
+                for (size_t i = 0; i < node->call_args->used; i++)
+                    typecheck_expr(checker, &(node->call_args->array[i]), Type_NONE);
+            }
+            break;
+
+        // Already checked, e.g. a node checked again as a literal
+        case NodeType_CONVERT:
+            type = node->vtype;
+            break;
+
+        default:
+            break;
+    }
+
+    node->vtype = type;
+    return type;
+}
+
+/**
+ * @brief Check a condition, which must be a bool
+ */
+static void typecheck_condition(TypeChecker *checker, Node *node) {
+    TypeId type = typecheck_expr(checker, node, Type_BOOL);
+
+    if (type != Type_BOOL && type != Type_DYNAMIC)
+        typecheck_mismatch(checker, node->offset, U"Condition must be bool, not ", type, NULL, Type_NONE, NULL);
+}
+
+static void typecheck_statements(TypeChecker *checker, Node *body) {
+    NodeArray *statements = Node_body(body);
+
+    for (size_t i = 0; i < statements->used; i++)
+        typecheck_stmt(checker, &(statements->array[i]));
+}
+
+static void typecheck_body(TypeChecker *checker, Node *body) {
+    typecheck_push(checker, body->body_slots);
+    typecheck_statements(checker, body);
+    typecheck_pop(checker);
+}
+
+/**
+ * @brief Check an enumeration, its members are int64
+ */
+static void typecheck_enum(TypeChecker *checker, Node *body) {
+    NodeArray *members = Node_body(body);
+
+    typecheck_push(checker, body->body_slots);
+
+    for (size_t i = 0; i < members->used; i++) {
+        Node *member = &(members->array[i]);
+
+        if (member->type == NodeType_ASSIGN) {
+            typecheck_expr(checker, member->assign_expr, Type_INT64);
+            typecheck_assign(checker, member->assign_expr, Type_INT64);
+            typecheck_declare(checker, member->assign_slot, Type_INT64);
+            member->vtype = Type_INT64;
+        }
+        else if (member->type == NodeType_VAR) {
+            typecheck_declare(checker, member->var_slot, Type_INT64);
+            member->vtype = Type_INT64;
+        }
+    }
+
+    typecheck_pop(checker);
+}
+
+static void typecheck_assignment(TypeChecker *checker, Node *node) {
+    TypeId target = typecheck_lookup(checker, node->assign_depth, node->assign_slot);
+    TypeId type = typecheck_expr(checker, node->assign_expr, target);
+
+    node->vtype = target;
+
+    if (u32isequal(node->assign_op, U"=") || Type_isnumber(target)) {
+        typecheck_assign(checker, node->assign_expr, target);
+        return;
+    }
+
+    // Only numbers and strings (with +=) have operator assignments
+    if (target == Type_DYNAMIC || type == Type_DYNAMIC) return;
+    if (target == Type_STRING && type == Type_STRING && u32isequal(node->assign_op, U"+=")) return;
+
+    StringBuilder *after = StringBuilder_new(8);
+    StringBuilder_append(after, U" for ");
+    StringBuilder_append(after, node->assign_op);
+    u32char *suffix = StringBuilder_finish(after);
+
+    typecheck_mismatch(checker, node->offset, U"Mismatched types ", target, U" and ", type, suffix);
+    dust_free(suffix);
+}
+
+void typecheck_stmt(TypeChecker *checker, Node *node) {
+    switch (node->type) {
+        case NodeType_DECL: {
+            TypeId type = Type_parse(node->decl_type);
+            typecheck_expr(checker, node->decl_expr, type);
+            typecheck_assign(checker, node->decl_expr, type);
+            typecheck_declare(checker, node->decl_slot, type);
+            node->vtype = type;
+            break;
+        }
+
+        case NodeType_DECLN:
+            node->vtype = Type_parse(node->decln_type);
+            typecheck_declare(checker, node->decln_slot, node->vtype);
+            break;
+
+        case NodeType_ASSIGN:
+            typecheck_assignment(checker, node);
+            break;
+
+        case NodeType_IMPORT:
+        case NodeType_IMPORTF:
+            typecheck_declare(checker, node->import_slot, Type_DYNAMIC);
+            break;
+
+        case NodeType_ENUM:
+            typecheck_declare(checker, node->enum_slot, Type_DYNAMIC);
+            typecheck_enum(checker, node->enum_body);
+            break;
+
+        case NodeType_BODY:
+            typecheck_body(checker, node);
+            break;
+
+        case NodeType_IF:
+            typecheck_condition(checker, node->if_expr);
+            typecheck_body(checker, node->if_body);
+            break;
+
+        case NodeType_ELIF:
+            typecheck_condition(checker, node->elif_expr);
+            typecheck_body(checker, node->elif_body);
+            break;
+
+        case NodeType_ELSE:
+            typecheck_body(checker, node->else_body);
+            break;
+
+        case NodeType_WHILE:
+            typecheck_condition(checker, node->while_expr);
+            typecheck_body(checker, node->while_body);
+            break;
+
+        case NodeType_REPEAT: {
+            TypeId type = typecheck_expr(checker, node->repeat_expr, Type_NONE);
+
+            if (!Type_isint(type) && type != Type_DYNAMIC)
+                typecheck_mismatch(checker, node->repeat_expr->offset, U"Repeat count must be an integer, not ", type,
+                                   NULL, Type_NONE, NULL);
+            typecheck_body(checker, node->repeat_body);
+            break;
+        }
+
+        case NodeType_FOR: {
+            TypeId type = typecheck_expr(checker, node->for_expr, Type_NONE);
+            TypeId element = Type_DYNAMIC;
+
+            if (TYPE_DIMS(type) > 0) element = TYPE_ELEMENT(type);
+            else if (type == Type_STRING) element = Type_STRING;
+            else if (type != Type_DYNAMIC)
+                typecheck_mismatch(checker, node->for_expr->offset, U"Can't iterate over ", type, NULL, Type_NONE, NULL);
+
+            typecheck_push(checker, node->for_body->body_slots);
+            typecheck_declare(checker, node->for_var->var_slot, element);
+            node->for_var->vtype = element;
+            typecheck_statements(checker, node->for_body);
+            typecheck_pop(checker);
+            break;
+        }
+
+        default:
+            typecheck_expr(checker, node, Type_NONE);
+            break;
+    }
+}
+
+/**
+ * @brief Type check a body that was resolved with resolve()
+ *
+ * Errors of the previous run are freed, the ones of this run stay in
+ * checker->errors until the next run or TypeChecker_free.
+ *
+ * @param checker Type checker
+ * @param body Body node returned by the parser
+ * @return true if there were no mismatches
+ */
+bool typecheck(TypeChecker *checker, Node *body) {
+    typecheck_clear_errors(checker);
+    checker->slot_count = 0;
+    checker->frame_count = 0;
+
+    typecheck_body(checker, body);
+
+    return checker->error_count == 0;
+}
@@ -58,6 +58,15 @@
 #include <string.h>
 #include <math.h>
 #include "dust/ustring.h"
+#include "dust/platform.h"
+#include "dust/error.h"
+
+#if defined(SIMD_X86)
+#include <immintrin.h>
+#endif
+#include "dust/trace.h"
+#include "dust/allocator.h"
+#include "dust/alloc.h"
 
 
 #define ENCODING_ASCII_STRICT false //replace overflowed characters with TMPCHR?
@@ -207,7 +216,7 @@ size_t u32len(u32char *str) {
  */
 char *u8push(char *str, char chr) {
     size_t len = strlen(str);
-    char *newstr = (char *)realloc(str, sizeof(char)*len+sizeof(char)*2);
+    char *newstr = (char *)dust_realloc(str, sizeof(char)*len+sizeof(char)*2);
     newstr[len] = chr;
     newstr[len+1] = '\0';
     return newstr;
@@ -222,7 +231,7 @@ char *u8push(char *str, char chr) {
  */
 u32char *u32push(u32char *str, u32char chr) {
     size_t len = u32len(str);
-    u32char *newstr = (u32char *)realloc(str, sizeof(u32char)*len+sizeof(u32char)*2);
+    u32char *newstr = (u32char *)dust_realloc(str, sizeof(u32char)*len+sizeof(u32char)*2);
     newstr[len] = chr;
     newstr[len+1] = '\0';
     return newstr;
@@ -230,7 +239,7 @@ u32char *u32push(u32char *str, u32char chr) {
 
 u32char *u32pushl(u32char *str, u32char chr) {
     size_t len = u32len(str);
-    u32char *newstr = (u32char *)malloc(sizeof(u32char)*len+sizeof(u32char)*2);
+    u32char *newstr = (u32char *)dust_malloc(sizeof(u32char)*len+sizeof(u32char)*2);
 
     u32copy(newstr, str);
     newstr[len] = chr;
@@ -251,40 +260,34 @@ char *utf32_to_utf8(u32char *str) {
     size_t i = u32len(str);
     size_t j = 0;
 
-    char *u8str = (char *)malloc(sizeof(char));
-    u8str[0] = '\0';
+    // every character takes 4 bytes at most
+    char *u8str = (char *)dust_malloc(sizeof(char) * (i * 4 + 1));
 
     for (; i; i--, tstr++) {
-        // outside of UTF-32 code point
-        if (*tstr > 0x10FFFF) {
-            printf("outside of utf32 code point!\n");
-        };
+        // Outside of UTF-32 code points, encoded as the replacement character
+        u32char chr = (*tstr > 0x10FFFF) ? 0xFFFD : *tstr;
 
-        if (*tstr < 0x7F) {
-            u8str = u8push(u8str, *tstr);
-            j++;
+        if (chr < 0x7F) {
+            u8str[j++] = chr;
         }
-        else if (*tstr < 0x7FF) {
-            u8str = u8push(u8str, 0xC0 | *tstr >> 6);
-            u8str = u8push(u8str, 0x80 | *tstr & 0x3f);
-            j += 2;
+        else if (chr < 0x7FF) {
+            u8str[j++] = 0xC0 | chr >> 6;
+            u8str[j++] = 0x80 | chr & 0x3f;
         }
-        else if (*tstr < 0xFFFF) {
-            u8str = u8push(u8str, 0xE0 | *tstr >> 12);
-            u8str = u8push(u8str, 0x80 | *tstr >> 6 & 0x3f);
-            u8str = u8push(u8str, 0x80 | *tstr & 0x3f);
-            j += 3;
+        else if (chr < 0xFFFF) {
+            u8str[j++] = 0xE0 | chr >> 12;
+            u8str[j++] = 0x80 | chr >> 6 & 0x3f;
+            u8str[j++] = 0x80 | chr & 0x3f;
         }
         else {
-            u8str = u8push(u8str, 0xF0 | *tstr >> 18);
-            u8str = u8push(u8str, 0x80 | *tstr >> 12 & 0x3f);
-            u8str = u8push(u8str, 0x80 | *tstr >> 6 & 0x3f);
-            u8str = u8push(u8str, 0x80 | *tstr & 0x3f);
-            j += 4;
+            u8str[j++] = 0xF0 | chr >> 18;
+            u8str[j++] = 0x80 | chr >> 12 & 0x3f;
+            u8str[j++] = 0x80 | chr >> 6 & 0x3f;
+            u8str[j++] = 0x80 | chr & 0x3f;
         }
     }
 
-    u8str[j+1] = U'\0';
+    u8str[j] = '\0';
     return u8str;
 }
 
@@ -300,30 +303,127 @@ char *utf32_to_ascii(u32char *str) {
     size_t i = u32len(str);
     size_t j = 0;
 
-    char *u8str = (char *)malloc(sizeof(char));
-    u8str[0] = '\0';
+    char *u8str = (char *)dust_malloc(sizeof(char) * (i * 2 + 1));
 
     for (; i; i--, tstr++) {
         if (*tstr < 0x7F) {
-            u8str = u8push(u8str, *tstr);
-            j++;
+            u8str[j++] = *tstr;
         }
         else if (*tstr < 0xFF) {
-            u8str = u8push(u8str, 0xC0 | *tstr >> 6);
-            u8str = u8push(u8str, 0x80 | *tstr & 0x3f);
-            j += 2;
+            u8str[j++] = 0xC0 | *tstr >> 6;
+            u8str[j++] = 0x80 | *tstr & 0x3f;
         }
         else {
             #if !ENCODING_ASCII_STRICT
-            u8str = u8push(u8str, ENCODING_ASCII_TMPCHR);
-            j++;
+            u8str[j++] = ENCODING_ASCII_TMPCHR;
             #endif
         }
     }
 
+    u8str[j] = '\0';
     return u8str;
 }
 
+/**
+ * @brief Widen the leading ASCII bytes of a string into characters
+ * 
+ * @param str String
+ * @param n Number of bytes to look at
+ * @param out Characters
+ * @return Number of bytes widened, stops at the first non-ASCII byte
+ */
+size_t utf8_ascii_scalar(char *str, size_t n, u32char *out) {
+    size_t i = 0;
+
+    while (i < n && (unsigned char)str[i] < 128) {
+        out[i] = str[i];
+        i++;
+    }
+
+    return i;
+}
+
+#if defined(SIMD_X86)
+
+/**
+ * @brief Widen the leading ASCII bytes of a string, 16 bytes at a time
+ * 
+ * @param str String
+ * @param n Number of bytes to look at
+ * @param out Characters
+ * @return Number of bytes widened, stops at the first non-ASCII byte
+ */
+SIMD_TARGET("sse2") size_t utf8_ascii_sse2(char *str, size_t n, u32char *out) {
+    __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(str + i));
+        if (_mm_movemask_epi8(bytes) != 0) break;
+
+        __m128i low = _mm_unpacklo_epi8(bytes, zero);
+        __m128i high = _mm_unpackhi_epi8(bytes, zero);
+
+        _mm_storeu_si128((__m128i *)(out + i), _mm_unpacklo_epi16(low, zero));
+        _mm_storeu_si128((__m128i *)(out + i + 4), _mm_unpackhi_epi16(low, zero));
+        _mm_storeu_si128((__m128i *)(out + i + 8), _mm_unpacklo_epi16(high, zero));
+        _mm_storeu_si128((__m128i *)(out + i + 12), _mm_unpackhi_epi16(high, zero));
+    }
+
+    return i + utf8_ascii_scalar(str + i, n - i, out + i);
+}
+
+/**
+ * @brief Widen the leading ASCII bytes of a string, 32 bytes at a time
+ * 
+ * @param str String
+ * @param n Number of bytes to look at
+ * @param out Characters
+ * @return Number of bytes widened, stops at the first non-ASCII byte
+ */
+SIMD_TARGET("avx2") size_t utf8_ascii_avx2(char *str, size_t n, u32char *out) {
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *)(str + i));
+        if (_mm256_movemask_epi8(bytes) != 0) break;
+
+        for (size_t j = 0; j < 32; j += 8) {
+            __m128i part = _mm_loadl_epi64((const __m128i *)(str + i + j));
+            _mm256_storeu_si256((__m256i *)(out + i + j), _mm256_cvtepu8_epi32(part));
+        }
+    }
+
+    return i + utf8_ascii_scalar(str + i, n - i, out + i);
+}
+
+/**
+ * @brief Widen the leading ASCII bytes of a string, 64 bytes at a time
+ * 
+ * @param str String
+ * @param n Number of bytes to look at
+ * @param out Characters
+ * @return Number of bytes widened, stops at the first non-ASCII byte
+ */
+SIMD_TARGET("avx512f") size_t utf8_ascii_avx512(char *str, size_t n, u32char *out) {
+    size_t i = 0;
+
+    for (; i + 64 <= n; i += 64) {
+        __m256i low = _mm256_loadu_si256((const __m256i *)(str + i));
+        __m256i high = _mm256_loadu_si256((const __m256i *)(str + i + 32));
+        if (_mm256_movemask_epi8(_mm256_or_si256(low, high)) != 0) break;
+
+        for (size_t j = 0; j < 64; j += 16) {
+            __m128i part = _mm_loadu_si128((const __m128i *)(str + i + j));
+            _mm512_storeu_si512((void *)(out + i + j), _mm512_cvtepu8_epi32(part));
+        }
+    }
+
+    return i + utf8_ascii_scalar(str + i, n - i, out + i);
+}
+
+#endif
+
 /**
  * @brief Encode multibyte UTF-8 string to 4byte UTF-32 string
  * 
@@ -331,17 +431,26 @@ char *utf32_to_ascii(u32char *str) {
  * @return 4byte UTF-32 encoded string
  */
 u32char *utf8_to_utf32(char *str) {
-    u32char *u32str = (u32char *)malloc(sizeof(u32char));
-    u32str[0] = U'\0';
     size_t len = strlen(str);
+    size_t j = 0;
+
+    // never more characters than bytes
+    u32char *u32str = (u32char *)dust_malloc(sizeof(u32char) * (len + 1));
+
+    dispatch_init();
+    size_t (*ascii)(char *, size_t, u32char *) = atomic_load_explicit(&DISPATCH.utf8_ascii, memory_order_relaxed);
+    char *end = str + len;
 
     char *cursor = str;
-    while (*cursor != str[len]) {
+    while (*cursor != '\0') {
         u32char chr = 0;
 
-        // pass ASCII characters
+        // pass runs of ASCII characters
         if ((unsigned char)(*cursor) < 128) {
-            chr = *(cursor++);
+            size_t run = ascii(cursor, end - cursor, u32str + j);
+            cursor += run;
+            j += run;
+            continue;
         }
         else {
             char continuation = 0;
@@ -377,21 +486,23 @@ u32char *utf8_to_utf32(char *str) {
             }
         }
 
-        u32str = u32push(u32str, chr);
+        // stray continuation bytes decode to nothing
+        if (chr != 0) u32str[j++] = chr;
     }
 
+    u32str[j] = U'\0';
     return u32str;
 }
 
 u32char *ascii_to_utf32(char *str) {
-    u32char *u32str = (u32char *)malloc(sizeof(u32char));
-    u32str[0] = U'\0';
     size_t len = strlen(str);
+    u32char *u32str = (u32char *)dust_malloc(sizeof(u32char) * (len + 1));
 
     for (size_t i = 0; i < len; i++) {
-        u32str = u32push(u32str, str[i]);
+        u32str[i] = str[i];
     }
 
+    u32str[len] = U'\0';
     return u32str;
 }
 
@@ -430,6 +541,18 @@ bool u32isequal(u32char *str1, u32char *str2) {
     return true;
 }
 
+// u32find(str, substr) == 0 without scanning the rest of the string,
+// an empty substring is never found
+static bool u32prefix(u32char *str, u32char *substr) {
+    if (*substr == U'\0') return false;
+
+    while (*substr != U'\0') {
+        if (*str++ != *substr++) return false;
+    }
+
+    return true;
+}
+
 /**
  * @brief Checks if string starts with substring
  * 
@@ -438,7 +561,7 @@ bool u32isequal(u32char *str1, u32char *str2) {
  * @return (bool) result
  */
 bool u32startswith(u32char *str, u32char *substr) {
-    return (u32find(str, substr) == 0);
+    return u32prefix(str, substr);
 }
 
 /**
@@ -670,9 +793,7 @@ size_t u32countchr(u32char *str, u32char chr) {
  * @return New string
  */
 u32char *u32join(u32char *str1, u32char *str2) {
-    u32char *result = (u32char *)malloc(  sizeof(u32char)*u32len(str1)
-                                        + sizeof(u32char)*u32len(str2)
-                                        + 1);
+    u32char *result = (u32char *)dust_malloc(sizeof(u32char) * (u32len(str1) + u32len(str2) + 1));
     u32copy(result, str1);
     u32concat(result, str2);
     
@@ -695,19 +816,19 @@ u32char *u32replace(u32char *str, u32char *oldstr, u32char *newstr) {
     int oldlen = u32len(oldstr);
   
     for (i = 0; str[i] != U'\0'; i++) {
-        if (u32find(str+i, oldstr) == 0) {
+        if (u32prefix(str+i, oldstr)) {
             cnt++;
             i += oldlen - 1;
         }
     }
   
-    result = (u32char *)malloc((i + cnt * (newlen - oldlen) + 1) * 
+    result = (u32char *)dust_malloc((i + cnt * (newlen - oldlen) + 1) * 
                                 sizeof(u32char));
 
     i = 0;
     u32char *ptr = result;
     while (*str != U'\0') {
-        if (u32find(str, oldstr) == 0) {
+        if (u32prefix(str, oldstr)) {
             u32copy(ptr+i, newstr);
             i += newlen;
             str += oldlen;
@@ -749,21 +870,15 @@ u32char *u32strip(u32char *str) {
  * @return Sliced portion of the string
  */
 u32char *u32slice(u32char *str, size_t start, size_t end) {
-    u32char *result = U"";
-
-    while (start <= end) {
-        u32char sbuf[2];
-        sbuf[0] = str[start];
-        sbuf[1] = U'\0';
-        result = u32join(result, sbuf);
+    size_t len = start <= end ? end - start + 1 : 0;
+    u32char *result = (u32char *)dust_malloc(sizeof(u32char) * (len + 1));
 
-        start++;
-    }
+    memcpy(result, str + start, sizeof(u32char) * len);
+    result[len] = U'\0';
 
     return result;
 }
 
-//TODO: find a way better then u32join
 /**
  * @brief Fill string with some other string
  * 
@@ -773,29 +888,39 @@ u32char *u32slice(u32char *str, size_t start, size_t end) {
  * @return New filled string
  */
 u32char *u32fill(u32char *dest, u32char *str, size_t amount) {
+    if (amount == 0) return dest;
+
+    size_t destlen = u32len(dest);
+    size_t len = u32len(str);
+    u32char *result = (u32char *)dust_malloc(sizeof(u32char) * (destlen + len * amount + 1));
+
+    memcpy(result, dest, sizeof(u32char) * destlen);
     for (size_t i = 0; i < amount; i++) {
-        dest = u32join(dest, str);
+        memcpy(result + destlen + len * i, str, sizeof(u32char) * len);
     }
+    result[destlen + len * amount] = U'\0';
 
-    return dest;
+    return result;
 }
 
 //TODO: better conversion functions like in STD strto... family
 /**
- * @brief Convert string into decimal integer
+ * @brief Convert string into integer
  * 
  * @param str String to convert
- * @param base Number base
+ * @param base Number base (digits after 9 are a-z or A-Z)
  * @return Converted integer
  */
-int u32toint(u32char *str, int base) {
-    size_t len = u32len(str);
-
-    int result = 0;
+long u32toint(u32char *str, int base) {
+    long result = 0;
     int i = 0;
     while (str[i] != U'\0') {
-        int digit = str[i] - 48;
-        result += digit * pow(base, len-i-1);
+        int digit;
+        if (str[i] >= U'a') digit = str[i] - U'a' + 10;
+        else if (str[i] >= U'A') digit = str[i] - U'A' + 10;
+        else digit = str[i] - U'0';
+
+        result = result * base + digit;
         i++;
     }
 
@@ -822,11 +947,13 @@ double u32tofloat(u32char *str) {
  */
 char *u8readfile(char *filepath) {
     FILE *f = fopen(filepath, "r");
+    if (f == NULL) raise_internal(u32join(U"Couldn't read file: ", utf8_to_utf32(filepath)));
+
     fseek(f, 0, SEEK_END);
     long fsize = ftell(f);
     fseek(f, 0, SEEK_SET);
 
-    char *string = (char *)malloc(fsize + 1);
+    char *string = (char *)dust_malloc(fsize + 1);
     fread(string, 1, fsize, f);
     fclose(f);
 
@@ -842,5 +969,117 @@ char *u8readfile(char *filepath) {
  * @return 4byte UTF-32 encoded string
  */
 u32char *u32readfile(char *filepath) {
-    return utf8_to_utf32(u8readfile(filepath));
+    TRACE_SPAN(span);
+
+    TRACE_BEGIN(span, "read", TRACE_NOARG);
+    char *content = u8readfile(filepath);
+
+    TRACE_BEGIN(span, "decode", TRACE_NOARG);
+    u32char *result = utf8_to_utf32(content);
+    dust_free(content);
+
+    TRACE_END(span);
+    return result;
+}
+
+
+/**
+ * @brief Create a new string builder
+ * 
+ * @param def_size Initial capacity in characters
+ * @return String builder's pointer
+ */
+StringBuilder *StringBuilder_new(size_t def_size) {
+    StringBuilder *builder = (StringBuilder *)dust_malloc(sizeof(StringBuilder));
+
+    if (def_size < 16) def_size = 16;
+
+    builder->data = (u32char *)dust_malloc(sizeof(u32char) * def_size);
+    builder->data[0] = U'\0';
+    builder->length = 0;
+    builder->size = def_size;
+
+    return builder;
+}
+
+/**
+ * @brief Release all resources used by the string builder
+ * 
+ * @param builder String builder to free
+ */
+void StringBuilder_free(StringBuilder *builder) {
+    dust_free(builder->data);
+    dust_free(builder);
+}
+
+// Grow capacity geometrically so appending stays amortized O(1) per character
+static void StringBuilder_reserve(StringBuilder *builder, size_t extra) {
+    if (builder->length + extra + 1 <= builder->size) return;
+
+    while (builder->length + extra + 1 > builder->size) builder->size *= 2;
+    builder->data = (u32char *)dust_realloc(builder->data, sizeof(u32char) * builder->size);
+}
+
+/**
+ * @brief Append the first n characters of a string
+ * 
+ * @param builder String builder to append to
+ * @param str String to append
+ * @param n Number of characters to append
+ */
+void StringBuilder_appendn(StringBuilder *builder, u32char *str, size_t n) {
+    StringBuilder_reserve(builder, n);
+
+    memcpy(builder->data + builder->length, str, sizeof(u32char) * n);
+    builder->length += n;
+    builder->data[builder->length] = U'\0';
+}
+
+/**
+ * @brief Append a string
+ * 
+ * @param builder String builder to append to
+ * @param str String to append
+ */
+void StringBuilder_append(StringBuilder *builder, u32char *str) {
+    StringBuilder_appendn(builder, str, u32len(str));
+}
+
+/**
+ * @brief Append a character
+ * 
+ * @param builder String builder to append to
+ * @param chr Character to append
+ */
+void StringBuilder_push(StringBuilder *builder, u32char chr) {
+    StringBuilder_reserve(builder, 1);
+
+    builder->data[builder->length++] = chr;
+    builder->data[builder->length] = U'\0';
+}
+
+/**
+ * @brief Append a character repeatedly
+ * 
+ * @param builder String builder to append to
+ * @param chr Character to append
+ * @param amount Number of times to append
+ */
+void StringBuilder_fill(StringBuilder *builder, u32char chr, size_t amount) {
+    StringBuilder_reserve(builder, amount);
+
+    for (size_t i = 0; i < amount; i++) builder->data[builder->length++] = chr;
+    builder->data[builder->length] = U'\0';
+}
+
+/**
+ * @brief Free the string builder but keep the string built
+ * 
+ * @param builder String builder to finish
+ * @return Built string
+ */
+u32char *StringBuilder_finish(StringBuilder *builder) {
+    u32char *result = builder->data;
+    dust_free(builder);
+    return result;
 }
\ No newline at end of file
@@ -0,0 +1,520 @@
+/*
+
+  This file is a part of the Dust Programming Language
+  project and distributed under the MIT license.
+
+  Copyright © Kadir Aksoy
+  https://github.com/kadir014/Dust
+
+
+  watch.c  -  Watch mode
+  -------------------------------------------------
+  `--watch` keeps checking or transpiling the .dust files
+  of a directory as they change. Changes are picked up
+  with inotify, and only the changed files and the files
+  importing them (directly or through other files) are
+  read, tokenized and parsed again, so a rebuild costs
+  as much as the change and not the whole project. A
+  file's imports are taken from the import nodes of its
+  last tree. Transpiled code is written next to each
+  source, with the .c extension.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "dust/platform.h"
+#include "dust/ustring.h"
+#include "dust/error.h"
+#include "dust/source.h"
+#include "dust/tokenizer.h"
+#include "dust/parser.h"
+#include "dust/check.h"
+#include "dust/transpiler.h"
+#include "dust/bench.h"
+#include "dust/watch.h"
+
+#if OS == OS_LINUX
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+#include "dust/allocator.h"
+#include "dust/alloc.h"
+
+
+static char *watch_strdup(char *string) {
+    char *copy = (char *)malloc(strlen(string) + 1);
+    strcpy(copy, string);
+    return copy;
+}
+
+static char *watch_join(char *directory, char *name) {
+    char *path = (char *)malloc(strlen(directory) + strlen(name) + 2);
+    sprintf(path, "%s/%s", directory, name);
+    return path;
+}
+
+static bool watch_is_source(char *path) {
+    size_t length = strlen(path);
+    return length > 5 && !strcmp(path + length - 5, ".dust");
+}
+
+static void WatchFile_free(WatchFile *file) {
+    for (size_t i = 0; i < file->import_count; i++) free(file->imports[i]);
+    free(file->imports);
+    free(file->module);
+    free(file->path);
+    free(file);
+}
+
+static WatchFile *WatchFile_new(char *path) {
+    WatchFile *file = (WatchFile *)malloc(sizeof(WatchFile));
+    char *name = strrchr(path, '/');
+    name = name != NULL ? name + 1 : path;
+
+    file->path = watch_strdup(path);
+    file->module = watch_strdup(name);
+    file->module[strlen(name) - 5] = '\0';
+    file->imports = NULL;
+    file->import_count = 0;
+    file->dirty = true;
+    file->failed = false;
+
+    return file;
+}
+
+static WatchFile *watch_find(Watcher *watcher, char *path, size_t *index) {
+    for (size_t i = 0; i < watcher->count; i++) {
+        if (!strcmp(watcher->files[i]->path, path)) {
+            if (index != NULL) *index = i;
+            return watcher->files[i];
+        }
+    }
+
+    return NULL;
+}
+
+static bool watch_imports(WatchFile *file, char *module) {
+    for (size_t i = 0; i < file->import_count; i++)
+        if (!strcmp(file->imports[i], module)) return true;
+
+    return false;
+}
+
+// Mark the files importing module, and the files importing those
+static void watch_mark_importers(Watcher *watcher, char *module) {
+    for (size_t i = 0; i < watcher->count; i++) {
+        WatchFile *file = watcher->files[i];
+
+        if (!file->dirty && watch_imports(file, module)) {
+            file->dirty = true;
+            watch_mark_importers(watcher, file->module);
+        }
+    }
+}
+
+// Replace the imports of the file with the import nodes of its tree
+static void watch_collect_imports(WatchFile *file, Node *root) {
+    for (size_t i = 0; i < file->import_count; i++) free(file->imports[i]);
+    free(file->imports);
+
+    file->imports = (char **)malloc(sizeof(char *) * (root->body->used + 1));
+    file->import_count = 0;
+
+    for (size_t i = 0; i < root->body->used; i++) {
+        Node *node = &root->body->array[i];
+
+        if (node->type == NodeType_IMPORT || node->type == NodeType_IMPORTF) {
+            char *module = utf32_to_utf8(node->import_module);
+            file->imports[file->import_count++] = watch_strdup(module);
+        }
+    }
+}
+
+// Write transpiled code next to the source, replacing the previous code at once
+static bool watch_write(WatchFile *file, Node *root) {
+    size_t length = strlen(file->path);
+    char *path = (char *)malloc(length);
+
+    memcpy(path, file->path, length - 5);
+    strcpy(path + length - 5, ".c");
+
+    Writer *writer = Writer_open(path);
+    bool written = writer != NULL;
+
+    if (written) {
+        transpile_write(root->body, writer);
+        written = Writer_close(writer);
+    }
+
+    if (!written) printf("Couldn't write file: %s\n", path);
+
+    free(path);
+    return written;
+}
+
+// Tokenize, check or parse and transpile the file, printing its diagnostic if it fails
+static bool WatchFile_build(Watcher *watcher, WatchFile *file) {
+    ErrorTrap *outer = ERROR_TRAP;
+    Source *current = CURRENT_SOURCE;
+    DustAllocator *previous = dust_allocator_use(&watcher->arena->allocator);
+    int lazy = PARSER_LAZY;
+    ErrorTrap trap;
+    char *error = NULL;
+    bool built = false;
+
+    FILE *f = fopen(file->path, "r");
+
+    if (f == NULL) {
+        printf("Couldn't read file: %s\n", file->path);
+        dust_allocator_use(previous);
+        return false;
+    }
+
+    fclose(f);
+
+    u32char *raw = u32readfile(file->path);
+    CURRENT_SOURCE = Source_new(utf8_to_utf32(file->path), raw, u32len(raw));
+    ERROR_TRAP = &trap;
+
+    if (setjmp(trap.jump) == 0) {
+        TokenArray *tokens = tokenize(raw);
+        CheckError check_error;
+
+        if (!watcher->transpiling && !check(tokens, &check_error)) {
+            error = report_text(ErrorType_Syntax, check_error.message, check_error.offset, !watcher->nocolor);
+        }
+        else {
+            // Checked files only need their imports, the check already went through the bodies
+            PARSER_LAZY = !watcher->transpiling;
+            Node *root = parse_body(tokens);
+
+            watch_collect_imports(file, root);
+            built = !watcher->transpiling || watch_write(file, root);
+        }
+    }
+
+    else {
+        parse_reset();
+        error = report_text(trap.type, trap.message, trap.offset, !watcher->nocolor);
+    }
+
+    ERROR_TRAP = outer;
+    PARSER_LAZY = lazy;
+
+    if (error != NULL) {
+        printf("%s", error);
+        fflush(stdout);
+    }
+
+    CURRENT_SOURCE = current;
+    dust_allocator_use(previous);
+    Arena_reset(watcher->arena);
+
+    return built;
+}
+
+/**
+ * @brief Create a new watcher with the source files of a directory,
+ *        every file is built on the first rebuild
+ *
+ * @param directory Directory to watch
+ * @param transpiling Files are transpiled, otherwise only checked
+ * @param nocolor Diagnostics have no ANSI colors
+ * @return Watcher's pointer
+ */
+Watcher *Watcher_new(char *directory, bool transpiling, bool nocolor) {
+    Watcher *watcher = (Watcher *)malloc(sizeof(Watcher));
+
+    watcher->directory = watch_strdup(directory);
+    watcher->transpiling = transpiling;
+    watcher->nocolor = nocolor;
+    watcher->size = 16;
+    watcher->count = 0;
+    watcher->files = (WatchFile **)malloc(sizeof(WatchFile *) * watcher->size);
+    watcher->arena = Arena_new(0);
+
+    Watcher_scan(watcher, watcher->directory);
+    return watcher;
+}
+
+/**
+ * @brief Free watcher
+ *
+ * @param watcher Watcher to free
+ */
+void Watcher_free(Watcher *watcher) {
+    for (size_t i = 0; i < watcher->count; i++) WatchFile_free(watcher->files[i]);
+
+    Arena_free(watcher->arena);
+    free(watcher->files);
+    free(watcher->directory);
+    free(watcher);
+}
+
+/**
+ * @brief Add the source files of a directory and its subdirectories
+ *
+ * @param watcher Watcher
+ * @param directory Directory to scan
+ */
+void Watcher_scan(Watcher *watcher, char *directory) {
+    DIR *dir = opendir(directory);
+    struct dirent *entry;
+    struct stat info;
+
+    if (dir == NULL) return;
+
+    while ((entry = readdir(dir)) != NULL) {
+        // Hidden directories are skipped with . and ..
+        if (entry->d_name[0] == '.') continue;
+
+        char *path = watch_join(directory, entry->d_name);
+
+        if (stat(path, &info) == 0 && S_ISDIR(info.st_mode)) Watcher_scan(watcher, path);
+        else if (watch_is_source(path)) Watcher_touch(watcher, path);
+
+        free(path);
+    }
+
+    closedir(dir);
+}
+
+/**
+ * @brief Tell the watcher a file was written, created or removed
+ *
+ * @param watcher Watcher
+ * @param path Path of the file
+ */
+void Watcher_touch(Watcher *watcher, char *path) {
+    struct stat info;
+    size_t index;
+    WatchFile *file = watch_find(watcher, path, &index);
+
+    if (!watch_is_source(path)) return;
+
+    if (stat(path, &info) != 0) {
+        if (file == NULL) return;
+
+        // Files importing a removed file are built again to report it
+        watcher->files[index] = watcher->files[--watcher->count];
+        watch_mark_importers(watcher, file->module);
+        WatchFile_free(file);
+        return;
+    }
+
+    if (file != NULL) {
+        file->dirty = true;
+        return;
+    }
+
+    if (watcher->count == watcher->size) {
+        watcher->size *= 2;
+        watcher->files = (WatchFile **)realloc(watcher->files, sizeof(WatchFile *) * watcher->size);
+    }
+
+    file = WatchFile_new(path);
+    watcher->files[watcher->count++] = file;
+}
+
+/**
+ * @brief Build the changed files and the files importing them
+ *
+ * @param watcher Watcher
+ * @param failed Set to the number of files that failed to build
+ * @return Number of files built
+ */
+size_t Watcher_rebuild(Watcher *watcher, size_t *failed) {
+    size_t built = 0;
+    *failed = 0;
+
+    for (size_t i = 0; i < watcher->count; i++)
+        if (watcher->files[i]->dirty) watch_mark_importers(watcher, watcher->files[i]->module);
+
+    for (size_t i = 0; i < watcher->count; i++) {
+        WatchFile *file = watcher->files[i];
+        if (!file->dirty) continue;
+
+        file->failed = !WatchFile_build(watcher, file);
+        file->dirty = false;
+
+        if (file->failed) (*failed)++;
+        built++;
+    }
+
+    return built;
+}
+
+#if OS == OS_LINUX
+
+/**
+ * @param inotify inotify instance
+ * @param descriptors Watch descriptor of each directory
+ * @param paths Path of each directory
+ * @param count Number of directories
+ */
+typedef struct {
+    int inotify;
+    int *descriptors;
+    char **paths;
+    size_t count;
+} WatchDirectories;
+
+static void watch_directory(WatchDirectories *directories, char *directory) {
+    DIR *dir;
+    struct dirent *entry;
+    struct stat info;
+
+    int descriptor = inotify_add_watch(directories->inotify, directory,
+                                       IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM |
+                                       IN_CREATE | IN_DELETE | IN_ONLYDIR);
+    if (descriptor < 0) return;
+
+    directories->descriptors = (int *)realloc(directories->descriptors, sizeof(int) * (directories->count + 1));
+    directories->paths = (char **)realloc(directories->paths, sizeof(char *) * (directories->count + 1));
+    directories->descriptors[directories->count] = descriptor;
+    directories->paths[directories->count] = watch_strdup(directory);
+    directories->count++;
+
+    dir = opendir(directory);
+    if (dir == NULL) return;
+
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+
+        char *path = watch_join(directory, entry->d_name);
+        if (stat(path, &info) == 0 && S_ISDIR(info.st_mode)) watch_directory(directories, path);
+        free(path);
+    }
+
+    closedir(dir);
+}
+
+static char *watch_directory_path(WatchDirectories *directories, int descriptor) {
+    for (size_t i = 0; i < directories->count; i++)
+        if (directories->descriptors[i] == descriptor) return directories->paths[i];
+
+    return NULL;
+}
+
+// Pass the events in buffer to the watcher
+static void watch_events(Watcher *watcher, WatchDirectories *directories, char *buffer, ssize_t length) {
+    for (char *at = buffer; at < buffer + length;) {
+        struct inotify_event *event = (struct inotify_event *)at;
+        char *directory = watch_directory_path(directories, event->wd);
+
+        at += sizeof(struct inotify_event) + event->len;
+        if (directory == NULL || event->len == 0 || event->name[0] == '.') continue;
+
+        char *path = watch_join(directory, event->name);
+
+        // Files of a new directory don't have events of their own
+        if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+            watch_directory(directories, path);
+            Watcher_scan(watcher, path);
+        }
+        else if (!(event->mask & IN_ISDIR)) Watcher_touch(watcher, path);
+
+        free(path);
+    }
+}
+
+static void watch_report(Watcher *watcher, size_t built, size_t failed, double start) {
+    double elapsed = (bench_clock() - start) * 1000.0;
+
+    if (failed > 0)
+        printf("Rebuilt %zu of %zu files in %.2f ms, %zu failed\n", built, watcher->count, elapsed, failed);
+    else
+        printf("Rebuilt %zu of %zu files in %.2f ms\n", built, watcher->count, elapsed);
+
+    fflush(stdout);
+}
+
+#endif
+
+/**
+ * @brief Build every source file of a directory, then rebuild the changed
+ *        ones as they change until the process is interrupted
+ *
+ * @param directory Directory to watch
+ * @param transpiling Files are transpiled, otherwise only checked
+ * @param nocolor Diagnostics have no ANSI colors
+ * @return Exit status
+ */
+int watch(char *directory, bool transpiling, bool nocolor) {
+    #if OS != OS_LINUX
+
+    printf("--watch is only supported on Linux\n");
+    return 1;
+
+    #else
+
+    WatchDirectories directories = {inotify_init1(IN_CLOEXEC), NULL, NULL, 0};
+    char buffer[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd pending;
+    size_t built, failed;
+    double start;
+
+    if (directories.inotify < 0) {
+        printf("Couldn't start watching: %s\n", strerror(errno));
+        return 1;
+    }
+
+    watch_directory(&directories, directory);
+
+    if (directories.count == 0) {
+        printf("Couldn't watch directory: %s\n", directory);
+        close(directories.inotify);
+        return 1;
+    }
+
+    Watcher *watcher = Watcher_new(directory, transpiling, nocolor);
+
+    start = bench_clock();
+    built = Watcher_rebuild(watcher, &failed);
+    watch_report(watcher, built, failed, start);
+
+    printf("Watching %s for changes\n", directory);
+    fflush(stdout);
+
+    pending.fd = directories.inotify;
+    pending.events = POLLIN;
+
+    while (true) {
+        ssize_t length = read(directories.inotify, buffer, sizeof(buffer));
+
+        if (length < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        watch_events(watcher, &directories, buffer, length);
+
+        // Saving a file is often several events, they are built together
+        while (poll(&pending, 1, WATCH_SETTLE) > 0) {
+            length = read(directories.inotify, buffer, sizeof(buffer));
+            if (length <= 0) break;
+            watch_events(watcher, &directories, buffer, length);
+        }
+
+        start = bench_clock();
+        built = Watcher_rebuild(watcher, &failed);
+        if (built > 0) watch_report(watcher, built, failed, start);
+    }
+
+    for (size_t i = 0; i < directories.count; i++) free(directories.paths[i]);
+    free(directories.paths);
+    free(directories.descriptors);
+    close(directories.inotify);
+    Watcher_free(watcher);
+
+    return 1;
+
+    #endif
+}
@@ -14,9 +14,39 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <math.h>
+#include <stdint.h>
 #include "dust/ustring.h"
+#include "dust/error.h"
 #include "dust/tokenizer.h"
 #include "dust/parser.h"
+#include "dust/incremental.h"
+#include "dust/pipeline.h"
+#include "dust/structural.h"
+#include "dust/source.h"
+#include "dust/check.h"
+#include "dust/resolver.h"
+#include "dust/typecheck.h"
+#include "dust/module.h"
+#include "dust/ir.h"
+#include "dust/bench.h"
+#include "dust/alloc.h"
+#include "dust/thread.h"
+#include "dust/scheduler.h"
+#include "dust/trace.h"
+#include "dust/allocator.h"
+#include "dust/dust.h"
+#include "dust/io.h"
+#include "dust/serve.h"
+#include "dust/watch.h"
+#include "dust/platform.h"
+
+#if OS != OS_WINDOWS
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#endif
 
 
 char *CURRENT_TEST;
@@ -128,6 +158,26 @@ void expect_string(char *value, char *expect) {
         FAILS++;
 }
 
+/**
+ * @brief Expect a growth exponent not above a limit and print result message
+ * 
+ * @param phase Name of the measured phase
+ * @param exponent Measured growth exponent
+ * @param limit Largest allowed exponent
+ */
+void expect_growth(char *phase, double exponent, double limit) {
+    TESTS++;
+    if (exponent <= limit) {
+        printf("[PASSED] %s\n", CURRENT_TEST);
+    }
+    else {
+        printf("[FAILED] %s: Expected %s to grow at most as n^%.2f but got n^%.2f\n",
+                CURRENT_TEST,
+                phase, limit, exponent);
+        FAILS++;
+    }
+}
+
 
 /*
   TEST SUITES
@@ -265,6 +315,1184 @@ void TEST__u32isdigit() {
     expect_true(u32isdigit(str));
 }
 
+void TEST__Document_edit() {
+    Document *document = Document_new(U"int a = 1;\nif a > 2 { b = 3; }\nc = a;\n");
+    Document_edit(document, 18, 1, U"4");
+    Document_edit(document, 0, 0, U"int z = 5;\n");
+
+    TokenArray *tokens = tokenize(document->source);
+    Node *tree = parse_body(tokens);
+    expect_true(u32isequal(Node_repr(document->tree, 0), Node_repr(tree, 0)));
+
+    // Reused statements point where they moved to, relative to their base
+    Node *moved = &(document->tree->body->array[2]);
+    size_t base = Document_offset(document, 2);
+    expect_true(moved->offset + base == tree->body->array[2].offset &&
+                moved->if_expr->bin_left->offset + base == tree->body->array[2].if_expr->bin_left->offset);
+    Document_free(document);
+
+    // Edits between the braces of a body reparse only that body
+    document = Document_new(U"if a { b = 3; while b { b -= 1; } c = b; }\nd = a;\n");
+    Node *expr = document->tree->body->array[0].if_expr;
+    Document_edit(document, 11, 1, U"300");
+    Document_edit(document, 31, 1, U"10");
+    expect_true(document->tree->body->array[0].if_expr == expr);
+
+    tokens = tokenize(document->source);
+    tree = parse_body(tokens);
+    expect_true(u32isequal(Node_repr(document->tree, 0), Node_repr(tree, 0)));
+
+    NodeArray *inner = document->tree->body->array[0].if_body->body;
+    NodeArray *fresh = tree->body->array[0].if_body->body;
+    expect_true(inner->array[1].while_body->offset == fresh->array[1].while_body->offset &&
+                inner->array[2].assign_expr->offset == fresh->array[2].assign_expr->offset &&
+                document->tree->body->array[1].offset + Document_offset(document, 1) == tree->body->array[1].offset);
+
+    // Tokens and brace matches are the same as lexing again
+    bool same = true;
+    for (size_t s = 0, k = 0; s < document->count; s++) {
+        TokenArray *part = document->statements[s].tokens;
+        for (size_t t = 0; t < part->used; t++, k++) {
+            Token *token = &(part->array[t]);
+            same = same && token->offset + Document_offset(document, s) == tokens->array[k].offset &&
+                           token->match == tokens->array[k].match;
+        }
+    }
+    expect_true(same);
+    Document_free(document);
+}
+
+void TEST__fold_expr() {
+    PARSER_FOLD = 1;
+    Node *tree = parse_body(tokenize(U"int8 a = 100 + 100;\nb = 2 ^ 10 * 3 - 0x10;\nc = 1 / 0;\nd = 1 < 2 and true;\n"));
+    PARSER_FOLD = 0;
+
+    Node *a = tree->body->array[0].decl_expr;
+    Node *b = tree->body->array[1].assign_expr;
+    Node *c = tree->body->array[2].assign_expr;
+    Node *d = tree->body->array[3].assign_expr;
+
+    expect_true(a->type == NodeType_INTEGER && a->integer == -56);
+    expect_true(b->type == NodeType_INTEGER && b->integer == 3056);
+    expect_true(c->type == NodeType_BINOP);
+    expect_true(d->type == NodeType_VAR && u32isequal(d->variable, U"true"));
+}
+
+void TEST__parse_block() {
+    u32char *source = U"import io;\nif a > 1 { b = 2; while b { b -= 1; } }\nelse { c = 3; }\n";
+
+    Node *eager = parse_body(tokenize(source));
+    TokenArray *tokens = tokenize(source);
+    PARSER_LAZY = 1;
+    Node *lazy = parse_body(tokens);
+    PARSER_LAZY = 0;
+
+    // Deferred bodies view the tokens they were parsed with, from after their {
+    Node *body = lazy->body->array[1].if_body;
+    expect_true(body->body_lazy == tokens && body->body_start == 8);
+    expect_true(u32isequal(Node_repr(lazy, 0), Node_repr(eager, 0)));
+    expect_true(body->body_lazy == NULL);
+
+    // Statements parsed in parallel defer theirs into the same tokens
+    StringBuilder *builder = StringBuilder_new(64);
+    for (int i = 0; i < PARSER_PARALLEL_MIN * 2; i++) StringBuilder_append(builder, U"if a { b = 2; }\n");
+    tokens = tokenize(StringBuilder_finish(builder));
+    PARSER_LAZY = 1;
+    lazy = parse_body_parallel(tokens, 2);
+    PARSER_LAZY = 0;
+
+    body = lazy->body->array[PARSER_PARALLEL_MIN].if_body;
+    expect_true(body->body_lazy == tokens && body->body_start == PARSER_PARALLEL_MIN * 8 + 3);
+    expect_true(Node_body(body)->used == 1 && Node_body(body)->array[0].offset == PARSER_PARALLEL_MIN * 16 + 7);
+
+    // Last statement of a body can leave out its ;, but a { can't end one
+    Node *tree = parse_body(tokenize(U"if a { a -= 1 }\nb = 2;\n"));
+    expect_true(tree->body->used == 2 && tree->body->array[0].if_body->body->used == 1);
+
+    ErrorTrap trap;
+    ERROR_TRAP = &trap;
+    if (setjmp(trap.jump) == 0) parse_body(tokenize(U"{ c = f(1) { x = 1; } }\n"));
+    parse_reset();
+    ERROR_TRAP = NULL;
+    expect_true(u32isequal(trap.message, U"Expected ;") && trap.offset == 11);
+}
+
+void TEST__parse_body_parallel() {
+    u32char *source = U"";
+    int i;
+    for (i = 0; i < 200; i++)
+        source = u32join(source, U"int a = 1 + 2;\nif a > 2 { b = [1, 2]; } else { c = f(a); }\n");
+
+    TokenArray *tokens = tokenize(source);
+    Node *serial = parse_body(tokens);
+    Node *parallel = parse_body_parallel(tokens, 4);
+
+    expect_true(parallel->body_arena != NULL);
+    expect_true(u32isequal(Node_repr(parallel, 0), Node_repr(serial, 0)));
+}
+
+void TEST__parse_body_parallel_error() {
+    u32char *source = U"";
+    int i;
+    for (i = 0; i < 200; i++)
+        source = u32join(source, (i == 120 || i == 180) ? U"int a = (1 + ;\n" : U"int a = 1 + 2;\n");
+
+    TokenArray *tokens = tokenize(source);
+    ErrorTrap serial;
+    ErrorTrap parallel;
+
+    ERROR_TRAP = &serial;
+    if (setjmp(serial.jump) == 0) parse_body(tokens);
+    parse_reset();
+
+    ERROR_TRAP = &parallel;
+    if (setjmp(parallel.jump) == 0) parse_body_parallel(tokens, 4);
+    parse_reset();
+
+    ERROR_TRAP = NULL;
+    expect_true(parallel.offset == serial.offset);
+    expect_true(u32isequal(parallel.message, serial.message));
+}
+
+static bool scheduler_mark(size_t index, void *arg) {
+    atomic_int *visits = (atomic_int *)arg;
+    atomic_fetch_add(&visits[index], 1);
+    return index != 300 && index != 700;
+}
+
+static void scheduler_leaf(TaskGroup *group, void *arg) {
+    atomic_fetch_add((atomic_int *)arg, 1);
+}
+
+static void scheduler_branch(TaskGroup *group, void *arg) {
+    for (int i = 0; i < 10; i++) TaskGroup_spawn(group, scheduler_leaf, arg);
+}
+
+void TEST__scheduler() {
+    Deque *deque = Deque_new(4);
+    Task tasks[1000];
+    bool contended = false;
+    int i;
+
+    // Owner takes newest first, thieves oldest first, across growing
+    for (i = 0; i < 1000; i++) Deque_push(deque, &tasks[i]);
+    expect_true(Deque_take(deque) == &tasks[999]);
+    expect_true(Deque_steal(deque, &contended) == &tasks[0]);
+    for (i = 1; i < 999; i++) Deque_take(deque);
+    expect_true(Deque_take(deque) == NULL);
+    expect_true(Deque_steal(deque, &contended) == NULL);
+    Deque_free(deque);
+
+    Scheduler *scheduler = Scheduler_new(4, false);
+    expect_true(scheduler->jobs == 4);
+
+    atomic_int *visits = (atomic_int *)calloc(1000, sizeof(atomic_int));
+    expect_true(Scheduler_for(scheduler, 0, 1000, scheduler_mark, visits) == 300);
+
+    bool once = true;
+    for (i = 0; i <= 300; i++) once = once && atomic_load(&visits[i]) == 1;
+    expect_true(once);
+
+    // Tasks spawned by tasks belong to the same group
+    TaskGroup group;
+    atomic_int count = 0;
+    TaskGroup_init(&group, scheduler);
+    for (i = 0; i < 100; i++) TaskGroup_spawn(&group, scheduler_branch, &count);
+    expect_true(TaskGroup_wait(&group));
+    expect_true(atomic_load(&count) == 1000);
+
+    // Nothing of a cancelled group starts
+    atomic_store(&count, 0);
+    TaskGroup_init(&group, scheduler);
+    TaskGroup_cancel(&group);
+    for (i = 0; i < 100; i++) TaskGroup_spawn(&group, scheduler_leaf, &count);
+    expect_true(!TaskGroup_wait(&group));
+    expect_true(atomic_load(&count) == 0);
+
+    free(visits);
+    Scheduler_free(scheduler);
+}
+
+void TEST__parse_pipelined() {
+    u32char *line = U"int a = 1; /* ; */\nif a > 2 {\n  b = \"}\";\n} // {\n";
+    size_t linelen = u32len(line);
+    size_t count = 1000;
+    size_t i;
+
+    // Long enough to be lexed in multiple batches
+    u32char *source = (u32char *)malloc(sizeof(u32char) * (linelen * count + 1));
+    for (i = 0; i < count; i++) u32copy(source + i * linelen, line);
+
+    Node *serial = parse_body(tokenize(source));
+    Node *pipelined = parse_pipelined(source);
+
+    expect_true(pipelined->body->used == serial->body->used);
+
+    bool same = true;
+    for (i = 0; i < serial->body->used; i++) {
+        if (!u32isequal(Node_repr(&(pipelined->body->array[i]), 0),
+                        Node_repr(&(serial->body->array[i]), 0))) same = false;
+    }
+    expect_true(same);
+}
+
+
+void TEST__StructuralIndex() {
+    u32char *source = U"a = \"s t\";\n/* c */ b(x[1], y.z) {}\n// d\n"
+                      U"e += 'f' * 2 ^ 3 % 4 != 5 <= 6 - 7 / 8;\n   g   h  ";
+    size_t len = u32len(source);
+    StructuralIndex *index = StructuralIndex_new(source, len);
+    uint64_t masks[6];
+    u32char block[64];
+    bool same = true;
+
+    for (size_t w = 0; w < index->words; w++) {
+        for (size_t i = 0; i < 64; i++)
+            block[i] = w * 64 + i < len ? source[w * 64 + i] : U'\0';
+
+        structural_classify_scalar(block, masks);
+
+        same = same && masks[0] == index->quote[w] && masks[1] == index->space[w] &&
+               masks[2] == index->newline[w] && masks[3] == index->star[w] &&
+               masks[4] == index->structural[w] && masks[5] == index->delim[w];
+    }
+
+    expect_true(index->words == 2 && same);
+    expect_true(StructuralIndex_next(index, index->quote, 5) == 8);
+    expect_true(StructuralIndex_next_clear(index, index->space, len - 2) == len);
+    StructuralIndex_free(index);
+
+    TokenArray *tokens = tokenize(U"x = \"a b\"; /* c */ yy  += 1;");
+    expect_true(tokens->used == 8);
+    expect_true(u32isequal(tokens->array[2].data, U"a b"));
+    expect_true(u32isequal(tokens->array[4].data, U"yy"));
+}
+
+void TEST__dispatch() {
+    char *text = "int a = \"ğü\"; /* €𝄞 */ while b < 1 { c(d[2], e.f); } "
+                 "g += 'h' * 3 ^ 4 % 5 != 6 <= 7 - 8 / 9;\n x";
+    u32char *expect = utf8_to_utf32(text);
+    size_t len = u32len(expect);
+    StructuralIndex *scalar;
+
+    dispatch_use(SIMDLevel_SCALAR);
+    expect_true(DISPATCH.level == SIMDLevel_SCALAR);
+    scalar = StructuralIndex_new(expect, len);
+
+    // Every level the CPU has gives what the scalar kernels give
+    for (SIMDLevel level = SIMDLevel_SSE2; level <= get_cpuinfo()->simd; level++) {
+        dispatch_use(level);
+
+        u32char *decoded = utf8_to_utf32(text);
+        StructuralIndex *index = StructuralIndex_new(expect, len);
+        bool same = u32isequal(decoded, expect);
+
+        for (size_t w = 0; w < index->words; w++)
+            same = same && index->quote[w] == scalar->quote[w] && index->space[w] == scalar->space[w] &&
+                   index->newline[w] == scalar->newline[w] && index->star[w] == scalar->star[w] &&
+                   index->structural[w] == scalar->structural[w] && index->delim[w] == scalar->delim[w];
+
+        expect_true(same);
+        StructuralIndex_free(index);
+        free(decoded);
+    }
+
+    dispatch_use(get_cpuinfo()->simd);
+    expect_true(DISPATCH.level == get_cpuinfo()->simd);
+    expect_true(get_cpuinfo() == get_cpuinfo());
+    expect_true(get_cpuinfo()->physical_cores >= 1 && get_cpuinfo()->cache_line > 0);
+
+    StructuralIndex_free(scalar);
+    free(expect);
+}
+
+void TEST__Source_position() {
+    u32char *raw = U"int a = 1;\n/* b\n c */ int d = \"e\nf\";\n\ng = 2;";
+    TokenArray *tokens = tokenize(raw);
+    Source *source = CURRENT_SOURCE;
+    int x, y;
+
+    expect_true(source != NULL && source->raw == raw && source->line_count == 5);
+
+    // g = 2;
+    Source_position(source, tokens->array[tokens->used - 4].offset, &x, &y);
+    expect_true(x == 0 && y == 5);
+
+    // int d after the comment
+    Source_position(source, tokens->array[5].offset, &x, &y);
+    expect_true(x == 6 && y == 2);
+    expect_true(u32isequal(Source_line(source, 2), U" c */ int d = \"e"));
+
+    // Errors at the end of a statement point just past its last token
+    ErrorTrap trap;
+    tokens = tokenize(U"int a = 1;\nint b = (2;");
+    ERROR_TRAP = &trap;
+    if (setjmp(trap.jump) == 0) parse_body(tokens);
+    parse_reset();
+    ERROR_TRAP = NULL;
+
+    Source_position(CURRENT_SOURCE, trap.offset, &x, &y);
+    expect_true(u32isequal(trap.message, U"Expected )") && x == 10 && y == 1);
+}
+
+void TEST__Writer() {
+    size_t size = WRITER_BUFFER_SIZE * 2 + 3;
+    char *large = (char *)malloc(size + 1);
+    memset(large, 'x', size);
+    large[size] = '\0';
+
+    expect_true(write_file("writer_test.txt", "old"));
+
+    // Encoded straight into the buffer, flushed around the large write
+    Writer *writer = Writer_open("writer_test.txt");
+    Writer_write_u32(writer, U"ğüş €𝄞\n");
+    Writer_write(writer, large, size);
+    for (int i = 0; i < 20000; i++) Writer_write_u32(writer, U"ö");
+    expect_true(Writer_close(writer));
+
+    char *content = u8readfile("writer_test.txt");
+    expect_true(!strncmp(content, "ğüş €𝄞\n", strlen("ğüş €𝄞\n")));
+    expect_true(strlen(content) == strlen("ğüş €𝄞\n") + size + 40000);
+    expect_true(!strcmp(content + strlen(content) - 2, "ö"));
+    free(content);
+
+    expect_true(write_file("writer_test.txt", "new"));
+    content = u8readfile("writer_test.txt");
+    expect_true(!strcmp(content, "new"));
+    free(content);
+
+    expect_true(Writer_open("writer_test/missing/out.txt") == NULL);
+
+    remove("writer_test.txt");
+    free(large);
+}
+
+void TEST__check() {
+    CheckError error;
+
+    expect_true(check(tokenize(U"import io;\nint a = f(1, b[2]).c;\narray<int> d = [1, 2];\n"
+                               U"enum E { X, Y = 2 };\nfor i in 0..a { if i > 1 { a -= i } else { g(); } }\n"), &error));
+
+    expect_true(!check(tokenize(U"int a = 1;\nb = (2 + 3;\n"), &error));
+    expect_true(u32isequal(error.message, U"Expected )") && error.offset == 21);
+
+    expect_true(!check(tokenize(U"while a { a = 1 2; }"), &error));
+    expect_true(u32isequal(error.message, U"Expected ;") && error.offset == 16);
+
+    // The parser rejects the same sources, at the same token
+    u32char *rejected[] = {U"while x < 3 { x += 1; ", U"repeat 3 { f(); enum E {A, B = 2 }", U"} a = 1;", U"; a = 1;"};
+    ErrorTrap trap;
+
+    for (size_t i = 0; i < 4; i++) {
+        TokenArray *tokens = tokenize(rejected[i]);
+        bool parsed = false;
+
+        ERROR_TRAP = &trap;
+        if (setjmp(trap.jump) == 0) {
+            parse_body(tokens);
+            parsed = true;
+        }
+        parse_reset();
+        ERROR_TRAP = NULL;
+
+        expect_true(!check(tokens, &error) && !parsed &&
+                    u32isequal(error.message, trap.message) && error.offset == trap.offset);
+    }
+
+    expect_true(check(tokenize(U"if a { enum E {A, B = 2 } }"), &error));
+    expect_true(parse_body(tokenize(U"if a { enum E {A, B = 2 } }"))->body->used == 1);
+}
+
+void TEST__resolve() {
+    Node *tree = parse_body(tokenize(U"int a = 1;\nint b = a;\nif a > 0 { int a = b; c = a; }\n"
+                                      U"enum E { X, Y = X };\nint b;\nfor i in 0..b { a += i; }\n"));
+    Resolver *resolver = Resolver_new();
+
+    expect_true(!resolve(resolver, tree));
+    expect_true(resolver->error_count == 2);
+    expect_true(u32isequal(resolver->errors[0].message, U"Undefined name c") && resolver->errors[0].offset == 44);
+    expect_true(u32isequal(resolver->errors[1].message, U"Duplicate name b") && resolver->errors[1].offset == 78);
+
+    Node *b = &(tree->body->array[1]);
+    Node *inner = Node_body(tree->body->array[2].if_body)->array;
+    Node *members = Node_body(tree->body->array[3].enum_body)->array;
+    Node *loop = &(tree->body->array[5]);
+    Node *add = &(Node_body(loop->for_body)->array[0]);
+
+    expect_true(tree->body_slots == 3 && b->decl_slot == 1);
+    expect_true(b->decl_expr->var_depth == 0 && b->decl_expr->var_slot == 0);
+    expect_true(inner[0].decl_slot == 0 && inner[0].decl_expr->var_depth == 1 && inner[0].decl_expr->var_slot == 1);
+    expect_true(inner[1].assign_depth == NODE_UNRESOLVED && inner[1].assign_expr->var_depth == 0);
+    expect_true(members[1].assign_slot == 1 && members[1].assign_expr->var_slot == 0);
+    expect_true(loop->for_var->var_slot == 0 && loop->for_body->body_slots == 1);
+    expect_true(add->assign_depth == 1 && add->assign_slot == 0 && add->assign_expr->var_depth == 0);
+
+    Resolver_free(resolver);
+}
+
+void TEST__typecheck() {
+    Node *tree = parse_body(tokenize(U"int8 a = 100;\nuint8 u = 7;\nint64 d = a * u;\nfloat f = a + 1;\n"
+                                      U"int8 b = 300;\nint g = f;\nif a { }\nfor i in [1, 2] { d += i; }\n"));
+    Resolver *resolver = Resolver_new();
+    TypeChecker *checker = TypeChecker_new();
+
+    expect_true(resolve(resolver, tree));
+    expect_true(!typecheck(checker, tree));
+    expect_true(checker->error_count == 3);
+    expect_true(u32isequal(checker->errors[0].message, U"Integer 300 doesn't fit in int8"));
+    expect_true(u32isequal(checker->errors[1].message, U"Can't convert float32 to int32"));
+    expect_true(u32isequal(checker->errors[2].message, U"Condition must be bool, not int8"));
+
+    // int8 * uint8 meet at int16, then widen to the declared int64
+    Node *d = tree->body->array[2].decl_expr;
+    expect_true(d->type == NodeType_CONVERT && d->vtype == Type_INT64);
+    expect_true(d->conv_expr->vtype == Type_INT16);
+    expect_true(d->conv_expr->bin_left->type == NodeType_CONVERT && d->conv_expr->bin_left->conv_expr->vtype == Type_INT8);
+
+    // Literals take the type of the operand they meet, the sum is converted at the declaration
+    Node *f = tree->body->array[3].decl_expr;
+    expect_true(f->type == NodeType_CONVERT && f->vtype == Type_FLOAT32);
+    expect_true(f->conv_expr->vtype == Type_INT8 && f->conv_expr->bin_right->type == NodeType_INTEGER);
+
+    Node *loop = &(tree->body->array[7]);
+    expect_true(loop->for_expr->vtype == TYPE_ARRAY(Type_INT64) && loop->for_var->vtype == Type_INT64);
+
+    // No signed type is wider than uint128
+    tree = parse_body(tokenize(U"int64 a = 1;\nuint128 b = 2;\nuint64 u = 3;\nint128 c = a + b;\nint128 d = a + u;\n"));
+    expect_true(resolve(resolver, tree));
+    expect_true(!typecheck(checker, tree));
+    expect_true(checker->error_count == 1);
+    expect_true(u32isequal(checker->errors[0].message, U"Mismatched types int64 and uint128 for +"));
+    expect_true(tree->body->array[4].decl_expr->vtype == Type_INT128);
+
+    // Dividing by a literal is the same division as dividing by a variable,
+    // the type a literal is used as only counts if every operand is one
+    tree = parse_body(tokenize(U"int64 c = 7;\nint64 d = 2;\nfloat64 f = c / 2;\nfloat64 g = c / d;\nfloat64 h = 7 / 2;\n"));
+    expect_true(resolve(resolver, tree));
+    expect_true(typecheck(checker, tree));
+    Node *by_literal = tree->body->array[2].decl_expr;
+    Node *by_variable = tree->body->array[3].decl_expr;
+    expect_true(by_literal->type == NodeType_CONVERT && by_literal->conv_expr->vtype == Type_INT64);
+    expect_true(by_variable->type == NodeType_CONVERT && by_variable->conv_expr->vtype == Type_INT64);
+    expect_true(by_literal->conv_expr->bin_right->vtype == Type_INT64);
+    expect_true(tree->body->array[4].decl_expr->vtype == Type_FLOAT64 &&
+                tree->body->array[4].decl_expr->bin_right->type == NodeType_FLOAT);
+
+    TypeChecker_free(checker);
+    Resolver_free(resolver);
+}
+
+void TEST__Loader() {
+    create_dir("loader_test");
+    write_file("loader_test/a.dust", "import b;\nimport c;\nint32 x = 1;\n");
+    write_file("loader_test/b.dust", "import c;\nstr s = \"b\";\nif x < 2.5 { x += -1; }\n");
+    write_file("loader_test/c.dust", "array<int8> v = [1, 2];\nenum E { X, Y = 2 };\n");
+
+    Loader *loader = Loader_new("loader_test/cache");
+    Module *a = Loader_load(loader, "loader_test/a.dust");
+
+    // c is loaded once, before every module importing it
+    expect_true(a != NULL && loader->count == 3 && loader->order_count == 3 && loader->parsed == 3);
+    expect_true(!strcmp(loader->order[0]->name, "c") && !strcmp(loader->order[1]->name, "b") && loader->order[2] == a);
+    expect_true(Loader_error_count(loader) == 0);
+
+    // Another loader reads the same trees back from the cache
+    Loader *cached = Loader_new("loader_test/cache");
+    expect_true(Loader_load(cached, "loader_test/a.dust") != NULL);
+    expect_true(cached->cached == 3 && cached->parsed == 0);
+
+    for (size_t i = 0; i < 3; i++)
+        expect_true(u32isequal(Node_repr(cached->order[i]->tree, 0), Node_repr(loader->order[i]->tree, 0)));
+
+    Loader_free(cached);
+    Loader_free(loader);
+
+    // A lazy loader still finds the imports, bodies wait for their first use
+    loader = Loader_new(NULL);
+    loader->lazy = true;
+    expect_true(Loader_load(loader, "loader_test/a.dust") != NULL && loader->order_count == 3);
+
+    Node *branch = &(loader->order[1]->tree->body->array[2]);
+    expect_true(branch->if_body->body_lazy != NULL && Node_body(branch->if_body)->used == 1);
+    expect_true(PARSER_LAZY == 0);
+
+    Loader_free(loader);
+
+    // A changed source isn't read from the cache, cycles and missing modules are reported at the import
+    write_file("loader_test/c.dust", "import d;\nimport a;\n");
+    loader = Loader_new("loader_test/cache");
+    Loader_load(loader, "loader_test/a.dust");
+
+    expect_true(loader->cached == 2 && loader->parsed == 1);
+    expect_true(loader->order[0]->error_count == 2);
+    expect_true(strstr(loader->order[0]->errors[0], "No module named d") != NULL);
+    expect_true(strstr(loader->order[0]->errors[1], "Import cycle a -> b -> c -> a") != NULL);
+
+    Loader_free(loader);
+
+    DIR *directory = opendir("loader_test/cache");
+    struct dirent *entry;
+
+    while (directory != NULL && (entry = readdir(directory)) != NULL) {
+        char path[300];
+        snprintf(path, sizeof(path), "loader_test/cache/%s", entry->d_name);
+        if (entry->d_name[0] != '.') remove(path);
+    }
+    if (directory != NULL) closedir(directory);
+
+    remove("loader_test/a.dust");
+    remove("loader_test/b.dust");
+    remove("loader_test/c.dust");
+    remove_dir("loader_test/cache");
+    remove_dir("loader_test");
+}
+
+void TEST__ir() {
+    Node *tree = parse_body(tokenize(U"int32 x = 0;\nwhile x < 10 { x += 1; }\nif x > 5 { x = 2; }\nprint(x);\n"));
+    Resolver *resolver = Resolver_new();
+    TypeChecker *checker = TypeChecker_new();
+
+    expect_true(resolve(resolver, tree));
+    expect_true(typecheck(checker, tree));
+
+    IrProgram *program = ir_lower(tree);
+    expect_true(IrProgram_verify(program));
+    expect_true(program->block_count == 7);
+
+    // x is merged where the loop comes back and after the if
+    u32char *repr = IrProgram_repr(program);
+    expect_true(u32contains(repr, U"b1: ; preds b0, b2\n    %2 = int32 phi [%0, b0], [%7, b2]\n"));
+    expect_true(u32contains(repr, U"    %7 = int32 add %2, %6\n    jump b1\n"));
+    expect_true(u32contains(repr, U"    %15 = int32 phi [%12, b4], [%2, b5]\n    %16 = dynamic call print(%15)\n"));
+    dust_free(repr);
+    IrProgram_free(program);
+
+    // A use the definition doesn't dominate, and a block without a terminator
+    program = IrProgram_new();
+    int entry = IrProgram_block(program);
+    int then = IrProgram_block(program);
+    int end = IrProgram_block(program);
+    int condition = IrProgram_add(program, entry, IrOp_CONST, Type_BOOL, 0);
+    IrProgram_branch(program, entry, condition, then, end, 0);
+    int one = IrProgram_add(program, then, IrOp_CONST, Type_INT32, 0);
+    IrProgram_jump(program, then, end, 0);
+    IrProgram_arg(program, IrProgram_add(program, end, IrOp_NEG, Type_INT32, 0), one);
+
+    expect_true(!IrProgram_verify(program));
+    expect_true(program->error_count == 1);
+    expect_true(u32isequal(program->errors[0].message, U"b2 doesn't end with a terminator"));
+
+    IrProgram_add(program, end, IrOp_RETURN, Type_NONE, 0);
+    expect_true(!IrProgram_verify(program));
+    expect_true(program->error_count == 1);
+    expect_true(u32isequal(program->errors[0].message, U"%4 uses %2 before it is defined"));
+    IrProgram_free(program);
+
+    TypeChecker_free(checker);
+    Resolver_free(resolver);
+}
+
+void TEST__bench() {
+    double samples[5] = {0.5, 0.1, 0.4, 0.2, 0.3};
+    BenchStats stats = bench_stats(samples, 5);
+
+    expect_true(stats.min == 0.1 && stats.median == 0.3 && stats.p99 == 0.5);
+
+    BenchResult result, loaded;
+    memset(&result, 0, sizeof(BenchResult));
+    result.runs = 5;
+    result.bytes = 1234;
+    result.phases[BenchPhase_PARSE] = stats;
+    result.counted[PerfCounter_PAGE_FAULTS] = true;
+    result.counters[BenchPhase_PARSE][PerfCounter_PAGE_FAULTS] = 42.0;
+
+    expect_true(bench_save(&result, "bench_test.json"));
+    expect_true(bench_load(&loaded, "bench_test.json"));
+    expect_true(loaded.runs == 5 && loaded.bytes == 1234);
+    expect_true(loaded.phases[BenchPhase_PARSE].median == 0.3 &&
+                loaded.phases[BenchPhase_PARSE].p99 == 0.5);
+    expect_true(loaded.counted[PerfCounter_PAGE_FAULTS] && !loaded.counted[PerfCounter_CYCLES]);
+    expect_true(loaded.counters[BenchPhase_PARSE][PerfCounter_PAGE_FAULTS] == 42.0);
+    remove("bench_test.json");
+}
+
+void TEST__alloc() {
+    alloc_reset();
+    alloc_phase("test");
+
+    char *a = alloc_malloc(100, __FILE__, __LINE__);
+    char *b = alloc_calloc(10, 10, __FILE__, __LINE__);
+    b = alloc_realloc(b, 300, __FILE__, __LINE__);
+
+    AllocCounts totals = alloc_totals();
+    expect_true(totals.allocations == 3 && totals.bytes == 500 && alloc_live() == 400);
+
+    // Blocks not allocated through the counting allocator are just freed
+    alloc_free(malloc(16));
+    alloc_free(a);
+    alloc_free(b);
+
+    totals = alloc_totals();
+    expect_true(alloc_live() == 0 && totals.peak == 400 && totals.frees == 3);
+
+    alloc_reset();
+}
+
+void *allocator_worker(void *arg) {
+    return DUST_ALLOCATOR;
+}
+
+void TEST__allocator() {
+    // Sources are released by whichever allocator made them
+    if (CURRENT_SOURCE != NULL) Source_free(CURRENT_SOURCE);
+
+    Arena *arena = Arena_new(256);
+    Pool *pool = Pool_new();
+    DustAllocator *previous = dust_allocator_use(&arena->allocator);
+
+    // Last block of an arena grows in place
+    char *a = (char *)dust_malloc(10);
+    char *b = (char *)dust_realloc(a, 100);
+    expect_true(a == b);
+
+    // Threads started by Dust use the allocator of their parent
+    Thread worker;
+    expect_true(Thread_start(&worker, allocator_worker, NULL));
+    expect_true(Thread_join(&worker) == &arena->allocator);
+
+    TokenArray *tokens = tokenize(U"int x = 1 + 2; if x > 2 { x += 1; }");
+    Node *body = parse_body(tokens);
+    expect_true(Node_body(body)->used == 2);
+
+    Source_free(CURRENT_SOURCE);
+    Arena_reset(arena);
+    expect_true(arena->allocated == 256);
+
+    // Freed pool blocks are reused by the same size class
+    dust_allocator_use(&pool->allocator);
+    a = (char *)dust_malloc(20);
+    dust_free(a);
+    b = (char *)dust_malloc(30);
+    expect_true(a == b);
+
+    char *large = (char *)dust_malloc(POOL_MAX_SIZE * 2);
+    large[POOL_MAX_SIZE * 2 - 1] = 1;
+    b = (char *)dust_realloc(b, 1000);
+    expect_true(a != b);
+
+    dust_allocator_use(previous);
+    expect_true(DUST_ALLOCATOR == NULL);
+
+    Pool_free(pool);
+    Arena_free(arena);
+}
+
+void TEST__library() {
+    Source *current = CURRENT_SOURCE;
+    DustDocument *document = dust_parse("int x = 1 + 2;\nif x > 2 { print(x); }");
+    const DustNode *root = dust_root(document);
+    DustToken token;
+
+    expect_true(dust_api_version() == DUST_API_VERSION);
+    expect_true(dust_diagnostic_count(document) == 0);
+    expect_true(dust_node_kind(root) == DustNode_BODY);
+    expect_true(dust_node_child_count(root) == 2);
+
+    const DustNode *decl = dust_node_child(root, 0);
+    expect_true(dust_node_kind(decl) == DustNode_DECL);
+    expect_true(!strcmp(dust_node_text(document, decl), "x"));
+    expect_true(!strcmp(dust_node_operator(document, dust_node_child(decl, 1)), "+"));
+    expect_true(dust_node_integer(dust_node_child(dust_node_child(decl, 1), 1)) == 2);
+    expect_true(dust_node_child(decl, 2) == NULL);
+
+    const DustNode *body = dust_node_child(dust_node_child(root, 1), 1);
+    expect_true(dust_node_kind(dust_node_child(body, 0)) == DustNode_CALL);
+
+    expect_true(dust_token(document, 0, &token));
+    expect_true(token.kind == DustToken_IDENTIFIER && !strcmp(token.text, "int"));
+    expect_true(!dust_token(document, dust_token_count(document), &token));
+    dust_document_free(document);
+
+    // Errors are diagnostics, the parser is left usable
+    DustDiagnostic diagnostic;
+    document = dust_parse("int x = 1;\nx = \"abc");
+    expect_true(dust_root(document) == NULL);
+    expect_true(dust_diagnostic(document, 0, &diagnostic));
+    expect_true(diagnostic.kind == DustDiagnostic_SYNTAX);
+    expect_true(diagnostic.line == 2 && diagnostic.column == 5);
+    expect_true(CURRENT_SOURCE == current && DUST_ALLOCATOR == NULL);
+    dust_document_free(document);
+
+    document = dust_parse("int y = 3;");
+    expect_true(dust_diagnostic_count(document) == 0);
+    expect_true(dust_node_child_count(dust_root(document)) == 1);
+    dust_document_free(document);
+
+#if OS != OS_WINDOWS
+    // Nothing is written to the host's stdout, even for a syntax error
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int out = open("library_test.txt", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    dup2(out, STDOUT_FILENO);
+    document = dust_parse("a = 1 2;");
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    struct stat info;
+    fstat(out, &info);
+    close(out);
+    remove("library_test.txt");
+    expect_true(dust_diagnostic_count(document) == 1 && info.st_size == 0);
+    dust_document_free(document);
+#endif
+}
+
+#if OS != OS_WINDOWS
+
+void *serve_test_server(void *arg) {
+    return (void *)(intptr_t)serve((char *)arg, 2);
+}
+
+void TEST__serve() {
+    char *path = "serve_test.sock";
+    char *good[] = {"int x = 1;"};
+    char *bad[] = {"int x = 1;\nx = \"abc"};
+    Thread server;
+    int status = -1;
+
+    expect_true(Thread_start(&server, serve_test_server, path));
+
+    // Retried until the server is listening
+    for (int i = 0; i < 1000 && status < 0; i++) {
+        status = serve_client(path, "check", true, false, good, 1);
+        if (status < 0) thread_yield();
+    }
+    expect_true(status == 0);
+
+    // Second request is answered from the cache
+    expect_true(serve_client(path, "check", true, false, good, 1) == 0);
+
+    // A bad source is reported without taking the server down
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    status = serve_client(path, "check", true, false, bad, 1);
+    dup2(saved, STDOUT_FILENO);
+    close(null);
+    close(saved);
+    expect_true(status == 1);
+    expect_true(serve_client(path, "check", true, false, good, 1) == 0);
+
+    expect_true(serve_client(path, "stop", true, false, NULL, 0) == 0);
+    expect_true(Thread_join(&server) == NULL);
+    expect_true(serve_client(path, "check", true, false, good, 1) == -1);
+}
+
+void watch_test_write(char *path, char *code) {
+    FILE *f = fopen(path, "w");
+    fputs(code, f);
+    fclose(f);
+}
+
+void TEST__Watcher() {
+    size_t failed;
+
+    mkdir("watch_test", 0755);
+    mkdir("watch_test/lib", 0755);
+    watch_test_write("watch_test/a.dust", "import b;\nint x = 1;");
+    watch_test_write("watch_test/b.dust", "import c;\nint y = 2;");
+    watch_test_write("watch_test/lib/c.dust", "int z = 3;");
+    watch_test_write("watch_test/d.dust", "int w = 4;");
+
+    Watcher *watcher = Watcher_new("watch_test", true, true);
+    expect_true(watcher->count == 4);
+    expect_true(Watcher_rebuild(watcher, &failed) == 4 && failed == 0);
+
+    char *code = u8readfile("watch_test/lib/c.c");
+    expect_true(strstr(code, "int32_t z = 3;") != NULL);
+    free(code);
+
+    // Nothing changed, nothing is built
+    expect_true(Watcher_rebuild(watcher, &failed) == 0);
+
+    // Files importing a changed file are built again, through other files too
+    watch_test_write("watch_test/lib/c.dust", "int z = 5;");
+    Watcher_touch(watcher, "watch_test/lib/c.dust");
+    expect_true(Watcher_rebuild(watcher, &failed) == 3);
+
+    code = u8readfile("watch_test/lib/c.c");
+    expect_true(strstr(code, "int32_t z = 5;") != NULL);
+    free(code);
+
+    Watcher_touch(watcher, "watch_test/d.dust");
+    expect_true(Watcher_rebuild(watcher, &failed) == 1);
+
+    remove("watch_test/d.dust");
+    Watcher_touch(watcher, "watch_test/d.dust");
+    expect_true(watcher->count == 3);
+    expect_true(Watcher_rebuild(watcher, &failed) == 0);
+
+    Watcher_free(watcher);
+
+    // Checked files are parsed lazily, the imports in them still mark importers
+    watch_test_write("watch_test/b.dust", "import c;\nif 1 { int y = 2; }");
+    watcher = Watcher_new("watch_test", false, true);
+    expect_true(Watcher_rebuild(watcher, &failed) == 3 && failed == 0);
+
+    Watcher_touch(watcher, "watch_test/lib/c.dust");
+    expect_true(Watcher_rebuild(watcher, &failed) == 3);
+    expect_true(PARSER_LAZY == 0);
+
+    Watcher_free(watcher);
+
+    char *files[] = {"a.dust", "a.c", "b.dust", "b.c", "d.c", "lib/c.dust", "lib/c.c"};
+    for (int i = 0; i < 7; i++) {
+        char path[64];
+        sprintf(path, "watch_test/%s", files[i]);
+        remove(path);
+    }
+    rmdir("watch_test/lib");
+    rmdir("watch_test");
+}
+
+#endif
+
+void *trace_worker(void *arg) {
+    TraceSpan span = {NULL, 0.0, TRACE_NOARG};
+
+    trace_begin(&span, "first", 0);
+    trace_begin(&span, "second", 42);
+    trace_end(&span);
+
+    return NULL;
+}
+
+void TEST__trace() {
+    TraceSpan span = {NULL, 0.0, TRACE_NOARG};
+    Thread worker;
+
+    trace_reset();
+    trace_thread("test");
+
+    trace_begin(&span, "outer", TRACE_NOARG);
+    expect_true(Thread_start(&worker, trace_worker, NULL));
+    Thread_join(&worker);
+    trace_end(&span);
+
+    expect_true(trace_dump("trace_test.json"));
+
+    char *json = u8readfile("trace_test.json");
+    expect_true(strstr(json, "\"name\": \"test\"") != NULL);
+    expect_true(strstr(json, "\"name\": \"outer\"") != NULL);
+    expect_true(strstr(json, "\"name\": \"first\"") != NULL);
+    expect_true(strstr(json, "\"args\": {\"offset\": 42}") != NULL);
+
+    free(json);
+    remove("trace_test.json");
+}
+
+void TEST__perf() {
+    Perf perf;
+    uint64_t values[PerfCounter_COUNT];
+
+    // Either some counter is available or there is a reason why none is
+    bool opened = Perf_open(&perf);
+    expect_true(opened || perf.error != NULL);
+
+    Perf_start(&perf);
+    Perf_stop(&perf, values);
+
+    for (size_t c = 0; c < PerfCounter_COUNT; c++)
+        if (!Perf_has(&perf, c)) expect_true(values[c] == 0);
+
+    Perf_close(&perf);
+    expect_true(!Perf_has(&perf, PerfCounter_CYCLES));
+}
+
+/*
+  Complexity tests run a phase on 8 inputs of size n, 4 of size 2n, 2 of
+  size 4n and 1 of size 8n. A linear phase does the same work over the
+  same memory at every size, so caches and page faults cost the same and
+  only the algorithm changes the time. The growth exponent is fit from
+  log(time per input) against log(size) and fails when it is clearly
+  above O(n log n), which is about n^1.1 over these sizes.
+*/
+
+#define COMPLEXITY_LIMIT 1.25
+
+// Number of sizes measured, the largest input is n << (COMPLEXITY_SIZES - 1)
+#define COMPLEXITY_SIZES 4
+
+// Number of runs the fastest time of each size is taken from
+#define COMPLEXITY_RUNS 5
+
+typedef double (*ComplexityPhase)(size_t n, size_t copies);
+
+// Source with n statements of every kind next to each other
+u32char *complexity_source(size_t n) {
+    u32char *statement = U"int v = f(a, b[1]) + 2 * (c - 3); /* ; */\n"
+                         U"if v > 3 { v -= 1; print(\"ğ{\"); } else { g.h(); }\n"
+                         U"array<int> w = [1, 2, 3]; // }\n";
+    size_t len = u32len(statement);
+    u32char *source = (u32char *)malloc(sizeof(u32char) * (len * n + 1));
+
+    for (size_t i = 0; i < n; i++) memcpy(source + len * i, statement, sizeof(u32char) * len);
+    source[len * n] = U'\0';
+
+    return source;
+}
+
+// Source with n bodies nested in each other
+u32char *complexity_nested(size_t n) {
+    StringBuilder *builder = StringBuilder_new(n * 16);
+
+    for (size_t i = 0; i < n; i++) StringBuilder_append(builder, i % 2 ? U"while b {\n" : U"if a {\n");
+    StringBuilder_append(builder, U"c = 1;\n");
+    for (size_t i = 0; i < n; i++) StringBuilder_append(builder, U"}\n");
+
+    return StringBuilder_finish(builder);
+}
+
+// Array of pointers to the copies of an input
+void **complexity_array(size_t copies) {
+    return (void **)calloc(copies, sizeof(void *));
+}
+
+// Free every copy and the array holding them
+void complexity_array_free(void **array, size_t copies) {
+    for (size_t c = 0; c < copies; c++) free(array[c]);
+    free(array);
+}
+
+// Sources are resolved through the current source, which must not outlive them
+void complexity_free(u32char **sources, size_t copies) {
+    if (CURRENT_SOURCE != NULL) Source_free(CURRENT_SOURCE);
+    complexity_array_free((void **)sources, copies);
+}
+
+double complexity_decode(size_t n, size_t copies) {
+    char **encoded = (char **)complexity_array(copies);
+    u32char **decoded = (u32char **)complexity_array(copies);
+
+    for (size_t c = 0; c < copies; c++) {
+        u32char *source = complexity_source(n);
+        encoded[c] = utf32_to_utf8(source);
+        free(source);
+    }
+
+    double start = bench_clock();
+    for (size_t c = 0; c < copies; c++) decoded[c] = utf8_to_utf32(encoded[c]);
+    double time = bench_clock() - start;
+
+    complexity_array_free((void **)decoded, copies);
+    complexity_array_free((void **)encoded, copies);
+    return time;
+}
+
+double complexity_encode(size_t n, size_t copies) {
+    u32char **sources = (u32char **)complexity_array(copies);
+    char **encoded = (char **)complexity_array(copies);
+    for (size_t c = 0; c < copies; c++) sources[c] = complexity_source(n);
+
+    double start = bench_clock();
+    for (size_t c = 0; c < copies; c++) encoded[c] = utf32_to_utf8(sources[c]);
+    double time = bench_clock() - start;
+
+    complexity_array_free((void **)encoded, copies);
+    complexity_array_free((void **)sources, copies);
+    return time;
+}
+
+double complexity_ustring(size_t n, size_t copies) {
+    u32char **sources = (u32char **)complexity_array(copies);
+    u32char **slices = (u32char **)complexity_array(copies);
+    u32char **replaced = (u32char **)complexity_array(copies);
+    u32char **filled = (u32char **)complexity_array(copies);
+    // Kept so the prefix checks aren't optimized away
+    volatile size_t prefixes = 0;
+    for (size_t c = 0; c < copies; c++) sources[c] = complexity_source(n);
+    size_t len = u32len(sources[0]);
+
+    double start = bench_clock();
+    for (size_t c = 0; c < copies; c++) {
+        slices[c] = u32slice(sources[c], 1, len - 2);
+        replaced[c] = u32replace(sources[c], U"v", U"value");
+        filled[c] = u32fill(U"", U"ab", len);
+        prefixes += u32startswith(sources[c], U"int w");
+    }
+    double time = bench_clock() - start;
+
+    complexity_array_free((void **)slices, copies);
+    complexity_array_free((void **)replaced, copies);
+    complexity_array_free((void **)filled, copies);
+    complexity_array_free((void **)sources, copies);
+    return time;
+}
+
+double complexity_builder(size_t n, size_t copies) {
+    u32char **built = (u32char **)complexity_array(copies);
+    size_t len = n * 128;
+
+    double start = bench_clock();
+    for (size_t c = 0; c < copies; c++) {
+        StringBuilder *builder = StringBuilder_new(0);
+        for (size_t i = 0; i < len; i++) StringBuilder_push(builder, U'a' + i % 26);
+        built[c] = StringBuilder_finish(builder);
+    }
+    double time = bench_clock() - start;
+
+    complexity_array_free((void **)built, copies);
+    return time;
+}
+
+double complexity_tokenize(size_t n, size_t copies) {
+    u32char **sources = (u32char **)complexity_array(copies);
+    TokenArray **tokens = (TokenArray **)complexity_array(copies);
+    for (size_t c = 0; c < copies; c++) sources[c] = complexity_source(n);
+
+    double start = bench_clock();
+    for (size_t c = 0; c < copies; c++) tokens[c] = tokenize(sources[c]);
+    double time = bench_clock() - start;
+
+    for (size_t c = 0; c < copies; c++) TokenArray_free(tokens[c]);
+    free(tokens);
+    complexity_free(sources, copies);
+    return time;
+}
+
+// Time parsing copies of the sources made by the source function
+double complexity_parse_sources(u32char *(*source)(size_t), size_t n, size_t copies) {
+    u32char **sources = (u32char **)complexity_array(copies);
+    TokenArray **tokens = (TokenArray **)complexity_array(copies);
+    Node **bodies = (Node **)complexity_array(copies);
+
+    for (size_t c = 0; c < copies; c++) {
+        sources[c] = source(n);
+        tokens[c] = tokenize(sources[c]);
+    }
+
+    double start = bench_clock();
+    for (size_t c = 0; c < copies; c++) bodies[c] = parse_body(tokens[c]);
+    double time = bench_clock() - start;
+
+    for (size_t c = 0; c < copies; c++) {
+        Node_free(bodies[c]);
+        TokenArray_free(tokens[c]);
+    }
+    free(bodies);
+    free(tokens);
+    complexity_free(sources, copies);
+    return time;
+}
+
+double complexity_parse(size_t n, size_t copies) {
+    return complexity_parse_sources(complexity_source, n, copies);
+}
+
+double complexity_parse_nested(size_t n, size_t copies) {
+    return complexity_parse_sources(complexity_nested, n, copies);
+}
+
+double complexity_Node_repr(size_t n, size_t copies) {
+    u32char **sources = (u32char **)complexity_array(copies);
+    TokenArray **tokens = (TokenArray **)complexity_array(copies);
+    Node **bodies = (Node **)complexity_array(copies);
+    u32char **reprs = (u32char **)complexity_array(copies);
+
+    for (size_t c = 0; c < copies; c++) {
+        sources[c] = complexity_source(n);
+        tokens[c] = tokenize(sources[c]);
+        bodies[c] = parse_body(tokens[c]);
+    }
+
+    double start = bench_clock();
+    for (size_t c = 0; c < copies; c++) reprs[c] = Node_repr(bodies[c], 0);
+    double time = bench_clock() - start;
+
+    for (size_t c = 0; c < copies; c++) {
+        Node_free(bodies[c]);
+        TokenArray_free(tokens[c]);
+    }
+    free(bodies);
+    free(tokens);
+    complexity_array_free((void **)reprs, copies);
+    complexity_free(sources, copies);
+    return time;
+}
+
+double complexity_TokenArray_repr(size_t n, size_t copies) {
+    u32char **sources = (u32char **)complexity_array(copies);
+    TokenArray **tokens = (TokenArray **)complexity_array(copies);
+    u32char **reprs = (u32char **)complexity_array(copies);
+
+    for (size_t c = 0; c < copies; c++) {
+        sources[c] = complexity_source(n);
+        tokens[c] = tokenize(sources[c]);
+    }
+
+    double start = bench_clock();
+    for (size_t c = 0; c < copies; c++) reprs[c] = TokenArray_repr(tokens[c]);
+    double time = bench_clock() - start;
+
+    for (size_t c = 0; c < copies; c++) TokenArray_free(tokens[c]);
+    free(tokens);
+    complexity_array_free((void **)reprs, copies);
+    complexity_free(sources, copies);
+    return time;
+}
+
+/**
+ * @brief Growth exponent of a phase, the slope of the least squares fit
+ *        of log(time per input) against log(size) over sizes n to 8n
+ * 
+ * @param phase Phase to measure
+ * @param n Smallest size
+ * @return Growth exponent
+ */
+double growth_exponent(ComplexityPhase phase, size_t n) {
+    double best[COMPLEXITY_SIZES];
+    double xs[COMPLEXITY_SIZES], ys[COMPLEXITY_SIZES];
+    double mx = 0.0, my = 0.0, sxy = 0.0, sxx = 0.0;
+    size_t largest = n << (COMPLEXITY_SIZES - 1);
+
+    // Runs go through every size in turn so slow periods of the machine
+    // don't fall on a single size, and the fastest run of each is kept
+    for (int r = 0; r < COMPLEXITY_RUNS; r++) {
+        for (size_t k = 0; k < COMPLEXITY_SIZES; k++) {
+            size_t size = n << k;
+            double time = phase(size, largest / size) / (double)(largest / size);
+            if (r == 0 || time < best[k]) best[k] = time;
+        }
+    }
+
+    for (size_t k = 0; k < COMPLEXITY_SIZES; k++) {
+        xs[k] = log((double)(n << k));
+        ys[k] = log(best[k] > 1e-9 ? best[k] : 1e-9);
+        mx += xs[k] / COMPLEXITY_SIZES;
+        my += ys[k] / COMPLEXITY_SIZES;
+    }
+
+    for (size_t k = 0; k < COMPLEXITY_SIZES; k++) {
+        sxy += (xs[k] - mx) * (ys[k] - my);
+        sxx += (xs[k] - mx) * (xs[k] - mx);
+    }
+
+    return sxy / sxx;
+}
+
+void TEST__complexity() {
+    expect_growth("utf8_to_utf32", growth_exponent(complexity_decode, 1000), COMPLEXITY_LIMIT);
+    expect_growth("utf32_to_utf8", growth_exponent(complexity_encode, 1000), COMPLEXITY_LIMIT);
+    expect_growth("ustring", growth_exponent(complexity_ustring, 1000), COMPLEXITY_LIMIT);
+    expect_growth("StringBuilder", growth_exponent(complexity_builder, 1000), COMPLEXITY_LIMIT);
+    expect_growth("tokenize", growth_exponent(complexity_tokenize, 500), COMPLEXITY_LIMIT);
+    expect_growth("parse_body", growth_exponent(complexity_parse, 500), COMPLEXITY_LIMIT);
+    expect_growth("parse_body nested", growth_exponent(complexity_parse_nested, 200), COMPLEXITY_LIMIT);
+    expect_growth("Node_repr", growth_exponent(complexity_Node_repr, 200), COMPLEXITY_LIMIT);
+    expect_growth("TokenArray_repr", growth_exponent(complexity_TokenArray_repr, 500), COMPLEXITY_LIMIT);
+}
 
 int main() {
     CURRENT_TEST = "u32count   ";   TEST__u32count();
@@ -290,6 +1518,33 @@ int main() {
     CURRENT_TEST = "u32endswith";   TEST__u32endswith();
     CURRENT_TEST = "u32contains";   TEST__u32contains();
     CURRENT_TEST = "u32isdigit";    TEST__u32isdigit();
+    CURRENT_TEST = "Document_edit"; TEST__Document_edit();
+    CURRENT_TEST = "fold_expr";     TEST__fold_expr();
+    CURRENT_TEST = "parse_block";   TEST__parse_block();
+    CURRENT_TEST = "parse_body_parallel"; TEST__parse_body_parallel();
+    CURRENT_TEST = "parse_body_parallel_error"; TEST__parse_body_parallel_error();
+    CURRENT_TEST = "scheduler"; TEST__scheduler();
+    CURRENT_TEST = "parse_pipelined"; TEST__parse_pipelined();
+    CURRENT_TEST = "StructuralIndex"; TEST__StructuralIndex();
+    CURRENT_TEST = "dispatch";      TEST__dispatch();
+    CURRENT_TEST = "Source_position"; TEST__Source_position();
+    CURRENT_TEST = "Writer";        TEST__Writer();
+    CURRENT_TEST = "check";         TEST__check();
+    CURRENT_TEST = "resolve";       TEST__resolve();
+    CURRENT_TEST = "typecheck";     TEST__typecheck();
+    CURRENT_TEST = "Loader";        TEST__Loader();
+    CURRENT_TEST = "ir";            TEST__ir();
+    CURRENT_TEST = "bench";         TEST__bench();
+    CURRENT_TEST = "perf";          TEST__perf();
+    CURRENT_TEST = "alloc";         TEST__alloc();
+    CURRENT_TEST = "trace";         TEST__trace();
+    CURRENT_TEST = "allocator";     TEST__allocator();
+    CURRENT_TEST = "library";       TEST__library();
+    #if OS != OS_WINDOWS
+    CURRENT_TEST = "serve";         TEST__serve();
+    CURRENT_TEST = "Watcher";       TEST__Watcher();
+    #endif
+    CURRENT_TEST = "complexity";    TEST__complexity();
 
     printf("tests: %d\n", TESTS);
     printf("fails: %d\n", FAILS);
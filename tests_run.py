@@ -34,9 +34,9 @@ print("Running tests...")
 if os.path.exists(binaryfile): os.remove(binaryfile)
 
 if platform.system() == "Windows":
-    os.system("gcc -o tests tests.c src/ustring.c src/error.c src/platform.c src/tokenizer.c src/parser.c -I./include/ -lws2_32")
+    os.system("gcc -o tests tests.c src/ustring.c src/error.c src/platform.c src/tokenizer.c src/parser.c src/incremental.c src/fold.c src/thread.c src/scheduler.c src/pipeline.c src/structural.c src/source.c src/check.c src/resolver.c src/typecheck.c src/module.c src/ir.c src/lower.c src/transpiler.c src/bench.c src/perf.c src/alloc.c src/trace.c src/allocator.c src/dust.c src/serve.c src/watch.c src/io.c -I./include/ -lws2_32")
 else:
-    os.system("gcc -o tests tests.c src/ustring.c src/error.c src/platform.c src/tokenizer.c src/parser.c -I./include/ -lm")
+    os.system("gcc -o tests tests.c src/ustring.c src/error.c src/platform.c src/tokenizer.c src/parser.c src/incremental.c src/fold.c src/thread.c src/scheduler.c src/pipeline.c src/structural.c src/source.c src/check.c src/resolver.c src/typecheck.c src/module.c src/ir.c src/lower.c src/transpiler.c src/bench.c src/perf.c src/alloc.c src/trace.c src/allocator.c src/dust.c src/serve.c src/watch.c src/io.c -I./include/ -lm -lpthread")
 
 start = time.perf_counter()
 out = subprocess.check_output(binaryrun).decode("utf-8").replace("\r", "")